@@ -0,0 +1,318 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stddef.h>      // for size_t
+#include <stdint.h>      // for uint32_t, uintptr_t
+#if defined(__x86_64__)
+#include <immintrin.h>   // for the SSE2 and AVX2 intrinsics
+#endif
+
+#include "./ByteScan.h"
+
+namespace hw4 {
+
+static const char* FindFirstOfScalar(const char* begin, const char* end,
+                                     char a, char b) {
+  for (; begin < end; begin++) {
+    if (*begin == a || *begin == b) {
+      return begin;
+    }
+  }
+  return end;
+}
+
+static const char* FindLineEndScalar(const char* begin, const char* end,
+                                     char delim, const char** first_delim) {
+  if (first_delim != nullptr) {
+    *first_delim = nullptr;
+  }
+  for (; begin < end && *begin != '\n'; begin++) {
+    if (*begin == delim && first_delim != nullptr &&
+        *first_delim == nullptr) {
+      *first_delim = begin;
+    }
+  }
+  return begin;
+}
+
+#if defined(__x86_64__)
+// Each of these compares a block of bytes against the bytes looked for
+// all at once, and turns the matches into bitmasks whose lowest set bit
+// is the first match.  Request lines and headers are short, so rather
+// than finish off a partial block at either end a byte at a time, the
+// blocks are aligned, and the bits for bytes outside [begin, end) are
+// masked off.  An aligned block never crosses a page boundary, so
+// reading the whole of one is safe even when [begin, end) covers only
+// part of it (which is also why AddressSanitizer is told to look away);
+// nor is reading an unaligned one that doesn't cross one.
+
+// The bits of the block at "block", "width" bytes long, that are within
+// [begin, end).
+static inline uint32_t InRange(const char* block, size_t width,
+                               const char* begin, const char* end) {
+  uint32_t mask = (width == 32) ? 0xffffffff : (1U << width) - 1;
+  if (block < begin) {
+    mask &= mask << (begin - block);
+  }
+  if (static_cast<size_t>(end - block) < width) {
+    mask &= (1U << (end - block)) - 1;
+  }
+  return mask;
+}
+
+// True if the "width" bytes at "p" cross into the next page.
+static inline bool CrossesPage(const char* p, size_t width) {
+  return (reinterpret_cast<uintptr_t>(p) & 4095) > 4096 - width;
+}
+
+// Records in "*first_delim", unless it's already known, the first of
+// the block's "delims" that comes before the first of its "newlines"
+// (if it has any).
+static inline void NoteDelim(const char* block, uint32_t delims,
+                             uint32_t newlines, const char** first_delim) {
+  if (first_delim == nullptr || *first_delim != nullptr) {
+    return;
+  }
+  if (newlines != 0) {
+    delims &= (1U << __builtin_ctz(newlines)) - 1;  // only those before it
+  }
+  if (delims != 0) {
+    *first_delim = block + __builtin_ctz(delims);
+  }
+}
+
+__attribute__((no_sanitize_address))
+static const char* FindFirstOfSse2(const char* begin, const char* end,
+                                   char a, char b) {
+  if (begin >= end) {
+    return end;  // not even a byte of the first block is ours to read
+  }
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  const char* block = begin - (reinterpret_cast<uintptr_t>(begin) & 15);
+  for (; block < end; block += 16) {
+    __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+    uint32_t mask = _mm_movemask_epi8(
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, va), _mm_cmpeq_epi8(bytes, vb)));
+    mask &= InRange(block, 16, begin, end);
+    if (mask != 0) {
+      return block + __builtin_ctz(mask);
+    }
+  }
+  return end;
+}
+
+__attribute__((no_sanitize_address))
+static const char* FindLineEndSse2(const char* begin, const char* end,
+                                   char delim, const char** first_delim) {
+  if (first_delim != nullptr) {
+    *first_delim = nullptr;
+  }
+  if (begin >= end) {
+    return end;
+  }
+  const __m128i vnl = _mm_set1_epi8('\n');
+  const __m128i vdelim = _mm_set1_epi8(delim);
+  const char* block = begin - (reinterpret_cast<uintptr_t>(begin) & 15);
+  if (!CrossesPage(begin, 16)) {
+    // Most lines end within a block of where they start, so start with
+    // the (unaligned) block at "begin", which takes in the rest of the
+    // first aligned one.
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    uint32_t in_range = InRange(begin, 16, begin, end);
+    uint32_t newlines =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, vnl)) & in_range;
+    uint32_t delims =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, vdelim)) & in_range;
+    NoteDelim(begin, delims, newlines, first_delim);
+    if (newlines != 0) {
+      return begin + __builtin_ctz(newlines);
+    }
+    block += 16;
+  }
+  for (; block < end; block += 16) {
+    __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+    uint32_t in_range = InRange(block, 16, begin, end);
+    uint32_t newlines =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, vnl)) & in_range;
+    uint32_t delims =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, vdelim)) & in_range;
+    NoteDelim(block, delims, newlines, first_delim);
+    if (newlines != 0) {
+      return block + __builtin_ctz(newlines);
+    }
+  }
+  return end;
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static const char* FindFirstOfAvx2(const char* begin, const char* end,
+                                   char a, char b) {
+  if (begin >= end) {
+    return end;  // not even a byte of the first block is ours to read
+  }
+  const __m256i va = _mm256_set1_epi8(a);
+  const __m256i vb = _mm256_set1_epi8(b);
+  const char* block = begin - (reinterpret_cast<uintptr_t>(begin) & 31);
+  for (; block < end; block += 32) {
+    __m256i bytes =
+      _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+    uint32_t mask = _mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_cmpeq_epi8(bytes, va),
+                      _mm256_cmpeq_epi8(bytes, vb)));
+    mask &= InRange(block, 32, begin, end);
+    if (mask != 0) {
+      return block + __builtin_ctz(mask);
+    }
+  }
+  return end;
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static const char* FindLineEndAvx2(const char* begin, const char* end,
+                                   char delim, const char** first_delim) {
+  if (first_delim != nullptr) {
+    *first_delim = nullptr;
+  }
+  if (begin >= end) {
+    return end;
+  }
+  const __m256i vnl = _mm256_set1_epi8('\n');
+  const __m256i vdelim = _mm256_set1_epi8(delim);
+  const char* block = begin - (reinterpret_cast<uintptr_t>(begin) & 31);
+  if (!CrossesPage(begin, 32)) {
+    // Most lines end within a block of where they start, so start with
+    // the (unaligned) block at "begin", which takes in the rest of the
+    // first aligned one.
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+    uint32_t in_range = InRange(begin, 32, begin, end);
+    uint32_t newlines =
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, vnl)) & in_range;
+    uint32_t delims =
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, vdelim)) & in_range;
+    NoteDelim(begin, delims, newlines, first_delim);
+    if (newlines != 0) {
+      return begin + __builtin_ctz(newlines);
+    }
+    block += 32;
+  }
+  for (; block < end; block += 32) {
+    __m256i bytes =
+      _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+    uint32_t in_range = InRange(block, 32, begin, end);
+    uint32_t newlines =
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, vnl)) & in_range;
+    uint32_t delims =
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, vdelim)) & in_range;
+    NoteDelim(block, delims, newlines, first_delim);
+    if (newlines != 0) {
+      return block + __builtin_ctz(newlines);
+    }
+  }
+  return end;
+}
+#endif  // __x86_64__
+
+typedef const char* (*find_first_of_fn)(const char* begin, const char* end,
+                                        char a, char b);
+typedef const char* (*find_line_end_fn)(const char* begin, const char* end,
+                                        char delim,
+                                        const char** first_delim);
+
+static bool Supported(ByteScanKind kind) {
+  switch (kind) {
+    case kScanScalar:
+      return true;
+#if defined(__x86_64__)
+    case kScanSse2:
+      return true;
+    case kScanAvx2:
+      // This may run before libgcc has looked at the CPU itself.
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+static find_first_of_fn FindFirstOfKernel(ByteScanKind kind) {
+  switch (kind) {
+#if defined(__x86_64__)
+    case kScanSse2:
+      return &FindFirstOfSse2;
+    case kScanAvx2:
+      return &FindFirstOfAvx2;
+#endif
+    default:
+      return &FindFirstOfScalar;
+  }
+}
+
+static find_line_end_fn FindLineEndKernel(ByteScanKind kind) {
+  switch (kind) {
+#if defined(__x86_64__)
+    case kScanSse2:
+      return &FindLineEndSse2;
+    case kScanAvx2:
+      return &FindLineEndAvx2;
+#endif
+    default:
+      return &FindLineEndScalar;
+  }
+}
+
+static ByteScanKind BestKind() {
+  if (Supported(kScanAvx2)) {
+    return kScanAvx2;
+  }
+  return Supported(kScanSse2) ? kScanSse2 : kScanScalar;
+}
+
+static ByteScanKind kind_in_use = BestKind();
+static find_first_of_fn find_first_of = FindFirstOfKernel(kind_in_use);
+static find_line_end_fn find_line_end = FindLineEndKernel(kind_in_use);
+
+const char* FindFirstOf(const char* begin, const char* end, char a, char b) {
+  return find_first_of(begin, end, a, b);
+}
+
+const char* FindLineEnd(const char* begin, const char* end, char delim,
+                        const char** first_delim) {
+  return find_line_end(begin, end, delim, first_delim);
+}
+
+bool SelectByteScan(ByteScanKind kind) {
+  if (!Supported(kind)) {
+    return false;
+  }
+  kind_in_use = kind;
+  find_first_of = FindFirstOfKernel(kind);
+  find_line_end = FindLineEndKernel(kind);
+  return true;
+}
+
+ByteScanKind ByteScanKindInUse() {
+  return kind_in_use;
+}
+
+const char* ByteScanName(ByteScanKind kind) {
+  switch (kind) {
+    case kScanSse2:
+      return "sse2";
+    case kScanAvx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+}  // namespace hw4
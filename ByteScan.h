@@ -0,0 +1,52 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_BYTESCAN_H_
+#define HW4_BYTESCAN_H_
+
+namespace hw4 {
+
+// The ways the request parser can search its buffer for the bytes that
+// split a request up: line endings, the ':' after a header's name, and
+// the spaces between the words of the request line.
+enum ByteScanKind {
+  kScanScalar,  // one byte at a time, on any CPU
+  kScanSse2,    // 16 bytes at a time (any x86-64 CPU)
+  kScanAvx2     // 32 bytes at a time (x86-64 CPUs with AVX2)
+};
+
+// Returns a pointer to the first byte in [begin, end) that is "a" or
+// "b" (which may be the same byte), or "end" if there isn't one.
+//
+// This and FindLineEnd() are where the parser spends most of its time,
+// so they use the widest kind this CPU supports, as checked once at
+// startup, unless SelectByteScan() says otherwise.
+const char* FindFirstOf(const char* begin, const char* end, char a, char b);
+
+// Returns a pointer to the first '\n' in [begin, end), or "end" if
+// there isn't one.  In the same pass, sets "*first_delim" (unless it's
+// null) to the first "delim" before that, or to null if there isn't
+// one; e.g., a header line's ':'.
+const char* FindLineEnd(const char* begin, const char* end, char delim,
+                        const char** first_delim);
+
+// Makes FindFirstOf() use "kind".  Returns false, leaving it as it was,
+// if this CPU can't run that kind.  Meant for tests and benchmarks;
+// call it before starting any threads that parse requests.
+bool SelectByteScan(ByteScanKind kind);
+
+// The kind FindFirstOf() currently uses, and its name.
+ByteScanKind ByteScanKindInUse();
+const char* ByteScanName(ByteScanKind kind);
+
+}  // namespace hw4
+
+#endif  // HW4_BYTESCAN_H_
@@ -0,0 +1,273 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <sys/socket.h>  // for shutdown()
+#include <time.h>        // for clock_gettime()
+#include <unistd.h>      // for close()
+#include <vector>
+
+#include "./ConnectionReaper.h"
+#include "./HttpUtils.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::vector;
+
+namespace hw4 {
+
+// Returns the current CLOCK_MONOTONIC time in reaper ticks.
+static uint64_t NowTicks() {
+  struct timespec ts;
+  Verify333(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+  uint64_t ms = ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+  return ms / ConnectionReaper::kTickMs;
+}
+
+ConnectionReaper::ConnectionReaper(uint32_t idle_timeout_ms,
+                                   uint32_t header_timeout_ms,
+                                   uint32_t write_timeout_ms)
+  : idle_timeout_ms_(idle_timeout_ms), header_timeout_ms_(header_timeout_ms),
+    write_timeout_ms_(write_timeout_ms),
+    wheel_(NowTicks()), stop_(false), draining_(false), drain_deadline_(0),
+    drain_expired_(false), running_(false), num_reaped_(0) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+
+  // Time the reaper thread's naps on the same clock as the wheel.
+  pthread_condattr_t attr;
+  Verify333(pthread_condattr_init(&attr) == 0);
+  Verify333(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) == 0);
+  Verify333(pthread_cond_init(&cond_, &attr) == 0);
+  Verify333(pthread_condattr_destroy(&attr) == 0);
+}
+
+ConnectionReaper::~ConnectionReaper() {
+  Stop();
+  Verify333(pthread_cond_destroy(&cond_) == 0);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool ConnectionReaper::Start() {
+  if (running_) {
+    return false;
+  }
+  stop_ = false;
+  if (pthread_create(&thread_, nullptr, &ReaperThread,
+                     static_cast<void*>(this)) != 0) {
+    return false;
+  }
+  running_ = true;
+  return true;
+}
+
+void ConnectionReaper::Stop() {
+  if (running_) {
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    stop_ = true;
+    Verify333(pthread_cond_signal(&cond_) == 0);
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    Verify333(pthread_join(thread_, nullptr) == 0);
+    running_ = false;
+  }
+
+  // There's nobody left to wait on the lingering sockets.
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  for (const Lingering& lingering : lingering_) {
+    close(lingering.fd);
+  }
+  lingering_.clear();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+void ConnectionReaper::Arm(Deadline* deadline, int fd, DeadlineKind kind) {
+  Arm(deadline, fd, kind, false);
+}
+
+void ConnectionReaper::Rearm(Deadline* deadline, int fd, DeadlineKind kind) {
+  Arm(deadline, fd, kind, true);
+}
+
+void ConnectionReaper::Arm(Deadline* deadline, int fd, DeadlineKind kind,
+                           bool restart) {
+  uint32_t timeout_ms = (kind == kIdleDeadline) ? idle_timeout_ms_
+                      : (kind == kHeaderDeadline) ? header_timeout_ms_
+                      : write_timeout_ms_;
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (deadline->reaper == nullptr) {
+    deadline->reaper = this;
+    deadline->self = connections_.insert(connections_.end(), deadline);
+  }
+  deadline->fd = fd;
+  deadline->armed = true;
+  if (timeout_ms == 0 && !draining_) {
+    deadline->kind = kind;
+    wheel_.Cancel(deadline);
+  } else if (restart || !deadline->pending() || deadline->kind != kind) {
+    deadline->kind = kind;
+    wheel_.Schedule(deadline, Expiry(kind, timeout_ms));
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+void ConnectionReaper::Disarm(Deadline* deadline) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  deadline->armed = false;
+  wheel_.Cancel(deadline);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+void ConnectionReaper::Release(Deadline* deadline) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (deadline->reaper == this) {
+    wheel_.Cancel(deadline);
+    connections_.erase(deadline->self);
+    deadline->reaper = nullptr;
+    deadline->armed = false;
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+void ConnectionReaper::Drain(uint32_t grace_ms) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (!draining_) {
+    uint64_t now = NowTicks();
+    drain_deadline_ = now + (grace_ms + kTickMs - 1) / kTickMs + 1;
+    draining_ = true;
+
+    // Pull in the deadlines of the connections that are waiting on
+    // their clients; the ones that are busy get the same treatment when
+    // they next arm theirs.
+    for (Deadline* deadline : connections_) {
+      if (!deadline->armed) {
+        continue;
+      }
+      if (deadline->kind == kIdleDeadline) {
+        wheel_.Schedule(deadline, now);
+      } else if (!deadline->pending() ||
+                 deadline->expires() > drain_deadline_) {
+        wheel_.Schedule(deadline, drain_deadline_);
+      }
+    }
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+void ConnectionReaper::Linger(int fd) {
+  shutdown(fd, SHUT_WR);
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (!stop_ && lingering_.size() < kMaxLingering) {
+    uint64_t expires = NowTicks() + (kLingerMs + kTickMs - 1) / kTickMs + 1;
+    lingering_.push_back({fd, expires});
+    fd = -1;
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  if (fd != -1) {
+    CloseAfterResponse(fd);
+  }
+}
+
+uint32_t ConnectionReaper::num_connections() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  uint32_t num = connections_.size();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return num;
+}
+
+uint32_t ConnectionReaper::num_lingering() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  uint32_t num = lingering_.size();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return num;
+}
+
+uint64_t ConnectionReaper::Expiry(DeadlineKind kind,
+                                  uint32_t timeout_ms) const {
+  uint64_t now = NowTicks();
+  if (draining_ && kind == kIdleDeadline) {
+    return now;  // i.e., at the next tick
+  }
+
+  // Round up, and skip the rest of the current tick, so that a deadline
+  // never fires early.
+  uint64_t expires = now + (timeout_ms + kTickMs - 1) / kTickMs + 1;
+  if (draining_ && (timeout_ms == 0 || drain_deadline_ < expires)) {
+    expires = drain_deadline_;
+  }
+  return expires;
+}
+
+void* ConnectionReaper::ReaperThread(void* reaper) {
+  static_cast<ConnectionReaper*>(reaper)->Reap();
+  return nullptr;
+}
+
+// The reaper thread's main loop: once a tick, advance the wheel and
+// shut down the sockets whose deadlines have passed.  The shutdown()s
+// happen with the lock held, so a connection that releases its deadline
+// before closing its fd can't have some other socket that reuses the
+// fd number shut down by mistake.
+void ConnectionReaper::Reap() {
+  vector<TimerWheel::Timer*> expired;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  while (!stop_) {
+    struct timespec wake;
+    Verify333(clock_gettime(CLOCK_MONOTONIC, &wake) == 0);
+    wake.tv_nsec += kTickMs * 1000000L;
+    if (wake.tv_nsec >= 1000000000L) {
+      wake.tv_sec++;
+      wake.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&cond_, &lock_, &wake);
+    if (stop_) {
+      break;
+    }
+
+    expired.clear();
+    uint64_t now = NowTicks();
+    wheel_.Advance(now, &expired);
+    for (TimerWheel::Timer* timer : expired) {
+      // While draining, an idle connection only loses its read side, so
+      // that the tail of its last response still goes out.
+      Deadline* deadline = static_cast<Deadline*>(timer);
+      bool drain_idle = draining_ && !drain_expired_ &&
+                        deadline->kind == kIdleDeadline;
+      shutdown(deadline->fd, drain_idle ? SHUT_RD : SHUT_RDWR);
+      num_reaped_++;
+    }
+
+    // Once the drain deadline passes, hang up on everybody left.
+    if (draining_ && !drain_expired_ && now >= drain_deadline_) {
+      drain_expired_ = true;
+      for (Deadline* deadline : connections_) {
+        wheel_.Cancel(deadline);
+        shutdown(deadline->fd, SHUT_RDWR);
+        num_reaped_++;
+      }
+    }
+
+    // Read off what lingering clients have sent, and close the sockets
+    // of those that have hung up or run out of time.
+    size_t kept = 0;
+    for (const Lingering& lingering : lingering_) {
+      if (DrainSocket(lingering.fd) || now >= lingering.expires) {
+        close(lingering.fd);
+      } else {
+        lingering_[kept++] = lingering;
+      }
+    }
+    lingering_.resize(kept);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+}  // namespace hw4
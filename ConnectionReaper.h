@@ -0,0 +1,212 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_CONNECTIONREAPER_H_
+#define HW4_CONNECTIONREAPER_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <stdint.h>   // for uint32_t, etc.
+#include <atomic>     // for std::atomic
+#include <list>       // for std::list
+#include <vector>     // for std::vector
+
+#include "./TimerWheel.h"
+
+namespace hw4 {
+
+// A ConnectionReaper enforces deadlines on client connections, so that
+// a client that goes quiet can't hold on to a socket (and, in the
+// blocking server modes, a worker thread) forever.  There are three:
+//
+//  - the idle deadline, for a connection that is between requests,
+//  - the header deadline, for a connection that has sent part of a
+//    request header but not the rest (e.g., a "slowloris" client), and
+//  - the write deadline, for a connection with a response on its way
+//    out that the client has stopped reading.
+//
+// When a deadline passes, the reaper's thread shutdown()s the socket.
+// That doesn't close the fd -- its owner still does that -- but it
+// makes any blocked or future read see EOF and makes the socket
+// readable for epoll, which is all the server's connection handlers
+// need to wind the connection down.
+//
+// Deadlines live on a TimerWheel, so arming and disarming one costs the
+// same no matter how many connections there are.
+//
+// The reaper also winds connections down when the server shuts down
+// gracefully; see Drain().  And it closes the sockets of clients that
+// are sent away with a final response, once they have had a chance to
+// read it; see Linger().
+class ConnectionReaper {
+ public:
+  enum DeadlineKind { kIdleDeadline, kHeaderDeadline, kWriteDeadline };
+
+  // One connection's deadline.  Arming it for the first time registers
+  // the connection with the reaper, and it must be released (see
+  // Release()) before the connection's fd is closed.
+  class Deadline : public TimerWheel::Timer {
+   public:
+    Deadline()
+      : fd(-1), kind(kIdleDeadline), armed(false), reaper(nullptr) { }
+    virtual ~Deadline() {
+      if (reaper != nullptr) {
+        reaper->Release(this);
+      }
+    }
+
+   private:
+    friend class ConnectionReaper;
+    int fd;
+    DeadlineKind kind;
+
+    // True from Arm() until Disarm(), even if the timeout for "kind" is
+    // 0 and the deadline isn't actually on the wheel.
+    bool armed;
+
+    // The reaper this deadline is registered with, if any, and where it
+    // sits in the reaper's list of connections.
+    ConnectionReaper* reaper;
+    std::list<Deadline*>::iterator self;
+  };
+
+  // Creates a reaper that gives idle connections "idle_timeout_ms",
+  // partial request headers "header_timeout_ms", and responses the
+  // client isn't reading "write_timeout_ms" without progress; a timeout
+  // of 0 means that kind of deadline is never enforced.  The
+  // constructor doesn't create the reaper thread; Start() does.
+  ConnectionReaper(uint32_t idle_timeout_ms, uint32_t header_timeout_ms,
+                   uint32_t write_timeout_ms = 0);
+
+  // Stops the reaper thread if it is running.
+  virtual ~ConnectionReaper();
+
+  // Spawns the reaper thread.  Returns false if that fails.
+  bool Start();
+
+  // Stops the reaper thread.  Deadlines can still be armed and disarmed
+  // afterwards, but none of them will fire.
+  void Stop();
+
+  // Arms "deadline" to shut down "fd" once the timeout for "kind"
+  // passes.  If "deadline" is already armed with the same kind, it is
+  // left alone, so a client can't push a deadline back by trickling in
+  // bytes; if it is armed with another kind, it starts over.  Safe to
+  // call from any thread.
+  void Arm(Deadline* deadline, int fd, DeadlineKind kind);
+
+  // Like Arm(), except that a deadline already armed with the same kind
+  // starts over.  This is for the write deadline, which each bit of
+  // progress pushes back: it's there for a client that stops reading,
+  // not for one that reads slowly.
+  void Rearm(Deadline* deadline, int fd, DeadlineKind kind);
+
+  // Disarms "deadline" if it is armed.  Safe to call from any thread.
+  void Disarm(Deadline* deadline);
+
+  // Disarms "deadline" and forgets about its connection altogether,
+  // which must happen before the connection's fd is closed.  Safe to
+  // call from any thread, and more than once.
+  void Release(Deadline* deadline);
+
+  // Starts winding down every connection the reaper knows about, for a
+  // graceful shutdown.  From now on, a connection that is idle, or goes
+  // idle after finishing its current request, has the read side of its
+  // socket shut down at the next tick: its handler sees EOF once it has
+  // read whatever the client already sent, while the response it is
+  // writing still goes out.  Partial headers get at most "grace_ms" to
+  // finish, and once "grace_ms" has passed, every connection still
+  // registered is shut down completely, whatever it is doing.  Safe to
+  // call from any thread; later calls do nothing.
+  void Drain(uint32_t grace_ms);
+  bool draining() const { return draining_; }
+
+  // Takes over "fd", which has had its last response written to it,
+  // and closes it properly.  Closing a socket with unread data in it
+  // makes the kernel send a reset, which can get to the client before
+  // it has read the response and throw the response away.  So the
+  // write side is shut down now, and at each tick the reaper reads off
+  // whatever the client has sent, closing the socket once the client
+  // hangs up or kLingerMs have passed.  If kMaxLingering sockets are
+  // already waiting, "fd" is drained and closed right away instead.
+  // Stop() closes any sockets still waiting.  Safe to call from any
+  // thread.
+  void Linger(int fd);
+
+  // The number of connections registered with the reaper, i.e., that
+  // have armed a deadline and not yet released it.
+  uint32_t num_connections();
+
+  // The number of sockets handed to Linger() that are still open.
+  uint32_t num_lingering();
+
+  // The number of connections shut down so far.
+  uint64_t num_reaped() const { return num_reaped_; }
+
+  // How long a tick of the reaper's TimerWheel is.  Deadlines fire up
+  // to one tick late.
+  static const uint32_t kTickMs = 50;
+
+  // How long Linger() waits for a client to hang up, and how many
+  // sockets may wait at once.
+  static const uint32_t kLingerMs = 2000;
+  static const uint32_t kMaxLingering = 1024;
+
+ private:
+  static void* ReaperThread(void* reaper);
+  void Reap();
+
+  const uint32_t idle_timeout_ms_;
+  const uint32_t header_timeout_ms_;
+  const uint32_t write_timeout_ms_;
+
+  // Arm() and Rearm(), which differ in whether an armed deadline of the
+  // same kind is left alone or "restart"s.
+  void Arm(Deadline* deadline, int fd, DeadlineKind kind, bool restart);
+
+  // Works out when a deadline of kind "kind" that is armed now should
+  // fire.  Called with lock_ held.
+  uint64_t Expiry(DeadlineKind kind, uint32_t timeout_ms) const;
+
+  // Guards everything below.  cond_ tells the reaper thread to stop.
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+  TimerWheel wheel_;
+  bool stop_;
+
+  // Every registered connection's deadline, armed or not.
+  std::list<Deadline*> connections_;
+
+  // The sockets handed to Linger(), and the ticks at which the reaper
+  // stops waiting for their clients.
+  struct Lingering {
+    int fd;
+    uint64_t expires;
+  };
+  std::vector<Lingering> lingering_;
+
+  // Set once Drain() is called.  drain_deadline_ is the tick at which
+  // the reaper gives up on the stragglers, and drain_expired_ is set
+  // once it has.
+  std::atomic<bool> draining_;
+  uint64_t drain_deadline_;
+  bool drain_expired_;
+
+  pthread_t thread_;
+  bool running_;
+  std::atomic<uint64_t> num_reaped_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_CONNECTIONREAPER_H_
@@ -0,0 +1,118 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_COROUTINE_H_
+#define HW4_COROUTINE_H_
+
+#include <coroutine>  // for std::coroutine_handle, etc.
+#include <exception>  // for std::terminate()
+#include <optional>   // for std::optional
+#include <utility>    // for std::move, std::exchange
+
+namespace hw4 {
+
+// The return types of the server's C++20 coroutines.  A coroutine
+// suspends wherever it co_awaits something that isn't ready yet (see
+// Reactor.h), and whoever makes that thing ready resumes it, on
+// whatever thread that happens to be.  So a connection's handler can be
+// written as a plain loop of reads and writes, like a thread's, while
+// only holding a thread when it has something to do.
+//
+// Exceptions aren't carried across a co_await; one that escapes a
+// coroutine ends the process, as it would escaping a thread.
+
+// A CoTask<T> is a coroutine that returns a T to the coroutine that
+// co_awaits it, e.g., "bool ok = co_await conn.AsyncWriteResponse(...);".
+// It doesn't start until it's co_awaited, and when it finishes, it
+// resumes its awaiter right away, without a trip through anybody's
+// queue.  The CoTask owns the coroutine, and destroys it along with
+// itself.
+template <typename T>
+class CoTask {
+ public:
+  struct promise_type;
+  typedef std::coroutine_handle<promise_type> handle_type;
+
+  struct promise_type {
+    CoTask get_return_object() {
+      return CoTask(handle_type::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Hands the thread straight to the awaiter.
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(handle_type h) noexcept {
+        return h.promise().continuation;
+      }
+      void await_resume() noexcept { }
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void return_value(T v) { value = std::move(v); }
+    void unhandled_exception() { std::terminate(); }
+
+    std::optional<T> value;
+    std::coroutine_handle<> continuation;
+  };
+
+  CoTask(CoTask&& other) : handle_(std::exchange(other.handle_, nullptr)) { }
+  CoTask(const CoTask&) = delete;
+  CoTask& operator=(const CoTask&) = delete;
+  virtual ~CoTask() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  // What makes a CoTask awaitable: co_await starts it, with the awaiter
+  // to resume once it's done, and then returns its result.
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+    handle_.promise().continuation = awaiter;
+    return handle_;
+  }
+  T await_resume() { return std::move(*handle_.promise().value); }
+
+ private:
+  explicit CoTask(handle_type handle) : handle_(handle) { }
+
+  handle_type handle_;
+};
+
+// A CoDetached is a coroutine that nobody waits for, such as the one
+// serving a connection: it runs once something resumes it the first
+// time (see Reactor::Spawn()), and destroys itself when it finishes.
+class CoDetached {
+ public:
+  struct promise_type {
+    CoDetached get_return_object() {
+      return CoDetached(
+        std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() { }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  // The coroutine, for whoever is going to start it.
+  std::coroutine_handle<> handle() const { return handle_; }
+
+ private:
+  explicit CoDetached(std::coroutine_handle<> handle) : handle_(handle) { }
+
+  std::coroutine_handle<> handle_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_COROUTINE_H_
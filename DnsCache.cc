@@ -0,0 +1,202 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>   // for inet_pton()
+#include <netdb.h>       // for getnameinfo()
+#include <string.h>      // for memset(), memcpy()
+#include <sys/socket.h>  // for struct sockaddr_storage
+#include <time.h>        // for clock_gettime()
+#include <list>
+#include <map>
+#include <string>
+
+#include "./DnsCache.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::list;
+using std::map;
+using std::string;
+
+namespace hw4 {
+
+// Returns the current CLOCK_MONOTONIC time in seconds.
+static time_t Now() {
+  struct timespec ts;
+  Verify333(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+  return ts.tv_sec;
+}
+
+// Does a blocking reverse lookup of the printable address "addr".
+// Returns the DNS name, or an empty string if there isn't one.
+static string ReverseLookup(const string& addr) {
+  struct sockaddr_storage ss;
+  socklen_t len;
+  memset(&ss, 0, sizeof(ss));
+
+  struct sockaddr_in* in4 = reinterpret_cast<struct sockaddr_in*>(&ss);
+  struct sockaddr_in6* in6 = reinterpret_cast<struct sockaddr_in6*>(&ss);
+  if (inet_pton(AF_INET, addr.c_str(), &in4->sin_addr) == 1) {
+    in4->sin_family = AF_INET;
+    len = sizeof(*in4);
+  } else if (inet_pton(AF_INET6, addr.c_str(), &in6->sin6_addr) == 1) {
+    if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)) {
+      // Look up an IPv4 client on an IPv6 socket by its IPv4 address;
+      // resolvers don't always know the mapped form.
+      struct in_addr v4;
+      memcpy(&v4, &in6->sin6_addr.s6_addr[12], sizeof(v4));
+      memset(&ss, 0, sizeof(ss));
+      in4->sin_family = AF_INET;
+      in4->sin_addr = v4;
+      len = sizeof(*in4);
+    } else {
+      in6->sin6_family = AF_INET6;
+      len = sizeof(*in6);
+    }
+  } else {
+    return "";
+  }
+
+  char hostname[1024];  // ought to be big enough.
+  if (getnameinfo(reinterpret_cast<struct sockaddr*>(&ss), len,
+                  hostname, sizeof(hostname), nullptr, 0,
+                  NI_NAMEREQD) != 0) {
+    return "";
+  }
+  return hostname;
+}
+
+// static
+const uint32_t DnsCache::kMaxQueued;
+
+DnsCache::DnsCache(uint32_t capacity, uint32_t ttl_secs)
+  : capacity_(capacity > 0 ? capacity : 1), ttl_secs_(ttl_secs),
+    max_queued_(capacity_ < kMaxQueued ? capacity_ : kMaxQueued),
+    stop_(false) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+  Verify333(pthread_cond_init(&cond_, nullptr) == 0);
+  Verify333(pthread_create(&thread_, nullptr, &ResolverThread,
+                           static_cast<void*>(this)) == 0);
+}
+
+DnsCache::~DnsCache() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  stop_ = true;
+  Verify333(pthread_cond_signal(&cond_) == 0);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  Verify333(pthread_join(thread_, nullptr) == 0);
+  Verify333(pthread_cond_destroy(&cond_) == 0);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool DnsCache::Lookup(const string& addr, string* const name) {
+  time_t now = Now();
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+
+  map<string, Entry>::iterator it = entries_.find(addr);
+  if (it != entries_.end()) {
+    Entry& entry = it->second;
+    lru_.splice(lru_.begin(), lru_, entry.lru_pos);
+    if (entry.pending || entry.expires > now) {
+      bool hit = !entry.pending;
+      if (hit) {
+        *name = entry.name;
+      }
+      Verify333(pthread_mutex_unlock(&lock_) == 0);
+      return hit;
+    }
+  }
+
+  // The address needs looking up, but if the resolver is already that
+  // far behind, don't add to its backlog, or push anything out of the
+  // cache for the sake of an answer that's a long way off.
+  if (queue_.size() >= max_queued_) {
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return false;
+  }
+
+  if (it == entries_.end()) {
+    // Make room, then add a placeholder for the answer to land in.  An
+    // evicted address the resolver hasn't got to yet is dropped from
+    // its queue, rather than looked up for nobody.
+    if (entries_.size() >= capacity_) {
+      map<string, Entry>::iterator victim = entries_.find(lru_.back());
+      if (victim->second.queued) {
+        queue_.erase(victim->second.queue_pos);
+      }
+      entries_.erase(victim);
+      lru_.pop_back();
+    }
+    it = entries_.emplace(addr, Entry()).first;
+    it->second.expires = 0;
+    it->second.lru_pos = lru_.insert(lru_.begin(), addr);
+  }
+  // Otherwise the answer has expired, and is looked up again.
+  Entry& entry = it->second;
+  entry.pending = true;
+  entry.queued = true;
+  entry.queue_pos = queue_.insert(queue_.end(), addr);
+  Verify333(pthread_cond_signal(&cond_) == 0);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return false;
+}
+
+uint32_t DnsCache::size() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  uint32_t num = entries_.size();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return num;
+}
+
+uint32_t DnsCache::num_queued() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  uint32_t num = queue_.size();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return num;
+}
+
+void* DnsCache::ResolverThread(void* cache) {
+  static_cast<DnsCache*>(cache)->Resolve();
+  return nullptr;
+}
+
+// The resolver thread's main loop: take the next queued address, look
+// it up with the lock released, and record the answer if the address
+// is still in the cache.
+void DnsCache::Resolve() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  while (!stop_) {
+    if (queue_.empty()) {
+      Verify333(pthread_cond_wait(&cond_, &lock_) == 0);
+      continue;
+    }
+    string addr = queue_.front();
+    queue_.pop_front();
+    entries_[addr].queued = false;  // every queued address is cached
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+    string name = ReverseLookup(addr);
+
+    time_t now = Now();
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    map<string, Entry>::iterator it = entries_.find(addr);
+    if (it != entries_.end() && it->second.pending) {
+      it->second.name = name;
+      it->second.expires = now + ttl_secs_;
+      it->second.pending = false;
+    }
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+}  // namespace hw4
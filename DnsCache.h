@@ -0,0 +1,102 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_DNSCACHE_H_
+#define HW4_DNSCACHE_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <stdint.h>   // for uint32_t, etc.
+#include <time.h>     // for time_t
+#include <list>       // for std::list
+#include <map>        // for std::map
+#include <string>     // for std::string
+
+namespace hw4 {
+
+// A DnsCache maps numeric IP addresses to DNS names without ever
+// making its callers wait for a resolver.  A lookup either finds a
+// fresh answer in the cache or comes back empty-handed right away; in
+// the latter case, the address is queued for a background thread that
+// does the (blocking) reverse lookup and fills in the cache, so that a
+// later lookup of the same address succeeds.
+//
+// The cache holds at most "capacity" addresses, evicting the least
+// recently used one to make room, and an answer is good for "ttl_secs"
+// seconds.  Failed lookups are cached too, so an address with no name
+// is only sent to the resolver once per TTL.
+//
+// At most kMaxQueued addresses (or "capacity", if that's fewer) wait
+// for the resolver at a time.  While it's that far behind, e.g., stuck
+// on a slow DNS server while a flood of new clients arrive, a lookup of
+// a new address comes back empty-handed without queueing anything or
+// evicting anything, and the caller makes do with the numeric address.
+class DnsCache {
+ public:
+  // Creates the cache and spawns its resolver thread.
+  DnsCache(uint32_t capacity, uint32_t ttl_secs);
+
+  // Stops the resolver thread, waiting for any lookup it is in the
+  // middle of.
+  virtual ~DnsCache();
+
+  // Looks up the printable address "addr" (as produced by inet_ntop()).
+  // If a fresh answer is cached, returns true and returns the name via
+  // the output parameter "name"; the name is empty if the address
+  // doesn't have one.  Otherwise returns false, leaves "name" alone,
+  // and makes sure a lookup of "addr" is on its way.  Never blocks on
+  // the network.
+  bool Lookup(const std::string& addr, std::string* const name);
+
+  // The number of addresses in the cache, including those still being
+  // resolved.
+  uint32_t size();
+
+  // The number of addresses waiting for the resolver.
+  uint32_t num_queued();
+
+  // The most addresses that wait for the resolver at a time.
+  static const uint32_t kMaxQueued = 256;
+
+ private:
+  struct Entry {
+    std::string name;
+    time_t expires;    // in CLOCK_MONOTONIC seconds
+    bool pending;      // queued for, or being handled by, the resolver
+    bool queued;       // still in queue_, at "queue_pos"
+    std::list<std::string>::iterator lru_pos;
+    std::list<std::string>::iterator queue_pos;
+  };
+
+  static void* ResolverThread(void* cache);
+  void Resolve();
+
+  const uint32_t capacity_;
+  const uint32_t ttl_secs_;
+  const uint32_t max_queued_;
+
+  // Guards everything below.  cond_ tells the resolver thread that
+  // queue_ is no longer empty, or that it is time to stop.
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+  std::map<std::string, Entry> entries_;
+  std::list<std::string> lru_;    // most recently used first
+  std::list<std::string> queue_;  // addresses waiting for the resolver
+  bool stop_;
+
+  pthread_t thread_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_DNSCACHE_H_
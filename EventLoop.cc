@@ -0,0 +1,457 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>         // for errno
+#include <fcntl.h>         // for fcntl(), O_NONBLOCK
+#include <stdint.h>        // for uint64_t
+#include <string.h>        // for memset()
+#include <unistd.h>        // for read(), write(), close()
+#include <sys/epoll.h>     // for epoll_create1(), epoll_wait(), etc.
+#include <sys/eventfd.h>   // for eventfd()
+#include <sys/socket.h>    // for sendmsg(), MSG_NOSIGNAL
+#include <sys/uio.h>       // for struct iovec
+#include <list>
+#include <string>
+
+#include "./EventLoop.h"
+#include "./HttpUtils.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::list;
+using std::string;
+
+namespace hw4 {
+
+// The most events we pull out of the kernel per epoll_wait().
+static const int kMaxEvents = 256;
+
+// The most buffers we hand the kernel per sendmsg().
+static const int kMaxIov = 64;
+
+struct EventLoop::Connection {
+  explicit Connection(int fd)
+    : http(fd), out_offset(0), write_blocked(false), busy(false),
+      read_closed(false), closing(false), corked(false) { }
+
+  // Owns (and eventually closes) the client fd, and buffers any bytes
+  // read past the end of the current request.
+  HttpConnection http;
+
+  // Response headers and bodies that haven't been fully written yet, in
+  // order, and how much of the first one has already gone out on the
+  // wire.  Bodies are moved in rather than copied.
+  list<string> out;
+  size_t out_offset;
+
+  // True while "out" is waiting for the client to make room for it,
+  // which the write deadline bounds; the read deadlines wait until
+  // it's done.
+  bool write_blocked;
+
+  // True while a worker thread is processing one of our requests.
+  bool busy;
+
+  // True once the client has finished sending (or reading from it has
+  // failed).  The requests it already sent still get answered.
+  bool read_closed;
+
+  // True once the connection should be closed as soon as it is idle,
+  // i.e., when nothing is in flight and "out" has been flushed.
+  bool closing;
+
+  // True while the socket is corked because "out" didn't all fit in
+  // the socket buffer.
+  bool corked;
+
+  // Our position in connections_, for O(1) removal.
+  list<Connection*>::iterator self;
+};
+
+class EventLoop::RequestTask : public ThreadPool::Task {
+ public:
+  RequestTask(EventLoop* loop, Connection* conn)
+    : ThreadPool::Task(&RequestTask::Process),
+      loop_(loop), conn_(conn), close_after_(false) { }
+
+  // The thread_task_fn.  Runs the handler on a worker thread and then
+  // passes the task (and with it, ownership) back to the loop.
+  static void Process(ThreadPool::Task* t) {
+    RequestTask* task = static_cast<RequestTask*>(t);
+    EventLoop* loop = task->loop_;
+    HttpResponse response = loop->handler_(task->request_,
+                                           loop->handler_arg_);
+    task->header_ = response.GenerateHeaderString();
+    task->body_.swap(*response.mutable_body());
+    loop->PostCompletion(task);
+  }
+
+  EventLoop* loop_;
+  Connection* conn_;
+  HttpRequest request_;
+  string header_;
+  string body_;
+  bool close_after_;
+};
+
+EventLoop::EventLoop(ThreadPool* pool, handler_fn handler, void* handler_arg,
+                     ConnectionReaper* reaper, lane_fn lane,
+                     const HttpConnectionLimits& limits)
+  : pool_(pool), handler_(handler), handler_arg_(handler_arg),
+    reaper_(reaper), lane_(lane), limits_(limits), epoll_fd_(-1),
+    wake_fd_(-1), running_(false), stop_(false), num_connections_(0) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+EventLoop::~EventLoop() {
+  Stop();
+
+  // Nothing else touches our state now, so tear everything down.
+  for (RequestTask* task : completions_) {
+    delete task;
+  }
+  for (Connection* conn : connections_) {
+    delete conn;
+  }
+  for (int fd : pending_fds_) {
+    close(fd);
+  }
+  if (wake_fd_ != -1)
+    close(wake_fd_);
+  if (epoll_fd_ != -1)
+    close(epoll_fd_);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool EventLoop::Start() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ == -1) {
+    return false;
+  }
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ == -1) {
+    return false;
+  }
+
+  // The wakeup eventfd is the only registration whose data.ptr is null.
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) == -1) {
+    return false;
+  }
+
+  if (pthread_create(&thread_, nullptr, &LoopThread,
+                     static_cast<void*>(this)) != 0) {
+    return false;
+  }
+  running_ = true;
+  return true;
+}
+
+void EventLoop::Stop() {
+  if (!running_)
+    return;
+  stop_ = true;
+  Wakeup();
+  Verify333(pthread_join(thread_, nullptr) == 0);
+  running_ = false;
+}
+
+void EventLoop::AddConnection(int client_fd) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  pending_fds_.push_back(client_fd);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  Wakeup();
+}
+
+void EventLoop::PostCompletion(RequestTask* task) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  completions_.push_back(task);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  Wakeup();
+}
+
+void EventLoop::Wakeup() {
+  uint64_t one = 1;
+  ssize_t res = write(wake_fd_, &one, sizeof(one));
+  // EAGAIN means the counter is saturated, so a wakeup is pending anyway.
+  Verify333(res == sizeof(one) || errno == EAGAIN);
+}
+
+void* EventLoop::LoopThread(void* loop) {
+  static_cast<EventLoop*>(loop)->Loop();
+  return nullptr;
+}
+
+// This is the main loop of the loop thread.  It waits for sockets to
+// become ready (or for another thread to wake it up), handles whatever
+// is ready, and then picks up new connections and finished requests
+// that other threads have handed it.
+void EventLoop::Loop() {
+  struct epoll_event events[kMaxEvents];
+
+  while (!stop_) {
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (num_events == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    for (int i = 0; i < num_events; i++) {
+      if (events[i].data.ptr == nullptr) {
+        // Reset the eventfd counter; the queues are drained below.
+        uint64_t count;
+        while (read(wake_fd_, &count, sizeof(count)) > 0) { }
+        continue;
+      }
+      HandleEvent(static_cast<Connection*>(events[i].data.ptr),
+                  events[i].events);
+    }
+
+    AdoptPendingConnections();
+    HandleCompletions();
+  }
+}
+
+void EventLoop::AdoptPendingConnections() {
+  list<int> fds;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  fds.swap(pending_fds_);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+  for (int fd : fds) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+      close(fd);
+      continue;
+    }
+
+    // Register edge-triggered for both directions once, up front.  We
+    // always read until EAGAIN and write until EAGAIN, so we never need
+    // to touch the registration again.
+    Connection* conn = new Connection(fd);
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = conn;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      delete conn;
+      continue;
+    }
+    conn->self = connections_.insert(connections_.end(), conn);
+    num_connections_++;
+    conn->http.SetReaper(reaper_);
+    conn->http.SetLimits(limits_);
+    conn->http.ArmDeadline();
+  }
+}
+
+void EventLoop::HandleCompletions() {
+  list<RequestTask*> done;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  done.swap(completions_);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+  for (RequestTask* task : done) {
+    Connection* conn = task->conn_;
+    conn->busy = false;
+    conn->out.push_back(string());
+    conn->out.back().swap(task->header_);
+    conn->out.push_back(string());
+    conn->out.back().swap(task->body_);
+    if (task->close_after_) {
+      conn->closing = true;
+    }
+    delete task;
+
+    if (!Flush(conn)) {
+      conn->closing = true;
+      conn->out.clear();
+      conn->out_offset = 0;
+    }
+    DispatchNext(conn);
+    MaybeClose(conn);
+  }
+}
+
+void EventLoop::HandleEvent(Connection* conn, uint32_t events) {
+  if (events & EPOLLERR) {
+    conn->closing = true;
+    conn->out.clear();
+    conn->out_offset = 0;
+    MaybeClose(conn);
+    return;
+  }
+
+  if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && !conn->read_closed) {
+    if (!conn->http.ReadAvailable()) {
+      conn->read_closed = true;
+    }
+    DispatchNext(conn);
+  }
+
+  // A hangup (e.g., the reaper's, on a client that stopped reading)
+  // comes without EPOLLOUT, but the write that finds out is the same.
+  if ((events & (EPOLLOUT | EPOLLHUP)) && !Flush(conn)) {
+    conn->closing = true;
+    conn->out.clear();
+    conn->out_offset = 0;
+  }
+
+  MaybeClose(conn);
+}
+
+// If the connection is idle and has a complete request buffered, hand
+// that request to a worker thread.
+void EventLoop::DispatchNext(Connection* conn) {
+  if (conn->busy || conn->closing)
+    return;
+
+  HttpRequest request;
+  while (!conn->http.NextBufferedRequest(&request)) {
+    uint16_t status = conn->http.RejectedStatus();
+    if (status != 0) {
+      // Tell the client why, after whatever it's already owed.
+      HttpResponse response = HttpConnection::RejectionResponse(status);
+      conn->out.push_back(response.GenerateHeaderString());
+      conn->out.push_back(string());
+      conn->out.back().swap(*response.mutable_body());
+      conn->closing = true;
+      if (!Flush(conn)) {
+        conn->out.clear();
+        conn->out_offset = 0;
+      }
+      return;
+    }
+    if (!conn->http.more_to_read() && conn->read_closed) {
+      // The client is done, and so, once "out" is flushed, are we.  A
+      // request it only sent part of is never coming.
+      conn->closing = true;
+      return;
+    }
+    if (!conn->http.more_to_read()) {
+      // We're waiting on the client again.
+      if (conn->out.empty()) {
+        conn->http.SendContinue();
+      }
+      if (!conn->write_blocked) {
+        conn->http.ArmDeadline();
+      }
+      return;
+    }
+
+    // The last read stopped with the buffer full, so the socket may
+    // hold more than epoll will ever tell us about.  Go get it.
+    if (!conn->http.ReadAvailable()) {
+      conn->read_closed = true;
+    }
+  }
+
+  if (!conn->write_blocked) {
+    conn->http.DisarmDeadline();
+  }
+  RequestTask* task = new RequestTask(this, conn);
+  task->request_ = std::move(request);
+  task->close_after_ =
+    (task->request_.GetHeaderValue(kHeaderConnection) == "close");
+  if (lane_ != nullptr) {
+    task->lane_ = lane_(task->request_, handler_arg_);
+  }
+  conn->busy = true;
+  pool_->Dispatch(task);
+}
+
+// Writes as much of conn->out as the socket will take right now,
+// gathering up to kMaxIov buffers per sendmsg().  Returns false if the
+// connection failed; running out of socket buffer is not a failure, as
+// EPOLLOUT will bring us back here.
+bool EventLoop::Flush(Connection* conn) {
+  bool progress = false;
+  while (!conn->out.empty()) {
+    struct iovec iov[kMaxIov];
+    int iovcnt = 0;
+    size_t offset = conn->out_offset;
+    for (list<string>::iterator it = conn->out.begin();
+         it != conn->out.end() && iovcnt < kMaxIov; it++) {
+      iov[iovcnt].iov_base = const_cast<char*>(it->data()) + offset;
+      iov[iovcnt].iov_len = it->size() - offset;
+      iovcnt++;
+      offset = 0;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    ssize_t res = sendmsg(conn->http.fd(), &msg, MSG_NOSIGNAL);
+    if (res == -1 && errno == EINTR)
+      continue;
+    if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // Hold back partial segments until EPOLLOUT lets us send the
+      // rest, rather than dribbling them out as the buffer drains.
+      if (!conn->corked) {
+        conn->corked = SetTcpCork(conn->http.fd(), true);
+      }
+      // The client has until the write deadline to take some more,
+      // counting from the last time it did.
+      if (!conn->write_blocked || progress) {
+        conn->http.ArmWriteDeadline();
+        conn->write_blocked = true;
+      }
+      return true;
+    }
+    if (res < 0)
+      return false;
+
+    // Drop whatever went out.
+    size_t sent = res;
+    while (!conn->out.empty() &&
+           sent >= conn->out.front().size() - conn->out_offset) {
+      sent -= conn->out.front().size() - conn->out_offset;
+      conn->out.pop_front();
+      conn->out_offset = 0;
+    }
+    conn->out_offset += sent;
+    progress = true;
+  }
+
+  // With everything out, it's back to waiting on the client, if the
+  // connection is waiting on anyone.
+  if (conn->write_blocked) {
+    conn->write_blocked = false;
+    if (conn->busy || conn->closing) {
+      conn->http.DisarmDeadline();
+    } else {
+      conn->http.ArmDeadline();
+    }
+  }
+
+  // All caught up, so let the tail of the last response go.
+  if (conn->corked) {
+    SetTcpCork(conn->http.fd(), false);
+    conn->corked = false;
+  }
+  return true;
+}
+
+void EventLoop::MaybeClose(Connection* conn) {
+  if (conn->busy || !conn->closing || !conn->out.empty())
+    return;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn->http.fd(), nullptr);
+  connections_.erase(conn->self);
+  num_connections_--;
+  delete conn;  // ~HttpConnection closes the socket
+}
+
+}  // namespace hw4
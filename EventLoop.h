@@ -0,0 +1,139 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_EVENTLOOP_H_
+#define HW4_EVENTLOOP_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <stdint.h>   // for uint32_t, etc.
+#include <atomic>     // for std::atomic
+#include <list>       // for std::list
+#include <string>     // for std::string
+
+#include "./ConnectionReaper.h"
+#include "./HttpConnection.h"
+#include "./HttpRequest.h"
+#include "./HttpResponse.h"
+#include "./ThreadPool.h"
+
+namespace hw4 {
+
+// An EventLoop is a single thread that multiplexes many client
+// connections over one epoll instance.  Sockets handed to the loop are
+// switched to non-blocking mode; the loop reads from them only when
+// epoll reports them readable and writes to them only when they can
+// take more bytes, so an idle keep-alive client costs a few hundred
+// bytes of bookkeeping instead of a parked worker thread.
+//
+// Only complete requests leave the loop: each one is wrapped in a
+// ThreadPool::Task and dispatched to the pool, where the handler
+// function turns it into an HttpResponse.  The worker hands the
+// serialized response back to the loop, which writes it out and then
+// moves on to the connection's next buffered request.  A connection
+// never has more than one request in flight, so responses go out in
+// the order the requests arrived.
+class EventLoop {
+ public:
+  // The function a worker thread invokes to turn a request into a
+  // response.  "arg" is the handler_arg given to the constructor.
+  typedef HttpResponse (*handler_fn)(const HttpRequest& request, void* arg);
+
+  // The function the loop invokes to pick the ThreadPool lane a request
+  // waits in (see ThreadPoolOptions::lane_weights).  "arg" is the
+  // handler_arg given to the constructor.
+  typedef uint32_t (*lane_fn)(const HttpRequest& request, void* arg);
+
+  // Creates a new EventLoop that dispatches requests to "pool" and
+  // processes them with "handler".  If "reaper" isn't null, it enforces
+  // idle and header deadlines on the loop's connections.  If "lane"
+  // isn't null, it says which lane each request goes in; otherwise they
+  // all go in lane 0.  "limits" caps how much each connection buffers.
+  // The constructor does not create the epoll instance or the loop
+  // thread; Start() does.
+  EventLoop(ThreadPool* pool, handler_fn handler, void* handler_arg,
+            ConnectionReaper* reaper = nullptr, lane_fn lane = nullptr,
+            const HttpConnectionLimits& limits = HttpConnectionLimits());
+
+  // Stops the loop (if it is running) and closes every connection it
+  // still owns.  The ThreadPool must not run any more of this loop's
+  // tasks after the destructor begins.
+  virtual ~EventLoop();
+
+  // Creates the epoll instance and spawns the loop thread.  Returns
+  // false if any of the underlying system calls fail.
+  bool Start();
+
+  // Asks the loop thread to exit and waits for it to do so.  Requests
+  // already dispatched to the ThreadPool may still complete afterwards;
+  // their responses are simply dropped.
+  void Stop();
+
+  // Hands an accepted client socket to the loop, which takes ownership
+  // of it.  Safe to call from any thread.
+  void AddConnection(int client_fd);
+
+  // The number of client connections the loop currently owns.
+  uint32_t num_connections() const { return num_connections_; }
+
+ private:
+  // Per-client state.  Defined in EventLoop.cc.
+  struct Connection;
+
+  // The ThreadPool::Task that carries one request to a worker and its
+  // response back.  Defined in EventLoop.cc.
+  class RequestTask;
+
+  // The loop thread's start routine and main loop.
+  static void* LoopThread(void* loop);
+  void Loop();
+
+  // Called by worker threads when a request has been processed.
+  void PostCompletion(RequestTask* task);
+
+  // Helpers run on the loop thread.
+  void AdoptPendingConnections();
+  void HandleCompletions();
+  void HandleEvent(Connection* conn, uint32_t events);
+  void DispatchNext(Connection* conn);
+  bool Flush(Connection* conn);
+  void MaybeClose(Connection* conn);
+  void Wakeup();
+
+  ThreadPool* pool_;
+  handler_fn handler_;
+  void* handler_arg_;
+  ConnectionReaper* reaper_;
+  lane_fn lane_;
+  HttpConnectionLimits limits_;
+
+  int epoll_fd_;
+  int wake_fd_;    // an eventfd other threads poke to wake up the loop
+  pthread_t thread_;
+  bool running_;
+  std::atomic<bool> stop_;
+
+  // Guards the two hand-off queues below, which other threads fill and
+  // the loop thread drains after every wakeup.
+  pthread_mutex_t lock_;
+  std::list<int> pending_fds_;
+  std::list<RequestTask*> completions_;
+
+  // Every connection the loop owns, so the destructor can close them.
+  std::list<Connection*> connections_;
+  std::atomic<uint32_t> num_connections_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_EVENTLOOP_H_
@@ -15,12 +15,9 @@
 #include <iostream>
 #include <sstream>
 
-extern "C" {
-  #include "libhw2/FileParser.h"
-}
-
 #include "./HttpUtils.h"
 #include "./FileReader.h"
+#include "./IoEngine.h"
 
 using std::string;
 
@@ -45,17 +42,12 @@ bool FileReader::ReadFile(string* const contents) {
   // HttpUtils.h above the MallocDeleter class for details.
 
   // STEP 1:
-  int size = 0;
   if (!IsPathSafe(basedir_, full_file)) {
     return false;
   }
-  char* res = ReadFileToString(full_file.c_str(), &size);
-  if (res == NULL) {
-    return false;
-  }
-  *contents = std::string(res, size);
-  free(res);
-  return true;
+  // The I/O engine uses ::ReadFileToString(), or reads the file through
+  // io_uring if the server was started that way.
+  return IoEngine::Get()->ReadFile(full_file, contents);
 }
 
 }  // namespace hw4
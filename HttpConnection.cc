@@ -9,34 +9,24 @@
  * author.
  */
 
+#include <errno.h>
 #include <stdint.h>
-#include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
-#include <map>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
 #include <string>
 #include <vector>
-#include <iostream>
 
 #include "./HttpRequest.h"
 #include "./HttpUtils.h"
 #include "./HttpConnection.h"
+#include "./IoEngine.h"
 
-using std::map;
 using std::string;
-using std::vector;
-using boost::algorithm::split;
-using boost::algorithm::token_compress_on;
-using boost::trim;
-using boost::is_any_of;
-using boost::to_lower;
-
-#define BUFFER_LEN 256
 
 namespace hw4 {
 
-static const char* kHeaderEnd = "\r\n\r\n";
-static const int kHeaderEndLen = 4;
-
 bool HttpConnection::GetNextRequest(HttpRequest* const request) {
   // Use WrappedRead from HttpUtils.cc to read bytes from the files into
   // private buffer_ variable. Keep reading until:
@@ -46,8 +36,8 @@ bool HttpConnection::GetNextRequest(HttpRequest* const request) {
   // Hint: Try and read in a large amount of bytes each time you call
   // WrappedRead.
   //
-  // After reading complete request header, use ParseRequest() to parse into
-  // an HttpRequest and save to the output parameter request.
+  // After reading complete request header, use the HttpRequestParser to
+  // parse into an HttpRequest and save to the output parameter request.
   //
   // Important note: Clients may send back-to-back requests on the same socket.
   // This means WrappedRead may also end up reading more than one request.
@@ -55,89 +45,378 @@ bool HttpConnection::GetNextRequest(HttpRequest* const request) {
   // next time the caller invokes GetNextRequest()!
 
   // STEP 1:
-  size_t pos = buffer_.find(kHeaderEnd);
-  if (pos == string::npos) {
-    int bytes_read = -1;
-    char buf[BUFFER_LEN];
-    while (bytes_read != 0 && buffer_.find(kHeaderEnd) == string::npos) {
-      bytes_read = WrappedRead(
-        fd_, reinterpret_cast<unsigned char*>(buf), BUFFER_LEN);
-      if (bytes_read == -1) {
-        return false;
-      }
-      buffer_ += string(buf, bytes_read);
+  // The parser remembers how far it got, so each read is only scanned
+  // for the end of the header block once, and a body is read straight
+  // in behind it.
+  while (!NextBufferedRequest(request)) {
+    if (RejectedStatus() != 0) {
+      DisarmDeadline();
+      return false;
+    }
+    if (out_.empty()) {
+      SendContinue();
+    }
+    ArmDeadline();
+    int bytes_read = buffer_.Read(IoEngine::Get(), fd_,
+                                  limits_.max_buffered_bytes - buffer_.size());
+    if (bytes_read <= 0) {
+      DisarmDeadline();
+      return false;
     }
   }
 
-  // unable to find kHeaderEnd
-  pos = buffer_.find(kHeaderEnd);
-  if (pos == string::npos) {
-    return false;
+  // The client has had its say; whatever happens next is up to us.
+  DisarmDeadline();
+  return true;
+}
+
+void HttpConnection::Reset(int fd) {
+  if (reaper_ != nullptr) {
+    reaper_->Release(&deadline_);
+    reaper_ = nullptr;
   }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = fd;
+  buffer_.Clear();
+  parser_.Reset();
+  SetLimits(HttpConnectionLimits());
+  more_to_read_ = false;
+  sent_continue_ = false;
+  out_.clear();
+  queued_bytes_ = 0;
+}
 
-  *request = ParseRequest(buffer_.substr(0, pos));
+void HttpConnection::SetLimits(const HttpConnectionLimits& limits) {
+  limits_ = limits;
+  uint64_t min_buffered = static_cast<uint64_t>(limits_.max_header_bytes) +
+                          limits_.max_body_bytes;
+  if (limits_.max_buffered_bytes < min_buffered) {
+    limits_.max_buffered_bytes = std::min<uint64_t>(min_buffered,
+                                                    UINT32_MAX);
+  }
+  parser_.set_max_body_bytes(limits_.max_body_bytes);
+}
+
+void HttpConnection::ArmDeadline() {
+  if (reaper_ != nullptr) {
+    reaper_->Arm(&deadline_, fd_,
+                 HasBufferedData() ? ConnectionReaper::kHeaderDeadline
+                                   : ConnectionReaper::kIdleDeadline);
+  }
+}
 
-  buffer_.erase(0, pos + kHeaderEndLen);
+void HttpConnection::ArmWriteDeadline() {
+  if (reaper_ != nullptr) {
+    reaper_->Rearm(&deadline_, fd_, ConnectionReaper::kWriteDeadline);
+  }
+}
 
-  return true;  // You may want to change this.
+void HttpConnection::DisarmDeadline() {
+  if (reaper_ != nullptr) {
+    reaper_->Disarm(&deadline_);
+  }
 }
 
-bool HttpConnection::WriteResponse(const HttpResponse& response) const {
-  string str = response.GenerateResponseString();
-  int res = WrappedWrite(fd_,
-                         reinterpret_cast<const unsigned char*>(str.c_str()),
-                         str.length());
-  if (res != static_cast<int>(str.length()))
+bool HttpConnection::ReadAvailable() {
+  more_to_read_ = false;
+  while (1) {
+    if (buffer_.size() >= limits_.max_buffered_bytes) {
+      // Leave the rest in the socket until some of this is handled.
+      more_to_read_ = true;
+      break;
+    }
+    int bytes_read = buffer_.Read(nullptr, fd_,
+                                  limits_.max_buffered_bytes - buffer_.size());
+    if (bytes_read > 0) {
+      continue;
+    }
+    if (bytes_read == 0) {
+      return false;  // the client closed the connection
+    }
+    // EAGAIN means we've drained everything the kernel had for us.
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+      return false;
+    }
+    break;
+  }
+  return true;
+}
+
+uint16_t HttpConnection::RejectedStatus() {
+  bool complete = parser_.Parse(buffer_.data(), buffer_.size());
+  if (parser_.header_bytes() > limits_.max_header_bytes) {
+    return 431;
+  }
+  if (parser_.error() != 0) {
+    return parser_.error();
+  }
+  if (complete) {
+    return 0;
+  }
+
+  // If the parser can't find the end of the first request, everything
+  // buffered is part of it.  A body within the limit can still fill
+  // the buffer, if it's chunked into enough pieces.
+  if (!parser_.in_body()) {
+    return (buffer_.size() >= limits_.max_header_bytes) ? 431 : 0;
+  }
+  return (buffer_.size() >= limits_.max_buffered_bytes) ? 413 : 0;
+}
+
+// static
+HttpResponse HttpConnection::RejectionResponse(uint16_t status) {
+  const char* message;
+  switch (status) {
+    case 400: message = "Bad Request"; break;
+    case 413: message = "Content Too Large"; break;
+    case 431: message = "Request Header Fields Too Large"; break;
+    case 501: message = "Not Implemented"; break;
+    default: message = "Error"; break;
+  }
+  HttpResponse ret;
+  ret.set_protocol("HTTP/1.1");
+  ret.set_response_code(status);
+  ret.set_message(message);
+  ret.AddHeader("Connection", "close");
+  ret.AppendToBody(string("<html><body>") + message + "</body></html>\n");
+  return ret;
+}
+
+bool HttpConnection::QueueRejection() {
+  uint16_t status = RejectedStatus();
+  if (status == 0) {
     return false;
+  }
+  HttpResponse response = RejectionResponse(status);
+  QueueResponse(&response);
   return true;
 }
 
-HttpRequest HttpConnection::ParseRequest(const string& request) const {
-  HttpRequest req("/");  // by default, get "/".
+void HttpConnection::SendContinue() {
+  if (sent_continue_ || !parser_.expects_continue()) {
+    return;
+  }
+  sent_continue_ = true;
 
-  // Plan for STEP 2:
-  // 1. Split the request into different lines (split on "\r\n").
-  // 2. Extract the URI from the first line and store it in req.URI.
-  // 3. For the rest of the lines in the request, track the header name and
-  //    value and store them in req.headers_ (e.g. HttpRequest::AddHeader).
-  //
-  // Hint: Take a look at HttpRequest.h for details about the HTTP header
-  // format that you need to parse.
-  //
-  // You'll probably want to look up boost functions for:
-  // - Splitting a string into lines on a "\r\n" delimiter
-  // - Trimming whitespace from the end of a string
-  // - Converting a string to lowercase.
-  //
-  // Note: If a header is malformed, skip that line.
+  // It's short, and the client is waiting for it rather than sending,
+  // so there's room for it; if somehow there isn't, the client will
+  // give up waiting and send the body anyway.
+  static const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+  send(fd_, kContinue, sizeof(kContinue) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
 
-  // STEP 2:
-  vector<string> results;
-  vector<string> first;
-  vector<string> body;
+bool HttpConnection::NextBufferedRequest(HttpRequest* const request) {
+  if (!parser_.Parse(buffer_.data(), buffer_.size()) ||
+      parser_.header_bytes() > limits_.max_header_bytes) {
+    return false;
+  }
 
-  split(results, request, is_any_of("\r\n"), token_compress_on);
+  // The request's pieces point into buffer_, which the next read will
+  // overwrite, so this is where they're finally copied.
+  parser_.CopyTo(request);
+  buffer_.Consume(parser_.consumed());
+  parser_.Reset();
+  sent_continue_ = false;
+  return true;
+}
 
-  for (size_t i = 0; i < results.size(); i++) {
-    trim(results[i]);
+// The most buffers FlushResponses() gathers into a single write.
+static const int kMaxIov = 64;
+
+// Points "iov" at the header and body of each response in "out", from
+// "*next" on, up to kMaxIov buffers' worth.  Returns how many buffers
+// it filled in, and advances "*next" past them.
+static int GatherResponses(const std::vector<string>& out, size_t* next,
+                           struct iovec* iov) {
+  int iovcnt = 0;
+  for (; *next < out.size() && iovcnt < kMaxIov; (*next)++) {
+    iov[iovcnt].iov_base = const_cast<char*>(out[*next].data());
+    iov[iovcnt].iov_len = out[*next].size();
+    iovcnt++;
   }
+  return iovcnt;
+}
+
+// How much WriteIovecs() sends per write.  A blocking write carries on
+// until it's done, however long the client takes, so the write deadline
+// can only start over between writes: this much is what the client has
+// to take before the deadline passes.
+static const size_t kWriteSlice = 256 * 1024;
 
-  split(first, results[0], is_any_of(" "), token_compress_on);
-  if (first.size() == 3) {
-    req.set_uri(first[1]);
-    results.erase(results.begin());
+// Writes all "iovcnt" (at most kMaxIov) buffers of "iov" to "conn"
+// through the IoEngine.  Returns false if the connection failed.
+static bool WriteIovecs(HttpConnection* conn, struct iovec* iov,
+                        int iovcnt) {
+  // Usually one writev() sends everything.  If it doesn't, cork the
+  // socket for the rest, so that with TCP_NODELAY on we don't push out
+  // a short segment at the end of every partial write; uncorking at the
+  // end flushes the tail right away.
+  //
+  // Each write may block for as long as the client takes to make room,
+  // so the write deadline is armed around it, and it writes no more
+  // than kWriteSlice bytes.
+  int fd = conn->fd();
+  bool corked = false;
+  bool ok = true;
+  while (iovcnt > 0) {
+    struct iovec slice[kMaxIov];
+    int slicecnt = 0;
+    size_t slice_len = 0;
+    for (; slicecnt < iovcnt && slice_len < kWriteSlice; slicecnt++) {
+      slice[slicecnt] = iov[slicecnt];
+      if (slice[slicecnt].iov_len > kWriteSlice - slice_len) {
+        slice[slicecnt].iov_len = kWriteSlice - slice_len;
+      }
+      slice_len += slice[slicecnt].iov_len;
+    }
+    conn->ArmWriteDeadline();
+    int res = IoEngine::Get()->Writev(fd, slice, slicecnt);
+    if (res <= 0) {
+      ok = false;
+      break;
+    }
+    AdvanceIovec(&iov, &iovcnt, res);
+    if (iovcnt > 0 && !corked) {
+      corked = SetTcpCork(fd, true);
+    }
   }
+  conn->DisarmDeadline();
+  if (corked) {
+    SetTcpCork(fd, false);
+  }
+  return ok;
+}
 
-  for (size_t i = 0; i < results.size(); i++) {
-    split(body, results[i], is_any_of(": "), token_compress_on);
-    if (body.size() == 2) {
-      string header_name = body[0];
-      to_lower(header_name);
-      req.AddHeader(header_name, body[1]);
+// Just like WriteIovecs(), except that a full socket buffer means
+// waiting on "reactor" until it drains, rather than blocking in
+// writev().  Only those waits need the write deadline.
+static CoTask<bool> AsyncWriteIovecs(Reactor* reactor, HttpConnection* conn,
+                                     struct iovec* iov, int iovcnt) {
+  int fd = conn->fd();
+  bool corked = false;
+  bool ok = true;
+  bool armed = false, progress = true;
+  while (iovcnt > 0) {
+    ssize_t res = writev(fd, iov, iovcnt);
+    if (res == -1 && errno == EINTR) {
+      continue;
+    }
+    if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!corked) {
+        corked = SetTcpCork(fd, true);
+      }
+      if (progress) {
+        conn->ArmWriteDeadline();
+        armed = true;
+        progress = false;
+      }
+      if (!co_await reactor->Writable(fd)) {
+        ok = false;
+        break;
+      }
+      continue;
+    }
+    if (res <= 0) {
+      ok = false;
+      break;
     }
+    AdvanceIovec(&iov, &iovcnt, res);
+    progress = true;
   }
+  if (armed) {
+    conn->DisarmDeadline();
+  }
+  if (corked) {
+    SetTcpCork(fd, false);
+  }
+  co_return ok;
+}
+
+bool HttpConnection::WriteResponse(const HttpResponse& response) {
+  // Gather the headers and the body straight out of the response, so
+  // the body (which may be a large file or query result page) is never
+  // copied on its way to the socket.
+  string header = response.GenerateHeaderString();
+  const string& body = response.body();
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<char*>(header.data());
+  iov[0].iov_len = header.size();
+  iov[1].iov_base = const_cast<char*>(body.data());
+  iov[1].iov_len = body.size();
+  return WriteIovecs(this, iov, 2);
+}
+
+void HttpConnection::QueueResponse(HttpResponse* response) {
+  out_.push_back(response->GenerateHeaderString());
+  out_.emplace_back();
+  out_.back().swap(*response->mutable_body());
+  queued_bytes_ += out_[out_.size() - 2].size() + out_.back().size();
+}
+
+bool HttpConnection::FlushResponses() {
+  bool ok = true;
+  size_t next = 0;
+  while (ok && next < out_.size()) {
+    struct iovec iov[kMaxIov];
+    int iovcnt = GatherResponses(out_, &next, iov);
+    ok = WriteIovecs(this, iov, iovcnt);
+  }
+  out_.clear();
+  queued_bytes_ = 0;
+  return ok;
+}
 
-  return req;
+CoTask<bool> HttpConnection::AsyncGetNextRequest(
+  Reactor* reactor, HttpRequest* const request) {
+  // Read whatever has arrived, and if that doesn't complete a request,
+  // wait for more.  A request that was already buffered, or that came
+  // in just before the client hung up, is still returned.
+  while (1) {
+    bool open = ReadAvailable();
+    if (NextBufferedRequest(request)) {
+      DisarmDeadline();
+      co_return true;
+    }
+    if (!open || RejectedStatus() != 0) {
+      DisarmDeadline();
+      co_return false;
+    }
+    if (out_.empty()) {
+      SendContinue();
+    }
+    ArmDeadline();
+    if (!co_await reactor->Readable(fd_)) {
+      DisarmDeadline();
+      co_return false;
+    }
+  }
+}
+
+CoTask<bool> HttpConnection::AsyncWriteResponse(
+  Reactor* reactor, const HttpResponse& response) {
+  string header = response.GenerateHeaderString();
+  const string& body = response.body();
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<char*>(header.data());
+  iov[0].iov_len = header.size();
+  iov[1].iov_base = const_cast<char*>(body.data());
+  iov[1].iov_len = body.size();
+  co_return co_await AsyncWriteIovecs(reactor, this, iov, 2);
+}
+
+CoTask<bool> HttpConnection::AsyncFlushResponses(Reactor* reactor) {
+  bool ok = true;
+  size_t next = 0;
+  while (ok && next < out_.size()) {
+    struct iovec iov[kMaxIov];
+    int iovcnt = GatherResponses(out_, &next, iov);
+    ok = co_await AsyncWriteIovecs(reactor, this, iov, iovcnt);
+  }
+  out_.clear();
+  queued_bytes_ = 0;
+  co_return ok;
 }
 
 }  // namespace hw4
@@ -16,20 +16,51 @@
 #include <unistd.h>
 #include <map>
 #include <string>
+#include <vector>
 
+#include "./ConnectionReaper.h"
+#include "./Coroutine.h"
 #include "./HttpRequest.h"
+#include "./HttpRequestParser.h"
 #include "./HttpResponse.h"
+#include "./ReadBuffer.h"
+#include "./Reactor.h"
 
 namespace hw4 {
 
+// How much of a client's input a connection will hold at once.
+struct HttpConnectionLimits {
+  // The longest request header block, in bytes, including the empty
+  // line that ends it; a client that sends a longer one is hung up on.
+  uint32_t max_header_bytes = 64 * 1024;
+
+  // The longest request body, in bytes, once decoded; a client that
+  // says it will send a longer one is answered with a 413 right away.
+  uint32_t max_body_bytes = 256 * 1024;
+
+  // The most bytes read from the client but not yet handled, e.g.,
+  // requests pipelined behind the one being processed.  Once this many
+  // are buffered, the rest waits in the socket.  Never less than
+  // max_header_bytes plus max_body_bytes.
+  uint32_t max_buffered_bytes = 1024 * 1024;
+};
+
 // The HttpConnection class represents a connection to a single client
 class HttpConnection {
  public:
-  explicit HttpConnection(int fd) : fd_(fd) { }
-  virtual ~HttpConnection() {
-    close(fd_);
-    fd_ = -1;
-  }
+  // Makes a connection to the client on "fd", or a closed connection
+  // if "fd" is -1.
+  explicit HttpConnection(int fd = -1)
+    : fd_(fd), more_to_read_(false), sent_continue_(false),
+      queued_bytes_(0), reaper_(nullptr) { }
+  virtual ~HttpConnection() { Reset(-1); }
+
+  // Closes the connection's fd, if it's open, and makes the connection
+  // one to the client on "fd" instead (or closed, for -1), with no
+  // reaper, the default limits, and nothing buffered.  The buffer keeps
+  // its memory (see ReadBuffer.h), so that a connection recycled this
+  // way (see SlabPool.h) needn't allocate it all over again.
+  void Reset(int fd);
 
   // Read and parse the next request from the file descriptor fd_,
   // storing the state in the output parameter "request".
@@ -37,7 +68,8 @@ class HttpConnection {
   // Returns true if a request could be parsed and read, and false otherwise
   //
   // The caller is responsible to close the connection if the function
-  // returns false
+  // returns false, having first answered the request with
+  // QueueRejection() if it was turned down rather than cut short.
   bool GetNextRequest(HttpRequest* const request);
 
   // Write the response to the file descriptor fd_.
@@ -47,18 +79,139 @@ class HttpConnection {
   //
   // The caller is responsible to close the connection if the function
   // returns false
-  bool WriteResponse(const HttpResponse& response) const;
+  //
+  // With a reaper, a client that stops reading the response meanwhile
+  // is hung up on once the write deadline passes.
+  bool WriteResponse(const HttpResponse& response);
 
- private:
-  // A helper function to parse the contents of data read from
-  // the HTTP connection.
-  HttpRequest ParseRequest(const std::string& request) const;
+  // Pipelined requests' responses, which go out together.
+  // QueueResponse() adds "response" to the responses waiting to be
+  // written, taking its body rather than copying it, and
+  // FlushResponses() writes every waiting response, in order, with as
+  // few writes as it can.  FlushResponses() returns false, like
+  // WriteResponse(), if the connection should be closed; the responses
+  // are gone either way.
+  void QueueResponse(HttpResponse* response);
+  bool FlushResponses();
+  size_t num_queued_responses() const { return out_.size() / 2; }
+  size_t queued_bytes() const { return queued_bytes_; }
+
+  // The non-blocking counterparts of GetNextRequest(), used by the
+  // event-loop server (see EventLoop.h), which owns an O_NONBLOCK fd_
+  // and only calls in here when epoll says the socket is readable.
+  //
+  // ReadAvailable() drains whatever bytes are ready on fd_ into buffer_
+  // without ever waiting, or as many as the limits allow.  Returns
+  // false if the client closed the connection or the read failed, true
+  // otherwise.  A request that breaks the limits is left for
+  // RejectedStatus() to find.
+  bool ReadAvailable();
+
+  // True if the last ReadAvailable() stopped at max_buffered_bytes, and
+  // so may have left bytes in the socket that an edge-triggered epoll
+  // won't announce again.  Call ReadAvailable() again once a request has
+  // been taken out of the buffer.
+  bool more_to_read() const { return more_to_read_; }
+
+  // If the first request in buffer_ is one NextBufferedRequest() won't
+  // hand out, returns the status code to answer it with: 431 if its
+  // header block is (or has grown) longer than max_header_bytes, 413
+  // if its body is longer than max_body_bytes or has filled buffer_
+  // without ending, or the parser's error otherwise (see
+  // HttpRequestParser::error()).  Returns 0 if the request is fine, or
+  // fine so far.  Once a request is turned down, the connection should
+  // be closed, as there's no telling where the next one starts.
+  uint16_t RejectedStatus();
+
+  // The response to a request turned down with "status", which tells
+  // the client the connection is closing.
+  static HttpResponse RejectionResponse(uint16_t status);
+
+  // Queues the RejectionResponse() for the first request in buffer_, if
+  // it's been turned down.  Returns true if it has.
+  bool QueueRejection();
 
+  // If the client is holding back the body of the request being read
+  // until it hears "100 Continue", sends it that, once per request.
+  // GetNextRequest() and AsyncGetNextRequest() do this on their own
+  // before waiting for the body; callers that read with
+  // ReadAvailable() do it themselves, when no response is on its way
+  // out that it might get in the middle of.
+  void SendContinue();
+
+  // Parses the next request out of buffer_ if a complete header block
+  // has already been read, storing it in the output parameter
+  // "request".  Never reads from fd_.  Returns false if buffer_ does
+  // not (yet) hold a whole request.
+  bool NextBufferedRequest(HttpRequest* const request);
+
+  // The coroutine counterparts of GetNextRequest(), WriteResponse(),
+  // and FlushResponses(), for a connection whose fd_ has been added to
+  // "reactor" (see Reactor.h).  Where those would block the thread
+  // waiting on the client, these co_await it on "reactor", giving the
+  // thread back in the meantime.  Otherwise they behave the same,
+  // buffer_ and deadlines included, and return the same thing.
+  CoTask<bool> AsyncGetNextRequest(Reactor* reactor,
+                                   HttpRequest* const request);
+  CoTask<bool> AsyncWriteResponse(Reactor* reactor,
+                                  const HttpResponse& response);
+  CoTask<bool> AsyncFlushResponses(Reactor* reactor);
+
+  int fd() const { return fd_; }
+
+  // Returns true if bytes of a further request have already been read
+  // from fd_, i.e., if the next GetNextRequest() may not need to wait
+  // for the client at all.
+  bool HasBufferedData() const { return !buffer_.empty(); }
+
+  // Has "reaper" enforce deadlines on this connection (see
+  // ConnectionReaper.h).  GetNextRequest() and the writes arm and
+  // disarm them on their own; callers that read with ReadAvailable(),
+  // or that set the connection aside between requests, use
+  // ArmDeadline() and DisarmDeadline() to say when the connection is
+  // waiting on the client and when it is waiting on the server, and
+  // callers that write on their own use ArmWriteDeadline().
+  void SetReaper(ConnectionReaper* reaper) { reaper_ = reaper; }
+
+  // Sets how much of the client's input the connection will hold (see
+  // HttpConnectionLimits).  GetNextRequest() fails on a request that
+  // breaks the limits (see RejectedStatus()).
+  void SetLimits(const HttpConnectionLimits& limits);
+
+  // Arms the deadline for what the connection is waiting for: the idle
+  // deadline if none of the next request has arrived, or the header
+  // deadline if part of it has.  No-op without a reaper.
+  void ArmDeadline();
+
+  // Arms the write deadline, for when a response is waiting for the
+  // client to make room for it, starting it over if it's already armed;
+  // call it again whenever some of the response goes out.  No-op
+  // without a reaper.
+  void ArmWriteDeadline();
+
+  // Disarms the deadline, e.g., while a request is being processed.
+  void DisarmDeadline();
+
+ private:
   // The file descriptor associated with the client.
   int fd_;
 
-  // A buffer storing data read from the client.
-  std::string buffer_;
+  // A buffer storing data read from the client, whose first request
+  // parser_ is partway through, and how big it may get.
+  ReadBuffer buffer_;
+  HttpRequestParser parser_;
+  HttpConnectionLimits limits_;
+  bool more_to_read_;
+  bool sent_continue_;
+
+  // The queued responses' headers and bodies, one after the other, and
+  // how many bytes they add up to.
+  std::vector<std::string> out_;
+  size_t queued_bytes_;
+
+  // Who enforces this connection's deadlines, if anyone.
+  ConnectionReaper* reaper_;
+  ConnectionReaper::Deadline deadline_;
 };
 
 }  // namespace hw4
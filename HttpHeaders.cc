@@ -0,0 +1,168 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string.h>  // for memcpy(), memset()
+#include <algorithm>  // for std::min()
+#include <utility>    // for std::move()
+
+#include "./HttpHeaders.h"
+
+using std::min;
+using std::string_view;
+
+namespace hw4 {
+
+// static
+const size_t HttpHeaders::kInlineHeaders;
+// static
+const size_t HttpHeaders::kInlineBytes;
+
+// static
+HttpHeaderId HttpHeaders::Intern(string_view name) {
+  // No two known headers are the same length, so the length says which
+  // one "name" might be, and one comparison settles it.
+  switch (name.size()) {
+    case 4:
+      return (name == "host") ? kHeaderHost : kHeaderOther;
+    case 5:
+      return (name == "range") ? kHeaderRange : kHeaderOther;
+    case 10:
+      return (name == "connection") ? kHeaderConnection : kHeaderOther;
+    case 13:
+      return (name == "if-none-match") ? kHeaderIfNoneMatch : kHeaderOther;
+    case 14:
+      return (name == "content-length") ? kHeaderContentLength
+                                        : kHeaderOther;
+    case 15:
+      return (name == "accept-encoding") ? kHeaderAcceptEncoding
+                                         : kHeaderOther;
+    default:
+      return kHeaderOther;
+  }
+}
+
+HttpHeaders& HttpHeaders::operator=(const HttpHeaders& other) {
+  if (this != &other) {
+    num_entries_ = other.num_entries_;
+    memcpy(inline_entries_, other.inline_entries_,
+           min(num_entries_, kInlineHeaders) * sizeof(Entry));
+    heap_entries_ = other.heap_entries_;
+    num_bytes_ = other.num_bytes_;
+    on_heap_ = other.on_heap_;
+    if (on_heap_) {
+      heap_bytes_ = other.heap_bytes_;
+    } else {
+      memcpy(inline_bytes_, other.inline_bytes_, num_bytes_);
+      heap_bytes_.clear();
+    }
+    memcpy(known_, other.known_, sizeof(known_));
+  }
+  return *this;
+}
+
+HttpHeaders& HttpHeaders::operator=(HttpHeaders&& other) noexcept {
+  if (this != &other) {
+    num_entries_ = other.num_entries_;
+    memcpy(inline_entries_, other.inline_entries_,
+           min(num_entries_, kInlineHeaders) * sizeof(Entry));
+    heap_entries_ = std::move(other.heap_entries_);
+    num_bytes_ = other.num_bytes_;
+    on_heap_ = other.on_heap_;
+    if (on_heap_) {
+      heap_bytes_ = std::move(other.heap_bytes_);
+    } else {
+      memcpy(inline_bytes_, other.inline_bytes_, num_bytes_);
+      heap_bytes_.clear();
+    }
+    memcpy(known_, other.known_, sizeof(known_));
+    other.Clear();
+  }
+  return *this;
+}
+
+void HttpHeaders::Clear() {
+  num_entries_ = 0;
+  heap_entries_.clear();
+  num_bytes_ = 0;
+  on_heap_ = false;
+  heap_bytes_.clear();
+  memset(known_, 0, sizeof(known_));
+}
+
+int HttpHeaders::Find(HttpHeaderId id, string_view name) const {
+  if (id != kHeaderOther) {
+    return static_cast<int>(known_[id]) - 1;
+  }
+  for (size_t i = 0; i < num_entries_; i++) {
+    if (this->name(*entry(i)) == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+uint32_t HttpHeaders::Append(string_view data) {
+  uint32_t offset = num_bytes_;
+  if (!on_heap_ && num_bytes_ + data.size() > kInlineBytes) {
+    // Move out to the heap, where there's room to grow.
+    heap_bytes_.reserve(2 * (num_bytes_ + data.size()));
+    heap_bytes_.assign(inline_bytes_, num_bytes_);
+    on_heap_ = true;
+  }
+  if (on_heap_) {
+    heap_bytes_.append(data);
+  } else {
+    memcpy(inline_bytes_ + num_bytes_, data.data(), data.size());
+  }
+  num_bytes_ += data.size();
+  return offset;
+}
+
+void HttpHeaders::Add(string_view name, string_view value) {
+  HttpHeaderId id = Intern(name);
+  int i = Find(id, name);
+  if (i >= 0) {
+    // Over-write the value; the old one's bytes are simply left behind.
+    Entry* e = entry(i);
+    e->value_begin = Append(value);
+    e->value_length = value.size();
+    return;
+  }
+
+  Entry e;
+  e.name_begin = Append(name);
+  e.name_length = name.size();
+  e.value_begin = Append(value);
+  e.value_length = value.size();
+  if (num_entries_ < kInlineHeaders) {
+    inline_entries_[num_entries_] = e;
+  } else {
+    heap_entries_.push_back(e);
+  }
+  num_entries_++;
+  if (id != kHeaderOther) {
+    known_[id] = num_entries_;
+  }
+}
+
+string_view HttpHeaders::Get(HttpHeaderId id) const {
+  if (id == kHeaderOther || known_[id] == 0) {
+    return string_view();
+  }
+  return value(*entry(known_[id] - 1));
+}
+
+string_view HttpHeaders::Get(string_view name) const {
+  int i = Find(Intern(name), name);
+  return (i < 0) ? string_view() : value(*entry(i));
+}
+
+}  // namespace hw4
@@ -0,0 +1,136 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_HTTPHEADERS_H_
+#define HW4_HTTPHEADERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace hw4 {
+
+// The headers the server looks up by name on the request path, which
+// HttpHeaders can find without comparing any names.
+enum HttpHeaderId {
+  kHeaderConnection,
+  kHeaderHost,
+  kHeaderAcceptEncoding,
+  kHeaderIfNoneMatch,
+  kHeaderRange,
+  kHeaderContentLength,
+  kNumKnownHeaders,
+  kHeaderOther = kNumKnownHeaders  // any other header
+};
+
+// An HttpHeaders holds a request's headers, as name -> value mappings
+// with lowercase names (see HttpRequest.h), without a map: names and
+// values are copied one after the other into a single byte array, and
+// each header is an entry of offsets into it.  Both the entries and the
+// bytes live inside the object, up to kInlineHeaders headers and
+// kInlineBytes bytes, which covers what browsers send; only requests
+// with more spill over onto the heap.  So a typical request's headers
+// cost no allocations at all, and are copied once, on their way in.
+//
+// The headers in HttpHeaderId are interned as they're added, so looking
+// one up is an array index; any other is found by comparing names, so
+// adding n headers takes O(n^2) comparisons, which is why requests are
+// limited to HttpRequestParser::kMaxHeaders of them.  Lookups return
+// views of the stored bytes, valid until the headers are next modified
+// (or destroyed).
+class HttpHeaders {
+ public:
+  HttpHeaders() { Clear(); }
+  virtual ~HttpHeaders() { }
+
+  // Copies take only the part of the inline storage in use.  Moves take
+  // the heap storage too, and leave "other" without any headers.
+  HttpHeaders(const HttpHeaders& other) { *this = other; }
+  HttpHeaders(HttpHeaders&& other) noexcept { *this = std::move(other); }
+  HttpHeaders& operator=(const HttpHeaders& other);
+  HttpHeaders& operator=(HttpHeaders&& other) noexcept;
+
+  // Returns the id of the header "name", which must be lowercase, or
+  // kHeaderOther if it isn't one of the known headers.
+  static HttpHeaderId Intern(std::string_view name);
+
+  // Adds a "name" -> "value" mapping, over-writing any existing mapping
+  // for "name", which must be lowercase.
+  void Add(std::string_view name, std::string_view value);
+
+  // The value of the header "id" or "name" (lowercase), or an empty
+  // view if there isn't one.
+  std::string_view Get(HttpHeaderId id) const;
+  std::string_view Get(std::string_view name) const;
+
+  // The number of headers.
+  size_t size() const { return num_entries_; }
+
+  // Drops every header, keeping any heap memory for the next ones.
+  void Clear();
+
+  // How much fits inside the object.
+  static const size_t kInlineHeaders = 24;
+  static const size_t kInlineBytes = 1024;
+
+ private:
+  // A header, as offsets into the byte array.
+  struct Entry {
+    uint32_t name_begin, name_length;
+    uint32_t value_begin, value_length;
+  };
+
+  // The bytes, inline or (once they've outgrown that) on the heap, and
+  // the entries likewise.
+  const char* bytes() const {
+    return on_heap_ ? heap_bytes_.data() : inline_bytes_;
+  }
+  Entry* entry(size_t i) {
+    return (i < kInlineHeaders) ? &inline_entries_[i]
+                                : &heap_entries_[i - kInlineHeaders];
+  }
+  const Entry* entry(size_t i) const {
+    return (i < kInlineHeaders) ? &inline_entries_[i]
+                                : &heap_entries_[i - kInlineHeaders];
+  }
+  std::string_view name(const Entry& e) const {
+    return std::string_view(bytes() + e.name_begin, e.name_length);
+  }
+  std::string_view value(const Entry& e) const {
+    return std::string_view(bytes() + e.value_begin, e.value_length);
+  }
+
+  // Returns the index of the header "name" with id "id", or -1.
+  int Find(HttpHeaderId id, std::string_view name) const;
+
+  // Copies "data" to the end of the bytes, and returns its offset.
+  uint32_t Append(std::string_view data);
+
+  size_t num_entries_;
+  Entry inline_entries_[kInlineHeaders];
+  std::vector<Entry> heap_entries_;
+
+  uint32_t num_bytes_;
+  bool on_heap_;
+  char inline_bytes_[kInlineBytes];
+  std::string heap_bytes_;
+
+  // Each known header's index plus one, or 0 if it's absent.
+  uint32_t known_[kNumKnownHeaders];
+};
+
+}  // namespace hw4
+
+#endif  // HW4_HTTPHEADERS_H_
@@ -14,13 +14,15 @@
 
 #include <stdint.h>
 
-#include <map>
 #include <string>
+#include <string_view>
+
+#include "./HttpHeaders.h"
 
 namespace hw4 {
 
 // This class represents an HTTP Request. For our website search engine, we
-// will only handle "GET"-style requests, meaning the request will have the
+// will handle "GET"-style requests, meaning the request will have the
 // following format:
 //
 // GET [URI] [http_protocol]\r\n
@@ -35,6 +37,9 @@ namespace hw4 {
 // GET /foo/bar?baz=bam HTTP/1.1\r\n
 // Host: www.news.com\r\n
 //
+// as well as "POST"-style requests, whose header block is followed by a
+// body, framed by a Content-Length or a "Transfer-Encoding: chunked"
+// header.  The body held here is the decoded one, without any framing.
 class HttpRequest {
  public:
   HttpRequest() { }
@@ -42,42 +47,62 @@ class HttpRequest {
   virtual ~HttpRequest() { }
 
   const std::string& uri() const { return uri_; }
-  void set_uri(const std::string& uri) { uri_ = uri; }
+  void set_uri(std::string_view uri) { uri_.assign(uri); }
+
+  // The request method, e.g., "GET" or "POST"; empty if the request line
+  // was malformed.
+  const std::string& method() const { return method_; }
+  void set_method(std::string_view method) { method_.assign(method); }
+
+  // The request body, empty if there wasn't one.
+  const std::string& body() const { return body_; }
+  std::string* mutable_body() { return &body_; }
 
   // Returns the value associated with the passed-in header name, or empty
   // string if it does not exist in the header map.  The passed-in name must
   // be entirely lowercase to comply with our implementation of RFC 2616:4.2.
-  std::string GetHeaderValue(const std::string& name) const {
-    std::map<std::string, std::string>::const_iterator it = headers_.find(name);
-    if (it == headers_.end()) {
-      return "";
-    } else {
-      return it->second;
-    }
+  //
+  // The value is a view of the request's own copy, valid until the
+  // request is next modified; nothing is copied to look a header up.
+  // The headers in HttpHeaderId are found fastest by their id.
+  std::string_view GetHeaderValue(std::string_view name) const {
+    return headers_.Get(name);
+  }
+  std::string_view GetHeaderValue(HttpHeaderId id) const {
+    return headers_.Get(id);
   }
 
   // Adds a name -> value mapping to the header map, over-writing any existing
   // previous mapping for name.
-  void AddHeader(const std::string& name, const std::string& value) {
-    headers_[name] = value;
+  void AddHeader(std::string_view name, std::string_view value) {
+    headers_.Add(name, value);
+  }
+
+  // Removes every header.
+  void ClearHeaders() {
+    headers_.Clear();
   }
 
   // Returns the number of headers this HttpRequest contains
-  int GetHeaderCount() {
+  int GetHeaderCount() const {
     return headers_.size();
   }
 
  private:
-  // Which URI did the client request?
+  // Which URI did the client request, and how?
   std::string uri_;
+  std::string method_;
 
-  // A map from mapping a header name to a header value, which represents the
-  // headers a client would supply to us. Due to RFC 2616:4.2 stating that
-  // header names are case-insensitive, convert all header names to be
-  // lowercase.
+  // The headers, mapping each header name to a header value, which
+  // represents the headers a client would supply to us. Due to RFC
+  // 2616:4.2 stating that header names are case-insensitive, convert all
+  // header names to be lowercase.
   //
   // But note that the header values can remain the same.
-  std::map<std::string, std::string> headers_;
+  HttpHeaders headers_;
+
+  // What the client sent after the headers, if anything.
+  std::string body_;
 };
 
 }  // namespace hw4
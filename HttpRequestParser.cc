@@ -0,0 +1,356 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>  // for UINT32_MAX
+#include <string.h>  // for memmove()
+#include <algorithm>  // for std::min()
+#include <string>
+
+#include "./ByteScan.h"
+#include "./HttpRequestParser.h"
+
+using std::string_view;
+
+namespace hw4 {
+
+static bool IsSpace(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static char ToLower(char c) {
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// Compares "s" to the lowercase "lower", ignoring case.
+static bool EqualsLower(string_view s, string_view lower) {
+  if (s.size() != lower.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < s.size(); i++) {
+    if (ToLower(s[i]) != lower[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses a Content-Length value into "*length", which stops growing
+// once it's past any body limit, rather than overflowing.  Returns
+// false unless the value is all digits.
+static bool ParseLength(string_view value, uint64_t* length) {
+  if (value.empty()) {
+    return false;
+  }
+  uint64_t result = 0;
+  for (char c : value) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    result = (result > UINT32_MAX) ? result : result * 10 + (c - '0');
+  }
+  *length = result;
+  return true;
+}
+
+// The value of the hex digit "c", or -1 if it isn't one.
+static int HexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c = ToLower(c);
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+// static
+const size_t HttpRequestParser::kMaxHeaders = 100;
+
+void HttpRequestParser::Reset() {
+  phase_ = kHeaders;
+  line_start_ = 0;
+  scanned_ = 0;
+  colon_ = 0;
+  error_ = 0;
+  seen_request_line_ = false;
+  method_span_ = uri_span_ = protocol_span_ = {0, 0};
+  header_spans_.clear();  // keeping their memory for the next request
+  body_start_ = 0;
+  body_length_ = 0;
+  remaining_ = 0;
+  expect_continue_ = false;
+  consumed_ = 0;
+  method_ = uri_ = protocol_ = body_ = string_view();
+  headers_.clear();
+}
+
+bool HttpRequestParser::FindLine(const char* data, size_t size,
+                                 size_t* end, bool find_colon) {
+  if (scanned_ >= size) {
+    return false;
+  }
+
+  // Until the line's colon turns up, look for it and the line's end in
+  // the same pass.
+  const char* colon = nullptr;
+  const char* newline = FindLineEnd(
+    data + scanned_, data + size, ':',
+    (find_colon && colon_ == 0) ? &colon : nullptr);
+  if (colon != nullptr) {
+    colon_ = colon - data;
+  }
+  if (newline == data + size) {
+    scanned_ = size;
+    return false;
+  }
+  *end = newline - data;
+  scanned_ = *end + 1;
+  if (*end > line_start_ && data[*end - 1] == '\r') {
+    (*end)--;
+  }
+  return true;
+}
+
+bool HttpRequestParser::Parse(char* data, size_t size) {
+  if (consumed_ != 0) {
+    return true;  // already complete
+  }
+  if (error_ != 0) {
+    return false;  // given up on
+  }
+
+  // Find each line's end, and a header line's colon, with
+  // FindLineEnd(), which looks at many bytes at once, and handle the
+  // line; only the last, unfinished one is left for next time, and only
+  // the part of it not yet looked at.
+  size_t end;
+  while (phase_ == kHeaders &&
+         FindLine(data, size, &end, seen_request_line_)) {
+    if (end > line_start_) {
+      ParseLine(data, end);
+      if (error_ != 0) {
+        return false;
+      }
+    } else if (seen_request_line_) {
+      // The empty line ending the header block.
+      line_start_ = scanned_;
+      StartBody(data);
+      break;
+    }
+    line_start_ = scanned_;
+    colon_ = 0;
+  }
+  if (phase_ == kHeaders || !ParseBody(data, size)) {
+    return false;
+  }
+
+  consumed_ = line_start_;
+  method_ = string_view(data + method_span_.begin, method_span_.length);
+  uri_ = string_view(data + uri_span_.begin, uri_span_.length);
+  protocol_ = string_view(data + protocol_span_.begin,
+                          protocol_span_.length);
+  for (size_t i = 0; i + 1 < header_spans_.size(); i += 2) {
+    const Span& name = header_spans_[i];
+    const Span& value = header_spans_[i + 1];
+    headers_.push_back({string_view(data + name.begin, name.length),
+                        string_view(data + value.begin, value.length)});
+  }
+  body_ = string_view(data + body_start_, body_length_);
+  return true;
+}
+
+void HttpRequestParser::StartBody(const char* data) {
+  body_start_ = line_start_;
+  phase_ = kDone;
+
+  bool chunked = false, has_length = false;
+  uint64_t length = 0;
+  for (size_t i = 0; i + 1 < header_spans_.size(); i += 2) {
+    string_view name(data + header_spans_[i].begin,
+                     header_spans_[i].length);
+    string_view value(data + header_spans_[i + 1].begin,
+                      header_spans_[i + 1].length);
+    if (name == "content-length") {
+      // Repeats are fine, as long as they agree.
+      uint64_t this_length;
+      if (!ParseLength(value, &this_length) ||
+          (has_length && this_length != length)) {
+        error_ = 400;
+        return;
+      }
+      has_length = true;
+      length = this_length;
+    } else if (name == "transfer-encoding") {
+      if (!EqualsLower(value, "chunked")) {
+        error_ = 501;
+        return;
+      }
+      chunked = true;
+    } else if (name == "expect") {
+      expect_continue_ = EqualsLower(value, "100-continue");
+    }
+  }
+
+  if (chunked && has_length) {
+    // Whoever's in front of us may have framed it the other way, so
+    // there's no telling where the next request starts (RFC 9112 6.1).
+    error_ = 400;
+  } else if (chunked) {
+    phase_ = kChunkSize;
+  } else if (length > max_body_bytes_) {
+    error_ = 413;
+  } else if (length > 0) {
+    phase_ = kFixedBody;
+    remaining_ = length;
+  }
+}
+
+bool HttpRequestParser::ParseBody(char* data, size_t size) {
+  while (error_ == 0 && phase_ != kDone) {
+    if (phase_ == kFixedBody || phase_ == kChunkData) {
+      // Take whatever's arrived of the body (or chunk).  A fixed body is
+      // already where it belongs; a chunk's data is moved down over the
+      // framing before it, to follow on from the chunks before it.
+      size_t len = std::min(remaining_, size - line_start_);
+      size_t to = body_start_ + body_length_;
+      if (len > 0 && to != line_start_) {
+        memmove(data + to, data + line_start_, len);
+      }
+      body_length_ += len;
+      remaining_ -= len;
+      line_start_ += len;
+      scanned_ = line_start_;
+      if (remaining_ > 0) {
+        return false;
+      }
+      phase_ = (phase_ == kFixedBody) ? kDone : kChunkDataEnd;
+      continue;
+    }
+
+    size_t end;
+    if (!FindLine(data, size, &end)) {
+      return false;
+    }
+    size_t begin = line_start_;
+    line_start_ = scanned_;
+    if (phase_ == kChunkSize) {
+      ParseChunkSize(data, begin, end);
+    } else if (phase_ == kChunkDataEnd) {
+      if (end != begin) {
+        error_ = 400;  // the chunk was longer than it said
+      }
+      phase_ = kChunkSize;
+    } else if (end == begin) {
+      phase_ = kDone;  // the empty line after the trailer fields
+    }
+  }
+  return error_ == 0;
+}
+
+void HttpRequestParser::ParseChunkSize(const char* data, size_t begin,
+                                       size_t end) {
+  // Hex digits, optionally followed by chunk extensions, which are
+  // ignored.
+  uint64_t chunk_size = 0;
+  size_t i = begin;
+  for (; i < end && HexValue(data[i]) >= 0; i++) {
+    chunk_size = chunk_size * 16 + HexValue(data[i]);
+    if (body_length_ + chunk_size > max_body_bytes_) {
+      error_ = 413;
+      return;
+    }
+  }
+  if (i == begin || (i < end && data[i] != ';' && !IsSpace(data[i]))) {
+    error_ = 400;
+    return;
+  }
+  if (chunk_size == 0) {
+    phase_ = kTrailers;
+  } else {
+    phase_ = kChunkData;
+    remaining_ = chunk_size;
+  }
+}
+
+void HttpRequestParser::ParseLine(char* data, size_t end) {
+  size_t start = line_start_;
+
+  if (!seen_request_line_) {
+    // "method URI protocol", separated by runs of whitespace.
+    seen_request_line_ = true;
+    Span words[3];
+    int num_words = 0;
+    size_t i = start;
+    while (i < end) {
+      while (i < end && IsSpace(data[i]))
+        i++;
+      if (i == end)
+        break;
+      size_t word = i;
+      i = FindFirstOf(data + i, data + end, ' ', '\t') - data;
+      if (num_words == 3) {
+        return;  // one word too many
+      }
+      words[num_words++] = {static_cast<uint32_t>(word),
+                            static_cast<uint32_t>(i - word)};
+    }
+    if (num_words == 3) {
+      method_span_ = words[0];
+      uri_span_ = words[1];
+      protocol_span_ = words[2];
+    }
+    return;
+  }
+
+  // "name: value", whose colon FindLine() has already found, if it's
+  // on this line.
+  if (colon_ == 0 || colon_ >= end) {
+    return;
+  }
+  size_t name_begin = start, name_end = colon_;
+  while (name_begin < name_end && IsSpace(data[name_begin]))
+    name_begin++;
+  while (name_end > name_begin && IsSpace(data[name_end - 1]))
+    name_end--;
+  if (name_begin == name_end) {
+    return;
+  }
+  size_t value_begin = colon_ + 1, value_end = end;
+  while (value_begin < value_end && IsSpace(data[value_begin]))
+    value_begin++;
+  while (value_end > value_begin && IsSpace(data[value_end - 1]))
+    value_end--;
+
+  if (header_spans_.size() / 2 >= kMaxHeaders) {
+    error_ = 431;
+    return;
+  }
+  for (size_t i = name_begin; i < name_end; i++) {
+    data[i] = ToLower(data[i]);
+  }
+  header_spans_.push_back({static_cast<uint32_t>(name_begin),
+                           static_cast<uint32_t>(name_end - name_begin)});
+  header_spans_.push_back({static_cast<uint32_t>(value_begin),
+                           static_cast<uint32_t>(value_end - value_begin)});
+}
+
+void HttpRequestParser::CopyTo(HttpRequest* const request) const {
+  // Everything is assigned over what "request" held before, so a
+  // request reused from one parse to the next reuses its memory too.
+  request->set_uri(uri_.empty() ? string_view("/") : uri_);
+  request->set_method(method_);
+  request->ClearHeaders();
+  for (const Header& header : headers_) {
+    request->AddHeader(header.name, header.value);
+  }
+  request->mutable_body()->assign(body_);
+}
+
+}  // namespace hw4
@@ -0,0 +1,189 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_HTTPREQUESTPARSER_H_
+#define HW4_HTTPREQUESTPARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+#include "./HttpRequest.h"
+
+namespace hw4 {
+
+// An HttpRequestParser parses an HTTP request (see HttpRequest.h), its
+// header block and any body, incrementally, as it arrives.  The caller
+// keeps the bytes read so far in a buffer of its own, and calls Parse()
+// on the whole of it every time more arrive; the parser picks up where
+// it left off, so every byte is looked at once no matter how many
+// pieces the request comes in.
+//
+// Once a request is complete, its method, URI, protocol, headers, and
+// body are string_views into the caller's buffer: nothing is copied,
+// header names are lowercased where they lie, and a chunked body is
+// decoded in place, over its own framing.  They stay valid until
+// the buffer is next modified; CopyTo() copies them into an HttpRequest
+// when they need to outlive it.
+//
+// Lines end in "\r\n" (or, leniently, a bare "\n"), and an empty line
+// ends the request.  Empty lines before the request line are skipped.
+// A request line that isn't "method URI protocol" leaves the URI "/",
+// and a header line without a ':' or with an empty name is skipped;
+// whitespace around header values is dropped.
+//
+// The header block is followed by a body of Content-Length bytes, or
+// by a chunked one if Transfer-Encoding is "chunked", and otherwise by
+// nothing; the request ends after its body (and a chunked body's
+// trailer fields, which are skipped), so bytes the client pipelined
+// behind it are never mistaken for part of it.  A request whose body
+// can't be framed, or would be longer than set_max_body_bytes() allows,
+// is given up on as soon as that's known (see error()), without waiting
+// for the body to arrive.  So is one with more than kMaxHeaders headers.
+class HttpRequestParser {
+ public:
+  HttpRequestParser() : max_body_bytes_(UINT32_MAX) { Reset(); }
+  virtual ~HttpRequestParser() { }
+
+  struct Header {
+    std::string_view name;   // lowercase
+    std::string_view value;
+  };
+
+  // Parses data[0, size), which holds what the last call did (if it
+  // didn't return true) followed by anything that's arrived since.
+  // "data" may have moved in between, but its first "size" bytes from
+  // last time must not have changed (other than by the parser itself).
+  // Returns true once the request is complete, after which the
+  // accessors below describe it, and false while it's still arriving
+  // or once it's been given up on.
+  bool Parse(char* data, size_t size);
+
+  // Gets the parser ready for the next request, whose first byte will
+  // be data[0] of the next Parse().
+  void Reset();
+
+  // The longest body a request may have; longer ones are given up on.
+  // Kept across Reset().
+  void set_max_body_bytes(uint32_t max) { max_body_bytes_ = max; }
+
+  // 0, or, if the request has been given up on, the status code to
+  // answer it with: 400 for a malformed Content-Length or chunk, or a
+  // request with both a Content-Length and a Transfer-Encoding; 413 for
+  // a body longer than the limit; 431 for too many headers; 501 for a
+  // transfer coding other than "chunked".
+  uint16_t error() const { return error_; }
+
+  // The length of the header block, including the empty line that ended
+  // it, once it has; 0 until then.
+  size_t header_bytes() const { return body_start_; }
+
+  // True once the header block has been parsed and the body is still
+  // on its way.
+  bool in_body() const {
+    return phase_ != kHeaders && consumed_ == 0 && error_ == 0;
+  }
+
+  // True if the body is on its way, and the client said it would wait
+  // for a "100 Continue" before sending it.
+  bool expects_continue() const { return expect_continue_ && in_body(); }
+
+  // The number of bytes the complete request took up, header block,
+  // body, and all; the next request starts right after.
+  size_t consumed() const { return consumed_; }
+
+  std::string_view method() const { return method_; }
+  std::string_view uri() const { return uri_; }
+  std::string_view protocol() const { return protocol_; }
+  const std::vector<Header>& headers() const { return headers_; }
+  std::string_view body() const { return body_; }
+
+  // Copies the complete request into "request"; this is the one time
+  // the body is copied.
+  void CopyTo(HttpRequest* const request) const;
+
+  // The most headers a request may have.  Every header a request has
+  // makes looking up (or adding) any other header a little slower, so
+  // this bounds the work a request can make the server do.
+  static const size_t kMaxHeaders;
+
+ private:
+  // A piece of the buffer, as an offset, so that it survives the
+  // buffer moving.
+  struct Span {
+    uint32_t begin, length;
+  };
+
+  // What the parser is in the middle of.
+  enum Phase {
+    kHeaders,       // the request line and headers
+    kFixedBody,     // a body of Content-Length bytes
+    kChunkSize,     // a chunk's size line
+    kChunkData,     // a chunk's data
+    kChunkDataEnd,  // the line ending after a chunk's data
+    kTrailers,      // trailer fields, up to the empty line ending them
+    kDone
+  };
+
+  // Looks for the end of the line that starts at line_start_, in the
+  // part of data[0, size) not yet looked at.  Returns false if it
+  // hasn't arrived; otherwise sets "*end" to the end of the line without
+  // its line ending, and scanned_ to the start of the next line.  If
+  // "find_colon", the line's first ':' is looked for in the same pass,
+  // and recorded in colon_.
+  bool FindLine(const char* data, size_t size, size_t* end,
+                bool find_colon = false);
+
+  // Handles the header line data[line_start_, end).
+  void ParseLine(char* data, size_t end);
+
+  // Works out, once the header block has ended, how the body is framed.
+  void StartBody(const char* data);
+
+  // Parses as much of the body as data[0, size) holds.  Returns true
+  // once it's complete.
+  bool ParseBody(char* data, size_t size);
+
+  // Handles a chunk's size line, data[begin, end).
+  void ParseChunkSize(const char* data, size_t begin, size_t end);
+
+  // Where the next Parse() resumes: the start of the line (or the piece
+  // of body) it's in the middle of, and how far into that line it
+  // already looked for its end.
+  Phase phase_;
+  size_t line_start_;
+  size_t scanned_;
+  size_t colon_;  // the header line's first ':', or 0 if none yet
+  uint16_t error_;
+
+  bool seen_request_line_;
+  Span method_span_, uri_span_, protocol_span_;
+  std::vector<Span> header_spans_;  // name, value, name, value, ...
+
+  // The body, decoded so far, is data[body_start_, body_start_ +
+  // body_length_); "remaining_" more bytes of it are still to come in
+  // the body or chunk being read.
+  uint32_t max_body_bytes_;
+  size_t body_start_;
+  size_t body_length_;
+  size_t remaining_;
+  bool expect_continue_;
+
+  // The complete request.
+  size_t consumed_;
+  std::string_view method_, uri_, protocol_, body_;
+  std::vector<Header> headers_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_HTTPREQUESTPARSER_H_
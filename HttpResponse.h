@@ -51,10 +51,21 @@ class HttpResponse {
   void set_message(const std::string& msg) { message_ = msg; }
   void set_content_type(const std::string& type) { content_type_ = type; }
 
+  // Adds a "name: value" header to the response, in addition to the
+  // Content-type and Content-length headers.
+  void AddHeader(const std::string& name, const std::string& value) {
+    headers_[name] = value;
+  }
+
   void AppendToBody(const std::string& body_fragment) {
     body_ += body_fragment;
   }
 
+  // The response body, which callers may also fill in wholesale, e.g.,
+  // by swap()ping a string they've built into it without copying.
+  const std::string& body() const { return body_; }
+  std::string* mutable_body() { return &body_; }
+
   // A method to generate a std::string of the HTTP response, suitable for
   // writing back to the client.
   //
@@ -62,15 +73,24 @@ class HttpResponse {
   // last header in the block. The value of that Content-length header is the
   // size of the response body (in bytes).
   std::string GenerateResponseString() const {
+    return GenerateHeaderString() + body_;
+  }
+
+  // Like GenerateResponseString(), but stops after the blank line that
+  // ends the headers.  Writing the result followed by body() (e.g.,
+  // with writev()) sends the same bytes without copying the body.
+  std::string GenerateHeaderString() const {
     std::stringstream resp;
 
     resp << protocol_ << " " << response_code_ << " " << message_ << "\r\n";
     if (!content_type_.empty()) {
       resp << "Content-type: " << content_type_ << "\r\n";
     }
+    for (const auto& header : headers_) {
+      resp << header.first << ": " << header.second << "\r\n";
+    }
     resp << "Content-length: " << body_.size() << "\r\n";
     resp << "\r\n";
-    resp << body_;
     return resp.str();
   }
 
@@ -87,6 +107,9 @@ class HttpResponse {
   // The HTTP content type string to pass back in the header.  Optional.
   std::string content_type_;
 
+  // Any other headers to pass back, mapping names to values.  Optional.
+  std::map<std::string, std::string> headers_;
+
   // The body of the response.
   std::string body_;
 };
@@ -9,21 +9,30 @@
  * author.
  */
 
+#include <unistd.h>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <vector>
 #include <string>
 #include <sstream>
+#include <utility>
 
+#include "./EventLoop.h"
 #include "./FileReader.h"
 #include "./HttpConnection.h"
 #include "./HttpRequest.h"
 #include "./HttpUtils.h"
 #include "./HttpServer.h"
+#include "./SlabPool.h"
 #include "./libhw3/QueryProcessor.h"
 
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
 using std::cerr;
 using std::cout;
 using std::endl;
@@ -33,6 +42,7 @@ using std::string;
 using std::stringstream;
 using std::unique_ptr;
 using std::to_string;
+using std::vector;
 using boost::to_lower;
 using boost::trim;
 using boost::algorithm::split;
@@ -64,48 +74,378 @@ static const char* kThreegleStr =
   "</form>\n"
   "</center><p>\n";
 
-// static
-const int HttpServer::kNumThreads = 100;
+// How often Run() checks whether the connections have finished
+// draining.
+static const useconds_t kDrainPollUs = 10000;  // 0.01s
+
+// However many pipelined requests a batch may hold, its responses are
+// flushed once they add up to this many bytes, so that a client asking
+// for a run of big files doesn't have them all held in memory at once.
+static const size_t kMaxBatchBytes = 256 * 1024;
 
 // This is the function that threads are dispatched into
 // in order to process new client connections.
 static void HttpServer_ThrFn(ThreadPool::Task* t);
 
+// Logs a newly connected client.  Depending on the DNS mode, the
+// client's name may not be known (yet), in which case we print its
+// numeric address in its place.
+static void LogConnection(const string& c_addr,
+                          uint16_t c_port,
+                          const string& c_dns);
+
+// The coroutine that serves the client on "client_fd" in kCoroutine
+// mode, on whichever workers "context"'s Reactor resumes it on.
+static CoDetached HttpServer_CoFn(int client_fd, string c_addr,
+                                  uint16_t c_port, string c_dns,
+                                  const HttpServerContext* context);
+
+// This is the handler EventLoops run on worker threads in kEventLoop
+// mode; "arg" is the HttpServerContext.
+static HttpResponse HttpServer_EventFn(const HttpRequest& req, void* arg);
+
+// With priority lanes, the ThreadPool lanes that static file requests
+// and search queries wait in.  New and reawakened connections, whose
+// requests haven't been read yet, wait in the static lane too.
+static const uint32_t kStaticLane = 0;
+static const uint32_t kQueryLane = 1;
+
+// Whether "req" asks for a static file rather than a query.
+static bool IsStaticRequest(const HttpRequest& req);
+
+// Picks the lane for "req" in kEventLoop mode; "arg" is unused.
+static uint32_t HttpServer_LaneFn(const HttpRequest& req, void* arg);
+
+// Prints what each of "pool"'s lanes have been up to, if it has any.
+static void PrintLaneStats(ThreadPool* pool);
+
 // Given a request, produce a response.
 static HttpResponse ProcessRequest(const HttpRequest& req,
-                            const string& base_dir,
-                            const list<string>& indices);
+                                   const HttpServerContext& context);
 
 // Process a file request.
 static HttpResponse ProcessFileRequest(const string& uri,
                                 const string& base_dir);
 
-// Process a query request.
-static HttpResponse ProcessQueryRequest(const string& uri,
-                                 const list<string>& indices);
+// Process a query request for the search "terms", or, if "terms" is
+// null, for just the search page, searching the indices in parallel on
+// "query_pool" unless it's null.
+static HttpResponse ProcessQueryRequest(const string* terms,
+                                 const list<string>& indices,
+                                 ThreadPool* query_pool);
+
+// Runs the query "words" against "indices", in parallel on "query_pool"
+// unless it's null, and returns the results, best first.
+static vector<QueryProcessor::QueryResult> RunQuery(
+  const vector<string>& words, const list<string>& indices,
+  ThreadPool* query_pool);
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // HttpServer
 ///////////////////////////////////////////////////////////////////////////////
 bool HttpServer::Run(void) {
-  // Create the server listening socket.
-  int listen_fd;
-  cout << "  creating and binding the listening socket..." << endl;
-  if (!socket_.BindAndListen(AF_INET6, &listen_fd)) {
-    cerr << endl << "Couldn't bind to the listening socket." << endl;
-    return false;
+  // Create the server listening socket(s), or take over the ones that
+  // the server already running at handoff_path hands us.
+  uint32_t num_acceptors =
+    (options_.num_acceptors > 0) ? options_.num_acceptors : 1;
+  vector<int> listen_fds;
+  ListenerHandoff handoff(options_.handoff_path);
+  if (!options_.handoff_path.empty() && handoff.Claim(&listen_fds)) {
+    if (!socket_.AdoptListeners(listen_fds)) {
+      cerr << endl << "Couldn't take over the listening sockets." << endl;
+      for (int fd : listen_fds)
+        close(fd);
+      return false;
+    }
+    cout << "  took over " << listen_fds.size() << " listening socket(s)"
+         << " from the running server..." << endl;
+  } else {
+    cout << "  creating and binding the listening socket..." << endl;
+    if ((!options_.unix_only &&
+         !socket_.BindAndListen(AF_INET6, num_acceptors, &listen_fds)) ||
+        (!options_.unix_path.empty() &&
+         !socket_.BindUnix(options_.unix_path)) ||
+        socket_.num_listeners() == 0) {
+      cerr << endl << "Couldn't bind to the listening socket." << endl;
+      return false;
+    }
+    if (!options_.unix_path.empty()) {
+      cout << "  listening on the Unix socket " << options_.unix_path
+           << "..." << endl;
+    }
+  }
+
+  // Every listener, TCP or Unix, gets an acceptor of its own.
+  num_acceptors = socket_.num_listeners();
+
+  socket_.SetDnsMode(options_.dns_mode, options_.dns_cache_size,
+                     options_.dns_cache_ttl_secs);
+
+  if (!IoEngine::Select(options_.io_engine)) {
+    cerr << "  io_uring is unavailable; using system calls instead." << endl;
+  }
+  cout << "  doing I/O through " << IoEngine::Get()->name() << "..." << endl;
+
+  // The reaper has to outlive every connection, including those the
+  // event loops still own when they are destroyed below.
+  ConnectionReaper reaper(options_.idle_timeout_ms,
+                          options_.header_timeout_ms,
+                          options_.write_timeout_ms);
+  bool started = reaper.Start();
+  reaper_ = &reaper;
+  if (!started) {
+    cerr << "Couldn't start the connection reaper." << endl;
   }
 
   // Spin, accepting connections and dispatching them.  Use a
   // threadpool to dispatch connections into their own thread.
-  cout << "  accepting connections..." << endl << endl;
-  ThreadPool tp(kNumThreads);
+  uint32_t peak_threads = 0;
+  if (started) {
+    ThreadPoolOptions pool_options;
+    pool_options.num_threads = options_.min_threads;
+    pool_options.max_threads = options_.max_threads;
+    pool_options.idle_timeout_ms = options_.thread_idle_timeout_ms;
+    pool_options.lazy_start = options_.lazy_threads;
+    pool_options.placement = options_.worker_placement;
+    if (options_.priority_lanes) {
+      pool_options.lane_weights = {options_.static_lane_weight, 1};
+      pool_options.lane_scheduling = options_.lane_scheduling;
+    }
+    pool_options.max_queued = options_.max_queued;
+    ThreadPool tp(pool_options);
+    Verify333(pthread_mutex_lock(&status_lock_) == 0);
+    pool_ = &tp;
+    Verify333(pthread_mutex_unlock(&status_lock_) == 0);
+
+    // Declared after the threadpool, so they are stopped while the pool
+    // can still run the tasks they hand back, and hand it no more after.
+    IdleConnectionSet idle_set(&tp);
+    Reactor reactor(&tp);
+    context_.base_dir = &static_file_dir_path_;
+    context_.indices = &indices_;
+    context_.idle_set = (options_.mode == kParkIdle) ? &idle_set : nullptr;
+    context_.reaper = reaper_;
+    context_.limits = options_.connection_limits;
+    context_.pipeline_batch = std::max(options_.pipeline_batch, 1U);
+    context_.pool = options_.priority_lanes ? pool_ : nullptr;
+    context_.query_pool = options_.parallel_queries ? pool_ : nullptr;
+    context_.reactor = (options_.mode == kCoroutine) ? &reactor : nullptr;
+    if (options_.mode == kParkIdle) {
+      idle_set_ = &idle_set;
+      started = idle_set.Start();
+    } else if (options_.mode == kEventLoop) {
+      started = StartEventLoops();
+    } else if (options_.mode == kCoroutine) {
+      started = reactor.Start();
+    }
+
+    if (started) {
+      // We're ready to accept, so if we took the listening sockets over,
+      // let the old server know it can stop, and wait for a server to
+      // take them over from us in turn.
+      pthread_t handoff_thread;
+      bool handoff_started = false;
+      if (!options_.handoff_path.empty()) {
+        handoff.Confirm();
+        handoff_ = &handoff;
+        handoff_started =
+          handoff.Listen() &&
+          pthread_create(&handoff_thread, nullptr, &HandoffThread,
+                         static_cast<void*>(this)) == 0;
+        if (!handoff_started) {
+          cerr << "Couldn't listen for handoffs at "
+               << options_.handoff_path << "." << endl;
+        }
+      }
+
+      cout << "  accepting connections..." << endl << endl;
+      RunAcceptors(num_acceptors);
+
+      if (handoff_started) {
+        handoff.Stop();
+        Verify333(pthread_join(handoff_thread, nullptr) == 0);
+      }
+      handoff_ = nullptr;
+    } else {
+      cerr << "Couldn't start the connection handlers." << endl;
+    }
+
+    // However we got here, wind down gracefully: turn new clients away
+    // (unless another server has the listening sockets now), and give
+    // the connections still open until the drain deadline to finish
+    // what they're doing.  Past it, the reaper hangs up on whoever is
+    // left, so this doesn't take much longer than that.
+    socket_.CloseListeners();
+    cout << "  draining open connections..." << endl;
+    reaper.Drain(options_.drain_timeout_ms);
+    while (reaper.num_connections() > 0 || tp.num_queued() > 0) {
+      usleep(kDrainPollUs);
+    }
+
+    // Stop the loop threads before the threadpool winds down: ~ThreadPool
+    // runs leftover tasks inline, and those hand their responses back to
+    // a loop, which therefore has to outlive the pool.
+    for (auto& loop : loops_) {
+      loop->Stop();
+    }
+    idle_set_ = nullptr;
+    Verify333(pthread_mutex_lock(&status_lock_) == 0);
+    pool_ = nullptr;
+    Verify333(pthread_mutex_unlock(&status_lock_) == 0);
+    peak_threads = tp.peak_threads();
+    PrintLaneStats(&tp);
+  }
+  loops_.clear();
+  reaper_ = nullptr;
+
+  for (uint32_t i = 0; i < socket_.num_listeners(); i++) {
+    cout << "  listener " << i << " accepted " << socket_.accept_count(i)
+         << " connections" << endl;
+  }
+  cout << "  thread pool peaked at " << peak_threads << " threads" << endl;
+  cout << "  reaped " << reaper.num_reaped() << " idle or stalled connections"
+       << endl;
+  if (options_.max_queued > 0) {
+    cout << "  shed " << num_shed_ << " connections while overloaded"
+         << endl;
+  }
+  return started;
+}
+
+void HttpServer::Drain() {
+  socket_.StopAccepting();
+}
+
+void HttpServer::PrintStatus() {
+  Verify333(pthread_mutex_lock(&status_lock_) == 0);
+  if (pool_ == nullptr) {
+    cout << "  status: not running" << endl;
+  } else {
+    cout << "  status: " << pool_->num_threads() << " threads ("
+         << pool_->num_threads_idle() << " idle, "
+         << pool_->num_threads_blocked() << " blocked, peak "
+         << pool_->peak_threads() << "), " << pool_->num_queued()
+         << " queued" << endl;
+    PrintLaneStats(pool_);
+  }
+  Verify333(pthread_mutex_unlock(&status_lock_) == 0);
+}
+
+void* HttpServer::HandoffThread(void* arg) {
+  HttpServer* server = static_cast<HttpServer*>(arg);
+  if (server->handoff_->Serve(server->socket_.listen_fds())) {
+    cout << "  handed the listening sockets off to a new server." << endl;
+    server->Drain();
+  }
+  return nullptr;
+}
+
+bool HttpServer::StartEventLoops() {
+  uint32_t num_loops = options_.num_event_loops;
+  if (num_loops == 0) {
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);  // NOLINT(runtime/int)
+    num_loops = (num_cpus > 0) ? num_cpus : 1;
+  }
+  for (uint32_t i = 0; i < num_loops; i++) {
+    loops_.emplace_back(new EventLoop(
+      pool_, &HttpServer_EventFn, &context_, reaper_,
+      options_.priority_lanes ? &HttpServer_LaneFn : nullptr,
+      options_.connection_limits));
+    if (!loops_.back()->Start()) {
+      return false;
+    }
+  }
+  cout << "  running " << num_loops << " event loops..." << endl;
+  return true;
+}
+
+// The argument RunAcceptors() passes to each extra accept thread.
+struct AcceptorArgs {
+  HttpServer* server;
+  uint32_t listener;
+};
+
+void* HttpServer::AcceptThread(void* arg) {
+  AcceptorArgs* args = static_cast<AcceptorArgs*>(arg);
+  args->server->AcceptLoop(args->listener);
+  return nullptr;
+}
+
+void HttpServer::RunAcceptors(uint32_t num_acceptors) {
+  // Listener 0 is served by this thread, and every other listener gets
+  // an accept thread of its own, each placed as the options say.
+  ThreadPlacement placement(options_.acceptor_placement);
+  vector<pthread_t> threads(num_acceptors);
+  vector<AcceptorArgs> args(num_acceptors);
+  for (uint32_t i = 1; i < num_acceptors; i++) {
+    args[i].server = this;
+    args[i].listener = i;
+    Verify333(placement.Create(i, &threads[i], &AcceptThread,
+                               static_cast<void*>(&args[i])) == 0);
+  }
+
+  placement.PinThisThread(0);
+  AcceptLoop(0);
+
+  // Once one acceptor has given up, make sure the rest do too.
+  socket_.StopAccepting();
+  for (uint32_t i = 1; i < num_acceptors; i++) {
+    Verify333(pthread_join(threads[i], nullptr) == 0);
+  }
+}
+
+void HttpServer::AcceptLoop(uint32_t listener) {
+  if (options_.mode == kEventLoop) {
+    // Deal connections out to the loops round-robin.  Each acceptor
+    // starts at a different loop and steps over the others' starting
+    // points, so that acceptors sharing the loops don't pile onto the
+    // same ones.
+    uint32_t num_acceptors = socket_.num_listeners();
+    uint32_t next_loop = listener;
+    while (1) {
+      int client_fd;
+      uint16_t c_port;
+      string c_addr, c_dns, s_addr, s_dns;
+      if (!socket_.Accept(listener, &client_fd, &c_addr, &c_port,
+                          &c_dns, &s_addr, &s_dns)) {
+        break;
+      }
+      LogConnection(c_addr, c_port, c_dns);
+      loops_[next_loop % loops_.size()]->AddConnection(client_fd);
+      next_loop = (next_loop + num_acceptors) % loops_.size();
+    }
+    return;
+  }
+
+  if (options_.mode == kCoroutine) {
+    while (1) {
+      int client_fd;
+      uint16_t c_port;
+      string c_addr, c_dns, s_addr, s_dns;
+      if (!socket_.Accept(listener, &client_fd, &c_addr, &c_port,
+                          &c_dns, &s_addr, &s_dns)) {
+        break;
+      }
+      if (!context_.reactor->Add(client_fd)) {
+        close(client_fd);
+        continue;
+      }
+      context_.reactor->Spawn(
+        HttpServer_CoFn(client_fd, c_addr, c_port, c_dns, &context_));
+    }
+    return;
+  }
+
   while (1) {
-    HttpServerTask* hst = new HttpServerTask(HttpServer_ThrFn);
-    hst->base_dir = static_file_dir_path_;
-    hst->indices = &indices_;
-    if (!socket_.Accept(&hst->client_fd,
+    // Don't take on another client until a worker can get to it.
+    if (options_.overload_policy == kOverloadPause) {
+      pool_->WaitForRoom();
+    }
+
+    HttpServerTask* hst = HttpServerTask::Get(HttpServer_ThrFn, &context_);
+    if (!socket_.Accept(listener,
+                    &hst->client_fd,
                     &hst->c_addr,
                     &hst->c_port,
                     &hst->c_dns,
@@ -113,20 +453,71 @@ bool HttpServer::Run(void) {
                     &hst->s_dns)) {
       // The accept failed for some reason, so quit out of the server.
       // (Will happen when kill command is used to shut down the server.)
+      HttpServerTask::Put(hst);
       break;
     }
-    // The accept succeeded; dispatch it.
-    tp.Dispatch(hst);
+    // The accept succeeded; dispatch it, unless too many clients are
+    // already waiting for a worker.  (Even when pausing, another
+    // acceptor may have filled the queue since we checked.)
+    if (!pool_->TryDispatch(hst)) {
+      Shed(hst->client_fd);
+      HttpServerTask::Put(hst);
+    }
   }
-  return true;
+}
+
+void HttpServer::Shed(int client_fd) {
+  HttpResponse ret;
+  ret.set_protocol("HTTP/1.1");
+  ret.set_response_code(503);
+  ret.set_message("Service Unavailable");
+  ret.AddHeader("Retry-After", to_string(options_.retry_after_secs));
+  ret.AddHeader("Connection", "close");
+  ret.AppendToBody("<html><body>The server is busy; please try again"
+                   " later.</body></html>\n");
+
+  // The client hasn't had a chance to fill up the socket buffer yet, so
+  // this write won't block the accept thread.  The reaper closes the
+  // socket once the client has read the response.
+  string str = ret.GenerateResponseString();
+  WrappedWrite(client_fd, reinterpret_cast<const unsigned char*>(str.c_str()),
+               str.length());
+  reaper_->Linger(client_fd);
+  num_shed_++;
+}
+
+// static
+HttpServerTask* HttpServerTask::Get(ThreadPool::thread_task_fn f,
+                                    const HttpServerContext* context) {
+  HttpServerTask* task = SlabPool<HttpServerTask>::Get();
+  task->func_ = f;
+  task->context = context;
+  return task;
+}
+
+// static
+void HttpServerTask::Put(HttpServerTask* task) {
+  task->connection.Reset(-1);
+  task->client_fd = -1;
+  task->lane_ = kStaticLane;
+  task->queued_ns_ = 0;
+  task->has_pending = false;
+  SlabPool<HttpServerTask>::Put(task);
 }
 
 static void HttpServer_ThrFn(ThreadPool::Task* t) {
   // Cast back our HttpServerTask structure with all of our new
   // client's information in it.
-  unique_ptr<HttpServerTask> hst(static_cast<HttpServerTask*>(t));
-  cout << "  client " << hst->c_dns << ":" << hst->c_port << " "
-       << "(IP address " << hst->c_addr << ")" << " connected." << endl;
+  unique_ptr<HttpServerTask, HttpServerTask::Deleter> hst(
+    static_cast<HttpServerTask*>(t));
+  const HttpServerContext& context = *(hst->context);
+  if (hst->connection.fd() < 0) {
+    // First time through, i.e., the client was just accepted.
+    LogConnection(hst->c_addr, hst->c_port, hst->c_dns);
+    hst->connection.Reset(hst->client_fd);
+    hst->connection.SetReaper(context.reaper);
+    hst->connection.SetLimits(context.limits);
+  }
 
   // Read in the next request, process it, and write the response.
 
@@ -140,35 +531,224 @@ static void HttpServer_ThrFn(ThreadPool::Task* t) {
   // creating/destroying the same connection repeatedly.
 
   // STEP 1:
-  HttpConnection connection(hst->client_fd);
+  //
+  // The connection closes the client socket when hst is put back.
+  //
+  // Requests the client pipelined behind one another are answered
+  // back to back, and their responses go out together, in order, in a
+  // single write; only once the client has nothing more for us, or a
+  // batch is full, do the responses get flushed.
+  //
+  // The request is assigned over from one iteration to the next, so
+  // the memory it holds is reused rather than allocated afresh.
+  HttpConnection& connection = hst->connection;
+  HttpRequest request;
   bool done = false;
   while (!done) {
-    HttpRequest request;
-    if (!connection.GetNextRequest(&request) ||
-        request.GetHeaderValue("connection") == "close") {
-      close(hst->client_fd);
+    bool got_request = true;
+    bool our_turn = hst->has_pending;
+    if (hst->has_pending) {
+      // Our turn in the query lane has come.
+      request = std::move(hst->pending);
+      hst->has_pending = false;
+    } else if (connection.NextBufferedRequest(&request)) {
+      // Pipelined behind the last one; its response can wait for
+      // company.
+    } else {
+      // Waiting on the client can take a while, so let the pool know
+      // not to count on this worker in the meantime.  Before waiting,
+      // send the client whatever it's waiting on.
+      if (!connection.FlushResponses()) {
+        break;
+      }
+      ThreadPool::BeginBlocking();
+      got_request = connection.GetNextRequest(&request);
+      ThreadPool::EndBlocking();
+    }
+
+    // With lanes, a query waits its turn in the query lane, letting
+    // static file requests that came in meanwhile go first.  Spawn()
+    // rather than Dispatch(), in case the pool is running us as it
+    // winds down.
+    if (got_request && !our_turn && context.pool != nullptr &&
+        !IsStaticRequest(request) &&
+        request.GetHeaderValue(kHeaderConnection) != "close") {
+      if (!connection.FlushResponses()) {
+        break;
+      }
+      hst->pending = std::move(request);
+      hst->has_pending = true;
+      hst->lane_ = kQueryLane;
+      context.pool->Spawn(hst.release());
+      return;
+    }
+
+    // Should the connection go back to the pool, it's back in the static
+    // lane until it has another query.
+    hst->lane_ = kStaticLane;
+    if (!got_request) {
+      // A request we turned down still gets an answer.
+      connection.QueueRejection();
+      done = true;
+    } else if (request.GetHeaderValue(kHeaderConnection) == "close") {
       done = true;
     } else {
-      HttpResponse respond = ProcessRequest(
-        request, hst->base_dir, *(hst->indices));
-      if (!connection.WriteResponse(respond)) {
-        close(hst->client_fd);
+      HttpResponse respond = ProcessRequest(request, context);
+
+      // If the server is shutting down, this is the client's last
+      // response.
+      if (context.reaper != nullptr && context.reaper->draining()) {
+        respond.AddHeader("Connection", "close");
         done = true;
       }
+      connection.QueueResponse(&respond);
+      if (connection.num_queued_responses() >= context.pipeline_batch ||
+          connection.queued_bytes() >= kMaxBatchBytes) {
+        if (!connection.FlushResponses()) {
+          done = true;
+        }
+      }
+      if (!done && context.idle_set != nullptr &&
+          !connection.HasBufferedData()) {
+        // The client is caught up, so rather than blocking this thread
+        // until it sends something else, park the connection and give
+        // the thread back to the pool.  Once parked, the task may be
+        // running on another worker already, so don't touch it again.
+        // If the idle deadline passes first, the reaper's shutdown()
+        // wakes the parked connection up to see EOF.
+        if (!connection.FlushResponses()) {
+          done = true;
+          continue;
+        }
+        connection.ArmDeadline();
+        if (context.idle_set->Park(hst->client_fd, hst.get())) {
+          hst.release();
+          return;
+        }
+      }
     }
   }
+
+  // Whatever the client asked for before it said goodbye still goes
+  // out before the connection closes.
+  connection.FlushResponses();
+}
+
+static CoDetached HttpServer_CoFn(int client_fd, string c_addr,
+                                  uint16_t c_port, string c_dns,
+                                  const HttpServerContext* context) {
+  LogConnection(c_addr, c_port, c_dns);
+  Reactor* reactor = context->reactor;
+  HttpConnection connection(client_fd);
+  connection.SetReaper(context->reaper);
+  connection.SetLimits(context->limits);
+
+  // The same loop as HttpServer_ThrFn()'s, pipelined responses and
+  // all, except that where it would block, this gives the worker back
+  // until the client is ready.
+  HttpRequest request;
+  bool done = false;
+  while (!done) {
+    if (!connection.NextBufferedRequest(&request)) {
+      if (!co_await connection.AsyncFlushResponses(reactor)) {
+        break;
+      }
+      if (!co_await connection.AsyncGetNextRequest(reactor, &request)) {
+        connection.QueueRejection();
+        break;
+      }
+    }
+    if (request.GetHeaderValue(kHeaderConnection) == "close") {
+      break;
+    }
+    HttpResponse respond = ProcessRequest(request, *context);
+
+    // If the server is shutting down, this is the client's last
+    // response.
+    if (context->reaper != nullptr && context->reaper->draining()) {
+      respond.AddHeader("Connection", "close");
+      done = true;
+    }
+    connection.QueueResponse(&respond);
+    if (connection.num_queued_responses() >= context->pipeline_batch ||
+        connection.queued_bytes() >= kMaxBatchBytes) {
+      if (!co_await connection.AsyncFlushResponses(reactor)) {
+        done = true;
+      }
+    }
+  }
+  co_await connection.AsyncFlushResponses(reactor);
+
+  // The connection closes the client socket as the coroutine ends.
+  reactor->Remove(client_fd);
+}
+
+static void LogConnection(const string& c_addr,
+                          uint16_t c_port,
+                          const string& c_dns) {
+  if (c_addr.compare(0, 5, "unix:") == 0) {
+    cout << "  client on " << c_addr << " connected." << endl;
+    return;
+  }
+  cout << "  client " << (c_dns.empty() ? c_addr : c_dns) << ":" << c_port
+       << " " << "(IP address " << c_addr << ")" << " connected." << endl;
+}
+
+static bool IsStaticRequest(const HttpRequest& req) {
+  return req.uri().substr(0, 8) == "/static/";
+}
+
+static uint32_t HttpServer_LaneFn(const HttpRequest& req, void* arg) {
+  return IsStaticRequest(req) ? kStaticLane : kQueryLane;
+}
+
+static void PrintLaneStats(ThreadPool* pool) {
+  if (pool->num_lanes() < 2) {
+    return;
+  }
+  const char* kLaneNames[] = {"static", "query"};
+  for (uint32_t i = 0; i < pool->num_lanes(); i++) {
+    LaneStats stats = pool->lane_stats(i);
+    double mean_us = (stats.num_run == 0) ? 0 :
+      stats.total_wait_ns / 1e3 / stats.num_run;
+    cout << "  " << (i < 2 ? kLaneNames[i] : "other") << " lane: "
+         << stats.num_queued << " queued, " << stats.num_run
+         << " run, waited " << mean_us << " us on average and "
+         << stats.max_wait_ns / 1e3 << " us at most" << endl;
+  }
+}
+
+static HttpResponse HttpServer_EventFn(const HttpRequest& req, void* arg) {
+  const HttpServerContext& context =
+    *static_cast<const HttpServerContext*>(arg);
+  HttpResponse response = ProcessRequest(req, context);
+  if (context.reaper != nullptr && context.reaper->draining()) {
+    // The reaper hangs up once the response has gone out.
+    response.AddHeader("Connection", "close");
+  }
+  return response;
 }
 
 static HttpResponse ProcessRequest(const HttpRequest& req,
-                            const string& base_dir,
-                            const list<string>& indices) {
+                                   const HttpServerContext& context) {
   // Is the user asking for a static file?
-  if (req.uri().substr(0, 8) == "/static/") {
-    return ProcessFileRequest(req.uri(), base_dir);
+  if (IsStaticRequest(req)) {
+    return ProcessFileRequest(req.uri(), *(context.base_dir));
   }
 
-  // The user must be asking for a query.
-  return ProcessQueryRequest(req.uri(), indices);
+  // The user must be asking for a query, whose terms come in the URI,
+  // or, POSTed, in the form-encoded body, which can be as long as the
+  // connection limits allow.
+  URLParser parser;
+  parser.Parse(req.uri());
+  bool has_terms = (req.uri().find("query?terms=") != std::string::npos);
+  if (req.method() == "POST") {
+    parser.ParseArgs(req.body());
+    has_terms = (parser.args().count("terms") != 0);
+  }
+  string terms = has_terms ? parser.args()["terms"] : "";
+  return ProcessQueryRequest(has_terms ? &terms : nullptr,
+                             *(context.indices), context.query_pool);
 }
 
 static HttpResponse ProcessFileRequest(const string& uri,
@@ -210,7 +790,7 @@ static HttpResponse ProcessFileRequest(const string& uri,
     ret.set_protocol("HTTP/1.1");
     ret.set_response_code(200);
     ret.set_message("OK");
-    ret.AppendToBody(res);
+    ret.mutable_body()->swap(res);
     size_t pos = file_name.rfind(".");
     string type = file_name.substr(pos + 1);
     if (type == "htm" || type == "html") {
@@ -245,8 +825,9 @@ static HttpResponse ProcessFileRequest(const string& uri,
   return ret;
 }
 
-static HttpResponse ProcessQueryRequest(const string& uri,
-                                 const list<string>& indices) {
+static HttpResponse ProcessQueryRequest(const string* terms,
+                                 const list<string>& indices,
+                                 ThreadPool* query_pool) {
   // The response we're building up.
   HttpResponse ret;
 
@@ -272,17 +853,14 @@ static HttpResponse ProcessQueryRequest(const string& uri,
 
   // STEP 3:
   ret.AppendToBody(kThreegleStr);
-  if (uri.find("query?terms=") != std::string::npos) {
-    URLParser parser;
-    parser.Parse(uri);
-    string query = parser.args()["terms"];
+  if (terms != nullptr) {
+    string query = *terms;
     trim(query);
     to_lower(query);
     vector<string> words;
     split(words, query, is_any_of(" "), token_compress_on);
-    QueryProcessor query_processor(indices, false);
     vector<QueryProcessor::QueryResult> results =
-                                  query_processor.ProcessQuery(words);
+      RunQuery(words, indices, query_pool);
 
     if (results.size() == 0) {
       ret.AppendToBody("<p><br>\r\n");
@@ -320,4 +898,34 @@ static HttpResponse ProcessQueryRequest(const string& uri,
   return ret;
 }
 
+static vector<QueryProcessor::QueryResult> RunQuery(
+  const vector<string>& words, const list<string>& indices,
+  ThreadPool* query_pool) {
+  if (query_pool == nullptr || indices.size() < 2) {
+    QueryProcessor query_processor(indices, false);
+    return query_processor.ProcessQuery(words);
+  }
+
+  // Search each index on its own, and then merge the results.  A
+  // document in more than one index shows up once for each, just as
+  // when QueryProcessor searches them all.
+  vector<string> index_list(indices.begin(), indices.end());
+  vector<vector<QueryProcessor::QueryResult>> per_index(index_list.size());
+  query_pool->ParallelFor(0, index_list.size(), [&](size_t i) {
+      QueryProcessor query_processor({index_list[i]}, false);
+      per_index[i] = query_processor.ProcessQuery(words);
+    });
+
+  vector<QueryProcessor::QueryResult> results;
+  for (vector<QueryProcessor::QueryResult>& found : per_index) {
+    results.insert(results.end(), found.begin(), found.end());
+  }
+  std::stable_sort(results.begin(), results.end(),
+                   [](const QueryProcessor::QueryResult& a,
+                      const QueryProcessor::QueryResult& b) {
+                     return a.rank > b.rank;
+                   });
+  return results;
+}
+
 }  // namespace hw4
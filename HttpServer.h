@@ -13,14 +13,215 @@
 #define HW4_HTTPSERVER_H_
 
 #include <stdint.h>
+#include <atomic>
+#include <memory>
 #include <string>
 #include <list>
+#include <vector>
 
+#include "./ConnectionReaper.h"
+#include "./EventLoop.h"
+#include "./HttpConnection.h"
+#include "./IdleConnectionSet.h"
+#include "./IoEngine.h"
+#include "./ListenerHandoff.h"
+#include "./Reactor.h"
+#include "./ThreadPlacement.h"
 #include "./ThreadPool.h"
 #include "./ServerSocket.h"
 
 namespace hw4 {
 
+// How an HttpServer spreads client connections over threads.
+enum ServerMode {
+  // Every accepted connection is dispatched to a ThreadPool worker,
+  // which serves it with blocking reads and writes until it closes.
+  kThreadPerConnection,
+
+  // Connections are spread over one epoll EventLoop per core, and
+  // only complete requests are dispatched to ThreadPool workers.  See
+  // EventLoop.h.
+  kEventLoop,
+
+  // Like kThreadPerConnection, except that between requests a worker
+  // parks the connection in a shared IdleConnectionSet and returns to
+  // the ThreadPool; the connection is dispatched again only once the
+  // client sends more bytes.  See IdleConnectionSet.h.
+  kParkIdle,
+
+  // Every accepted connection is served by a C++20 coroutine, written
+  // like kThreadPerConnection's loop, which waits for the client on a
+  // Reactor instead of in a blocking read or write.  So a connection
+  // only holds a worker while it has something to do, and thousands of
+  // them share the pool.  See Coroutine.h and Reactor.h.
+  kCoroutine
+};
+
+// What an HttpServer does with a new connection when its ThreadPool
+// already has HttpServerOptions::max_queued connections waiting.
+enum OverloadPolicy {
+  // Answer the client straight from the accept thread with a "503
+  // Service Unavailable" and a Retry-After header, and hang up.
+  kOverloadShed,
+
+  // Stop accepting until the queue has room again, leaving new
+  // clients waiting in the kernel's listen backlog.
+  kOverloadPause
+};
+
+// Knobs for an HttpServer.  The defaults keep the original server's
+// thread-per-connection mode, but its worker pool is elastic: it starts
+// with 8 threads, grows to 100, and retires the extra ones once they
+// have been idle for 10 seconds.  (Setting min_threads and max_threads
+// both to 100 gives back the original fixed pool.)  Unlike the original
+// server, it also hangs up on clients that go quiet: after 60 seconds
+// idle between requests, 10 seconds partway through a request header,
+// or 30 seconds without taking any of a response.  Setting
+// idle_timeout_ms, header_timeout_ms, and write_timeout_ms to 0 turns
+// each of these off.
+struct HttpServerOptions {
+  ServerMode mode = kThreadPerConnection;
+
+  // How many EventLoops to run in kEventLoop mode; 0 means one per
+  // online CPU.
+  uint32_t num_event_loops = 0;
+
+  // How many listening sockets to open on the port, each drained by
+  // its own accept thread.  With more than one, the listeners share the
+  // port through SO_REUSEPORT and the kernel spreads connections across
+  // them.  0 means 1.
+  uint32_t num_acceptors = 0;
+
+  // Which CPUs to run the accept threads on (see ThreadPlacement.h);
+  // accept thread i serves listener i.
+  PlacementOptions acceptor_placement;
+
+  // How to find out client and server DNS names (see ServerSocket.h),
+  // and, in kDnsCached mode, how many names to cache for how long.
+  DnsMode dns_mode = kDnsBlocking;
+  uint32_t dns_cache_size = 4096;
+  uint32_t dns_cache_ttl_secs = 300;
+
+  // Which IoEngine to do blocking socket and file I/O through (see
+  // IoEngine.h).  If the kernel can't do io_uring, the server falls
+  // back to plain system calls.
+  IoEngineKind io_engine = kIoSyscalls;
+
+  // How many worker threads to start with, and how many the pool may
+  // grow to when connections back up or workers block on slow clients
+  // (see ThreadPoolOptions).  Threads beyond min_threads exit once
+  // they've been idle for thread_idle_timeout_ms.  With lazy_threads,
+  // even the first min_threads are only created as connections come in.
+  uint32_t min_threads = 8;
+  uint32_t max_threads = 100;
+  uint32_t thread_idle_timeout_ms = 10000;
+  bool lazy_threads = false;
+
+  // Which CPUs to run the worker threads on, and how big their stacks
+  // are.  Placing workers on more than one NUMA node splits the pool
+  // into a sub-pool per node (see ThreadPoolOptions::placement).
+  PlacementOptions worker_placement;
+
+  // Whether static file requests and search queries wait for workers
+  // in separate ThreadPool lanes, so that a burst of slow queries
+  // doesn't hold up cheap file fetches.  With kLanesWeighted, the
+  // static lane gets static_lane_weight turns for every one the query
+  // lane gets; with kLanesStrict, static files always go first.
+  bool priority_lanes = false;
+  LaneScheduling lane_scheduling = kLanesWeighted;
+  uint32_t static_lane_weight = 4;
+
+  // Whether a query searches the indices in parallel, one worker per
+  // index (see ThreadPool::ParallelFor()), rather than one index after
+  // another on the worker that read it.
+  bool parallel_queries = false;
+
+  // How many accepted connections may wait for a worker thread before
+  // the server is considered overloaded, and what to do about it then;
+  // 0 means no limit.  In kEventLoop mode connections don't wait for
+  // workers, so this has no effect there.  Shed clients are told to
+  // come back in retry_after_secs seconds.
+  uint32_t max_queued = 0;
+  OverloadPolicy overload_policy = kOverloadShed;
+  uint32_t retry_after_secs = 1;
+
+  // How much of its client's input each connection will hold (see
+  // HttpConnectionLimits).
+  HttpConnectionLimits connection_limits;
+
+  // How many requests a client has pipelined, i.e., sent without
+  // waiting for the responses to the ones before, are answered before
+  // their responses are written out together in one go.  Responses are
+  // also written whenever the client has nothing more buffered.  1
+  // writes each response as soon as it's ready.  (In kEventLoop mode,
+  // connections always answer one request at a time.)
+  uint32_t pipeline_batch = 32;
+
+  // How long a connection may sit idle between requests, and how long a
+  // client may take to send the rest of a request header once it has
+  // started, before the server hangs up on it (see ConnectionReaper.h);
+  // 0 means forever.
+  uint32_t idle_timeout_ms = 60000;
+  uint32_t header_timeout_ms = 10000;
+
+  // How long a client may go without taking any of a response the
+  // server is writing to it before the server hangs up on it; 0 means
+  // forever.
+  uint32_t write_timeout_ms = 30000;
+
+  // Once the server stops accepting, how long the connections still
+  // open get to finish what they are doing before the server hangs up
+  // on them (see ConnectionReaper::Drain()).
+  uint32_t drain_timeout_ms = 10000;
+
+  // If not empty, the path of a Unix socket at which to meet other
+  // server processes (see ListenerHandoff.h): on startup, the server
+  // takes over the listening sockets of whatever server is already
+  // running there instead of opening its own, and while it runs, it
+  // hands its listening sockets over to the next server to start up
+  // there and then drains.
+  std::string handoff_path;
+
+  // If not empty, the path of a Unix domain socket to listen on as well
+  // as the TCP port, for a reverse proxy on the same host to connect to
+  // (see ServerSocket::BindUnix()).  With unix_only set, the server
+  // listens only there.
+  std::string unix_path;
+  bool unix_only = false;
+};
+
+// What the tasks serving a server's connections need from it while it
+// runs.  HttpServer::Run() fills one in, and every task points at it,
+// rather than each getting copies of its own.
+struct HttpServerContext {
+  const std::string* base_dir;
+  const std::list<std::string>* indices;
+
+  // In kParkIdle mode, where to park a connection between requests;
+  // null otherwise.
+  IdleConnectionSet* idle_set;
+
+  // Who enforces the connections' idle and header deadlines, and how
+  // much each connection buffers.
+  ConnectionReaper* reaper;
+  HttpConnectionLimits limits;
+
+  // The most responses to pipelined requests to write in one go.
+  uint32_t pipeline_batch;
+
+  // With priority lanes, the pool to requeue a connection on when it
+  // has a query to run; null otherwise.
+  ThreadPool* pool;
+
+  // With parallel queries, the pool to search the indices on; null
+  // otherwise.
+  ThreadPool* query_pool;
+
+  // In kCoroutine mode, what connections wait for their clients on;
+  // null otherwise.
+  Reactor* reactor;
+};
+
 // The HttpServer class contains the main logic for the web server.
 class HttpServer {
  public:
@@ -30,40 +231,135 @@ class HttpServer {
   // does not do anything except memorize these variables.
   explicit HttpServer(uint16_t port,
                       const std::string& static_file_dir_path,
-                      const std::list<std::string>& indices)
+                      const std::list<std::string>& indices,
+                      const HttpServerOptions& options = HttpServerOptions())
     : socket_(port), static_file_dir_path_(static_file_dir_path),
-      indices_(indices) { }
+      indices_(indices), options_(options), pool_(nullptr),
+      idle_set_(nullptr), reaper_(nullptr), handoff_(nullptr),
+      context_(), num_shed_(0) {
+    pthread_mutex_init(&status_lock_, nullptr);
+  }
 
   // The destructor closes the listening socket if it is open and
   // also terminates any threads in the threadpool.
-  virtual ~HttpServer() { }
+  virtual ~HttpServer() { pthread_mutex_destroy(&status_lock_); }
 
   // Creates a listening socket for the server and launches it, accepting
   // connections and dispatching them to worker threads.
   //
   // Returns: true if the server was able to start and run and false otherwise.
   //
-  // The server continues to run until a kill command is used to send
-  // a SIGTERM signal to the server process (i.e., kill pid, ctrl+C).
+  // The server continues to run until Drain() is called, or it hands
+  // its listening sockets off to another server (see
+  // HttpServerOptions::handoff_path).  It then stops accepting and
+  // waits up to options.drain_timeout_ms for the connections it has
+  // open to finish their requests before returning.
   bool Run();
 
+  // Makes Run() stop accepting connections, drain the ones it has, and
+  // return.  Safe to call from any thread, e.g., one handling SIGTERM.
+  void Drain();
+
+  // Whether the server is winding down the connections it has open.
+  // Responses sent while draining are the connection's last.
+  bool draining() const {
+    return reaper_ != nullptr && reaper_->draining();
+  }
+
+  const std::string& static_file_dir_path() const {
+    return static_file_dir_path_;
+  }
+  const std::list<std::string>& indices() const { return indices_; }
+
+  // The server's listening socket(s), e.g., for their accept counts.
+  const ServerSocket& socket() const { return socket_; }
+
+  // The number of connections turned away with a 503 because the
+  // server was overloaded.
+  uint64_t num_shed() const { return num_shed_; }
+
+  // Prints how many worker threads the server has right now and what
+  // they're up to.  Safe to call from any thread, e.g., one handling
+  // SIGUSR1.
+  void PrintStatus();
+
  private:
+  // Creates and starts the EventLoops for kEventLoop mode.
+  bool StartEventLoops();
+
+  // Runs an accept loop on each of the "num_acceptors" listeners, one
+  // of them on the calling thread, until accepting fails.
+  void RunAcceptors(uint32_t num_acceptors);
+  static void* AcceptThread(void* arg);
+
+  // Accepts connections on listener number "listener" until accepting
+  // fails, handing each one off as options_.mode says.
+  void AcceptLoop(uint32_t listener);
+
+  // Sends a 503 down "client_fd" and closes it.
+  void Shed(int client_fd);
+
+  // The handoff thread's start routine: waits for another server to
+  // take over the listening sockets, and then drains.
+  static void* HandoffThread(void* arg);
+
   ServerSocket socket_;
   std::string static_file_dir_path_;
   std::list<std::string> indices_;
-  static const int kNumThreads;
+  HttpServerOptions options_;
+
+  // What the accept loops hand connections to while Run() is running.
+  // PrintStatus() looks at pool_ under status_lock_, which Run() holds
+  // to set and clear it.
+  ThreadPool* pool_;
+  pthread_mutex_t status_lock_;
+  IdleConnectionSet* idle_set_;                   // kParkIdle only
+  ConnectionReaper* reaper_;
+  ListenerHandoff* handoff_;
+  std::vector<std::unique_ptr<EventLoop>> loops_;  // kEventLoop only
+  HttpServerContext context_;
+
+  std::atomic<uint64_t> num_shed_;
 };
 
 class HttpServerTask : public ThreadPool::Task {
  public:
-  explicit HttpServerTask(ThreadPool::thread_task_fn f)
-    : ThreadPool::Task(f) { }
+  HttpServerTask()
+    : ThreadPool::Task(nullptr), client_fd(-1), c_port(0),
+      context(nullptr), has_pending(false) { }
+
+  // Takes a task out of a SlabPool (see SlabPool.h) rather than
+  // allocating one, ready to run "f" for a new client of the server
+  // that "context" describes.
+  static HttpServerTask* Get(ThreadPool::thread_task_fn f,
+                             const HttpServerContext* context);
+
+  // Hangs up on the task's client, if it got as far as connecting, and
+  // returns the task to the pool, where its strings and its
+  // connection's buffer keep their memory for the next client.
+  static void Put(HttpServerTask* task);
+
+  // Put()s the task, for a std::unique_ptr<HttpServerTask, Deleter>.
+  struct Deleter {
+    void operator()(HttpServerTask* task) const { Put(task); }
+  };
 
   int client_fd;
   uint16_t c_port;
   std::string c_addr, c_dns, s_addr, s_dns;
-  std::string base_dir;
-  std::list<std::string>* indices;
+
+  // What the task needs from the server, shared with every other task.
+  const HttpServerContext* context;
+
+  // With priority lanes, the query the connection runs once its turn
+  // in the query lane comes.
+  HttpRequest pending;
+  bool has_pending;
+
+  // The connection to the client, opened the first time a worker picks
+  // up the task.  It lives here rather than on the worker's stack so
+  // that its buffer survives a trip through the idle set.
+  HttpConnection connection;
 };
 
 }  // namespace hw4
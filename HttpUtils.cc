@@ -16,6 +16,8 @@
 #include <errno.h>
 #include <limits.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string.hpp>
 #include <stdint.h>
@@ -164,10 +166,13 @@ void URLParser::Parse(const string& url) {
 
   if (ps.size() < 2)
     return;
+  ParseArgs(ps[1]);
+}
 
+void URLParser::ParseArgs(const string& args) {
   // Split the args into each field=val; chunk.
   vector<string> vals;
-  boost::split(vals, ps[1], boost::is_any_of("&"));
+  boost::split(vals, args, boost::is_any_of("&"));
 
   // Iterate through the chunks.
   for (unsigned int i = 0; i < vals.size(); i++) {
@@ -219,6 +224,47 @@ int WrappedWrite(int fd, const unsigned char* buf, int write_len) {
   return written_so_far;
 }
 
+void AdvanceIovec(struct iovec** iov, int* iovcnt, size_t len) {
+  while (*iovcnt > 0 && len >= (*iov)->iov_len) {
+    len -= (*iov)->iov_len;
+    (*iov)++;
+    (*iovcnt)--;
+  }
+  if (*iovcnt > 0) {
+    (*iov)->iov_base = static_cast<char*>((*iov)->iov_base) + len;
+    (*iov)->iov_len -= len;
+  }
+}
+
+bool DrainSocket(int fd) {
+  unsigned char buf[4096];
+  for (int i = 0; i < 16; i++) {
+    ssize_t res = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (res > 0)
+      continue;
+    if (res == -1 && errno == EINTR)
+      continue;
+    return !(res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK));
+  }
+  return false;
+}
+
+void CloseAfterResponse(int fd) {
+  shutdown(fd, SHUT_WR);
+  DrainSocket(fd);
+  close(fd);
+}
+
+bool SetTcpNoDelay(int fd) {
+  int on = 1;
+  return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == 0;
+}
+
+bool SetTcpCork(int fd, bool cork) {
+  int on = cork ? 1 : 0;
+  return setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on)) == 0;
+}
+
 bool ConnectToServer(const string& host_name, uint16_t port_num,
                      int* client_fd) {
   struct addrinfo hints;
@@ -16,6 +16,7 @@
 #define HW4_HTTPUTILS_H_
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include <string>
 #include <utility>
@@ -75,6 +76,10 @@ class URLParser {
 
   void Parse(const std::string& url);
 
+  // Parses "field=value&field=value..." args, e.g., the part of a url
+  // after the "?", or a form-encoded POST body, into args().
+  void ParseArgs(const std::string& args);
+
   // Return the "path" component of the url, post-uri-decoding.
   std::string path() const { return path_; }
 
@@ -114,6 +119,33 @@ int WrappedRead(int fd, unsigned char* buf, int read_len);
 // like the connection being dropped.
 int WrappedWrite(int fd, const unsigned char* buf, int write_len);
 
+// Drops the first "len" bytes from the "*iovcnt" buffers in "*iov", as
+// after a partial writev(), by advancing "*iov" past the buffers that
+// were written in full and trimming the first one that wasn't.
+void AdvanceIovec(struct iovec** iov, int* iovcnt, size_t len);
+
+// Reads and throws away whatever is waiting on the socket fd, without
+// blocking, and reading no more than a few buffers' worth so that a
+// client that keeps sending can't hold the caller up.  Returns true if
+// the peer has hung up (or the socket has failed), and false if it may
+// still send more.
+bool DrainSocket(int fd);
+
+// Closes the socket fd after a final response has been written to it.
+// If the client's request is still sitting unread in the receive
+// buffer, a plain close() makes the kernel send a reset, which can
+// reach the client before it has read the response and throw the
+// response away.  So this sends a FIN first and drains what the client
+// has already sent before closing.  (ConnectionReaper::Linger() also
+// waits for what the client hasn't sent yet.)
+void CloseAfterResponse(int fd);
+
+// Turn Nagle's algorithm off, or TCP_CORK on or off, for the socket fd.
+// Corking holds back partial segments until the socket is uncorked,
+// which flushes them.  Both return false if fd isn't a TCP socket.
+bool SetTcpNoDelay(int fd);
+bool SetTcpCork(int fd, bool cork);
+
 // A convenience routine to manufacture a (blocking) socket to the
 // host_name and port number provided as arguments.  Hostname can
 // be a DNS name or an IP address, in string form.  On success,
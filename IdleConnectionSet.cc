@@ -0,0 +1,173 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>         // for errno
+#include <stdint.h>        // for uint64_t
+#include <unistd.h>        // for read(), write(), close()
+#include <sys/epoll.h>     // for epoll_create1(), epoll_wait(), etc.
+#include <sys/eventfd.h>   // for eventfd()
+#include <sys/socket.h>    // for shutdown()
+#include <list>
+#include <map>
+
+#include "./IdleConnectionSet.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::list;
+using std::map;
+
+namespace hw4 {
+
+// The most events we pull out of the kernel per epoll_wait().
+static const int kMaxEvents = 256;
+
+IdleConnectionSet::IdleConnectionSet(ThreadPool* pool)
+  : pool_(pool), epoll_fd_(-1), wake_fd_(-1), running_(false) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+IdleConnectionSet::~IdleConnectionSet() {
+  Stop();
+  if (wake_fd_ != -1)
+    close(wake_fd_);
+  if (epoll_fd_ != -1)
+    close(epoll_fd_);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool IdleConnectionSet::Start() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ == -1) {
+    return false;
+  }
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ == -1) {
+    return false;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = wake_fd_;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) == -1) {
+    return false;
+  }
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  running_ = true;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  if (pthread_create(&thread_, nullptr, &WatchThread,
+                     static_cast<void*>(this)) != 0) {
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    running_ = false;
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return false;
+  }
+  return true;
+}
+
+void IdleConnectionSet::Stop() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (!running_) {
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return;
+  }
+  running_ = false;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+  uint64_t one = 1;
+  Verify333(write(wake_fd_, &one, sizeof(one)) == sizeof(one));
+  Verify333(pthread_join(thread_, nullptr) == 0);
+
+  // Park() refuses new connections now, and the watcher is gone, so
+  // parked_ is ours.  Hang up on every parked client and let its Task
+  // run once more to notice the EOF and clean up.
+  for (auto& entry : parked_) {
+    shutdown(entry.first, SHUT_RDWR);
+    pool_->Dispatch(entry.second);
+  }
+  parked_.clear();
+}
+
+bool IdleConnectionSet::Park(int fd, ThreadPool::Task* task) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (!running_) {
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return false;
+  }
+
+  // The registration is one-shot, so it goes dormant after it fires
+  // rather than disappearing; re-arm it if this socket has been parked
+  // before, and add it otherwise.
+  parked_[fd] = task;
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  ev.data.fd = fd;
+  int res = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+  if (res == -1 && errno == ENOENT) {
+    res = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+  }
+  if (res == -1) {
+    parked_.erase(fd);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return res == 0;
+}
+
+uint32_t IdleConnectionSet::num_parked() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  uint32_t num = parked_.size();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return num;
+}
+
+void* IdleConnectionSet::WatchThread(void* set) {
+  static_cast<IdleConnectionSet*>(set)->Watch();
+  return nullptr;
+}
+
+// The watcher thread's main loop: wait for parked sockets to become
+// readable, and hand their Tasks back to the ThreadPool.
+void IdleConnectionSet::Watch() {
+  struct epoll_event events[kMaxEvents];
+
+  while (1) {
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (num_events == -1 && errno != EINTR) {
+      break;
+    }
+
+    list<ThreadPool::Task*> ready;
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    if (!running_) {
+      Verify333(pthread_mutex_unlock(&lock_) == 0);
+      break;
+    }
+    for (int i = 0; i < num_events; i++) {
+      map<int, ThreadPool::Task*>::iterator it =
+        parked_.find(events[i].data.fd);
+      if (it != parked_.end()) {
+        ready.push_back(it->second);
+        parked_.erase(it);
+      }
+    }
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+    // Dispatch with the lock released; a worker may want to Park()
+    // again before we're done.
+    for (ThreadPool::Task* task : ready) {
+      pool_->Dispatch(task);
+    }
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,87 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_IDLECONNECTIONSET_H_
+#define HW4_IDLECONNECTIONSET_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <stdint.h>   // for uint32_t, etc.
+#include <map>        // for std::map
+
+#include "./ThreadPool.h"
+
+namespace hw4 {
+
+// An IdleConnectionSet lets worker threads put a connection down
+// between requests instead of blocking on it.  A worker that has
+// answered every request a client sent so far calls Park() with the
+// client's socket and the Task that serves it, and then returns to the
+// ThreadPool.  The set watches all parked sockets with a single epoll
+// instance and a single thread; as soon as one becomes readable (or
+// the client hangs up), its Task is handed back to the ThreadPool with
+// Dispatch(), just as if it had been freshly accepted.
+//
+// This keeps the simple blocking request-handling code, but a worker
+// is only occupied while a client actually has bytes in flight, so a
+// crowd of idle keep-alive clients can't starve the pool.
+class IdleConnectionSet {
+ public:
+  // Creates a new IdleConnectionSet that re-dispatches woken Tasks to
+  // "pool".  The constructor does not create the epoll instance or the
+  // watcher thread; Start() does.
+  explicit IdleConnectionSet(ThreadPool* pool);
+
+  // Stops the set if it was started.  See Stop().
+  virtual ~IdleConnectionSet();
+
+  // Creates the epoll instance and spawns the watcher thread.  Returns
+  // false if any of the underlying system calls fail.
+  bool Start();
+
+  // Stops the watcher thread.  Every still-parked connection is shut
+  // down and its Task dispatched one last time, so that the Task's
+  // function sees EOF and cleans up after itself.  The ThreadPool must
+  // still be accepting work when Stop() is called.
+  void Stop();
+
+  // Parks "task" until "fd" becomes readable, at which point the set
+  // passes "task" to ThreadPool::Dispatch().  The caller gives up
+  // ownership of "task" (but not of "fd") in the meantime, and must not
+  // touch either until the task is dispatched again.  Returns false,
+  // without taking ownership, if the set isn't running; the caller
+  // should then keep serving the connection itself.
+  bool Park(int fd, ThreadPool::Task* task);
+
+  // The number of connections currently parked.
+  uint32_t num_parked();
+
+ private:
+  static void* WatchThread(void* set);
+  void Watch();
+
+  ThreadPool* pool_;
+  int epoll_fd_;
+  int wake_fd_;  // an eventfd Stop() uses to wake the watcher thread
+  pthread_t thread_;
+  bool running_;
+
+  // Guards parked_ and running_.  parked_ maps each parked socket to
+  // the Task that is waiting on it.
+  pthread_mutex_t lock_;
+  std::map<int, ThreadPool::Task*> parked_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_IDLECONNECTIONSET_H_
@@ -0,0 +1,404 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>        // for errno
+#include <fcntl.h>        // for O_RDONLY, AT_FDCWD
+#include <stdlib.h>       // for free()
+#include <sys/uio.h>      // for readv(), writev()
+#include <unistd.h>       // for read(), write()
+#include <atomic>
+#include <memory>
+#include <string>
+
+extern "C" {
+  #include "libhw2/FileParser.h"
+}
+
+#include "./IoEngine.h"
+#include "./IoUring.h"
+
+using std::string;
+using std::unique_ptr;
+
+namespace hw4 {
+
+///////////////////////////////////////////////////////////////////////////////
+// SyscallIoEngine: the way the server has always done its I/O.
+///////////////////////////////////////////////////////////////////////////////
+
+// Counts the system calls each thread makes through SyscallIoEngine.
+static thread_local uint64_t syscall_count = 0;
+
+class SyscallIoEngine : public IoEngine {
+ public:
+  int Accept(int listen_fd, struct sockaddr* addr,
+             socklen_t* addr_len) override {
+    syscall_count++;
+    return accept(listen_fd, addr, addr_len);
+  }
+
+  int Read(int fd, unsigned char* buf, int read_len) override {
+    int res;
+    while (1) {
+      syscall_count++;
+      res = read(fd, buf, read_len);
+      if (res == -1) {
+        if ((errno == EAGAIN) || (errno == EINTR))
+          continue;
+      }
+      break;
+    }
+    return res;
+  }
+
+  int Write(int fd, const unsigned char* buf, int write_len) override {
+    int res, written_so_far = 0;
+    while (written_so_far < write_len) {
+      syscall_count++;
+      res = write(fd, buf + written_so_far, write_len - written_so_far);
+      if (res == -1) {
+        if ((errno == EAGAIN) || (errno == EINTR))
+          continue;
+        break;
+      }
+      if (res == 0)
+        break;
+      written_so_far += res;
+    }
+    return written_so_far;
+  }
+
+  int Writev(int fd, const struct iovec* iov, int iovcnt) override {
+    while (1) {
+      syscall_count++;
+      int res = writev(fd, iov, iovcnt);
+      if (res == -1 && ((errno == EAGAIN) || (errno == EINTR)))
+        continue;
+      return res;
+    }
+  }
+
+  int Readv(int fd, const struct iovec* iov, int iovcnt) override {
+    while (1) {
+      syscall_count++;
+      int res = readv(fd, iov, iovcnt);
+      if (res == -1 && ((errno == EAGAIN) || (errno == EINTR)))
+        continue;
+      return res;
+    }
+  }
+
+  bool ReadFile(const string& path, string* const contents) override {
+    // ReadFileToString() does a stat(), open(), read() and close().
+    syscall_count += 4;
+    int size = 0;
+    char* res = ReadFileToString(path.c_str(), &size);
+    if (res == NULL) {
+      return false;
+    }
+    *contents = string(res, size);
+    free(res);
+    return true;
+  }
+
+  IoEngineKind kind() const override { return kIoSyscalls; }
+  const char* name() const override { return "syscalls"; }
+  uint64_t num_syscalls() const override { return syscall_count; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// UringIoEngine: the same operations, submitted through io_uring.
+///////////////////////////////////////////////////////////////////////////////
+
+// Each thread's ring is this big, and has one registered buffer of
+// kFileBufLen bytes that file reads land in, and a fixed file table
+// with one slot that files are opened into.  Using a registered buffer
+// and a fixed file saves the kernel from pinning the buffer and
+// looking up the fd on every request.
+static const uint32_t kRingEntries = 8;
+static const int kFileBufLen = 64 * 1024;
+static const uint32_t kFileSlot = 0;
+
+// The operations the engine needs the kernel to support.
+static const uint8_t kUringOps[] = {
+  IORING_OP_READ, IORING_OP_READV, IORING_OP_WRITE, IORING_OP_WRITEV,
+  IORING_OP_OPENAT, IORING_OP_READ_FIXED, IORING_OP_CLOSE
+};
+
+// A thread's io_uring, and the registered buffer that goes with it.
+struct UringThread {
+  IoUring ring;
+  unsigned char file_buf[kFileBufLen];
+
+  // Sets up the ring; returns false if the kernel isn't up to it.
+  bool Init() {
+    struct iovec iov;
+    iov.iov_base = file_buf;
+    iov.iov_len = sizeof(file_buf);
+    return ring.Init(kRingEntries) &&
+           ring.SupportsOps(kUringOps, sizeof(kUringOps)) &&
+           ring.RegisterBuffers(&iov, 1) &&
+           ring.RegisterFiles(1);
+  }
+};
+
+class UringIoEngine : public IoEngine {
+ public:
+  explicit UringIoEngine(IoEngine* fallback) : fallback_(fallback) { }
+
+  // io_uring ignores O_NONBLOCK on a listening socket and waits for a
+  // connection anyway, which would leave an accept thread deaf to
+  // ServerSocket::StopAccepting().  A lone accept costs one system call
+  // either way, so accept the old-fashioned way.
+  int Accept(int listen_fd, struct sockaddr* addr,
+             socklen_t* addr_len) override {
+    return fallback_->Accept(listen_fd, addr, addr_len);
+  }
+
+  int Read(int fd, unsigned char* buf, int read_len) override {
+    IoUring* ring = Ring();
+    if (ring == nullptr) {
+      return fallback_->Read(fd, buf, read_len);
+    }
+    while (1) {
+      struct io_uring_sqe* sqe = ring->GetSqe();
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(buf);
+      sqe->len = read_len;
+      sqe->off = -1;  // read from the current position, like read()
+      int res = Complete(ring);
+      if ((res == -EAGAIN) || (res == -EINTR)) {
+        continue;
+      }
+      return Result(res);
+    }
+  }
+
+  int Write(int fd, const unsigned char* buf, int write_len) override {
+    IoUring* ring = Ring();
+    if (ring == nullptr) {
+      return fallback_->Write(fd, buf, write_len);
+    }
+    int written_so_far = 0;
+    while (written_so_far < write_len) {
+      struct io_uring_sqe* sqe = ring->GetSqe();
+      sqe->opcode = IORING_OP_WRITE;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(buf + written_so_far);
+      sqe->len = write_len - written_so_far;
+      sqe->off = -1;
+      int res = Complete(ring);
+      if ((res == -EAGAIN) || (res == -EINTR)) {
+        continue;
+      }
+      if (res <= 0) {
+        Result(res);
+        break;
+      }
+      written_so_far += res;
+    }
+    return written_so_far;
+  }
+
+  int Writev(int fd, const struct iovec* iov, int iovcnt) override {
+    IoUring* ring = Ring();
+    if (ring == nullptr) {
+      return fallback_->Writev(fd, iov, iovcnt);
+    }
+    while (1) {
+      struct io_uring_sqe* sqe = ring->GetSqe();
+      sqe->opcode = IORING_OP_WRITEV;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(iov);
+      sqe->len = iovcnt;
+      sqe->off = -1;
+      int res = Complete(ring);
+      if ((res == -EAGAIN) || (res == -EINTR)) {
+        continue;
+      }
+      return Result(res);
+    }
+  }
+
+  int Readv(int fd, const struct iovec* iov, int iovcnt) override {
+    IoUring* ring = Ring();
+    if (ring == nullptr) {
+      return fallback_->Readv(fd, iov, iovcnt);
+    }
+    while (1) {
+      struct io_uring_sqe* sqe = ring->GetSqe();
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(iov);
+      sqe->len = iovcnt;
+      sqe->off = -1;
+      int res = Complete(ring);
+      if ((res == -EAGAIN) || (res == -EINTR)) {
+        continue;
+      }
+      return Result(res);
+    }
+  }
+
+  bool ReadFile(const string& path, string* const contents) override {
+    UringThread* t = Thread();
+    if (t == nullptr) {
+      return fallback_->ReadFile(path, contents);
+    }
+
+    // Open the file into our fixed file slot, read it into the
+    // registered buffer, and close it again, as a linked chain of three
+    // requests that costs a single io_uring_enter().  Files that are
+    // bigger than the buffer take one more round trip per buffer-full.
+    string result;
+    uint64_t offset = 0;
+    while (1) {
+      struct io_uring_sqe* sqe = t->ring.GetSqe();
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = reinterpret_cast<uint64_t>(path.c_str());
+      sqe->open_flags = O_RDONLY;
+      sqe->file_index = kFileSlot + 1;  // 0 means "not a direct open"
+      sqe->flags = IOSQE_IO_LINK;
+      sqe->user_data = 0;
+
+      sqe = t->ring.GetSqe();
+      sqe->opcode = IORING_OP_READ_FIXED;
+      sqe->fd = kFileSlot;
+      sqe->addr = reinterpret_cast<uint64_t>(t->file_buf);
+      sqe->len = kFileBufLen;
+      sqe->off = offset;
+      sqe->buf_index = 0;
+      sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+      sqe->user_data = 1;
+
+      // The hard link makes sure the file gets closed even if the read
+      // fails.
+      sqe = t->ring.GetSqe();
+      sqe->opcode = IORING_OP_CLOSE;
+      sqe->file_index = kFileSlot + 1;
+      sqe->user_data = 2;
+
+      if (t->ring.Submit(3) < 0) {
+        return false;
+      }
+      int res[3] = {-1, -1, -1};
+      for (int i = 0; i < 3; i++) {
+        struct io_uring_cqe cqe;
+        if (!t->ring.WaitCqe(&cqe)) {
+          return false;
+        }
+        res[cqe.user_data] = cqe.res;
+      }
+      if (res[0] < 0 || res[1] < 0) {
+        return false;
+      }
+
+      result.append(reinterpret_cast<char*>(t->file_buf), res[1]);
+      offset += res[1];
+      if (res[1] < kFileBufLen) {
+        break;
+      }
+    }
+    *contents = std::move(result);
+    return true;
+  }
+
+  IoEngineKind kind() const override { return kIoUring; }
+  const char* name() const override { return "io_uring"; }
+
+  uint64_t num_syscalls() const override {
+    UringThread* t = thread_.get();
+    return (t == nullptr ? 0 : t->ring.num_syscalls()) +
+           fallback_->num_syscalls();
+  }
+
+ private:
+  // Returns the calling thread's ring, setting it up the first time
+  // through; returns nullptr if that fails, in which case the thread
+  // does its I/O through the fallback engine instead.
+  static UringThread* Thread() {
+    if (!thread_ && !failed_) {
+      thread_.reset(new UringThread);
+      if (!thread_->Init()) {
+        thread_.reset();
+        failed_ = true;
+      }
+    }
+    return thread_.get();
+  }
+
+  static IoUring* Ring() {
+    UringThread* t = Thread();
+    return t == nullptr ? nullptr : &t->ring;
+  }
+
+  // Submits the single request just prepared on "ring" and returns its
+  // result: non-negative on success, or a negated errno value.
+  static int Complete(IoUring* ring) {
+    if (ring->Submit(1) < 0) {
+      return -errno;
+    }
+    struct io_uring_cqe cqe;
+    if (!ring->WaitCqe(&cqe)) {
+      return -errno;
+    }
+    return cqe.res;
+  }
+
+  // Converts a result from Complete() into the return value and errno
+  // that the equivalent system call would have produced.
+  static int Result(int res) {
+    if (res < 0) {
+      errno = -res;
+      return -1;
+    }
+    return res;
+  }
+
+  IoEngine* fallback_;
+  static thread_local unique_ptr<UringThread> thread_;
+  static thread_local bool failed_;
+};
+
+thread_local unique_ptr<UringThread> UringIoEngine::thread_;
+thread_local bool UringIoEngine::failed_ = false;
+
+///////////////////////////////////////////////////////////////////////////////
+// Engine selection
+///////////////////////////////////////////////////////////////////////////////
+
+static SyscallIoEngine syscall_engine;
+static UringIoEngine uring_engine(&syscall_engine);
+static std::atomic<IoEngine*> engine(&syscall_engine);
+
+IoEngine* IoEngine::Get() {
+  return engine.load(std::memory_order_acquire);
+}
+
+bool IoEngine::Select(IoEngineKind kind) {
+  if (kind == kIoSyscalls) {
+    engine.store(&syscall_engine, std::memory_order_release);
+    return true;
+  }
+
+  // Make sure this kernel can give us everything a server thread will
+  // ask for before switching over.
+  unique_ptr<UringThread> probe(new UringThread);
+  if (!probe->Init()) {
+    return false;
+  }
+  engine.store(&uring_engine, std::memory_order_release);
+  return true;
+}
+
+}  // namespace hw4
@@ -0,0 +1,86 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_IOENGINE_H_
+#define HW4_IOENGINE_H_
+
+#include <stdint.h>      // for uint64_t
+#include <sys/socket.h>  // for struct sockaddr, socklen_t
+#include <sys/uio.h>     // for struct iovec
+#include <string>        // for std::string
+
+namespace hw4 {
+
+// The ways the server can talk to the kernel.
+enum IoEngineKind {
+  kIoSyscalls,  // one read()/write()/accept()/etc. per operation
+  kIoUring      // batched through a per-thread io_uring
+};
+
+// An IoEngine does the blocking I/O on the server's request path:
+// accepting connections, reading requests, writing responses, and
+// reading static files.  There is one engine for the whole process;
+// IoEngine::Get() returns it, and IoEngine::Select() picks which one
+// it is.  All engines are thread-safe.
+class IoEngine {
+ public:
+  virtual ~IoEngine() { }
+
+  // Returns the process's engine.  Until Select() says otherwise, this
+  // is the plain system call engine.
+  static IoEngine* Get();
+
+  // Makes the engine of kind "kind" the process's engine.  Returns
+  // false, leaving the current engine in place, if this kernel can't
+  // support that kind.  Call this before starting any server threads.
+  static bool Select(IoEngineKind kind);
+
+  // Accepts a connection on "listen_fd" and returns its fd, filling in
+  // "addr" and "addr_len" like accept() does.  Like accept(), this
+  // waits for a connection only if "listen_fd" is blocking; on a
+  // non-blocking one it fails with EAGAIN instead.  Returns -1 with
+  // errno set on failure.
+  virtual int Accept(int listen_fd, struct sockaddr* addr,
+                     socklen_t* addr_len) = 0;
+
+  // Like WrappedRead() and WrappedWrite() from HttpUtils.h: Read()
+  // returns the number of bytes read, 0 on EOF, or -1 on error, and
+  // Write() returns the number of bytes written, which is less than
+  // "write_len" only on error.
+  virtual int Read(int fd, unsigned char* buf, int read_len) = 0;
+  virtual int Write(int fd, const unsigned char* buf, int write_len) = 0;
+
+  // Writes the "iovcnt" buffers in "iov" to "fd" in one gather write,
+  // like a single writev() that retries on EINTR and EAGAIN.  Returns
+  // the number of bytes written, which may be short, or -1 on error.
+  virtual int Writev(int fd, const struct iovec* iov, int iovcnt) = 0;
+
+  // Reads from "fd" into the "iovcnt" buffers in "iov" in one scatter
+  // read, like a single readv() that retries on EINTR and EAGAIN.
+  // Returns the number of bytes read, 0 on EOF, or -1 on error.
+  virtual int Readv(int fd, const struct iovec* iov, int iovcnt) = 0;
+
+  // Reads the whole file at "path" into "contents".  Returns false if
+  // the file can't be opened or read.
+  virtual bool ReadFile(const std::string& path,
+                        std::string* const contents) = 0;
+
+  virtual IoEngineKind kind() const = 0;
+  virtual const char* name() const = 0;
+
+  // The number of system calls the calling thread has made through
+  // this engine.
+  virtual uint64_t num_syscalls() const = 0;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_IOENGINE_H_
@@ -0,0 +1,242 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>        // for errno
+#include <stdlib.h>       // for calloc(), free()
+#include <string.h>       // for memset()
+#include <sys/mman.h>     // for mmap(), munmap()
+#include <sys/syscall.h>  // for SYS_io_uring_*
+#include <unistd.h>       // for syscall(), close()
+
+#include "./IoUring.h"
+
+namespace hw4 {
+
+// glibc has no wrappers for the io_uring system calls.
+static int io_uring_setup(uint32_t entries, struct io_uring_params* p) {
+  return syscall(SYS_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+                          uint32_t flags) {
+  return syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags,
+                 nullptr, 0);
+}
+
+static int io_uring_register(int fd, uint32_t opcode, const void* arg,
+                             uint32_t nr_args) {
+  return syscall(SYS_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// The ring indices are shared with the kernel, so reads of the indices
+// it writes need acquire semantics and our writes need release.
+static unsigned LoadAcquire(const unsigned* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void StoreRelease(unsigned* p, unsigned v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+IoUring::IoUring()
+  : ring_fd_(-1), sq_ptr_(MAP_FAILED), sq_size_(0), cq_ptr_(MAP_FAILED),
+    cq_size_(0), sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+    sqes_size_(0), sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(nullptr),
+    sq_array_(nullptr), sq_entries_(0), cq_head_(nullptr), cq_tail_(nullptr),
+    cq_mask_(nullptr), cqes_(nullptr), sqe_head_(0), sqe_tail_(0),
+    num_syscalls_(0) { }
+
+IoUring::~IoUring() {
+  if (sqes_ != MAP_FAILED) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+    munmap(cq_ptr_, cq_size_);
+  }
+  if (sq_ptr_ != MAP_FAILED) {
+    munmap(sq_ptr_, sq_size_);
+  }
+  if (ring_fd_ != -1) {
+    close(ring_fd_);
+  }
+}
+
+bool IoUring::Init(uint32_t entries) {
+  if (ring_fd_ != -1) {
+    return false;
+  }
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  num_syscalls_++;
+  ring_fd_ = io_uring_setup(entries, &p);
+  if (ring_fd_ < 0) {
+    ring_fd_ = -1;
+    return false;
+  }
+
+  // Map the submission and completion rings.  Newer kernels let us map
+  // both with one mmap().
+  sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    if (cq_size_ > sq_size_) {
+      sq_size_ = cq_size_;
+    }
+    cq_size_ = sq_size_;
+  }
+  num_syscalls_++;
+  sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ptr_ == MAP_FAILED) {
+    return false;
+  }
+  if (single_mmap) {
+    cq_ptr_ = sq_ptr_;
+  } else {
+    num_syscalls_++;
+    cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED) {
+      return false;
+    }
+  }
+  sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+  num_syscalls_++;
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+
+  char* sq = static_cast<char*>(sq_ptr_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+  sq_entries_ = p.sq_entries;
+
+  char* cq = static_cast<char*>(cq_ptr_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+  sqe_head_ = sqe_tail_ = *sq_tail_;
+  return true;
+}
+
+bool IoUring::SupportsOps(const uint8_t* ops, int num_ops) {
+  if (ring_fd_ == -1) {
+    return false;
+  }
+
+  size_t len = sizeof(struct io_uring_probe) +
+               256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe =
+    static_cast<struct io_uring_probe*>(calloc(1, len));
+  if (probe == nullptr) {
+    return false;
+  }
+  num_syscalls_++;
+  bool ok = io_uring_register(ring_fd_, IORING_REGISTER_PROBE, probe, 256)
+            == 0;
+  for (int i = 0; ok && i < num_ops; i++) {
+    ok = ops[i] <= probe->last_op &&
+         (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED) != 0;
+  }
+  free(probe);
+  return ok;
+}
+
+struct io_uring_sqe* IoUring::GetSqe() {
+  if (ring_fd_ == -1 ||
+      sqe_tail_ - LoadAcquire(sq_head_) >= sq_entries_) {
+    return nullptr;
+  }
+  struct io_uring_sqe* sqe = &sqes_[sqe_tail_ & *sq_mask_];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe_tail_++;
+  return sqe;
+}
+
+int IoUring::Submit(uint32_t wait_nr) {
+  // Publish the new entries to the kernel.  We always use the identity
+  // mapping between the index array and the SQE array.
+  unsigned to_submit = sqe_tail_ - sqe_head_;
+  for (; sqe_head_ != sqe_tail_; sqe_head_++) {
+    sq_array_[sqe_head_ & *sq_mask_] = sqe_head_ & *sq_mask_;
+  }
+  StoreRelease(sq_tail_, sqe_tail_);
+
+  if (to_submit == 0 && wait_nr == 0) {
+    return 0;
+  }
+  uint32_t flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+  while (1) {
+    num_syscalls_++;
+    int res = io_uring_enter(ring_fd_, to_submit, wait_nr, flags);
+    if (res >= 0) {
+      return res;
+    }
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+}
+
+bool IoUring::WaitCqe(struct io_uring_cqe* const cqe) {
+  while (1) {
+    unsigned head = *cq_head_;
+    if (head != LoadAcquire(cq_tail_)) {
+      *cqe = cqes_[head & *cq_mask_];
+      StoreRelease(cq_head_, head + 1);
+      return true;
+    }
+
+    // Nothing there yet; wait for the kernel to post something.
+    num_syscalls_++;
+    if (io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+        errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+bool IoUring::RegisterBuffers(const struct iovec* bufs, uint32_t num_bufs) {
+  num_syscalls_++;
+  return io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS, bufs,
+                           num_bufs) == 0;
+}
+
+bool IoUring::RegisterFiles(uint32_t num_files) {
+  struct io_uring_rsrc_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.nr = num_files;
+  reg.flags = IORING_RSRC_REGISTER_SPARSE;
+  num_syscalls_++;
+  return io_uring_register(ring_fd_, IORING_REGISTER_FILES2, &reg,
+                           sizeof(reg)) == 0;
+}
+
+bool IoUring::UpdateFile(uint32_t slot, int fd) {
+  struct io_uring_files_update update;
+  memset(&update, 0, sizeof(update));
+  update.offset = slot;
+  update.fds = reinterpret_cast<uint64_t>(&fd);
+  num_syscalls_++;
+  return io_uring_register(ring_fd_, IORING_REGISTER_FILES_UPDATE, &update,
+                           1) == 1;
+}
+
+}  // namespace hw4
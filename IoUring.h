@@ -0,0 +1,107 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_IOURING_H_
+#define HW4_IOURING_H_
+
+#include <linux/io_uring.h>  // for struct io_uring_sqe, IORING_OP_*, etc.
+#include <stdint.h>          // for uint32_t, etc.
+#include <sys/uio.h>         // for struct iovec
+
+namespace hw4 {
+
+// An IoUring is a minimal wrapper around one Linux io_uring instance,
+// talking to the kernel through the raw io_uring_setup(),
+// io_uring_enter() and io_uring_register() system calls (we don't
+// depend on liburing).  Callers fill in submission queue entries from
+// GetSqe(), push them all to the kernel with a single Submit(), and
+// then collect one completion per entry with WaitCqe().
+//
+// An IoUring is not thread-safe; give each thread its own.
+class IoUring {
+ public:
+  IoUring();
+
+  // Unmaps the rings and closes the io_uring fd.
+  virtual ~IoUring();
+
+  // Creates the io_uring instance with room for "entries" submissions
+  // and maps its rings.  Returns false if the kernel doesn't support
+  // io_uring (or won't let us use it).
+  bool Init(uint32_t entries);
+
+  // Returns true if the kernel supports every opcode in "ops".
+  bool SupportsOps(const uint8_t* ops, int num_ops);
+
+  // Returns a zeroed submission queue entry to fill in, or nullptr if
+  // the queue is full.  Entries go to the kernel on the next Submit().
+  struct io_uring_sqe* GetSqe();
+
+  // Submits every entry handed out by GetSqe() since the last call,
+  // and waits until at least "wait_nr" completions are available, all
+  // in one io_uring_enter().  Returns the number of entries submitted,
+  // or -1 (with errno set) on failure.
+  int Submit(uint32_t wait_nr);
+
+  // Copies the oldest completion into "cqe" and consumes it, waiting
+  // for one if necessary.  Returns false on failure.
+  bool WaitCqe(struct io_uring_cqe* const cqe);
+
+  // Registers "num_bufs" buffers for use by IORING_OP_READ_FIXED and
+  // friends; sqe->buf_index picks one.  Returns false on failure.
+  bool RegisterBuffers(const struct iovec* bufs, uint32_t num_bufs);
+
+  // Registers a table of "num_files" fixed files, all initially empty.
+  // Requests with IOSQE_FIXED_FILE set use sqe->fd as an index into the
+  // table.  Returns false on failure.
+  bool RegisterFiles(uint32_t num_files);
+
+  // Installs "fd" in slot "slot" of the fixed file table.
+  bool UpdateFile(uint32_t slot, int fd);
+
+  // The number of system calls this ring has made so far.
+  uint64_t num_syscalls() const { return num_syscalls_; }
+
+ private:
+  int ring_fd_;
+
+  // The mmap()ed regions, and their sizes.
+  void* sq_ptr_;
+  size_t sq_size_;
+  void* cq_ptr_;
+  size_t cq_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  // Pointers into the submission queue ring.
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned sq_entries_;
+
+  // Pointers into the completion queue ring.
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  struct io_uring_cqe* cqes_;
+
+  // Entries [sqe_head_, sqe_tail_) have been handed out by GetSqe() but
+  // not yet published to the kernel.
+  unsigned sqe_head_;
+  unsigned sqe_tail_;
+
+  uint64_t num_syscalls_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_IOURING_H_
@@ -0,0 +1,264 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>         // for errno
+#include <poll.h>          // for poll()
+#include <stdint.h>        // for uint64_t
+#include <string.h>        // for memset(), memcpy(), memcmp()
+#include <unistd.h>        // for close(), read(), write(), unlink()
+#include <sys/eventfd.h>   // for eventfd()
+#include <sys/socket.h>    // for socket(), sendmsg(), recvmsg(), etc.
+#include <sys/time.h>      // for struct timeval
+#include <sys/un.h>        // for struct sockaddr_un
+#include <string>
+#include <vector>
+
+#include "./ListenerHandoff.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// What the old process sends along with the file descriptors, and what
+// the new one sends back to confirm, so that neither end mistakes some
+// other program at the path for a server.
+static const char kHello[] = "http333d listeners";
+static const char kConfirm = 'K';
+
+// Fills in "addr" with "path".  Returns false if the path is too long
+// for a Unix socket address.
+static bool MakeAddress(const string& path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+    return false;
+  }
+  memcpy(addr->sun_path, path.c_str(), path.size());
+  return true;
+}
+
+ListenerHandoff::ListenerHandoff(const string& path)
+  : path_(path), listen_fd_(-1), claim_fd_(-1), handed_off_(false) {
+  stop_fd_ = eventfd(0, EFD_CLOEXEC);
+  Verify333(stop_fd_ != -1);
+}
+
+ListenerHandoff::~ListenerHandoff() {
+  if (listen_fd_ != -1) {
+    close(listen_fd_);
+    // Once we've handed off, the path belongs to our successor.
+    if (!handed_off_) {
+      unlink(path_.c_str());
+    }
+  }
+  if (claim_fd_ != -1) {
+    close(claim_fd_);
+  }
+  close(stop_fd_);
+}
+
+bool ListenerHandoff::Claim(vector<int>* const listen_fds) {
+  struct sockaddr_un addr;
+  if (!MakeAddress(path_, &addr)) {
+    return false;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return false;
+  }
+
+  // If nobody's listening (ENOENT, ECONNREFUSED), there's nothing to
+  // claim.  Don't wait forever on a process that is, but is stuck.
+  struct timeval timeout;
+  timeout.tv_sec = kConfirmTimeoutMs / 1000;
+  timeout.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+              sizeof(addr)) != 0) {
+    close(fd);
+    return false;
+  }
+
+  char hello[sizeof(kHello)];
+  struct iovec iov;
+  iov.iov_base = hello;
+  iov.iov_len = sizeof(hello);
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * kMaxListeners)];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t res;
+  do {
+    res = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+  } while (res == -1 && errno == EINTR);
+
+  // Whatever happens next, we own any descriptors that came through.
+  vector<int> fds;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+      fds.insert(fds.end(), data, data + num_fds);
+    }
+  }
+
+  if (res != static_cast<ssize_t>(sizeof(hello)) ||
+      memcmp(hello, kHello, sizeof(hello)) != 0 ||
+      (msg.msg_flags & MSG_CTRUNC) || fds.empty()) {
+    for (int listen_fd : fds)
+      close(listen_fd);
+    close(fd);
+    return false;
+  }
+
+  claim_fd_ = fd;
+  *listen_fds = fds;
+  return true;
+}
+
+void ListenerHandoff::Confirm() {
+  if (claim_fd_ == -1) {
+    return;
+  }
+  ssize_t res;
+  do {
+    res = write(claim_fd_, &kConfirm, 1);
+  } while (res == -1 && errno == EINTR);
+  close(claim_fd_);
+  claim_fd_ = -1;
+}
+
+bool ListenerHandoff::Listen() {
+  struct sockaddr_un addr;
+  if (!MakeAddress(path_, &addr)) {
+    return false;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return false;
+  }
+
+  // Whatever is at the path is either our predecessor's socket, which it
+  // is done with once we've confirmed, or a leftover from a server that
+  // crashed.
+  unlink(path_.c_str());
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(fd, 1) != 0) {
+    close(fd);
+    return false;
+  }
+  listen_fd_ = fd;
+  return true;
+}
+
+bool ListenerHandoff::Serve(const vector<int>& listen_fds) {
+  if (listen_fd_ == -1 || listen_fds.empty() ||
+      listen_fds.size() > kMaxListeners) {
+    return false;
+  }
+
+  while (WaitReadable(listen_fd_, -1)) {
+    int conn_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn_fd == -1) {
+      if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED) {
+        continue;
+      }
+      return false;
+    }
+
+    bool confirmed = HandOff(conn_fd, listen_fds);
+    close(conn_fd);
+    if (confirmed) {
+      handed_off_ = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ListenerHandoff::Stop() {
+  uint64_t one = 1;
+  Verify333(write(stop_fd_, &one, sizeof(one)) == sizeof(one));
+}
+
+bool ListenerHandoff::HandOff(int conn_fd, const vector<int>& listen_fds) {
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(kHello);
+  iov.iov_len = sizeof(kHello);
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * kMaxListeners)];
+    struct cmsghdr align;
+  } control;
+  memset(control.buf, 0, sizeof(control.buf));
+  size_t fds_len = sizeof(int) * listen_fds.size();
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE(fds_len);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(fds_len);
+  memcpy(CMSG_DATA(cmsg), listen_fds.data(), fds_len);
+
+  ssize_t res;
+  do {
+    res = sendmsg(conn_fd, &msg, MSG_NOSIGNAL);
+  } while (res == -1 && errno == EINTR);
+  if (res != static_cast<ssize_t>(sizeof(kHello))) {
+    return false;
+  }
+
+  // The new process now has the sockets open too, but until it says
+  // it's ready to accept on them, we keep accepting ourselves.
+  if (!WaitReadable(conn_fd, kConfirmTimeoutMs)) {
+    return false;
+  }
+  char confirm;
+  do {
+    res = read(conn_fd, &confirm, 1);
+  } while (res == -1 && errno == EINTR);
+  return res == 1 && confirm == kConfirm;
+}
+
+bool ListenerHandoff::WaitReadable(int fd, int timeout_ms) {
+  struct pollfd fds[2];
+  fds[0].fd = fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = stop_fd_;
+  fds[1].events = POLLIN;
+  while (1) {
+    int res = poll(fds, 2, timeout_ms);
+    if (res == -1 && errno == EINTR) {
+      continue;
+    }
+    return res > 0 && !(fds[1].revents & POLLIN);
+  }
+}
+
+}  // namespace hw4
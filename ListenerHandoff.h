@@ -0,0 +1,105 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_LISTENERHANDOFF_H_
+#define HW4_LISTENERHANDOFF_H_
+
+#include <stdint.h>   // for uint32_t, etc.
+#include <string>     // for std::string
+#include <vector>     // for std::vector
+
+namespace hw4 {
+
+// A ListenerHandoff passes a server's listening sockets from one
+// process to the next, so that a new server binary (or the same one
+// with new indices) can take over the port without a single client
+// being refused or reset.  The processes meet at a Unix domain socket
+// at an agreed-upon path:
+//
+//  1. The running server Listen()s at the path and waits in Serve().
+//
+//  2. The new server Claim()s the listening sockets: it connects to the
+//     path and receives their file descriptors (as SCM_RIGHTS
+//     ancillary data).  From here on both processes have the same
+//     sockets open, so connections keep queueing up in the same
+//     backlogs.
+//
+//  3. Once the new server is ready to accept, it Confirm()s, and the
+//     old server's Serve() returns true; the old server then stops
+//     accepting and drains.  If the new server dies (or gives up)
+//     before confirming, Serve() just goes back to waiting, and the old
+//     server carries on as if nothing happened.
+//
+//  4. The new server Listen()s at the path itself, ready for its own
+//     successor.
+class ListenerHandoff {
+ public:
+  // Creates a ListenerHandoff that meets other processes at the Unix
+  // socket "path".  The constructor doesn't touch the path.
+  explicit ListenerHandoff(const std::string& path);
+
+  // Closes our sockets, and removes the path if we are listening at it
+  // and haven't handed off.
+  virtual ~ListenerHandoff();
+
+  // The new process's side.  Connects to the process listening at the
+  // path, and returns the listening sockets it hands over (via an
+  // output parameter) in "listen_fds".  Returns false if there's nobody
+  // at the path, or the handoff fails.
+  bool Claim(std::vector<int>* const listen_fds);
+
+  // Tells the process we claimed the sockets from that we have taken
+  // over.  No-op unless Claim() succeeded.
+  void Confirm();
+
+  // The old process's side.  Starts listening at the path, replacing
+  // whatever is there.  Returns false on failure.
+  bool Listen();
+
+  // Blocks until a new process claims "listen_fds" and confirms, in
+  // which case it returns true, or until Stop() is called or something
+  // goes wrong, in which case it returns false.
+  bool Serve(const std::vector<int>& listen_fds);
+
+  // Makes Serve() return false promptly.  Safe to call from any
+  // thread.
+  void Stop();
+
+  // The most listening sockets one handoff can carry.
+  static const uint32_t kMaxListeners = 64;
+
+  // How long Serve() waits for a process that has claimed the sockets
+  // to confirm before giving up on it.
+  static const int kConfirmTimeoutMs = 10000;
+
+ private:
+  ListenerHandoff(const ListenerHandoff&) = delete;
+  ListenerHandoff& operator=(const ListenerHandoff&) = delete;
+
+  // Hands "listen_fds" to the new process on "conn_fd" and waits for it
+  // to confirm.  Returns true if it did.
+  bool HandOff(int conn_fd, const std::vector<int>& listen_fds);
+
+  // Waits up to "timeout_ms" (-1 means forever) for "fd" to become
+  // readable.  Returns false if Stop() was called, the wait timed out,
+  // or poll() failed.
+  bool WaitReadable(int fd, int timeout_ms);
+
+  std::string path_;
+  int listen_fd_;    // our Unix socket at path_, if we are listening
+  int claim_fd_;     // our connection to the old process, after Claim()
+  int stop_fd_;      // an eventfd Stop() makes readable
+  bool handed_off_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_LISTENERHANDOFF_H_
@@ -0,0 +1,135 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_MPMCQUEUE_H_
+#define HW4_MPMCQUEUE_H_
+
+#include <stdint.h>  // for uint64_t, etc.
+#include <atomic>    // for std::atomic
+#include <memory>    // for std::unique_ptr
+
+namespace hw4 {
+
+// An MpmcQueue is a bounded first-in, first-out queue that any number
+// of threads can push onto and pop from at once, without locks.  It is
+// Dmitry Vyukov's bounded MPMC queue: a ring of cells, each stamped
+// with a sequence number that says whose turn it is to use the cell.
+// A producer claims the cell at the tail by bumping the push position
+// with a compare-and-swap, fills it, and stamps it ready for the
+// consumer one lap behind; consumers do the same at the head.  So
+// threads only ever contend over one counter apiece, and never wait
+// for each other: a push onto a full queue, or a pop from an empty one,
+// just fails.
+//
+// T must be cheap to copy; the queue holds pointers in practice.
+template <typename T>
+class MpmcQueue {
+ public:
+  // Creates an empty queue that holds up to "capacity" items, rounded
+  // up to a power of two.
+  explicit MpmcQueue(uint32_t capacity)
+    : capacity_(RoundUp(capacity)), cells_(new Cell[capacity_]),
+      push_pos_(0), pop_pos_(0) {
+    for (uint64_t i = 0; i < capacity_; i++) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+  virtual ~MpmcQueue() { }
+
+  // Adds "item" to the tail of the queue.  Returns false if the queue
+  // is full.
+  bool TryPush(const T& item) {
+    uint64_t pos = push_pos_.load(std::memory_order_relaxed);
+    while (1) {
+      Cell* cell = &cells_[pos & (capacity_ - 1)];
+      uint64_t seq = cell->seq.load(std::memory_order_acquire);
+      int64_t lap = static_cast<int64_t>(seq - pos);
+      if (lap == 0) {
+        // The cell is free; try to claim it.
+        if (push_pos_.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+          cell->item = item;
+          cell->seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lap < 0) {
+        // The consumer from the last lap hasn't taken its item yet.
+        return false;
+      } else {
+        // Another producer beat us to the cell.
+        pos = push_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Removes the item at the head of the queue and returns it (via an
+  // output parameter) in "item".  Returns false if the queue is empty.
+  bool TryPop(T* const item) {
+    uint64_t pos = pop_pos_.load(std::memory_order_relaxed);
+    while (1) {
+      Cell* cell = &cells_[pos & (capacity_ - 1)];
+      uint64_t seq = cell->seq.load(std::memory_order_acquire);
+      int64_t lap = static_cast<int64_t>(seq - (pos + 1));
+      if (lap == 0) {
+        if (pop_pos_.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+          *item = cell->item;
+          cell->seq.store(pos + capacity_, std::memory_order_release);
+          return true;
+        }
+      } else if (lap < 0) {
+        // Its producer hasn't filled the cell yet.
+        return false;
+      } else {
+        pos = pop_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // The number of items in the queue.  Only a snapshot if other threads
+  // are pushing or popping.
+  uint32_t size() const {
+    uint64_t pop = pop_pos_.load(std::memory_order_acquire);
+    uint64_t push = push_pos_.load(std::memory_order_acquire);
+    return push > pop ? static_cast<uint32_t>(push - pop) : 0;
+  }
+
+  uint32_t capacity() const { return capacity_; }
+
+ private:
+  MpmcQueue(const MpmcQueue&) = delete;
+  MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+  struct Cell {
+    std::atomic<uint64_t> seq;
+    T item;
+  };
+
+  static uint64_t RoundUp(uint32_t capacity) {
+    uint64_t rounded = 1;
+    while (rounded < capacity)
+      rounded <<= 1;
+    return rounded;
+  }
+
+  // Keeps the push and pop positions on cache lines of their own, so
+  // producers and consumers don't slow each other down.
+  static const int kCacheLineSize = 64;
+
+  const uint64_t capacity_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(kCacheLineSize) std::atomic<uint64_t> push_pos_;
+  alignas(kCacheLineSize) std::atomic<uint64_t> pop_pos_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_MPMCQUEUE_H_
@@ -0,0 +1,177 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>        // for errno
+#include <fcntl.h>        // for fcntl(), O_NONBLOCK
+#include <unistd.h>       // for read(), write(), close()
+#include <sys/epoll.h>    // for epoll_create1(), epoll_wait(), etc.
+#include <sys/eventfd.h>  // for eventfd()
+
+#include "./Reactor.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+namespace hw4 {
+
+// The most events a single epoll_wait() returns.
+static const int kMaxEvents = 64;
+
+// static
+const uint32_t Reactor::kReadEvents = EPOLLIN | EPOLLRDHUP;
+// static
+const uint32_t Reactor::kWriteEvents = EPOLLOUT;
+
+// The task that Spawn() dispatches to start a coroutine.
+class StartTask : public ThreadPool::Task {
+ public:
+  explicit StartTask(std::coroutine_handle<> coroutine)
+    : ThreadPool::Task(&Start), coroutine_(coroutine) { }
+
+  static void Start(ThreadPool::Task* t) {
+    StartTask* task = static_cast<StartTask*>(t);
+    std::coroutine_handle<> coroutine = task->coroutine_;
+    delete task;
+    coroutine.resume();
+  }
+
+ private:
+  std::coroutine_handle<> coroutine_;
+};
+
+Reactor::Reactor(ThreadPool* pool)
+  : pool_(pool), epoll_fd_(-1), wake_fd_(-1), running_(false),
+    stop_(false), num_waiting_(0) { }
+
+Reactor::~Reactor() {
+  Stop();
+  if (wake_fd_ != -1)
+    close(wake_fd_);
+  if (epoll_fd_ != -1)
+    close(epoll_fd_);
+}
+
+bool Reactor::Start() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ == -1) {
+    return false;
+  }
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ == -1) {
+    return false;
+  }
+
+  // The wakeup eventfd is the only registration whose data.ptr is null.
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) == -1) {
+    return false;
+  }
+
+  if (pthread_create(&thread_, nullptr, &LoopThread,
+                     static_cast<void*>(this)) != 0) {
+    return false;
+  }
+  running_ = true;
+  return true;
+}
+
+void Reactor::Stop() {
+  if (!running_)
+    return;
+  stop_ = true;
+  uint64_t one = 1;
+  Verify333(write(wake_fd_, &one, sizeof(one)) == sizeof(one));
+  Verify333(pthread_join(thread_, nullptr) == 0);
+  running_ = false;
+}
+
+bool Reactor::Add(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    return false;
+  }
+
+  // Registered, but disarmed until somebody waits on it.
+  struct epoll_event ev;
+  ev.events = EPOLLONESHOT;
+  ev.data.ptr = nullptr;
+  return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+void Reactor::Remove(int fd) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void Reactor::Spawn(CoDetached coroutine) {
+  pool_->Dispatch(new StartTask(coroutine.handle()));
+}
+
+bool Reactor::Waiter::await_suspend(std::coroutine_handle<> coroutine) {
+  coroutine_ = coroutine;
+  Reactor* reactor = reactor_;
+  if (reactor->stop_ || !reactor->running_) {
+    return false;
+  }
+  reactor->num_waiting_++;
+
+  // Once the socket is armed, the coroutine may be resumed (and this
+  // Waiter, which lives in the coroutine's frame, be gone) before
+  // epoll_ctl() even returns, so don't touch "this" after it.
+  struct epoll_event ev;
+  ev.events = events_ | EPOLLONESHOT;
+  ev.data.ptr = this;
+  if (epoll_ctl(reactor->epoll_fd_, EPOLL_CTL_MOD, fd_, &ev) == -1) {
+    reactor->num_waiting_--;
+    return false;
+  }
+  return true;
+}
+
+// static
+void Reactor::Waiter::Resume(ThreadPool::Task* t) {
+  Waiter* waiter = static_cast<Waiter*>(t);
+  waiter->reactor_->num_waiting_--;
+  waiter->ready_ = true;
+  waiter->coroutine_.resume();
+}
+
+void* Reactor::LoopThread(void* reactor) {
+  static_cast<Reactor*>(reactor)->Loop();
+  return nullptr;
+}
+
+// This is the main loop of the Reactor thread.  It waits for sockets to
+// become ready, and hands each of their waiters to a worker to resume.
+void Reactor::Loop() {
+  struct epoll_event events[kMaxEvents];
+
+  while (!stop_) {
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (num_events == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    for (int i = 0; i < num_events; i++) {
+      if (events[i].data.ptr == nullptr) {
+        // Stop() wants us; the loop condition will notice.
+        continue;
+      }
+      pool_->Dispatch(static_cast<Waiter*>(events[i].data.ptr));
+    }
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,129 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_REACTOR_H_
+#define HW4_REACTOR_H_
+
+extern "C" {
+#include <pthread.h>  // for pthread_t
+}
+
+#include <stdint.h>   // for uint32_t, etc.
+#include <atomic>     // for std::atomic
+#include <coroutine>  // for std::coroutine_handle
+
+#include "./Coroutine.h"
+#include "./ThreadPool.h"
+
+namespace hw4 {
+
+// A Reactor lets coroutines (see Coroutine.h) wait for sockets to become
+// readable or writable without holding a thread while they wait.  A
+// coroutine co_awaits Readable(fd) or Writable(fd); the Reactor's thread
+// waits on epoll for every such socket at once, and when one is ready,
+// dispatches a task to the ThreadPool that resumes the coroutine
+// waiting on it.  The coroutine then runs on that worker until it
+// waits again (or finishes), so thousands of connections can share a
+// handful of workers, with none of them tied up by a slow client.
+//
+// Sockets are registered one-shot: a wakeup goes to exactly one waiter,
+// and the socket is quiet again until somebody waits on it again.  Only
+// one coroutine may be waiting on a socket at a time.
+class Reactor {
+ public:
+  // Creates a Reactor that resumes coroutines on "pool"'s workers.  The
+  // constructor doesn't create the epoll instance or the thread; Start()
+  // does.
+  explicit Reactor(ThreadPool* pool);
+
+  // Stops the Reactor if it's running.  Coroutines still waiting on it
+  // are never resumed.
+  virtual ~Reactor();
+
+  // Creates the epoll instance and starts the Reactor's thread.  Returns
+  // false if any of the underlying system calls fail.
+  bool Start();
+
+  // Asks the Reactor's thread to exit, and waits for it to.
+  void Stop();
+
+  // Makes "fd" non-blocking and registers it, so that coroutines can
+  // wait on it.  Returns false if either fails.
+  bool Add(int fd);
+
+  // Unregisters "fd", which nobody may be waiting on.  Call before
+  // closing it.
+  void Remove(int fd);
+
+  // Starts "coroutine" on one of the pool's workers.
+  void Spawn(CoDetached coroutine);
+
+  // What Readable() and Writable() return: co_await it to suspend the
+  // calling coroutine until the socket is ready.  It is also the task
+  // that resumes the coroutine, which is why waiting never allocates.
+  class Waiter : public ThreadPool::Task {
+   public:
+    Waiter(Reactor* reactor, int fd, uint32_t events)
+      : ThreadPool::Task(&Resume), reactor_(reactor), fd_(fd),
+        events_(events), ready_(false) { }
+
+    bool await_ready() const noexcept { return false; }
+
+    // Registers interest in the socket, after which the coroutine may
+    // be resumed on another thread at any moment.  Returns false,
+    // resuming the coroutine right away, if that fails.
+    bool await_suspend(std::coroutine_handle<> coroutine);
+
+    // The value of the co_await: true once the socket is ready, or
+    // false if the Reactor couldn't wait on it, e.g., because it has
+    // been stopped.
+    bool await_resume() const noexcept { return ready_; }
+
+   private:
+    // The thread_task_fn.
+    static void Resume(ThreadPool::Task* t);
+
+    Reactor* reactor_;
+    int fd_;
+    uint32_t events_;
+    bool ready_;
+    std::coroutine_handle<> coroutine_;
+  };
+
+  // Waits until "fd" has something to read, or the client has hung up.
+  Waiter Readable(int fd) { return Waiter(this, fd, kReadEvents); }
+
+  // Waits until "fd" can take more to write.
+  Waiter Writable(int fd) { return Waiter(this, fd, kWriteEvents); }
+
+  // The number of coroutines waiting on the Reactor right now.
+  uint32_t num_waiting() const { return num_waiting_; }
+
+ private:
+  static const uint32_t kReadEvents;
+  static const uint32_t kWriteEvents;
+
+  // The Reactor thread's start routine and main loop.
+  static void* LoopThread(void* reactor);
+  void Loop();
+
+  ThreadPool* pool_;
+  int epoll_fd_;
+  int wake_fd_;  // an eventfd that Stop() pokes to wake up the loop
+  pthread_t thread_;
+  bool running_;
+  std::atomic<bool> stop_;
+  std::atomic<uint32_t> num_waiting_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_REACTOR_H_
@@ -0,0 +1,117 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>     // for errno
+#include <stdlib.h>    // for malloc(), realloc(), free()
+#include <string.h>    // for memcpy(), memmove()
+#include <sys/uio.h>   // for readv(), struct iovec
+#include <algorithm>   // for std::min(), std::max()
+
+#include "./ReadBuffer.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::max;
+using std::min;
+
+namespace hw4 {
+
+// How much a single Read() may take in beyond the buffer's free space.
+static const size_t kSpillLen = 16384;
+
+// static
+const size_t ReadBuffer::kInitialCapacity = 4096;
+// static
+const size_t ReadBuffer::kRetainedCapacity = 16384;
+
+ReadBuffer::~ReadBuffer() {
+  free(data_);
+}
+
+void ReadBuffer::Consume(size_t len) {
+  Verify333(len <= size());
+  begin_ += len;
+  if (begin_ == end_) {
+    Clear();
+  }
+}
+
+void ReadBuffer::Clear() {
+  begin_ = end_ = 0;
+  if (capacity_ > kRetainedCapacity) {
+    // A big request has come and gone; don't hold on to its memory for
+    // as long as the connection stays open.
+    free(data_);
+    data_ = nullptr;
+    capacity_ = 0;
+  }
+}
+
+void ReadBuffer::Reserve(size_t len) {
+  if (begin_ > 0) {
+    // Only what's left of a request that's still coming in gets moved.
+    memmove(data_, data_ + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  if (capacity_ - end_ >= len) {
+    return;
+  }
+  size_t capacity = max(max(capacity_ * 2, kInitialCapacity), end_ + len);
+  char* data = static_cast<char*>(realloc(data_, capacity));
+  Verify333(data != nullptr);
+  data_ = data;
+  capacity_ = capacity;
+}
+
+void ReadBuffer::Append(const char* data, size_t len) {
+  Reserve(len);
+  memcpy(data_ + end_, data, len);
+  end_ += len;
+}
+
+int ReadBuffer::Read(IoEngine* engine, int fd, size_t max_len) {
+  Verify333(max_len > 0);
+
+  // Start with kInitialCapacity, which most requests fit in; beyond
+  // that, let the spill buffer say how much more is needed.
+  Reserve(capacity_ == 0 ? kInitialCapacity : 0);
+
+  char spill[kSpillLen];
+  struct iovec iov[2];
+  iov[0].iov_base = data_ + end_;
+  iov[0].iov_len = min(capacity_ - end_, max_len);
+  iov[1].iov_base = spill;
+  iov[1].iov_len = min(kSpillLen, max_len - iov[0].iov_len);
+
+  int res;
+  if (engine != nullptr) {
+    res = engine->Readv(fd, iov, 2);
+  } else {
+    do {
+      res = readv(fd, iov, 2);
+    } while (res == -1 && errno == EINTR);
+  }
+  if (res <= 0) {
+    return res;
+  }
+
+  size_t in_place = min(static_cast<size_t>(res), iov[0].iov_len);
+  end_ += in_place;
+  if (static_cast<size_t>(res) > in_place) {
+    Append(spill, res - in_place);
+  }
+  return res;
+}
+
+}  // namespace hw4
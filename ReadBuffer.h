@@ -0,0 +1,81 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_READBUFFER_H_
+#define HW4_READBUFFER_H_
+
+#include <stddef.h>
+
+#include "./IoEngine.h"
+
+namespace hw4 {
+
+// A ReadBuffer holds the bytes a connection has read from its client
+// and not yet handled.  Bytes are read straight into the buffer's free
+// space, and whatever doesn't fit there lands in a stack buffer read
+// into by the same readv(), and is then appended; so one system call
+// reads as much as the kernel has, however small the buffer was, and
+// the buffer only grows as big as the client's requests need.
+//
+// Handled bytes are dropped from the front by moving the pointer, and
+// only moved out of the way, once, when more are about to be read.  The
+// memory is kept from one request to the next (and, as part of a
+// recycled HttpConnection, from one connection to the next), up to
+// kRetainedCapacity bytes of it.
+class ReadBuffer {
+ public:
+  ReadBuffer() : data_(nullptr), capacity_(0), begin_(0), end_(0) { }
+  virtual ~ReadBuffer();
+
+  ReadBuffer(const ReadBuffer&) = delete;
+  ReadBuffer& operator=(const ReadBuffer&) = delete;
+
+  // The bytes not yet handled.
+  char* data() { return data_ + begin_; }
+  const char* data() const { return data_ + begin_; }
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+  size_t capacity() const { return capacity_; }
+
+  // Drops the first "len" bytes, which have been handled.
+  void Consume(size_t len);
+
+  // Drops everything, keeping up to kRetainedCapacity bytes of memory.
+  void Clear();
+
+  // Appends "len" bytes of "data".
+  void Append(const char* data, size_t len);
+
+  // Reads at most "max_len" bytes from "fd" in a single readv(): through
+  // "engine", which waits for the client, or, if "engine" is null,
+  // straight from a non-blocking "fd".  Returns the number of bytes
+  // read, 0 on EOF, or -1 with errno set on error (EAGAIN included, for
+  // a non-blocking "fd").
+  int Read(IoEngine* engine, int fd, size_t max_len);
+
+  // How much the buffer allocates to begin with.
+  static const size_t kInitialCapacity;
+
+  // How much memory an empty buffer holds on to.
+  static const size_t kRetainedCapacity;
+
+ private:
+  // Makes room for at least "len" more bytes at the end.
+  void Reserve(size_t len);
+
+  char* data_;
+  size_t capacity_;
+  size_t begin_, end_;  // the unhandled bytes are data_[begin_, end_)
+};
+
+}  // namespace hw4
+
+#endif  // HW4_READBUFFER_H_
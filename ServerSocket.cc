@@ -11,14 +11,21 @@
 
 #include <stdio.h>       // for snprintf()
 #include <unistd.h>      // for close(), fcntl()
+#include <fcntl.h>       // for fcntl(), O_NONBLOCK
+#include <poll.h>        // for poll()
+#include <sys/eventfd.h>  // for eventfd()
 #include <sys/types.h>   // for socket(), getaddrinfo(), etc.
 #include <sys/socket.h>  // for socket(), getaddrinfo(), etc.
+#include <sys/stat.h>    // for lstat()
+#include <sys/un.h>      // for struct sockaddr_un
 #include <arpa/inet.h>   // for inet_ntop()
 #include <netdb.h>       // for getaddrinfo()
 #include <errno.h>       // for errno, used by strerror()
 #include <string.h>      // for memset, strerror()
 #include <iostream>      // for std::cerr, etc.
 
+#include "./HttpUtils.h"
+#include "./IoEngine.h"
 #include "./ServerSocket.h"
 
 extern "C" {
@@ -27,30 +34,192 @@ extern "C" {
 
 namespace hw4 {
 
-ServerSocket::ServerSocket(uint16_t port) {
+ServerSocket::ServerSocket(uint16_t port) : stopped_(false) {
   port_ = port;
   listen_sock_fd_ = -1;
+  num_listeners_ = 0;
+  dns_mode_ = kDnsBlocking;
+  stop_fd_ = eventfd(0, EFD_CLOEXEC);
+  Verify333(stop_fd_ != -1);
 }
 
 ServerSocket::~ServerSocket() {
-  // Close the listening socket if it's not zero.  The rest of this
-  // class will make sure to zero out the socket if it is closed
+  // Close the listening sockets if they're open.  The rest of this
+  // class will make sure to clear out listen_fds_ if they are closed
   // elsewhere.
-  if (listen_sock_fd_ != -1)
-    close(listen_sock_fd_);
-  listen_sock_fd_ = -1;
+  CloseListeners();
+  close(stop_fd_);
 }
 
 bool ServerSocket::BindAndListen(int ai_family, int* const listen_fd) {
-  // Use "getaddrinfo," "socket," "bind," and "listen" to
-  // create a listening socket on port port_.  Return the
-  // listening socket through the output parameter "listen_fd"
-  // and set the ServerSocket data member "listen_sock_fd_"
+  std::vector<int> listen_fds;
+  if (!BindAndListen(ai_family, 1, &listen_fds)) {
+    return false;
+  }
+  *listen_fd = listen_fds[0];
+  return true;
+}
+
+bool ServerSocket::BindAndListen(int ai_family, uint32_t num_listeners,
+                                 std::vector<int>* const listen_fds) {
+  // Use CreateListener() to create "num_listeners" listening sockets
+  // on port port_.  Return the listening sockets through the output
+  // parameter "listen_fds" and set the ServerSocket data members
+  // "listen_fds_" and "listen_sock_fd_"
+  sock_family_ = ai_family;
+  std::vector<int> fds;
+  for (uint32_t i = 0; i < num_listeners; i++) {
+    int fd = CreateListener(num_listeners > 1);
+    if (fd == -1) {
+      for (int open_fd : fds)
+        close(open_fd);
+      return false;
+    }
+    fds.push_back(fd);
+  }
+
+  SetListeners(fds);
+  *listen_fds = fds;
+  return true;
+}
+
+// Clears the way to bind a Unix socket at "addr": removes the socket
+// file a server that's gone left behind, if that's what's there.
+// Returns false if the way isn't clear, i.e., something else is there,
+// whether a socket a server is still listening on or a file that isn't
+// a socket at all, which the caller mustn't clobber.
+static bool RemoveStaleSocket(const struct sockaddr_un& addr) {
+  struct stat st;
+  if (lstat(addr.sun_path, &st) != 0) {
+    return errno == ENOENT;
+  }
+  if (!S_ISSOCK(st.st_mode)) {
+    return false;
+  }
+
+  // Only a socket nobody is listening on refuses the connection.  A
+  // live server just sees a client that hangs up without a word.
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd == -1) {
+    return false;
+  }
+  bool stale = connect(fd, reinterpret_cast<const struct sockaddr*>(&addr),
+                       sizeof(addr)) != 0 && errno == ECONNREFUSED;
+  close(fd);
+  return stale && unlink(addr.sun_path) == 0;
+}
+
+bool ServerSocket::BindUnix(const std::string& path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size());
+
+  if (!RemoveStaleSocket(addr)) {
+    return false;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd == -1) {
+    return false;
+  }
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return false;
+  }
+
+  std::vector<int> fds = listen_fds_;
+  fds.push_back(fd);
+  SetListeners(fds);
+  return true;
+}
+
+bool ServerSocket::AdoptListeners(const std::vector<int>& listen_fds) {
+  if (listen_fds.empty()) {
+    return false;
+  }
+
+  // The server address of a TCP connection is formatted according to
+  // the family of the TCP listeners.
+  int family = AF_INET6;
+  for (int fd : listen_fds) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int listening = 0;
+    socklen_t listening_len = sizeof(listening);
+    if (getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    &addr_len) != 0 ||
+        (addr.ss_family != AF_INET && addr.ss_family != AF_INET6 &&
+         addr.ss_family != AF_UNIX) ||
+        getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening,
+                   &listening_len) != 0 ||
+        !listening) {
+      return false;
+    }
+    if (addr.ss_family != AF_UNIX) {
+      family = addr.ss_family;
+    }
+  }
+
+  // Whoever opened the sockets may not have made them non-blocking.
+  for (int fd : listen_fds) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+      return false;
+    }
+  }
 
+  sock_family_ = family;
+  SetListeners(listen_fds);
+  return true;
+}
+
+void ServerSocket::SetListeners(const std::vector<int>& fds) {
+  listen_fds_ = fds;
+  listen_sock_fd_ = fds[0];
+  num_listeners_ = fds.size();
+  accept_counts_.reset(new std::atomic<uint64_t>[num_listeners_]);
+  for (uint32_t i = 0; i < num_listeners_; i++)
+    accept_counts_[i] = 0;
+}
+
+void ServerSocket::SetDnsMode(DnsMode mode,
+                              uint32_t cache_size,
+                              uint32_t ttl_secs) {
+  dns_mode_ = mode;
+  if (mode == kDnsCached) {
+    dns_cache_.reset(new DnsCache(cache_size, ttl_secs));
+  } else {
+    dns_cache_.reset();
+  }
+}
+
+void ServerSocket::StopAccepting() {
+  // Accept() checks stopped_ before each accept, and the eventfd wakes
+  // up anybody waiting in poll() for a connection.  (Shutting down the
+  // listening sockets would wake them up too, but it would also reset
+  // every connection in the backlogs, even if another process is going
+  // to carry on accepting them.)
+  stopped_ = true;
+  uint64_t one = 1;
+  Verify333(write(stop_fd_, &one, sizeof(one)) == sizeof(one));
+}
+
+void ServerSocket::CloseListeners() {
+  for (int fd : listen_fds_)
+    close(fd);
+  listen_fds_.clear();
+  listen_sock_fd_ = -1;
+}
+
+int ServerSocket::CreateListener(bool reuse_port) const {
   // STEP 1:
   // Populate the "hints" addrinfo structure for getaddrinfo().
   // ("man addrinfo")
-  sock_family_ = ai_family;
   struct addrinfo hints;
   memset(&hints, 0, sizeof(struct addrinfo));
   hints.ai_family = AF_INET6;       // IPv6 (also handles IPv4 clients)
@@ -69,8 +238,10 @@ bool ServerSocket::BindAndListen(int ai_family, int* const listen_fd) {
 
   int listen_fd_val = -1;
   for (struct addrinfo* rp = result; rp != nullptr; rp = rp->ai_next) {
+    // The socket is non-blocking so that Accept() can wait for either
+    // a connection or StopAccepting() (see below).
     listen_fd_val = socket(rp->ai_family,
-                       rp->ai_socktype,
+                       rp->ai_socktype | SOCK_NONBLOCK,
                        rp->ai_protocol);
     if (listen_fd_val == -1) {
       listen_fd_val = -1;
@@ -80,6 +251,13 @@ bool ServerSocket::BindAndListen(int ai_family, int* const listen_fd) {
     int optval = 1;
     setsockopt(listen_fd_val, SOL_SOCKET, SO_REUSEADDR,
                &optval, sizeof(optval));
+    if (reuse_port &&
+        setsockopt(listen_fd_val, SOL_SOCKET, SO_REUSEPORT,
+                   &optval, sizeof(optval)) != 0) {
+      close(listen_fd_val);
+      listen_fd_val = -1;
+      continue;
+    }
 
     if (bind(listen_fd_val, rp->ai_addr, rp->ai_addrlen) == 0) {
       break;
@@ -92,17 +270,15 @@ bool ServerSocket::BindAndListen(int ai_family, int* const listen_fd) {
   freeaddrinfo(result);
 
   if (listen_fd_val == -1) {
-    return false;
+    return -1;
   }
 
   if (listen(listen_fd_val, SOMAXCONN) != 0) {
     close(listen_fd_val);
-    return false;
+    return -1;
   }
 
-  listen_sock_fd_ = listen_fd_val;
-  *listen_fd = listen_fd_val;
-  return true;
+  return listen_fd_val;
 }
 
 bool ServerSocket::Accept(int* const accepted_fd,
@@ -111,30 +287,86 @@ bool ServerSocket::Accept(int* const accepted_fd,
                           std::string* const client_dns_name,
                           std::string* const server_addr,
                           std::string* const server_dns_name) const {
-  // Accept a new connection on the listening socket listen_sock_fd_.
+  return Accept(0, accepted_fd, client_addr, client_port,
+                client_dns_name, server_addr, server_dns_name);
+}
+
+bool ServerSocket::Accept(uint32_t listener,
+                          int* const accepted_fd,
+                          std::string* const client_addr,
+                          uint16_t* const client_port,
+                          std::string* const client_dns_name,
+                          std::string* const server_addr,
+                          std::string* const server_dns_name) const {
+  // Accept a new connection on the listening socket listen_fds_[listener].
   // (Block until a new connection arrives.)  Return the newly accepted
   // socket, as well as information about both ends of the new connection,
   // through the various output parameters.
+  if (listener >= listen_fds_.size()) {
+    return false;
+  }
 
   // STEP 2:
   while (1) {
+    if (stopped_) {
+      return false;
+    }
+
+    // The listening socket is non-blocking, so when there's nobody to
+    // accept, wait until there is or until StopAccepting() is called.
+    // Another process may share the socket and beat us to a connection,
+    // which is why we accept first and poll after, not the other way
+    // round.
     struct sockaddr_storage caddr;
     socklen_t caddr_len = sizeof(caddr);
-    int client_fd = accept(listen_sock_fd_,
-                           reinterpret_cast<struct sockaddr*>(&caddr),
-                           &caddr_len);
+    int client_fd = IoEngine::Get()->Accept(
+      listen_fds_[listener], reinterpret_cast<struct sockaddr*>(&caddr),
+      &caddr_len);
     if (client_fd < 0) {
-      if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        struct pollfd fds[2];
+        fds[0].fd = listen_fds_[listener];
+        fds[0].events = POLLIN;
+        fds[1].fd = stop_fd_;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+          return false;
+        }
+        continue;
+      }
+      if ((errno == EINTR) || (errno == ECONNABORTED)) {
         continue;
       }
       return false;
     }
+    accept_counts_[listener]++;
 
     // set fd
     *accepted_fd = client_fd;
 
-    // set client_addr + client_port
+    // A Unix socket client is known by the socket it connected to,
+    // which is also the server end's address.
     struct sockaddr *addr = reinterpret_cast<struct sockaddr*>(&caddr);
+    if (addr->sa_family == AF_UNIX) {
+      struct sockaddr_un srvr;
+      socklen_t srvrlen = sizeof(srvr);
+      memset(&srvr, 0, sizeof(srvr));
+      getsockname(client_fd, reinterpret_cast<struct sockaddr*>(&srvr),
+                  &srvrlen);
+      *client_addr = std::string("unix:") + srvr.sun_path;
+      *client_port = 0;
+      client_dns_name->clear();
+      *server_addr = *client_addr;
+      server_dns_name->clear();
+      return true;
+    }
+
+    // Responses go out in as few writes as we can manage, so there's
+    // nothing for Nagle's algorithm to coalesce; it would only hold back
+    // the tail of a response waiting for an ACK.
+    SetTcpNoDelay(client_fd);
+
+    // set client_addr + client_port
     if (addr->sa_family == AF_INET) {
       char astring[INET_ADDRSTRLEN];
       struct sockaddr_in* in4 = reinterpret_cast<struct sockaddr_in*>(addr);
@@ -151,7 +383,10 @@ bool ServerSocket::Accept(int* const accepted_fd,
 
     // set client_dns
     char hostname[1024];  // ought to be big enough.
-    getnameinfo(addr, sizeof(caddr), hostname, 1024, nullptr, 0, 0);
+    hostname[0] = '\0';
+    if (dns_mode_ == kDnsBlocking) {
+      getnameinfo(addr, sizeof(caddr), hostname, 1024, nullptr, 0, 0);
+    }
     *client_dns_name = hostname;
 
     // set server_addr + server_dns
@@ -165,8 +400,10 @@ bool ServerSocket::Accept(int* const accepted_fd,
                   reinterpret_cast<struct sockaddr*>(&srvr),
                   &srvrlen);
       inet_ntop(AF_INET, &srvr.sin_addr, addrbuf, INET_ADDRSTRLEN);
-      getnameinfo(reinterpret_cast<struct sockaddr*>(&srvr),
-                  srvrlen, hname, 1024, nullptr, 0, 0);
+      if (dns_mode_ == kDnsBlocking) {
+        getnameinfo(reinterpret_cast<struct sockaddr*>(&srvr),
+                    srvrlen, hname, 1024, nullptr, 0, 0);
+      }
       *server_addr = addrbuf;
       *server_dns_name = hname;
     } else {
@@ -177,12 +414,21 @@ bool ServerSocket::Accept(int* const accepted_fd,
                   reinterpret_cast<struct sockaddr*>(&srvr),
                   &srvrlen);
       inet_ntop(AF_INET6, &srvr.sin6_addr, addrbuf, INET6_ADDRSTRLEN);
-      getnameinfo(reinterpret_cast<struct sockaddr*>(&srvr),
-                  srvrlen, hname, 1024, nullptr, 0, 0);
+      if (dns_mode_ == kDnsBlocking) {
+        getnameinfo(reinterpret_cast<struct sockaddr*>(&srvr),
+                    srvrlen, hname, 1024, nullptr, 0, 0);
+      }
       *server_addr = addrbuf;
       *server_dns_name = hname;
     }
 
+    // In kDnsCached mode, use whatever names the cache already has;
+    // the rest will be there for the next connection from that address.
+    if (dns_mode_ == kDnsCached) {
+      dns_cache_->Lookup(*client_addr, client_dns_name);
+      dns_cache_->Lookup(*server_addr, server_dns_name);
+    }
+
     return true;
   }
 }
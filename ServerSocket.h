@@ -16,10 +16,29 @@
 #include <stdint.h>      // for uint16_t, etc.
 #include <sys/types.h>   // for AF_UNSPEC, AF_INET, AF_INET6
 #include <sys/socket.h>  // for AF_UNSPEC, AF_INET, AF_INET6
+#include <atomic>        // for std::atomic
+#include <memory>        // for std::unique_ptr
 #include <string>        // for std::string
+#include <vector>        // for std::vector
+
+#include "./DnsCache.h"
 
 namespace hw4 {
 
+// How ServerSocket::Accept() fills in the client and server DNS names.
+enum DnsMode {
+  // Resolve both names with getnameinfo() before Accept() returns.
+  // Simple, but every accept waits on the resolver.
+  kDnsBlocking,
+
+  // Look both names up in a DnsCache.  A name that isn't cached yet
+  // comes back empty and is resolved in the background.
+  kDnsCached,
+
+  // Never resolve names; they always come back empty.
+  kDnsNone
+};
+
 // A ServerSocket class abstracts away the messy details of creating a
 // TCP listening socket at a specific port and on a (hopefully)
 // externally visible IP address.  As well, a ServerSocket helps
@@ -55,6 +74,42 @@ class ServerSocket {
   // - listen_fd: the file descriptor for the listening socket.
   bool BindAndListen(int ai_family, int* const listen_fd);
 
+  // Like the above, but opens "num_listeners" listening sockets on the
+  // same port.  If there is more than one, each is opened with
+  // SO_REUSEPORT, so that the kernel spreads incoming connections
+  // across them and each can be drained by its own accept thread.
+  //
+  // On failure this function returns false and leaves no socket open.
+  // On success, it returns true and returns the listening sockets' file
+  // descriptors (via an output parameter) in "listen_fds".  Listener 0
+  // is the one the single-listener functions use.
+  bool BindAndListen(int ai_family, uint32_t num_listeners,
+                     std::vector<int>* const listen_fds);
+
+  // Adds a listener on the Unix domain stream socket "path", after any
+  // opened by BindAndListen(), so that a reverse proxy on the same host
+  // can connect without going through the TCP stack.  A stale socket at
+  // "path", which nothing is listening on any more, is replaced; it
+  // fails if anything else is there, be it a socket some other server
+  // is listening on or a file that isn't a socket.  The socket file is
+  // left in place when
+  // the listener is closed, since another server may have taken the
+  // listener over (see ListenerHandoff.h).  Must be called before any
+  // Accept().  Returns false on failure.
+  //
+  // Unix socket clients have no address of their own, so Accept()
+  // reports "unix:" followed by the path as both the client and the
+  // server address, 0 as the client port, and no DNS names.
+  bool BindUnix(const std::string& path);
+
+  // Instead of creating listening sockets, takes over "listen_fds",
+  // which are already bound and listening, e.g., because another server
+  // process handed them over (see ListenerHandoff.h).  The ServerSocket
+  // owns them from now on, and listener i is listen_fds[i].  Returns
+  // false if "listen_fds" is empty or any of them isn't a listening TCP
+  // or Unix stream socket, in which case they are left open.
+  bool AdoptListeners(const std::vector<int>& listen_fds);
+
   // This function causes the ServerSocket to attempt to accept
   // an incoming connection from a client.  On failure, returns false.
   // On success, it returns true, and also returns (via output
@@ -71,13 +126,15 @@ class ServerSocket {
   //   connected from.
   //
   // - client_dnsname: a C++ string object containing the DNS name
-  //   of the client.
+  //   of the client.  Depending on the DNS mode (see SetDnsMode()),
+  //   this may be empty, in which case callers should fall back on
+  //   client_addr.
   //
   // - server_addr: a C++ string object containing a printable
   //   representation of the server IP address for the connection.
   //
   // - server_dnsname: a C++ string object containing the DNS name
-  //   of the server.
+  //   of the server.  Like client_dnsname, may be empty.
   bool Accept(int* const accepted_fd,
               std::string* const client_addr,
               uint16_t* const client_port,
@@ -85,10 +142,77 @@ class ServerSocket {
               std::string* const server_addr,
               std::string* const server_dns_name) const;
 
+  // Like the above, but accepts a connection from listening socket
+  // number "listener" (see the sharded BindAndListen()).  Several
+  // threads may call this concurrently, as long as each one uses a
+  // different listener.
+  bool Accept(uint32_t listener,
+              int* const accepted_fd,
+              std::string* const client_addr,
+              uint16_t* const client_port,
+              std::string* const client_dns_name,
+              std::string* const server_addr,
+              std::string* const server_dns_name) const;
+
+  // Chooses how Accept() fills in DNS names; the default is
+  // kDnsBlocking.  In kDnsCached mode, the cache holds up to
+  // "cache_size" addresses, each for "ttl_secs" seconds.  Must not be
+  // called while another thread is in Accept().
+  void SetDnsMode(DnsMode mode,
+                  uint32_t cache_size = 4096,
+                  uint32_t ttl_secs = 300);
+
+  // Makes pending and future Accept() calls fail promptly.  The
+  // listening sockets themselves are left alone, so that connections
+  // waiting in their backlogs can still be accepted by another process
+  // that shares them.  Safe to call from any thread.
+  void StopAccepting();
+
+  // Closes every listening socket, after which new clients are refused
+  // (unless another process still has the sockets open).  Must not be
+  // called while another thread is in Accept().
+  void CloseListeners();
+
+  // The listening sockets' file descriptors; listener i is the i'th.
+  const std::vector<int>& listen_fds() const { return listen_fds_; }
+
+  // The number of listening sockets, and the number of connections
+  // that listener "listener" has accepted so far.  Comparing the counts
+  // shows how evenly the kernel is spreading the load.
+  uint32_t num_listeners() const { return num_listeners_; }
+  uint64_t accept_count(uint32_t listener) const {
+    return accept_counts_[listener];
+  }
+
  private:
+  // Creates one socket bound to port_ and listening, optionally with
+  // SO_REUSEPORT set.  Returns its file descriptor, or -1 on failure.
+  int CreateListener(bool reuse_port) const;
+
   uint16_t port_;
   int listen_sock_fd_;
   int sock_family_;  // either AF_INET or AF_INET6 for ipv4 or ipv6/v4
+
+  // Sets up the bookkeeping for the listening sockets "fds", which are
+  // already open.
+  void SetListeners(const std::vector<int>& fds);
+
+  // Every listening socket we have open (listen_sock_fd_ is the first),
+  // and how many connections each has accepted.  The counts outlive
+  // CloseListeners().
+  std::vector<int> listen_fds_;
+  uint32_t num_listeners_;
+  std::unique_ptr<std::atomic<uint64_t>[]> accept_counts_;
+
+  // An eventfd that StopAccepting() makes readable, to wake up accept
+  // threads waiting in poll().
+  int stop_fd_;
+  std::atomic<bool> stopped_;
+
+  // How Accept() resolves names, and the cache it uses in kDnsCached
+  // mode.
+  DnsMode dns_mode_;
+  std::unique_ptr<DnsCache> dns_cache_;
 };
 
 }  // namespace hw4
@@ -0,0 +1,167 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_SLABPOOL_H_
+#define HW4_SLABPOOL_H_
+
+extern "C" {
+#include <pthread.h>  // for pthread_mutex_t
+#include "libhw1/CSE333.h"  // for Verify333()
+}
+
+#include <stdint.h>  // for uint32_t, etc.
+#include <vector>    // for std::vector
+
+namespace hw4 {
+
+// A SlabPool<T> recycles objects of type T that are made and thrown
+// away at a high rate, from many threads, such as the task for each
+// connection the server accepts.  Rather than new and delete, callers
+// Get() an object from the pool and Put() it back when they are done
+// with it.  The pool never frees an object, but hands it out again
+// still constructed, so whatever memory the object held onto (a
+// string's buffer, say) is reused along with it.  Resetting an object
+// before it is Put() back is up to the caller.
+//
+// Every thread keeps a cache of free objects, so that most Get()s and
+// Put()s touch nothing shared at all.  The caches trade objects with a
+// depot, under a lock, kBatch at a time: a thread whose cache runs out
+// takes a batch from the depot, and a thread whose cache fills up gives
+// a batch back.  That's how objects get from the threads that Put()
+// them (e.g., the workers) to the thread that Get()s them (e.g., an
+// acceptor).  When the depot runs out too, the pool allocates a slab of
+// kBatch new objects at once.  A thread's cache goes back to the depot
+// when the thread exits.
+//
+// There is one pool per type T, which lasts as long as the process.  T
+// must be default-constructible.
+template <typename T>
+class SlabPool {
+ public:
+  // How many objects the caches and depot trade at a time, and how many
+  // a slab holds.
+  static const uint32_t kBatch;
+
+  // Returns a free object, allocating more if there are none.
+  static T* Get();
+
+  // Returns "obj", which must have come from Get(), to the pool.
+  static void Put(T* obj);
+
+  // The number of objects the pool has allocated so far, i.e., the
+  // most that have been out at once, give or take the objects sitting
+  // in caches.
+  static uint64_t num_allocated();
+
+ private:
+  struct Depot {
+    Depot() : num_allocated(0) {
+      Verify333(pthread_mutex_init(&lock, nullptr) == 0);
+    }
+
+    pthread_mutex_t lock;
+    std::vector<T*> free;
+    uint64_t num_allocated;
+  };
+
+  struct Cache {
+    // Holds up to two batches, so that a thread that goes back and
+    // forth between Get() and Put() doesn't trade with the depot every
+    // time.
+    Cache() { free.reserve(2 * kBatch); }
+    ~Cache() { GiveBack(this, free.size()); }
+
+    std::vector<T*> free;
+  };
+
+  // The depot is never destroyed, since threads may still be exiting
+  // (and handing their caches back) while the process shuts down.
+  static Depot* depot() {
+    static Depot* depot = new Depot;
+    return depot;
+  }
+
+  static Cache* cache() {
+    static thread_local Cache cache;
+    return &cache;
+  }
+
+  // Moves the last "count" objects in "cache" to the depot.
+  static void GiveBack(Cache* cache, uint32_t count);
+};
+
+// static
+template <typename T>
+const uint32_t SlabPool<T>::kBatch = 32;
+
+// static
+template <typename T>
+T* SlabPool<T>::Get() {
+  Cache* c = cache();
+  if (c->free.empty()) {
+    Depot* d = depot();
+    Verify333(pthread_mutex_lock(&d->lock) == 0);
+    uint32_t count = (d->free.size() < kBatch) ? d->free.size() : kBatch;
+    c->free.insert(c->free.end(), d->free.end() - count, d->free.end());
+    d->free.resize(d->free.size() - count);
+    if (count == 0) {
+      d->num_allocated += kBatch;
+    }
+    Verify333(pthread_mutex_unlock(&d->lock) == 0);
+
+    if (count == 0) {
+      T* slab = new T[kBatch];
+      for (uint32_t i = 0; i < kBatch; i++) {
+        c->free.push_back(&slab[i]);
+      }
+    }
+  }
+  T* obj = c->free.back();
+  c->free.pop_back();
+  return obj;
+}
+
+// static
+template <typename T>
+void SlabPool<T>::Put(T* obj) {
+  Cache* c = cache();
+  c->free.push_back(obj);
+  if (c->free.size() >= 2 * kBatch) {
+    GiveBack(c, kBatch);
+  }
+}
+
+// static
+template <typename T>
+uint64_t SlabPool<T>::num_allocated() {
+  Depot* d = depot();
+  Verify333(pthread_mutex_lock(&d->lock) == 0);
+  uint64_t num = d->num_allocated;
+  Verify333(pthread_mutex_unlock(&d->lock) == 0);
+  return num;
+}
+
+// static
+template <typename T>
+void SlabPool<T>::GiveBack(Cache* cache, uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+  Depot* d = depot();
+  Verify333(pthread_mutex_lock(&d->lock) == 0);
+  d->free.insert(d->free.end(), cache->free.end() - count, cache->free.end());
+  Verify333(pthread_mutex_unlock(&d->lock) == 0);
+  cache->free.resize(cache->free.size() - count);
+}
+
+}  // namespace hw4
+
+#endif  // HW4_SLABPOOL_H_
@@ -0,0 +1,255 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <dirent.h>   // for opendir(), etc.
+#include <limits.h>   // for PTHREAD_STACK_MIN
+#include <sched.h>    // for sched_getaffinity(), sched_getcpu()
+#include <stdlib.h>   // for strtol()
+#include <unistd.h>   // for sysconf()
+#include <algorithm>
+#include <fstream>
+
+#include "./ThreadPlacement.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Where the kernel describes the NUMA nodes.
+static const char* kNodeDir = "/sys/devices/system/node";
+
+// Reads the CPUs in the kernel-style CPU list in file "path" into
+// "cpus".
+static bool ReadCpuList(const string& path, vector<int>* const cpus) {
+  std::ifstream in(path);
+  string list;
+  return std::getline(in, list) && ParseCpuList(list, cpus);
+}
+
+CpuTopology::CpuTopology(const vector<vector<int>>& nodes) : num_cpus_(0) {
+  for (const vector<int>& cpus : nodes) {
+    if (cpus.empty())
+      continue;
+    nodes_.push_back(cpus);
+    std::sort(nodes_.back().begin(), nodes_.back().end());
+    for (int cpu : cpus) {
+      if (cpu >= static_cast<int>(node_of_.size()))
+        node_of_.resize(cpu + 1, -1);
+      node_of_[cpu] = nodes_.size() - 1;
+      num_cpus_++;
+    }
+  }
+}
+
+// static
+const CpuTopology& CpuTopology::System() {
+  static const CpuTopology* topology = [] {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+      CPU_SET(0, &allowed);
+    }
+
+    // Nodes are named node0, node1, ..., though not necessarily without
+    // gaps.
+    vector<int> node_ids;
+    DIR* dir = opendir(kNodeDir);
+    if (dir != nullptr) {
+      struct dirent* entry;
+      while ((entry = readdir(dir)) != nullptr) {
+        string name = entry->d_name;
+        if (name.compare(0, 4, "node") == 0 && name.size() > 4 &&
+            name.find_first_not_of("0123456789", 4) == string::npos) {
+          node_ids.push_back(atoi(name.c_str() + 4));
+        }
+      }
+      closedir(dir);
+    }
+    std::sort(node_ids.begin(), node_ids.end());
+
+    vector<vector<int>> nodes;
+    for (int id : node_ids) {
+      vector<int> cpus, ours;
+      ReadCpuList(string(kNodeDir) + "/node" + std::to_string(id) +
+                  "/cpulist", &cpus);
+      for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+          ours.push_back(cpu);
+      }
+      nodes.push_back(ours);
+    }
+
+    CpuTopology* t = new CpuTopology(nodes);
+    if (t->num_cpus() == 0) {
+      // No NUMA information; make it one node.
+      vector<int> cpus;
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed))
+          cpus.push_back(cpu);
+      }
+      delete t;
+      t = new CpuTopology({cpus});
+    }
+    return t;
+  }();
+  return *topology;
+}
+
+int CpuTopology::NodeOf(int cpu) const {
+  if (cpu < 0 || cpu >= static_cast<int>(node_of_.size()))
+    return -1;
+  return node_of_[cpu];
+}
+
+bool ParseCpuList(const string& list, vector<int>* const cpus) {
+  vector<int> parsed;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == string::npos)
+      end = list.size();
+    string range = list.substr(pos, end - pos);
+    pos = end + 1;
+
+    // Each piece is "N" or "N-M".
+    char* rest;
+    long first = strtol(range.c_str(), &rest, 10);  // NOLINT(runtime/int)
+    long last = first;                               // NOLINT(runtime/int)
+    if (rest == range.c_str() || first < 0)
+      return false;
+    if (*rest == '-') {
+      const char* second = rest + 1;
+      last = strtol(second, &rest, 10);
+      if (rest == second || last < first)
+        return false;
+    }
+    if (*rest != '\0' || last >= CPU_SETSIZE)
+      return false;
+    for (long cpu = first; cpu <= last; cpu++)  // NOLINT(runtime/int)
+      parsed.push_back(cpu);
+  }
+  if (parsed.empty())
+    return false;
+  *cpus = parsed;
+  return true;
+}
+
+bool ParsePlacement(const string& spec, PlacementOptions* const options) {
+  if (spec == "none") {
+    options->policy = kPlaceNone;
+  } else if (spec == "compact") {
+    options->policy = kPlaceCompact;
+  } else if (spec == "scatter") {
+    options->policy = kPlaceScatter;
+  } else if (ParseCpuList(spec, &options->cpus)) {
+    options->policy = kPlaceList;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+ThreadPlacement::ThreadPlacement(const PlacementOptions& options,
+                                 const CpuTopology& topology)
+  : options_(options), topology_(topology) {
+  switch (options_.policy) {
+    case kPlaceNone:
+      break;
+    case kPlaceCompact:
+      for (uint32_t node = 0; node < topology_.num_nodes(); node++) {
+        const vector<int>& cpus = topology_.cpus(node);
+        order_.insert(order_.end(), cpus.begin(), cpus.end());
+      }
+      break;
+    case kPlaceScatter:
+      // Round r takes the r'th CPU of every node that has one.
+      for (uint32_t r = 0; order_.size() < topology_.num_cpus(); r++) {
+        for (uint32_t node = 0; node < topology_.num_nodes(); node++) {
+          if (r < topology_.cpus(node).size())
+            order_.push_back(topology_.cpus(node)[r]);
+        }
+      }
+      break;
+    case kPlaceList:
+      // Pinning a thread to a CPU the process isn't allowed on would
+      // keep it from being created at all, so leave those out.
+      for (int cpu : options_.cpus) {
+        if (topology_.NodeOf(cpu) >= 0)
+          order_.push_back(cpu);
+      }
+      break;
+  }
+}
+
+int ThreadPlacement::CpuFor(uint32_t index) const {
+  if (order_.empty())
+    return -1;
+  return order_[index % order_.size()];
+}
+
+uint32_t ThreadPlacement::NodeFor(uint32_t index) const {
+  int cpu = CpuFor(index);
+  return (cpu < 0) ? 0 : topology_.NodeOf(cpu);
+}
+
+uint32_t ThreadPlacement::num_nodes() const {
+  return order_.empty() ? 1 : topology_.num_nodes();
+}
+
+uint32_t ThreadPlacement::CurrentNode() const {
+  if (order_.empty())
+    return 0;
+  int node = topology_.NodeOf(sched_getcpu());
+  return (node < 0) ? 0 : node;
+}
+
+int ThreadPlacement::Create(uint32_t index, pthread_t* const thread,
+                            void* (*start_routine)(void*), void* arg) const {
+  pthread_attr_t attr;
+  int err = pthread_attr_init(&attr);
+  if (err != 0)
+    return err;
+
+  if (options_.stack_size > 0) {
+    // The stack has to be at least the minimum, in whole pages.
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = std::max(options_.stack_size,
+                           static_cast<size_t>(PTHREAD_STACK_MIN));
+    size = (size + page - 1) / page * page;
+    err = pthread_attr_setstacksize(&attr, size);
+  }
+
+  int cpu = CpuFor(index);
+  if (err == 0 && cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    err = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  }
+
+  if (err == 0)
+    err = pthread_create(thread, &attr, start_routine, arg);
+  pthread_attr_destroy(&attr);
+  return err;
+}
+
+void ThreadPlacement::PinThisThread(uint32_t index) const {
+  int cpu = CpuFor(index);
+  if (cpu < 0)
+    return;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+}  // namespace hw4
@@ -0,0 +1,141 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_THREADPLACEMENT_H_
+#define HW4_THREADPLACEMENT_H_
+
+extern "C" {
+#include <pthread.h>  // for pthread_t
+}
+
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uint32_t, etc.
+#include <string>     // for std::string
+#include <vector>     // for std::vector
+
+namespace hw4 {
+
+// The CPUs a process may run on, grouped by NUMA node.  Nodes without
+// any such CPUs are left out, and the rest are numbered 0, 1, ... in
+// the order the kernel numbers them.
+class CpuTopology {
+ public:
+  // A topology with the CPUs "nodes[n]" on node n, e.g., for testing.
+  explicit CpuTopology(const std::vector<std::vector<int>>& nodes);
+
+  // This machine's topology, read out of /sys the first time it's
+  // asked for and limited to the CPUs the process is allowed on.  If
+  // the kernel doesn't say, every CPU is on node 0.
+  static const CpuTopology& System();
+
+  uint32_t num_nodes() const { return nodes_.size(); }
+  uint32_t num_cpus() const { return num_cpus_; }
+
+  // The CPUs on node "node", in increasing order.
+  const std::vector<int>& cpus(uint32_t node) const { return nodes_[node]; }
+
+  // The node that CPU "cpu" is on, or -1 if it isn't one of ours.
+  int NodeOf(int cpu) const;
+
+ private:
+  std::vector<std::vector<int>> nodes_;
+  std::vector<int> node_of_;  // indexed by CPU number
+  uint32_t num_cpus_;
+};
+
+// How to place a set of threads on CPUs.
+enum PlacementPolicy {
+  // Let the kernel put them wherever it likes.
+  kPlaceNone,
+
+  // Pin thread i to the i'th CPU, filling up one node before moving on
+  // to the next, so that threads share caches and memory as much as
+  // possible.
+  kPlaceCompact,
+
+  // Deal threads out to the nodes round-robin, pinning each to the next
+  // CPU on its node, so that threads get as much cache and memory
+  // bandwidth to themselves as possible.
+  kPlaceScatter,
+
+  // Pin thread i to the i'th CPU on a list given explicitly.
+  kPlaceList
+};
+
+struct PlacementOptions {
+  PlacementPolicy policy = kPlaceNone;
+
+  // The CPUs for kPlaceList.  Threads wrap around the list if there are
+  // more of them than it has CPUs.
+  std::vector<int> cpus;
+
+  // The stack size to give each thread, in bytes; 0 means the system's
+  // default.
+  size_t stack_size = 0;
+};
+
+// Parses a CPU list like the kernel's, e.g., "0-3,8,10-11", into
+// "cpus".  Returns false if it's malformed.
+bool ParseCpuList(const std::string& list, std::vector<int>* const cpus);
+
+// Parses "none", "compact", "scatter" or a CPU list (see
+// ParseCpuList()) into "options".  Returns false, leaving "options"
+// alone, if it's none of those.
+bool ParsePlacement(const std::string& spec, PlacementOptions* const options);
+
+// A ThreadPlacement creates threads numbered 0, 1, ... with the stack
+// size and on the CPUs that a PlacementOptions asks for.  A thread is
+// pinned from the moment it's created, so that it never runs on (or
+// touches memory from) the wrong node.
+class ThreadPlacement {
+ public:
+  // Places threads as "options" says on "topology", which must outlive
+  // the ThreadPlacement.
+  explicit ThreadPlacement(
+    const PlacementOptions& options,
+    const CpuTopology& topology = CpuTopology::System());
+
+  // The CPU that thread "index" is pinned to, or -1 if it isn't.
+  int CpuFor(uint32_t index) const;
+
+  // The node that thread "index" runs on; 0 for a thread that isn't
+  // pinned.
+  uint32_t NodeFor(uint32_t index) const;
+
+  // The number of nodes that threads are placed on, counting all the
+  // unpinned threads as one node.
+  uint32_t num_nodes() const;
+
+  // The node that the calling thread is running on right now; 0 if
+  // threads aren't being placed.
+  uint32_t CurrentNode() const;
+
+  // Creates thread number "index", running "start_routine(arg)", like
+  // pthread_create().  Returns 0, or pthread_create()'s error.
+  int Create(uint32_t index, pthread_t* const thread,
+             void* (*start_routine)(void*), void* arg) const;
+
+  // Pins the calling thread as if it were thread number "index", e.g.,
+  // for a thread the caller didn't create.  Failure is harmless, so it
+  // is ignored.
+  void PinThisThread(uint32_t index) const;
+
+ private:
+  PlacementOptions options_;
+  const CpuTopology& topology_;
+
+  // The CPUs to pin threads to, thread i getting order_[i % size].
+  std::vector<int> order_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_THREADPLACEMENT_H_
@@ -9,7 +9,13 @@
  * author.
  */
 
+#include <limits.h>       // for INT_MAX
+#include <linux/futex.h>  // for FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE
+#include <sched.h>        // for sched_yield()
+#include <sys/syscall.h>  // for SYS_futex
+#include <time.h>         // for clock_gettime()
 #include <unistd.h>
+#include <algorithm>
 #include <iostream>
 
 #include "./ThreadPool.h"
@@ -20,120 +26,728 @@ extern "C" {
 
 namespace hw4 {
 
+// static
+const uint32_t ThreadPool::kQueueCapacity;
+
+// The worker that the calling thread is, if it's one.
+static thread_local ThreadPool::Worker* current_worker = nullptr;
+
 // This is the thread start routine, i.e., the function that threads
 // are born into.
-void* ThreadLoop(void* t_pool);
+void* ThreadLoop(void* t_worker);
+
+// Sleeps until "word" is woken up, unless it no longer holds
+// "expected", in which case there is no point, or until "timeout_ns"
+// nanoseconds go by (0 means no timeout).  May also return spuriously.
+static void FutexWait(std::atomic<uint32_t>* word, uint32_t expected,
+                      uint64_t timeout_ns = 0) {
+  static_assert(sizeof(*word) == sizeof(uint32_t), "futexes are 32 bits");
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ns / 1000000000;
+  timeout.tv_nsec = timeout_ns % 1000000000;
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE,
+          expected, timeout_ns == 0 ? nullptr : &timeout, nullptr, 0);
+}
+
+// Wakes up to "num_waiters" threads sleeping on "word".
+static void FutexWake(std::atomic<uint32_t>* word, int num_waiters) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE,
+          num_waiters, nullptr, nullptr, 0);
+}
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t MaxThreads(const ThreadPoolOptions& options) {
+  return std::max(options.num_threads, options.max_threads);
+}
+
+// Deals out turns to lanes with the given weights, each lane getting
+// as many as its weight, interleaved the way nginx's smooth weighted
+// round-robin does it: e.g., weights {3, 1} give 0, 0, 1, 0.
+static std::vector<uint32_t> LaneSchedule(
+    const std::vector<uint32_t>& weights) {
+  std::vector<uint32_t> schedule;
+  std::vector<int64_t> current(weights.size(), 0);
+  int64_t total = 0;
+  for (uint32_t weight : weights) {
+    total += weight;
+  }
+  for (int64_t turn = 0; turn < total; turn++) {
+    uint32_t pick = 0;
+    for (uint32_t i = 0; i < weights.size(); i++) {
+      current[i] += weights[i];
+      if (current[i] > current[pick]) {
+        pick = i;
+      }
+    }
+    current[pick] -= total;
+    schedule.push_back(pick);
+  }
+  return schedule;
+}
+
+static ThreadPoolOptions MakeOptions(uint32_t num_threads,
+                                     uint32_t max_queued) {
+  ThreadPoolOptions options;
+  options.num_threads = num_threads;
+  options.max_queued = max_queued;
+  return options;
+}
 
-ThreadPool::ThreadPool(uint32_t num_threads) {
+ThreadPool::ThreadPool(uint32_t num_threads, uint32_t max_queued)
+  : ThreadPool(MakeOptions(num_threads, max_queued)) { }
+
+ThreadPool::ThreadPool(const ThreadPoolOptions& options)
+  : submitted_(kQueueCapacity),
+    work_queue_(std::max(kQueueCapacity,
+                         options.max_queued + MaxThreads(options))),
+    placement_(options.placement) {
   // Initialize our member variables.
   num_threads_running_ = 0;
+  num_threads_idle_ = 0;
+  num_threads_blocked_ = 0;
+  num_threads_ = 0;
+  peak_threads_ = 0;
+  min_threads_ = options.num_threads;
+  max_threads_ = MaxThreads(options);
+  elastic_ = max_threads_ > min_threads_;
+  grow_wait_ns_ = options.grow_wait_ms * 1000000ULL;
+  idle_timeout_ns_ = options.idle_timeout_ms * 1000000ULL;
+  growing_ = false;
   terminate_threads_ = false;
-  Verify333(pthread_mutex_init(&q_lock_, nullptr) == 0);
-  Verify333(pthread_cond_init(&q_cond_, nullptr) == 0);
+  max_queued_ = options.max_queued;
+  num_overflow_ = 0;
+  room_seq_ = 0;
+  num_room_waiters_ = 0;
+  work_stealing_ = options.work_stealing;
+  num_stolen_ = 0;
+  Verify333(pthread_mutex_init(&overflow_lock_, nullptr) == 0);
+
+  // With more than one lane, each one gets a queue of its own.
+  num_lanes_ = std::max<size_t>(1, options.lane_weights.size());
+  lane_scheduling_ = options.lane_scheduling;
+  lane_turn_ = 0;
+  if (num_lanes_ > 1) {
+    lanes_.reset(new Lane[num_lanes_]);
+    for (uint32_t i = 0; i < num_lanes_; i++) {
+      lanes_[i].queue.reset(new MpmcQueue<Task*>(work_queue_.capacity()));
+      lanes_[i].num_run = 0;
+      lanes_[i].total_wait_ns = 0;
+      lanes_[i].max_wait_ns = 0;
+    }
+    if (lane_scheduling_ == kLanesWeighted) {
+      lane_schedule_ = LaneSchedule(options.lane_weights);
+    }
+  }
+  stamp_tasks_ = elastic_ || num_lanes_ > 1;
 
-  // Allocate the array of pthread structures.
-  thread_array_ = new pthread_t[num_threads];
+  // Each node gets a list of its idle workers, and, if there's more
+  // than one node (and tasks aren't queued by lane instead), a queue of
+  // its own.
+  num_nodes_ = placement_.num_nodes();
+  for (uint32_t node = 0; node < num_nodes_; node++) {
+    idle_workers_.emplace_back(new MpmcQueue<Worker*>(max_threads_));
+    if (num_nodes_ > 1 && num_lanes_ == 1) {
+      node_queues_.emplace_back(
+        new MpmcQueue<Task*>(work_queue_.capacity()));
+    }
+  }
+
+  // Allocate a slot for every worker the pool may grow to.
+  workers_ = new Worker[max_threads_];
+  for (uint32_t i = 0; i < max_threads_; i++) {
+    workers_[i].pool = this;
+    workers_[i].index = i;
+    workers_[i].node = placement_.NodeFor(i);
+    workers_[i].parked = 0;
+    workers_[i].queued = false;
+    workers_[i].active = false;
+    workers_[i].joinable = false;
+    workers_[i].blocked = false;
+    if (work_stealing_) {
+      workers_[i].deque.reset(new WorkStealingDeque<Task*>(kDequeCapacity));
+    }
+  }
 
-  // Spawn the threads one by one, passing them a pointer to self
-  // as the argument to the thread start routine.
-  Verify333(pthread_mutex_lock(&q_lock_) == 0);
-  for (uint32_t i = 0; i < num_threads; i++) {
-    Verify333(pthread_create(&(thread_array_[i]),
-                             nullptr,
-                             &ThreadLoop,
-                             static_cast<void*>(this)) == 0);
+  // A lazy pool is ready as it is; its threads come along with its
+  // first tasks.
+  if (options.lazy_start) {
+    return;
   }
 
-  // Wait for all of the threads to be born and initialized.
-  while (num_threads_running_ != num_threads) {
-    Verify333(pthread_mutex_unlock(&q_lock_) == 0);
-    sleep(1);  // give another thread the chance to acquire the lock
-    Verify333(pthread_mutex_lock(&q_lock_) == 0);
+  // Spawn the first num_threads threads one by one; the rest wait until
+  // they're needed.
+  growing_ = true;
+  for (uint32_t i = 0; i < min_threads_; i++) {
+    StartWorker();
+  }
+  growing_ = false;
+  Verify333(num_threads_ == min_threads_);
+
+  // Wait for all of the threads to be born and initialized.  Each one
+  // wakes us up as it checks in.
+  uint32_t running;
+  while ((running = num_threads_running_) < min_threads_) {
+    FutexWait(&num_threads_running_, running);
   }
-  Verify333(pthread_mutex_unlock(&q_lock_) == 0);
 
   // Done!  The thread pool is ready, and all of the worker threads
-  // are initialized and waiting on q_cond_ to be notified of available
-  // work.
+  // are initialized, waiting to be woken up with work.
 }
 
 ThreadPool:: ~ThreadPool() {
-  Verify333(pthread_mutex_lock(&q_lock_) == 0);
-  uint32_t num_threads = num_threads_running_;
-
-  // Tell all of the worker threads to terminate.
+  // Tell all of the worker threads to terminate, and release anyone
+  // waiting for room in the queue.  Clearing the futex words makes sure
+  // that a thread on its way to sleep doesn't.  Once any worker being
+  // added has started, no more can be.
   terminate_threads_ = true;
+  bool not_growing = false;
+  while (!growing_.compare_exchange_weak(not_growing, true)) {
+    not_growing = false;
+    sched_yield();
+  }
+  room_seq_++;
+  FutexWake(&room_seq_, INT_MAX);
+  for (uint32_t i = 0; i < max_threads_; i++) {
+    workers_[i].parked = 0;
+    FutexWake(&workers_[i].parked, 1);
+  }
+
+  // Join with the threads 1-by-1 until they have all died, including
+  // those that retired since they were last joined.
+  for (uint32_t i = 0; i < max_threads_; i++) {
+    if (workers_[i].joinable) {
+      Verify333(pthread_join(workers_[i].thread, nullptr) == 0);
+      workers_[i].joinable = false;
+    }
+  }
 
-  // Join with the running threads 1-by-1 until they have all died.
-  for (uint32_t i = 0; i < num_threads; i++) {
-    // Use a sledgehammer and broadcast every loop iteration, just to
-    // be extra-certain that worker threads wake up and see the terminate flag.
-    Verify333(pthread_cond_broadcast(&q_cond_) == 0);
-    Verify333(pthread_mutex_unlock(&q_lock_) == 0);
-    Verify333(pthread_join(thread_array_[i], nullptr) == 0);
-    Verify333(pthread_mutex_lock(&q_lock_) == 0);
+  // Empty the task queue and the workers' deques, serially issuing any
+  // remaining work.
+  Verify333(num_threads_running_ == 0);
+  Task* nextTask;
+  while (TakeTask(nullptr, &nextTask)) {
+    nextTask->func_(nextTask);
   }
 
   // All of the worker threads are dead, so clean up the thread
   // structures.
-  Verify333(num_threads_running_ == 0);
-  if (thread_array_ != nullptr) {
-    delete[] thread_array_;
+  if (workers_ != nullptr) {
+    delete[] workers_;
   }
-  thread_array_ = nullptr;
-  Verify333(pthread_mutex_unlock(&q_lock_) == 0);
+  workers_ = nullptr;
+  Verify333(pthread_mutex_destroy(&overflow_lock_) == 0);
+}
 
-  // Empty the task queue, serially issuing any remaining work.
-  while (!work_queue_.empty()) {
-    Task* nextTask = work_queue_.front();
-    work_queue_.pop_front();
-    nextTask->func_(nextTask);
+void ThreadPool::StartWorker() {
+  // A thread that has just retired may not have given up its slot yet,
+  // in which case there may be no free slot after all; we'll get
+  // another chance to grow.
+  Worker* worker = nullptr;
+  for (uint32_t i = 0; i < max_threads_ && worker == nullptr; i++) {
+    if (!workers_[i].active) {
+      worker = &workers_[i];
+    }
+  }
+  if (worker == nullptr) {
+    return;
+  }
+
+  // The thread that ran here last is gone, or all but.
+  if (worker->joinable) {
+    Verify333(pthread_join(worker->thread, nullptr) == 0);
+    worker->joinable = false;
   }
+
+  worker->active = true;
+  uint32_t num_threads = ++num_threads_;
+  if (placement_.Create(worker->index, &(worker->thread), &ThreadLoop,
+                        static_cast<void*>(worker)) != 0) {
+    num_threads_--;
+    worker->active = false;
+    return;
+  }
+  worker->joinable = true;
+
+  uint32_t peak = peak_threads_;
+  while (num_threads > peak &&
+         !peak_threads_.compare_exchange_weak(peak, num_threads)) { }
+}
+
+void ThreadPool::MaybeGrow(bool backed_up) {
+  uint32_t num_threads = num_threads_;
+  if (num_threads >= max_threads_ || terminate_threads_) {
+    return;
+  }
+  bool short_of_min = num_threads < min_threads_;
+  if (!short_of_min && !elastic_) {
+    return;
+  }
+  uint32_t queued = num_queued();
+  if (queued == 0) {
+    return;
+  }
+  if (!backed_up && !short_of_min) {
+    // The workers that are neither idle nor blocked will get to the
+    // queue as soon as they finish what they're doing, so only grow if
+    // there's more waiting than they can take on.
+    uint32_t unavailable = num_threads_idle_ + num_threads_blocked_;
+    uint32_t available =
+      (num_threads > unavailable) ? num_threads - unavailable : 0;
+    if (queued <= available) {
+      return;
+    }
+  }
+
+  // Grow by one thread at a time; if somebody else is already growing
+  // the pool, that will do for now.
+  bool not_growing = false;
+  if (!growing_.compare_exchange_strong(not_growing, true)) {
+    return;
+  }
+  if (num_threads_ < max_threads_ && !terminate_threads_) {
+    StartWorker();
+  }
+  growing_ = false;
+}
+
+void ThreadPool::NoteWait(Task* t) {
+  if (t->queued_ns_ == 0) {
+    return;
+  }
+  uint64_t wait_ns = NowNs() - t->queued_ns_;
+  if (num_lanes_ > 1) {
+    Lane* lane = &lanes_[std::min(t->lane_, num_lanes_ - 1)];
+    lane->num_run++;
+    lane->total_wait_ns += wait_ns;
+    uint64_t max = lane->max_wait_ns;
+    while (wait_ns > max &&
+           !lane->max_wait_ns.compare_exchange_weak(max, wait_ns)) { }
+  }
+  if (elastic_ && grow_wait_ns_ > 0 && wait_ns > grow_wait_ns_) {
+    MaybeGrow(true);
+  }
+}
+
+void ThreadPool::BeginBlocking() {
+  Worker* worker = current_worker;
+  if (worker == nullptr || worker->blocked) {
+    return;
+  }
+  worker->blocked = true;
+  worker->pool->num_threads_blocked_++;
+  worker->pool->MaybeGrow(false);
+}
+
+void ThreadPool::EndBlocking() {
+  Worker* worker = current_worker;
+  if (worker == nullptr || !worker->blocked) {
+    return;
+  }
+  worker->blocked = false;
+  worker->pool->num_threads_blocked_--;
 }
 
 // Enqueue a Task for dispatch.
 void ThreadPool::Dispatch(Task* t) {
-  Verify333(pthread_mutex_lock(&q_lock_) == 0);
   Verify333(terminate_threads_ == false);
-  work_queue_.push_back(t);
-  Verify333(pthread_cond_signal(&q_cond_) == 0);
-  Verify333(pthread_mutex_unlock(&q_lock_) == 0);
+  Enqueue(t);
+}
+
+void ThreadPool::Spawn(Task* t) {
+  Worker* worker = current_worker;
+  if (terminate_threads_ || worker == nullptr || worker->pool != this ||
+      !worker->deque) {
+    Enqueue(t);
+    return;
+  }
+  if (stamp_tasks_) {
+    t->queued_ns_ = NowNs();
+  }
+  if (!worker->deque->Push(t)) {
+    Enqueue(t);
+    return;
+  }
+
+  // Let an idle worker know there's something to steal.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!UnparkWorker(worker->node)) {
+    MaybeGrow(false);
+  }
+}
+
+void ThreadPool::EnqueueSubmitted(Task* t) {
+  if (!submitted_.TryPush(t)) {
+    t->func_(t);
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!UnparkWorker(placement_.CurrentNode())) {
+    MaybeGrow(false);
+  }
+}
+
+void ThreadPool::WaitFor(FutureStateBase* state) {
+  Worker* worker = current_worker;
+  if (worker != nullptr && worker->pool != this) {
+    worker = nullptr;
+  }
+  while (!state->done()) {
+    // Help with submitted tasks for as long as there are any.  If the
+    // one we're waiting for is among them, we'll get to it; if not,
+    // somebody is running it already.
+    Task* t;
+    if (submitted_.TryPop(&t)) {
+      t->func_(t);
+      continue;
+    }
+
+    // Sleep until Finish() wakes us.  Meanwhile, an elastic pool
+    // shouldn't count on this worker to get to queued tasks.
+    uint32_t expected = FutureStateBase::kPending;
+    if (!state->state_.compare_exchange_strong(
+          expected, FutureStateBase::kSleeping) &&
+        expected == FutureStateBase::kDone) {
+      break;
+    }
+    bool was_blocked = (worker == nullptr) || worker->blocked;
+    if (!was_blocked) {
+      BeginBlocking();
+    }
+    FutexWait(&state->state_, FutureStateBase::kSleeping, 0);
+    if (!was_blocked) {
+      EndBlocking();
+    }
+  }
+}
+
+void FutureStateBase::Finish(std::exception_ptr error) {
+  error_ = error;
+  if (state_.exchange(kDone, std::memory_order_acq_rel) == kSleeping) {
+    FutexWake(&state_, INT_MAX);
+  }
+}
+
+void WhenAll(std::vector<TaskFuture<void>>* futures) {
+  for (const TaskFuture<void>& future : *futures) {
+    future.Wait();
+  }
+  for (TaskFuture<void>& future : *futures) {
+    future.Get();
+  }
+}
+
+bool ThreadPool::TryDispatch(Task* t) {
+  Verify333(terminate_threads_ == false);
+  if (QueueFull()) {
+    return false;
+  }
+  Enqueue(t);
+  return true;
+}
+
+void ThreadPool::Enqueue(Task* t) {
+  if (stamp_tasks_) {
+    t->queued_ns_ = NowNs();
+  }
+
+  // The task waits in its lane, if there's more than one, or else on
+  // the queue of the node it came from, if there's more than one of
+  // those.  Once anything has overflowed, later tasks line up behind
+  // it, so that tasks are still picked up in the order they came in.
+  uint32_t node = (num_nodes_ > 1) ? placement_.CurrentNode() : 0;
+  bool queued = false;
+  if (num_overflow_ == 0) {
+    if (num_lanes_ > 1) {
+      queued = lanes_[std::min(t->lane_, num_lanes_ - 1)].queue->TryPush(t);
+    } else {
+      queued = (!node_queues_.empty() && node_queues_[node]->TryPush(t)) ||
+               work_queue_.TryPush(t);
+    }
+  }
+  if (!queued) {
+    Verify333(pthread_mutex_lock(&overflow_lock_) == 0);
+    overflow_queue_.push_back(t);
+    num_overflow_++;
+    Verify333(pthread_mutex_unlock(&overflow_lock_) == 0);
+  }
+
+  // Either a worker went idle before the task went in, in which case
+  // we find it on idle_workers_ here, or it will find the task when it
+  // takes its last look at the queue before parking.  If there's
+  // nobody idle, maybe it's time the pool grew.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!UnparkWorker(node)) {
+    MaybeGrow(false);
+  }
+}
+
+bool ThreadPool::TakeTask(Worker* worker, Task** const t) {
+  if (worker != nullptr && worker->deque && worker->deque->Pop(t)) {
+    return true;
+  }
+
+  // Submit()ted tasks are parts of a job that somebody is waiting on,
+  // so they go first.
+  if (submitted_.TryPop(t)) {
+    return true;
+  }
+
+  // Work from our own node comes first, then the shared queue, then
+  // work from the other nodes.  Or, with lanes, whichever lane's turn
+  // it is.
+  uint32_t node = (worker == nullptr) ? 0 : worker->node;
+  bool took;
+  if (num_lanes_ > 1) {
+    took = TakeFromLanes(t);
+  } else {
+    took = !node_queues_.empty() && node_queues_[node]->TryPop(t);
+    if (!took) {
+      took = work_queue_.TryPop(t);
+    }
+  }
+  if (!took && num_overflow_ > 0) {
+    Verify333(pthread_mutex_lock(&overflow_lock_) == 0);
+    if (!overflow_queue_.empty()) {
+      *t = overflow_queue_.front();
+      overflow_queue_.pop_front();
+      num_overflow_--;
+      took = true;
+    }
+    Verify333(pthread_mutex_unlock(&overflow_lock_) == 0);
+  }
+  for (uint32_t i = 1; !took && i < node_queues_.size(); i++) {
+    took = node_queues_[(node + i) % node_queues_.size()]->TryPop(t);
+  }
+  if (took) {
+    NotifyRoom();
+    return true;
+  }
+  return work_stealing_ && StealTask(worker, t);
+}
+
+bool ThreadPool::TakeFromLanes(Task** const t) {
+  // A weighted pool whose lanes all weigh nothing is as good as strict.
+  uint32_t first = 0;
+  if (!lane_schedule_.empty()) {
+    uint64_t turn = lane_turn_.fetch_add(1, std::memory_order_relaxed);
+    first = lane_schedule_[turn % lane_schedule_.size()];
+  }
+  if (lanes_[first].queue->TryPop(t)) {
+    return true;
+  }
+  for (uint32_t i = 0; i < num_lanes_; i++) {
+    if (i != first && lanes_[i].queue->TryPop(t)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::StealTask(Worker* thief, Task** const t) {
+  // Start with the worker after the thief, so that thieves spread out
+  // over their victims.
+  uint32_t first = (thief == nullptr) ? 0 : thief->index + 1;
+  for (uint32_t i = 0; i < max_threads_; i++) {
+    Worker* victim = &workers_[(first + i) % max_threads_];
+    if (victim == thief || (thief != nullptr && !victim->active)) {
+      continue;
+    }
+    if (victim->deque->Steal(t)) {
+      num_stolen_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+ThreadPool::Task* ThreadPool::Park(Worker* worker, bool* const retire) {
+  *retire = false;
+  num_threads_idle_++;
+
+  // In an elastic pool, idle threads time out, and retire if the pool
+  // is above its minimum.
+  bool may_retire = elastic_ && idle_timeout_ns_ > 0;
+  Task* task = nullptr;
+  while (task == nullptr && !terminate_threads_) {
+    worker->parked = 1;
+    if (!worker->queued.exchange(true)) {
+      Verify333(idle_workers_[worker->node]->TryPush(worker));
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    NotifyRoom();
+
+    // Take one last look at the queue: a task that went in before we
+    // got onto idle_workers_ is our job, not Dispatch()'s, to notice.
+    if (TakeTask(worker, &task)) {
+      worker->parked = 0;
+      break;
+    }
+
+    uint64_t deadline = may_retire ? NowNs() + idle_timeout_ns_ : 0;
+    while (worker->parked == 1 && !terminate_threads_) {
+      uint64_t now = may_retire ? NowNs() : 0;
+      if (may_retire && now >= deadline) {
+        break;
+      }
+      FutexWait(&worker->parked, 1, may_retire ? deadline - now : 0);
+    }
+    if (worker->parked.exchange(0) != 1) {
+      // Somebody unparked us.
+      break;
+    }
+    if (terminate_threads_) {
+      break;
+    }
+
+    // We timed out.  Retire, unless that would leave the pool below its
+    // minimum, in which case park all over again.
+    uint32_t num_threads = num_threads_;
+    while (num_threads > min_threads_ &&
+           !num_threads_.compare_exchange_weak(num_threads,
+                                               num_threads - 1)) { }
+    if (num_threads <= min_threads_) {
+      continue;
+    }
+
+    // A task queued while we were making up our minds may have found
+    // nobody to unpark, and counted on us to get to it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (TakeTask(worker, &task)) {
+      num_threads_++;
+      break;
+    }
+    *retire = true;
+    break;
+  }
+  num_threads_idle_--;
+  return task;
+}
+
+bool ThreadPool::UnparkWorker(uint32_t node) {
+  // A worker that found work on its own before anyone unparked it, or
+  // has since retired, leaves a stale entry behind; skip past those.
+  // Try the workers on "node" first, since the task's data is likely
+  // there, but any idle worker beats none.
+  Worker* worker;
+  for (uint32_t i = 0; i < num_nodes_; i++) {
+    MpmcQueue<Worker*>* idle = idle_workers_[(node + i) % num_nodes_].get();
+    while (idle->TryPop(&worker)) {
+      worker->queued = false;
+      if (worker->parked.exchange(0) == 1) {
+        FutexWake(&worker->parked, 1);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WaitForRoom() {
+  while (1) {
+    // The same dance as a parking worker's: announce we're waiting,
+    // then check once more, so that a worker making room in between is
+    // bound to see us and bump room_seq_.
+    uint32_t seq = room_seq_;
+    if (!QueueFull() || terminate_threads_) {
+      return;
+    }
+    num_room_waiters_++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (QueueFull() && !terminate_threads_) {
+      FutexWait(&room_seq_, seq);
+    }
+    num_room_waiters_--;
+  }
+}
+
+void ThreadPool::NotifyRoom() {
+  if (max_queued_ == 0) {
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_room_waiters_ > 0) {
+    room_seq_++;
+    FutexWake(&room_seq_, INT_MAX);
+  }
+}
+
+bool ThreadPool::QueueFull() {
+  return max_queued_ > 0 && num_queued() >= max_queued_ + num_threads_idle_;
+}
+
+uint32_t ThreadPool::num_queued() {
+  uint32_t num = submitted_.size() + work_queue_.size() + num_overflow_;
+  for (auto& queue : node_queues_) {
+    num += queue->size();
+  }
+  for (uint32_t i = 0; num_lanes_ > 1 && i < num_lanes_; i++) {
+    num += lanes_[i].queue->size();
+  }
+  if (work_stealing_) {
+    for (uint32_t i = 0; i < max_threads_; i++) {
+      num += workers_[i].deque->size();
+    }
+  }
+  return num;
+}
+
+LaneStats ThreadPool::lane_stats(uint32_t lane) {
+  LaneStats stats;
+  if (num_lanes_ == 1) {
+    stats.num_queued = num_queued();
+  } else if (lane < num_lanes_) {
+    stats.num_queued = lanes_[lane].queue->size();
+    stats.num_run = lanes_[lane].num_run;
+    stats.total_wait_ns = lanes_[lane].total_wait_ns;
+    stats.max_wait_ns = lanes_[lane].max_wait_ns;
+  }
+  return stats;
 }
 
 // This is the main loop that all worker threads are born into.  They
-// wait for a signal on the work queue condition variable, then they
-// grab work off the queue.  Threads return (i.e., terminate)
-// when they notice that terminate_threads_ is true.
-void* ThreadLoop(void* t_pool) {
-  ThreadPool* pool = static_cast<ThreadPool*>(t_pool);
-
-  // Grab the lock, increment the thread count so that the ThreadPool
-  // constructor knows this new thread is alive.
-  Verify333(pthread_mutex_lock(&(pool->q_lock_)) == 0);
+// take work off the queue until it's empty, and then park until
+// Dispatch() wakes them up with more.  Threads return (i.e., terminate)
+// when they notice that terminate_threads_ is true, or when they have
+// been surplus to requirements for long enough.
+void* ThreadLoop(void* t_worker) {
+  ThreadPool::Worker* worker = static_cast<ThreadPool::Worker*>(t_worker);
+  ThreadPool* pool = worker->pool;
+  current_worker = worker;
+
+  // Increment the thread count so that the ThreadPool constructor knows
+  // this new thread is alive.
   pool->num_threads_running_++;
+  FutexWake(&pool->num_threads_running_, 1);
 
   // This is our main thread work loop.
   while (pool->terminate_threads_ == false) {
-    // Wait to be signaled that something has happened.
-    Verify333(pthread_cond_wait(&(pool->q_cond_), &(pool->q_lock_)) == 0);
-
-    // Keep trying to dequeue work until the work queue is empty.
-    while (!pool->work_queue_.empty() && (pool->terminate_threads_ == false)) {
-      ThreadPool::Task* nextTask = pool->work_queue_.front();
-      pool->work_queue_.pop_front();
-
-      // We picked up a Task, so invoke the task function with the
-      // lock released, then check so see if more tasks are waiting to
-      // be picked up.
-      Verify333(pthread_mutex_unlock(&(pool->q_lock_)) == 0);
-      nextTask->func_(nextTask);
-      Verify333(pthread_mutex_lock(&(pool->q_lock_)) == 0);
+    ThreadPool::Task* nextTask;
+    if (!pool->TakeTask(worker, &nextTask)) {
+      bool retire;
+      nextTask = pool->Park(worker, &retire);
+      if (retire) {
+        break;
+      }
+      if (nextTask == nullptr) {
+        continue;
+      }
     }
+    pool->NoteWait(nextTask);
+    nextTask->func_(nextTask);
+
+    // In case the task forgot.
+    ThreadPool::EndBlocking();
   }
 
-  // All done, exit.
+  // All done, exit, leaving our slot to whichever thread the pool adds
+  // next.
   pool->num_threads_running_--;
-  Verify333(pthread_mutex_unlock(&(pool->q_lock_)) == 0);
+  worker->active = false;
   return nullptr;
 }
 
@@ -16,11 +16,183 @@ extern "C" {
 #include <pthread.h>  // for the pthread threading/mutex functions
 }
 
-#include <stdint.h>   // for uint32_t, etc.
-#include <list>       // for std::list
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint32_t, etc.
+#include <algorithm>    // for std::min, std::max
+#include <atomic>       // for std::atomic
+#include <exception>    // for std::exception_ptr
+#include <list>         // for std::list
+#include <memory>       // for std::unique_ptr, std::shared_ptr
+#include <optional>     // for std::optional
+#include <type_traits>  // for std::invoke_result_t
+#include <utility>      // for std::move
+#include <vector>       // for std::vector
+
+#include "./MpmcQueue.h"
+#include "./ThreadPlacement.h"
+#include "./WorkStealingDeque.h"
 
 namespace hw4 {
 
+// How a ThreadPool with more than one lane (see
+// ThreadPoolOptions::lane_weights) picks the lane to take a task from.
+enum LaneScheduling {
+  // Each lane gets a share of the workers' attention in proportion to
+  // its weight, as long as it has tasks waiting.
+  kLanesWeighted,
+
+  // Lane 0 first, and lane 1 only when lane 0 is empty, and so on.
+  kLanesStrict
+};
+
+// How a ThreadPool is set up; the defaults make a single thread with an
+// unbounded first-in, first-out queue.
+struct ThreadPoolOptions {
+  // The number of threads the pool starts with, and never shrinks
+  // below.
+  uint32_t num_threads = 1;
+
+  // The most threads the pool grows to, one at a time, when tasks back
+  // up: when there are more tasks waiting than workers busy with tasks
+  // that aren't blocked (see BeginBlocking()), or when a task has
+  // waited longer than grow_wait_ms to be picked up.  Threads beyond
+  // num_threads exit once they've been idle for idle_timeout_ms (0
+  // means never).  0, or anything up to num_threads, means a pool of
+  // fixed size.
+  uint32_t max_threads = 0;
+  uint32_t grow_wait_ms = 10;
+  uint32_t idle_timeout_ms = 10000;
+
+  // How many tasks TryDispatch() lets wait in the queue with no idle
+  // worker to pick them up before it starts turning new ones away; 0
+  // means no limit.
+  uint32_t max_queued = 0;
+
+  // If true, the pool starts out with no threads at all, and creates
+  // them as tasks arrive that no idle worker is there to pick up, until
+  // it has num_threads of them (and then as above).  This makes
+  // constructing a pool that may never get any work next to free.
+  bool lazy_start = false;
+
+  // If true, every worker also has a deque of its own (see
+  // WorkStealingDeque.h) that the tasks it Spawn()s go onto.  A worker
+  // runs the newest task on its own deque first, while it's still warm
+  // in the cache, and only when that is empty looks at the shared queue
+  // and then steals the oldest task off some other worker's deque.
+  bool work_stealing = false;
+
+  // Which CPUs to run the workers on, and how big their stacks are (see
+  // ThreadPlacement.h).  Worker i is the pool's i'th thread slot.  When
+  // the workers span more than one NUMA node, the pool splits into a
+  // sub-pool per node: a task goes onto the queue of the node it was
+  // dispatched from, and wakes up an idle worker there if it can, and
+  // workers look at their own node's queue before any other.
+  PlacementOptions placement;
+
+  // With more than one entry, the pool queues tasks in separate lanes,
+  // one per entry, so that a burst of one kind of task doesn't hold up
+  // another: a task waits in the lane its lane_ says, and workers pick
+  // lanes as lane_scheduling says, giving lane i lane_weights[i] turns
+  // for every sum-of-the-weights tasks with kLanesWeighted.  Tasks in
+  // lanes wait in lane order, not by node.
+  std::vector<uint32_t> lane_weights;
+  LaneScheduling lane_scheduling = kLanesWeighted;
+};
+
+// What a ThreadPool lane has been up to (see ThreadPool::lane_stats()).
+struct LaneStats {
+  uint32_t num_queued = 0;     // waiting right now
+  uint64_t num_run = 0;        // picked up by a worker so far
+  uint64_t total_wait_ns = 0;  // between being queued and picked up
+  uint64_t max_wait_ns = 0;
+};
+
+class ThreadPool;
+
+// What a TaskFuture shares with the task that fulfills it: whether the
+// task has finished, and whether it threw.  FutureState<T> adds the
+// task's result.
+class FutureStateBase {
+ public:
+  FutureStateBase() : state_(kPending) { }
+  virtual ~FutureStateBase() { }
+
+  bool done() const {
+    return state_.load(std::memory_order_acquire) == kDone;
+  }
+
+  // Called by the task once it has stored its result, or with what it
+  // threw: marks it finished and wakes up whoever is waiting for it.
+  void Finish(std::exception_ptr error);
+
+  // Throws whatever the task threw, if anything.
+  void Rethrow() const {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  friend class ThreadPool;
+
+  // state_ doubles as the futex that waiters sleep on, once they've set
+  // it to kSleeping to ask Finish() to wake them.
+  enum { kPending, kDone, kSleeping };
+  std::atomic<uint32_t> state_;
+  std::exception_ptr error_;
+};
+
+template <typename T>
+class FutureState : public FutureStateBase {
+ public:
+  std::optional<T> value;
+};
+
+template <>
+class FutureState<void> : public FutureStateBase { };
+
+// A TaskFuture is the result of a task handed to ThreadPool::Submit(),
+// which the task fills in when it's done.  Waiting for it never just
+// sits there while tasks the result may depend on are still queued:
+// the waiting thread runs those itself, even if it's one of the pool's
+// workers, so that tasks that Submit() more tasks and wait for them
+// can't tie up every worker waiting on work that nobody is left to do.
+template <typename T>
+class TaskFuture {
+ public:
+  TaskFuture() : pool_(nullptr) { }
+
+  // Whether the TaskFuture came from Submit(), rather than being made
+  // empty.
+  bool valid() const { return state_ != nullptr; }
+
+  // Whether the task has finished.
+  bool ready() const { return state_->done(); }
+
+  // Waits for the task to finish, running submitted tasks, including
+  // this one if no worker has got to it yet, in the meantime.
+  void Wait() const;
+
+  // Waits, and then returns the task's result, or throws whatever the
+  // task threw.  Call at most once.
+  T Get();
+
+ private:
+  friend class ThreadPool;
+  TaskFuture(ThreadPool* pool, std::shared_ptr<FutureState<T>> state)
+    : pool_(pool), state_(std::move(state)) { }
+
+  ThreadPool* pool_;
+  std::shared_ptr<FutureState<T>> state_;
+};
+
+// Waits for all of "futures", and returns their results in order.  If
+// any of the tasks threw, rethrows what the first of them did, once
+// all of them have finished.
+template <typename T>
+std::vector<T> WhenAll(std::vector<TaskFuture<T>>* futures);
+void WhenAll(std::vector<TaskFuture<void>>* futures);
+
 // A ThreadPool is, well, a pool of threads. ;)  A ThreadPool is an
 // abstraction that allows customers to dispatch tasks to a set of
 // worker threads.  Tasks are queued, and as a worker thread becomes
@@ -34,7 +206,14 @@ class ThreadPool {
   // threads.  Arguments:
   //
   //  - num_threads:  the number of threads in the pool.
-  explicit ThreadPool(uint32_t num_threads);
+  //
+  //  - max_queued:  how many tasks TryDispatch() lets wait in the
+  //    queue with no idle worker to pick them up before it starts
+  //    turning new ones away; 0 means no limit.
+  explicit ThreadPool(uint32_t num_threads, uint32_t max_queued = 0);
+
+  // Construct a new ThreadPool set up according to "options".
+  explicit ThreadPool(const ThreadPoolOptions& options);
   virtual ~ThreadPool();
 
   // This inner class defines what a Task is.  A worker thread will
@@ -50,41 +229,398 @@ class ThreadPool {
    public:
     // "f" is the task function that a worker thread should invoke to
     // process the task.
-    explicit Task(thread_task_fn func) : func_(func) { }
+    explicit Task(thread_task_fn func)
+      : func_(func), lane_(0), queued_ns_(0) { }
 
     // The dispatch function.
     thread_task_fn func_;
+
+    // The lane the task waits in, if the pool has lanes; a lane the
+    // pool doesn't have means its last one.
+    uint32_t lane_;
+
+    // When the task was queued, if the pool is keeping track, in
+    // CLOCK_MONOTONIC nanoseconds.
+    uint64_t queued_ns_;
   };
 
   // Customers use Dispatch() to enqueue a Task for dispatch to a
   // worker thread.
   void Dispatch(Task* t);
 
-  // A lock and condition variable that worker threads and the
-  // Dispatch function use to guard the Task queue.
-  pthread_mutex_t q_lock_;
-  pthread_cond_t  q_cond_;
+  // Like Dispatch(), but if max_queued tasks are already waiting for a
+  // busy worker, returns false without queueing "t"; the caller keeps
+  // ownership of it.  Dispatch() itself ignores the limit, so that work
+  // which is already under way (e.g., a parked connection waking up)
+  // is never refused; only new work should go through TryDispatch().
+  // With several threads dispatching at once, the limit may be
+  // overshot by a task or two per thread.
+  bool TryDispatch(Task* t);
+
+  // Like Dispatch(), but for a running task to queue up a child task of
+  // its own.  With work stealing, the child goes onto the calling
+  // worker's deque, where that worker will get to it next unless an
+  // idle worker steals it first; otherwise (or when called from outside
+  // the pool) it's the same as Dispatch().  Unlike Dispatch(), Spawn()
+  // may be called by a task the destructor is running, in which case
+  // the destructor runs the child too.
+  void Spawn(Task* t);
+
+  // Queues "f", a callable object taking no arguments, to be called
+  // by a worker, and returns a TaskFuture for what it returns.  This is
+  // for splitting a job into parts that run in parallel, e.g., a query
+  // over several indices: submitted tasks wait in a queue of their own,
+  // which workers get to before any other, and threads waiting on a
+  // TaskFuture run them while they wait.  So "f" should only ever wait
+  // on other submitted tasks, never on a client, say.  If the queue is
+  // full, the calling thread calls "f" itself, then and there.
+  template <typename F>
+  TaskFuture<std::invoke_result_t<F>> Submit(F f);
+
+  // Calls "body(i)" for every i in [begin, end), and returns once all
+  // the calls have.  The range is split into chunks of at least "grain"
+  // indices, a few per worker, which are Submit()ted, except for the
+  // first, which the calling thread runs itself before helping with
+  // the rest.  If any call throws, rethrows what the first chunk to
+  // throw threw, once every chunk has finished.
+  template <typename F>
+  void ParallelFor(size_t begin, size_t end, F body, size_t grain = 1);
+
+  // Blocks until TryDispatch() would accept a task, or the pool is
+  // being destroyed.
+  void WaitForRoom();
+
+  // The number of tasks waiting for a worker, including those on the
+  // workers' deques.
+  uint32_t num_queued();
+
+  // The number of tasks that workers have stolen off other workers'
+  // deques.
+  uint64_t num_stolen() const { return num_stolen_; }
+
+  // The number of lanes the pool has (1 if it wasn't given any), and
+  // what lane "lane" has been up to.  Wait times are only kept track of
+  // with more than one lane.
+  uint32_t num_lanes() const { return num_lanes_; }
+  LaneStats lane_stats(uint32_t lane);
+
+  // The number of worker threads in the pool right now, and the most
+  // there have ever been.  Of the threads there are, num_threads_idle()
+  // are waiting for work, and num_threads_blocked() are running a task
+  // that said it's waiting on something else.
+  uint32_t num_threads() const { return num_threads_; }
+  uint32_t peak_threads() const { return peak_threads_; }
+  uint32_t num_threads_idle() const { return num_threads_idle_; }
+  uint32_t num_threads_blocked() const { return num_threads_blocked_; }
+
+  // A task running on one of a pool's workers calls BeginBlocking()
+  // before it waits on something slow, e.g., a client or an index on
+  // disk, and EndBlocking() once it's done.  While blocked, the worker
+  // isn't counted on to get to queued tasks, so the pool may grow to
+  // make up for it.  Both are no-ops outside a pool's workers.
+  static void BeginBlocking();
+  static void EndBlocking();
+
+  // Tasks wait for a worker in a lock-free ring (see MpmcQueue.h), so
+  // dispatching and picking up work never takes a lock.  This many
+  // tasks fit, or max_queued plus one per worker if that's more.
+  static const uint32_t kQueueCapacity = 1024;
+
+  // How many tasks fit on a worker's deque; Spawn() puts any more on the
+  // shared queue.
+  static const uint32_t kDequeCapacity = 256;
+
+  // The ring of Submit()ted tasks, which workers take before any other
+  // task, and waiters take while they wait.
+  MpmcQueue<Task*> submitted_;
 
-  // The queue of Tasks waiting to be dispatched to a worker thread.
-  std::list<Task*> work_queue_;
+  // The ring of Tasks waiting to be dispatched to a worker thread.
+  // With a sub-pool per node, tasks wait on their node's ring in
+  // node_queues_ instead, and only end up here if that's full.
+  MpmcQueue<Task*> work_queue_;
+  std::vector<std::unique_ptr<MpmcQueue<Task*>>> node_queues_;
+
+  // Dispatch() can't refuse a task, so if the ring is ever full, the
+  // task waits here instead, guarded by overflow_lock_.  Workers only
+  // look here when num_overflow_ says there's something to find.
+  pthread_mutex_t overflow_lock_;
+  std::list<Task*> overflow_queue_;
+  std::atomic<uint32_t> num_overflow_;
+
+  // A worker thread.  An idle worker parks on a futex on "parked",
+  // after putting itself on its node's idle_workers_ (unless it's still
+  // there from last time, as "queued" says).  Dispatch() takes a worker
+  // off idle_workers_ and, if it's parked, unparks it, so a wakeup goes
+  // to one sleeping worker and isn't spent on any other.
+  struct Worker {
+    ThreadPool* pool;
+    uint32_t index;
+    uint32_t node;
+    pthread_t thread;
+    std::atomic<uint32_t> parked;
+    std::atomic<bool> queued;
+
+    // The tasks this worker has spawned, with work stealing.
+    std::unique_ptr<WorkStealingDeque<Task*>> deque;
+
+    // Whether a thread is running in this slot, and whether one has
+    // run here since it was last joined.
+    std::atomic<bool> active;
+    bool joinable;
+
+    // Whether the thread is inside BeginBlocking()/EndBlocking().
+    bool blocked;
+  };
+  std::vector<std::unique_ptr<MpmcQueue<Worker*>>> idle_workers_;
+
+  // Threads blocked in WaitForRoom() sleep on a futex on room_seq_,
+  // which workers bump as they take tasks off a full queue or go idle.
+  std::atomic<uint32_t> room_seq_;
+  std::atomic<uint32_t> num_room_waiters_;
+
+  // The queue limit that TryDispatch() enforces; 0 means no limit.
+  uint32_t max_queued_;
 
   // This should be set to "true" when it is time for the worker
   // threads to terminate, i.e., when the ThreadPool is
   // destroyed.  A worker thread will check this variable before
   // picking up its next piece of work; if it is true, the worker
   // threads will terminate.
-  bool terminate_threads_;
+  std::atomic<bool> terminate_threads_;
 
   // This variable stores how many threads are currently running.  As
   // worker threads are born, they increment it, and as worker threads
-  // terminate, they decrement it.
-  uint32_t num_threads_running_;
+  // terminate, they decrement it.  It doubles as the futex that the
+  // constructor sleeps on until the first threads are all running.
+  std::atomic<uint32_t> num_threads_running_;
+
+  // How many worker threads the pool has (or is about to, while one is
+  // being created or retiring), and the bounds set by the options.
+  std::atomic<uint32_t> num_threads_;
+  std::atomic<uint32_t> peak_threads_;
+  uint32_t min_threads_;
+  uint32_t max_threads_;
+
+  // How many of those threads are idle, waiting for work.  Tasks that
+  // these threads are about to pick up don't count against
+  // max_queued_.
+  std::atomic<uint32_t> num_threads_idle_;
+
+  // How many of those threads are blocked (see BeginBlocking()).
+  std::atomic<uint32_t> num_threads_blocked_;
+
+  // Takes the next task for "worker" (nullptr for a thread outside the
+  // pool) off its deque, the shared queue, or another worker's deque,
+  // in that order.  Returns false if there isn't one anywhere.
+  bool TakeTask(Worker* worker, Task** const t);
+
+  // Wakes up a thread blocked in WaitForRoom(), if there are any.
+  void NotifyRoom();
+
+  // Parks "worker" until Dispatch() has a task for it or the pool is
+  // being destroyed.  Returns a task if one shows up as it goes to
+  // sleep, or nullptr once it has been woken up.  If the worker is
+  // surplus and times out instead, sets "retire" and returns nullptr;
+  // the worker has been taken out of num_threads_ and should exit.
+  Task* Park(Worker* worker, bool* const retire);
+
+  // If the pool is elastic, notes how long "t" waited to be picked up,
+  // and grows the pool if that was too long.
+  void NoteWait(Task* t);
+
+  // Unparks an idle worker, preferably one on node "node", if there are
+  // any.  Returns false if there weren't.
+  bool UnparkWorker(uint32_t node);
 
  private:
-  // The pthreads pthread_t structures representing each thread.
-  pthread_t* thread_array_;
+  template <typename T>
+  friend class TaskFuture;
+
+  // A Submit()ted task: calls "f", and stores the result, or what "f"
+  // threw, in "state".
+  template <typename F, typename T>
+  class FunctionTask : public Task {
+   public:
+    FunctionTask(F f, std::shared_ptr<FutureState<T>> state)
+      : Task(&Run), f_(std::move(f)), state_(std::move(state)) { }
+
+   private:
+    static void Run(Task* t);
+
+    F f_;
+    std::shared_ptr<FutureState<T>> state_;
+  };
+
+  // Queues a Submit()ted task on submitted_, or runs it right away if
+  // submitted_ is full.
+  void EnqueueSubmitted(Task* t);
+
+  // Waits for "state" to be done, running submitted tasks meanwhile.
+  void WaitFor(FutureStateBase* state);
+
+  // Whether TryDispatch() should refuse a task.
+  bool QueueFull();
+
+  // Queues "t" and wakes up an idle worker to run it.
+  void Enqueue(Task* t);
+
+  // Steals a task for "thief" (nullptr for a thread outside the pool)
+  // off some other worker's deque.
+  bool StealTask(Worker* thief, Task** const t);
+
+  // Takes the next task off the lanes, picking a lane to try first as
+  // lane_scheduling_ says, and then trying the rest in order.
+  bool TakeFromLanes(Task** const t);
+
+  // Adds a worker thread, if the pool has room to grow and tasks are
+  // waiting with no worker available to run them, or "backed_up" says
+  // they've been waiting too long.  A lazily started pool short of its
+  // minimum grows whenever tasks are waiting.
+  void MaybeGrow(bool backed_up);
+
+  // Starts a worker thread in a free slot.  Called with growing_ set.
+  void StartWorker();
+
+  // Set while a thread is adding a worker, so that only one does at a
+  // time; the destructor sets it for good.
+  std::atomic<bool> growing_;
+
+  // A lane of tasks (see ThreadPoolOptions::lane_weights), with its
+  // counters.  Only used with more than one lane.
+  struct Lane {
+    std::unique_ptr<MpmcQueue<Task*>> queue;
+    std::atomic<uint64_t> num_run;
+    std::atomic<uint64_t> total_wait_ns;
+    std::atomic<uint64_t> max_wait_ns;
+  };
+  std::unique_ptr<Lane[]> lanes_;
+  uint32_t num_lanes_;
+  LaneScheduling lane_scheduling_;
+
+  // With kLanesWeighted, the order in which workers try the lanes
+  // first, each lane coming up as many times as its weight, spread out
+  // as evenly as possible; and how many turns have been taken so far.
+  std::vector<uint32_t> lane_schedule_;
+  std::atomic<uint64_t> lane_turn_;
+
+  // Whether tasks get stamped with the time they were queued, for
+  // growing the pool or for the lanes' wait times.
+  bool stamp_tasks_;
+
+  // Whether the pool may grow and shrink, and the thresholds for it.
+  bool elastic_;
+  uint64_t grow_wait_ns_;
+  uint64_t idle_timeout_ns_;
+
+  // Where the workers run, and how many nodes that spans.
+  ThreadPlacement placement_;
+  uint32_t num_nodes_;
+
+  // Whether workers have deques to spawn tasks onto and steal from.
+  bool work_stealing_;
+  std::atomic<uint64_t> num_stolen_;
+
+  // The worker slots, max_threads_ of them, including the pthread_t
+  // structures of the threads running in them.
+  Worker* workers_;
 };
 
+template <typename F>
+TaskFuture<std::invoke_result_t<F>> ThreadPool::Submit(F f) {
+  typedef std::invoke_result_t<F> T;
+  std::shared_ptr<FutureState<T>> state =
+    std::make_shared<FutureState<T>>();
+  EnqueueSubmitted(new FunctionTask<F, T>(std::move(f), state));
+  return TaskFuture<T>(this, state);
+}
+
+template <typename F>
+void ThreadPool::ParallelFor(size_t begin, size_t end, F body,
+                             size_t grain) {
+  if (begin >= end) {
+    return;
+  }
+
+  // A few chunks per worker evens things out when some chunks take
+  // longer than others.
+  size_t count = end - begin;
+  size_t max_chunks = 4 * std::max<size_t>(1, max_threads_);
+  grain = std::max<size_t>(grain, (count + max_chunks - 1) / max_chunks);
+  size_t num_chunks = (count + grain - 1) / grain;
+
+  auto run_chunk = [&body, begin, end, grain](size_t chunk) {
+    size_t first = begin + chunk * grain;
+    size_t last = std::min(end, first + grain);
+    for (size_t i = first; i < last; i++) {
+      body(i);
+    }
+  };
+  std::vector<TaskFuture<void>> futures;
+  futures.reserve(num_chunks - 1);
+  for (size_t chunk = 1; chunk < num_chunks; chunk++) {
+    futures.push_back(Submit([&run_chunk, chunk] { run_chunk(chunk); }));
+  }
+
+  // Our own chunk's exception waits until the others are done, since
+  // they refer to "body".
+  std::exception_ptr error;
+  try {
+    run_chunk(0);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  WhenAll(&futures);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// static
+template <typename F, typename T>
+void ThreadPool::FunctionTask<F, T>::Run(Task* t) {
+  std::unique_ptr<FunctionTask> task(static_cast<FunctionTask*>(t));
+  std::exception_ptr error;
+  try {
+    if constexpr (std::is_void_v<T>) {
+      task->f_();
+    } else {
+      task->state_->value.emplace(task->f_());
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  task->state_->Finish(error);
+}
+
+template <typename T>
+void TaskFuture<T>::Wait() const {
+  if (!state_->done()) {
+    pool_->WaitFor(state_.get());
+  }
+}
+
+template <typename T>
+T TaskFuture<T>::Get() {
+  Wait();
+  state_->Rethrow();
+  if constexpr (!std::is_void_v<T>) {
+    return std::move(*state_->value);
+  }
+}
+
+template <typename T>
+std::vector<T> WhenAll(std::vector<TaskFuture<T>>* futures) {
+  for (const TaskFuture<T>& future : *futures) {
+    future.Wait();
+  }
+  std::vector<T> results;
+  results.reserve(futures->size());
+  for (TaskFuture<T>& future : *futures) {
+    results.push_back(future.Get());
+  }
+  return results;
+}
+
 }  // namespace hw4
 
 #endif  // HW4_THREADPOOL_H_
@@ -0,0 +1,112 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <vector>
+
+#include "./TimerWheel.h"
+
+using std::vector;
+
+namespace hw4 {
+
+// How far ahead the whole wheel reaches, in ticks.
+static const uint64_t kWheelSpan =
+  1ULL << (TimerWheel::kSlotBits * TimerWheel::kLevels);
+
+TimerWheel::TimerWheel(uint64_t now) : next_tick_(now), size_(0) {
+  for (int level = 0; level < kLevels; level++) {
+    for (int slot = 0; slot < kSlots; slot++) {
+      Timer* head = &slots_[level][slot];
+      head->prev_ = head->next_ = head;
+    }
+  }
+}
+
+void TimerWheel::Schedule(Timer* timer, uint64_t expires) {
+  Cancel(timer);
+  if (expires < next_tick_) {
+    expires = next_tick_;
+  } else if (expires - next_tick_ >= kWheelSpan) {
+    expires = next_tick_ + kWheelSpan - 1;
+  }
+  timer->expires_ = expires;
+  Add(timer);
+  size_++;
+}
+
+void TimerWheel::Cancel(Timer* timer) {
+  if (!timer->pending()) {
+    return;
+  }
+  timer->prev_->next_ = timer->next_;
+  timer->next_->prev_ = timer->prev_;
+  timer->prev_ = timer->next_ = nullptr;
+  size_--;
+}
+
+void TimerWheel::Advance(uint64_t now, vector<Timer*>* const expired) {
+  // With nothing scheduled, there's nothing to step through.
+  if (size_ == 0 && now >= next_tick_) {
+    next_tick_ = now + 1;
+    return;
+  }
+
+  while (next_tick_ <= now) {
+    // Each time a level wraps around, pull the next slot of the level
+    // above down into it.
+    int slot = next_tick_ & (kSlots - 1);
+    for (int level = 1; slot == 0 && level < kLevels; level++) {
+      slot = (next_tick_ >> (kSlotBits * level)) & (kSlots - 1);
+      Cascade(level, slot);
+    }
+
+    // Everything left in this tick's level 0 slot expires now.
+    Timer* head = &slots_[0][next_tick_ & (kSlots - 1)];
+    while (head->next_ != head) {
+      Timer* timer = head->next_;
+      Cancel(timer);
+      expired->push_back(timer);
+    }
+    next_tick_++;
+  }
+}
+
+void TimerWheel::Add(Timer* timer) {
+  // Pick the finest level whose slots still reach out to the expiry
+  // time.
+  uint64_t expires = timer->expires_;
+  uint64_t delta = expires - next_tick_;
+  int level = 0;
+  while (level < kLevels - 1 &&
+         delta >= (1ULL << (kSlotBits * (level + 1)))) {
+    level++;
+  }
+  int slot = (expires >> (kSlotBits * level)) & (kSlots - 1);
+
+  Timer* head = &slots_[level][slot];
+  timer->next_ = head;
+  timer->prev_ = head->prev_;
+  head->prev_->next_ = timer;
+  head->prev_ = timer;
+}
+
+void TimerWheel::Cascade(int level, int slot) {
+  Timer* head = &slots_[level][slot];
+  Timer* timer = head->next_;
+  head->prev_ = head->next_ = head;
+  while (timer != head) {
+    Timer* next = timer->next_;
+    Add(timer);
+    timer = next;
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,106 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TIMERWHEEL_H_
+#define HW4_TIMERWHEEL_H_
+
+#include <stdint.h>  // for uint64_t, etc.
+#include <vector>    // for std::vector
+
+namespace hw4 {
+
+// A TimerWheel keeps track of many timers at once, with constant-time
+// scheduling and cancellation no matter how many are pending.  Time is
+// measured in abstract "ticks"; the owner decides how long a tick is
+// and calls Advance() as they go by.
+//
+// The wheel is hierarchical: level 0 has one slot per tick for the
+// next kSlots ticks, level 1 has one slot per kSlots ticks for the next
+// kSlots^2 ticks, and so on.  A timer sits in the coarsest slot that
+// still pins down when it expires, and is moved ("cascaded") down a
+// level each time the finer wheel below it wraps around, so every
+// timer is touched at most once per level before it fires.
+//
+// Timers are intrusive: the caller owns the Timer objects, which must
+// stay put while they are pending.  A TimerWheel is not thread-safe.
+class TimerWheel {
+ public:
+  // Something that can be scheduled on a TimerWheel.  Callers will
+  // typically subclass Timer to say what the timer is for.
+  class Timer {
+   public:
+    Timer() : expires_(0), prev_(nullptr), next_(nullptr) { }
+    virtual ~Timer() { }
+
+    // Whether the timer is scheduled on a wheel.
+    bool pending() const { return next_ != nullptr; }
+
+    // The tick at which the timer fires, if it is pending.
+    uint64_t expires() const { return expires_; }
+
+   private:
+    friend class TimerWheel;
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    uint64_t expires_;  // the tick at which the timer fires
+    Timer* prev_;
+    Timer* next_;
+  };
+
+  // Creates an empty wheel whose current tick is "now".
+  explicit TimerWheel(uint64_t now);
+  virtual ~TimerWheel() { }
+
+  // Schedules "timer" to fire at tick "expires", first cancelling it if
+  // it is already pending.  Timers that are already due fire on the
+  // next tick the wheel moves to, and timers further out than the wheel reaches
+  // (kSlots^kLevels ticks) fire at the far edge of the wheel.
+  void Schedule(Timer* timer, uint64_t expires);
+
+  // Cancels "timer" if it is pending.
+  void Cancel(Timer* timer);
+
+  // Moves the wheel forward to tick "now", appending every timer that
+  // expired along the way to "expired", in the order they expired.
+  // Expired timers are no longer pending.
+  void Advance(uint64_t now, std::vector<Timer*>* const expired);
+
+  // The number of pending timers.
+  uint64_t size() const { return size_; }
+
+  static const int kLevels = 4;
+  static const int kSlotBits = 6;
+  static const int kSlots = 1 << kSlotBits;
+
+ private:
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Puts "timer" into the slot its expiry time calls for.
+  void Add(Timer* timer);
+
+  // Re-adds every timer in slot "slot" of level "level", which moves
+  // them to finer slots now that the wheel has caught up with them.
+  void Cascade(int level, int slot);
+
+  // The first tick that hasn't been processed yet.  Every timer on the
+  // wheel expires at or after this tick.
+  uint64_t next_tick_;
+  uint64_t size_;
+
+  // The slots, each a circular list with a sentinel head.
+  Timer slots_[kLevels][kSlots];
+};
+
+}  // namespace hw4
+
+#endif  // HW4_TIMERWHEEL_H_
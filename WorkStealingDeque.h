@@ -0,0 +1,140 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_WORKSTEALINGDEQUE_H_
+#define HW4_WORKSTEALINGDEQUE_H_
+
+#include <stdint.h>  // for int64_t, etc.
+#include <atomic>    // for std::atomic
+#include <memory>    // for std::unique_ptr
+
+namespace hw4 {
+
+// A WorkStealingDeque is a bounded double-ended queue with one owner
+// thread, which pushes and pops items at the bottom, last-in first-out,
+// and any number of thieves, which steal items from the top, first-in
+// first-out.  It is the Chase-Lev deque, with the memory orderings
+// worked out by Lê et al. ("Correct and Efficient Work-Stealing for
+// Weak Memory Models", PPoPP 2013), minus the growing: a push onto a
+// full deque fails instead.
+//
+// The owner only contends with thieves over the last item, so it works
+// through its own items without a single compare-and-swap.
+//
+// T must be trivially copyable; the deque holds pointers in practice.
+template <typename T>
+class WorkStealingDeque {
+ public:
+  // Creates an empty deque that holds up to "capacity" items, rounded
+  // up to a power of two.
+  explicit WorkStealingDeque(uint32_t capacity)
+    : capacity_(RoundUp(capacity)), items_(new std::atomic<T>[capacity_]),
+      top_(0), bottom_(0) { }
+  virtual ~WorkStealingDeque() { }
+
+  // Owner only.  Adds "item" at the bottom.  Returns false if the deque
+  // is full.
+  bool Push(const T& item) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    if (bottom - top >= capacity_) {
+      return false;
+    }
+    items_[bottom & (capacity_ - 1)].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Owner only.  Removes the item at the bottom, i.e., the one pushed
+  // most recently, and returns it (via an output parameter) in "item".
+  // Returns false if the deque is empty.
+  bool Pop(T* const item) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      // Empty.
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+    *item = items_[bottom & (capacity_ - 1)].load(std::memory_order_relaxed);
+    if (top < bottom) {
+      return true;
+    }
+
+    // That was the last item, so a thief may be after it too; whoever
+    // moves top_ past it first gets it.
+    bool won = top_.compare_exchange_strong(top, top + 1,
+                                            std::memory_order_seq_cst,
+                                            std::memory_order_relaxed);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return won;
+  }
+
+  // Any thread.  Removes the item at the top, i.e., the oldest one, and
+  // returns it (via an output parameter) in "item".  Returns false if
+  // the deque is empty.
+  bool Steal(T* const item) {
+    while (1) {
+      int64_t top = top_.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t bottom = bottom_.load(std::memory_order_acquire);
+      if (top >= bottom) {
+        return false;
+      }
+      T stolen = items_[top & (capacity_ - 1)].load(
+        std::memory_order_relaxed);
+      if (top_.compare_exchange_strong(top, top + 1,
+                                       std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+        *item = stolen;
+        return true;
+      }
+      // Somebody else got that one; try for the next.
+    }
+  }
+
+  // The number of items in the deque.  Only a snapshot if other threads
+  // are using it.
+  uint32_t size() const {
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+    int64_t top = top_.load(std::memory_order_acquire);
+    return bottom > top ? static_cast<uint32_t>(bottom - top) : 0;
+  }
+
+  uint32_t capacity() const { return capacity_; }
+
+ private:
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  static int64_t RoundUp(uint32_t capacity) {
+    int64_t rounded = 1;
+    while (rounded < capacity)
+      rounded <<= 1;
+    return rounded;
+  }
+
+  // Keeps the thieves' end away from the owner's.
+  static const int kCacheLineSize = 64;
+
+  const int64_t capacity_;
+  std::unique_ptr<std::atomic<T>[]> items_;
+  alignas(kCacheLineSize) std::atomic<int64_t> top_;
+  alignas(kCacheLineSize) std::atomic<int64_t> bottom_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_WORKSTEALINGDEQUE_H_
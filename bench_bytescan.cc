@@ -0,0 +1,150 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures the scanning kernels the request parser splits requests
+// with (see ByteScan.h), on the header block of a typical browser
+// request, for each kind this CPU supports: splitting it into lines,
+// splitting it into lines while finding each header's ':' (what the
+// parser does), and parsing the whole request.  memchr(), which the
+// parser used to split lines with, is measured alongside.  Results are
+// in bytes per nanosecond.  The kernels are only worth having built
+// with optimization, e.g., with CFLAGS="... -O2" on the make line.
+//
+// Usage: bench_bytescan [iterations]
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cstdio>
+#include <string>
+
+#include "./ByteScan.h"
+#include "./HttpRequestParser.h"
+
+using std::string;
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char* kRequest =
+  "GET /query?terms=whale+ship HTTP/1.1\r\n"
+  "Host: localhost:5555\r\n"
+  "Connection: keep-alive\r\n"
+  "Cache-Control: max-age=0\r\n"
+  "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", "
+  "\"Not=A?Brand\";v=\"99\"\r\n"
+  "sec-ch-ua-mobile: ?0\r\n"
+  "sec-ch-ua-platform: \"Linux\"\r\n"
+  "Upgrade-Insecure-Requests: 1\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+  "(KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+  "image/avif,image/webp,image/apng,*/*;q=0.8,"
+  "application/signed-exchange;v=b3;q=0.7\r\n"
+  "Sec-Fetch-Site: same-origin\r\n"
+  "Sec-Fetch-Mode: navigate\r\n"
+  "Sec-Fetch-User: ?1\r\n"
+  "Sec-Fetch-Dest: document\r\n"
+  "Referer: http://localhost:5555/query?terms=whale\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Accept-Language: en-US,en;q=0.9\r\n"
+  "Cookie: _ga=GA1.1.1234567890.1697000000; "
+  "session=4f1d2c3b4a5e6f7081928374655647382910abcdef\r\n"
+  "\r\n";
+
+// Counts the lines in [begin, end) with memchr(), also finding each
+// line's first ':' if "colons", the way the parser used to.
+static uint64_t MemchrLines(const char* begin, const char* end,
+                            bool colons) {
+  uint64_t found = 0;
+  const char* newline;
+  while ((newline = static_cast<const char*>(
+            memchr(begin, '\n', end - begin))) != nullptr) {
+    if (colons && memchr(begin, ':', newline - begin) != nullptr) {
+      found++;
+    }
+    begin = newline + 1;
+    found++;
+  }
+  return found;
+}
+
+// The same, with FindLineEnd().
+static uint64_t ScanLines(const char* begin, const char* end, bool colons) {
+  uint64_t found = 0;
+  const char* newline;
+  const char* colon;
+  while ((newline = hw4::FindLineEnd(begin, end, ':',
+                                     colons ? &colon : nullptr)) != end) {
+    if (colons && colon != nullptr) {
+      found++;
+    }
+    begin = newline + 1;
+    found++;
+  }
+  return found;
+}
+
+// Parses the request with "parser", as HttpConnection does, reusing it
+// from one request to the next.
+static uint64_t Parse(hw4::HttpRequestParser* parser, string* request) {
+  parser->Reset();
+  parser->Parse(request->data(), request->size());
+  return parser->headers().size();
+}
+
+// Runs "which" "iterations" times and prints its speed.
+static void Run(const char* name, int which, int iterations) {
+  string request(kRequest);
+  const char* begin = request.data();
+  const char* end = begin + request.size();
+  hw4::HttpRequestParser parser;
+  uint64_t found = 0;
+  uint64_t start_ns = NowNs();
+  for (int i = 0; i < iterations; i++) {
+    switch (which) {
+      case 0: found += MemchrLines(begin, end, false); break;
+      case 1: found += MemchrLines(begin, end, true); break;
+      case 2: found += ScanLines(begin, end, false); break;
+      case 3: found += ScanLines(begin, end, true); break;
+      default: found += Parse(&parser, &request); break;
+    }
+  }
+  uint64_t ns = NowNs() - start_ns;
+  const char* kWhat[] = {"lines", "lines+colons", "lines", "lines+colons",
+                         "parse"};
+  printf("%-7s %-13s %6.2f bytes/ns %7.1f ns/request%s\n", name,
+         kWhat[which],
+         static_cast<double>(request.size()) * iterations / ns,
+         static_cast<double>(ns) / iterations,
+         (found == 0) ? " (found nothing?)" : "");
+}
+
+int main(int argc, char** argv) {
+  int iterations = (argc > 1) ? atoi(argv[1]) : 200000;
+  printf("%zu-byte request\n", strlen(kRequest));
+  Run("memchr", 0, iterations);
+  Run("memchr", 1, iterations);
+  for (hw4::ByteScanKind kind :
+         {hw4::kScanScalar, hw4::kScanSse2, hw4::kScanAvx2}) {
+    if (!hw4::SelectByteScan(kind)) {
+      continue;
+    }
+    for (int which = 2; which < 5; which++) {
+      Run(hw4::ByteScanName(kind), which, iterations);
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures what a request's headers cost to store and look up, in heap
+// allocations and time.  Each request is parsed with a reused parser,
+// copied into a request object, and has its Connection header looked
+// up twice, as HttpServer_ThrFn does.  Compares HttpRequest as it used
+// to be, which is reproduced here as LegacyRequest (a std::map of
+// strings, with lookups returning a copy), with HttpRequest's
+// HttpHeaders, both in a fresh request each time ("flat") and in one
+// request reused from each to the next ("reused"), as the server does
+// now.  Allocations are counted by replacing the global operator new.
+//
+// Usage: bench_headers [requests]
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <cstdio>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "./HttpRequest.h"
+#include "./HttpRequestParser.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+// The number of times operator new has been called.
+static uint64_t num_allocations = 0;
+
+void* operator new(size_t size) {
+  num_allocations++;
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+  free(p);
+}
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The headers part of HttpRequest as it used to be.
+class LegacyRequest {
+ public:
+  LegacyRequest() : uri_("/") { }
+  explicit LegacyRequest(const string& uri) : uri_(uri) { }
+
+  string GetHeaderValue(const string& name) const {
+    map<string, string>::const_iterator it = headers_.find(name);
+    if (it == headers_.end()) {
+      return "";
+    } else {
+      return it->second;
+    }
+  }
+
+  void AddHeader(std::string_view name, std::string_view value) {
+    headers_[string(name)].assign(value);
+  }
+
+ private:
+  string uri_;
+  map<string, string> headers_;
+};
+
+enum Which { kLegacy, kFlat, kReused };
+
+// Handles "num_requests" copies of "request", and returns the number of
+// them that asked to be closed, so nothing is optimized away.
+static uint64_t Handle(Which which, string request, uint32_t num_requests) {
+  hw4::HttpRequestParser parser;
+  hw4::HttpRequest reused;
+  uint64_t num_closed = 0;
+  for (uint32_t i = 0; i < num_requests; i++) {
+    if (!parser.Parse(request.data(), request.size())) {
+      abort();
+    }
+    if (which == kLegacy) {
+      LegacyRequest req(string(parser.uri()));
+      for (const hw4::HttpRequestParser::Header& h : parser.headers()) {
+        req.AddHeader(h.name, h.value);
+      }
+      if (req.GetHeaderValue("connection") != "keep-alive" &&
+          req.GetHeaderValue("connection") == "close") {
+        num_closed++;
+      }
+    } else {
+      hw4::HttpRequest fresh;
+      hw4::HttpRequest& req = (which == kFlat) ? fresh : reused;
+      parser.CopyTo(&req);
+      if (req.GetHeaderValue(hw4::kHeaderConnection) != "keep-alive" &&
+          req.GetHeaderValue(hw4::kHeaderConnection) == "close") {
+        num_closed++;
+      }
+    }
+    parser.Reset();
+  }
+  return num_closed;
+}
+
+static void Run(const char* name, const string& request,
+                uint32_t num_requests) {
+  printf("%-8s (%3zu bytes)", name, request.size());
+  for (Which which : {kLegacy, kFlat, kReused}) {
+    uint64_t allocations_before = num_allocations;
+    uint64_t start_ns = NowNs();
+    uint64_t num_closed = Handle(which, request, num_requests);
+    uint64_t ns = NowNs() - start_ns;
+    uint64_t allocations = num_allocations - allocations_before;
+    if (num_closed != 0) {
+      printf(" (closed?)");
+    }
+    printf("  %s %5.2f allocs/req %6.1f ns/req",
+           (which == kLegacy) ? "map" : (which == kFlat) ? "flat" : "reused",
+           static_cast<double>(allocations) / num_requests,
+           static_cast<double>(ns) / num_requests);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  uint32_t num_requests = (argc > 1) ? atoi(argv[1]) : 200000;
+
+  Run("curl",
+      "GET /query?terms=whale+ship HTTP/1.1\r\n"
+      "Host: localhost:5555\r\n"
+      "User-Agent: curl/7.88.1\r\n"
+      "Accept: */*\r\n\r\n", num_requests);
+  Run("browser",
+      "GET /query?terms=whale+ship HTTP/1.1\r\n"
+      "Host: localhost:5555\r\n"
+      "Connection: keep-alive\r\n"
+      "Cache-Control: max-age=0\r\n"
+      "Upgrade-Insecure-Requests: 1\r\n"
+      "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+      "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+      "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+      "image/avif,image/webp,*/*;q=0.8\r\n"
+      "Referer: http://localhost:5555/query?terms=whale\r\n"
+      "Accept-Encoding: gzip, deflate, br\r\n"
+      "Accept-Language: en-US,en;q=0.9\r\n\r\n", num_requests);
+  return EXIT_SUCCESS;
+}
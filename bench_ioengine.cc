@@ -0,0 +1,108 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures what each IoEngine costs to serve a static file: read a
+// request off a socket, read the file, and write the response back,
+// over and over.  Reports system calls and wall-clock time per request.
+//
+// Usage: bench_ioengine [iterations] [file]
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+
+#include "./HttpUtils.h"
+#include "./IoEngine.h"
+
+using std::string;
+
+static const char* kRequest =
+  "GET /static/test_files/hextext.txt HTTP/1.1\r\n"
+  "Host: localhost\r\n\r\n";
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Serves "iterations" requests for "file" through the selected engine.
+static void Run(int iterations, const string& file) {
+  hw4::IoEngine* engine = hw4::IoEngine::Get();
+  int spair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, spair) != 0) {
+    perror("socketpair");
+    exit(EXIT_FAILURE);
+  }
+
+  const unsigned char* req = reinterpret_cast<const unsigned char*>(kRequest);
+  int req_len = strlen(kRequest);
+  unsigned char buf[1024];
+  string response(64 * 1024, '\0');
+  string contents;
+
+  uint64_t syscalls = engine->num_syscalls();
+  uint64_t start = NowNs();
+  for (int i = 0; i < iterations; i++) {
+    // The client's side isn't part of the measurement.
+    hw4::WrappedWrite(spair[1], req, req_len);
+
+    if (engine->Read(spair[0], buf, sizeof(buf)) <= 0 ||
+        !engine->ReadFile(file, &contents) ||
+        engine->Write(spair[0],
+                      reinterpret_cast<const unsigned char*>(contents.data()),
+                      contents.size())
+          != static_cast<int>(contents.size())) {
+      fprintf(stderr, "%s: request %d failed\n", engine->name(), i);
+      exit(EXIT_FAILURE);
+    }
+
+    size_t got = 0;
+    while (got < contents.size()) {
+      int res = hw4::WrappedRead(
+        spair[1], reinterpret_cast<unsigned char*>(&response[0]),
+        response.size());
+      if (res <= 0) {
+        exit(EXIT_FAILURE);
+      }
+      got += res;
+    }
+  }
+  uint64_t elapsed = NowNs() - start;
+  syscalls = engine->num_syscalls() - syscalls;
+
+  printf("%-10s %8d requests  %6.2f syscalls/request  %8.0f ns/request\n",
+         engine->name(), iterations,
+         static_cast<double>(syscalls) / iterations,
+         static_cast<double>(elapsed) / iterations);
+  close(spair[0]);
+  close(spair[1]);
+}
+
+int main(int argc, char** argv) {
+  int iterations = (argc > 1) ? atoi(argv[1]) : 20000;
+  string file = (argc > 2) ? argv[2] : "test_files/hextext.txt";
+
+  hw4::IoEngine::Select(hw4::kIoSyscalls);
+  Run(iterations, file);
+
+  if (!hw4::IoEngine::Select(hw4::kIoUring)) {
+    printf("io_uring    unavailable on this kernel\n");
+    return EXIT_SUCCESS;
+  }
+  Run(iterations, file);
+  return EXIT_SUCCESS;
+}
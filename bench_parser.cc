@@ -0,0 +1,168 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures how fast requests are parsed as they come off the socket in
+// HttpConnection's 256-byte reads, without the socket.  Compares the
+// HttpRequestParser with the way HttpConnection used to do it, which is
+// reproduced here as LegacyParse(): search the whole buffer for the end
+// of the header block after every read, then copy the block out and
+// split, trim, and lowercase it into fresh strings with boost.  The
+// parser is timed both on its own ("views") and copying each request
+// into an HttpRequest, as HttpConnection does ("request").
+//
+// Usage: bench_parser [requests]
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <boost/algorithm/string.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "./HttpRequest.h"
+#include "./HttpRequestParser.h"
+
+using std::string;
+using std::vector;
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The size of HttpConnection's reads.
+static const size_t kReadLen = 256;
+
+static const char* kHeaderEnd = "\r\n\r\n";
+static const int kHeaderEndLen = 4;
+
+static hw4::HttpRequest LegacyParseRequest(const string& request) {
+  using boost::algorithm::split;
+  using boost::algorithm::token_compress_on;
+  using boost::is_any_of;
+
+  hw4::HttpRequest req("/");
+  vector<string> results;
+  vector<string> first;
+  vector<string> body;
+
+  split(results, request, is_any_of("\r\n"), token_compress_on);
+  for (size_t i = 0; i < results.size(); i++) {
+    boost::trim(results[i]);
+  }
+  split(first, results[0], is_any_of(" "), token_compress_on);
+  if (first.size() == 3) {
+    req.set_uri(first[1]);
+    results.erase(results.begin());
+  }
+  for (size_t i = 0; i < results.size(); i++) {
+    split(body, results[i], is_any_of(": "), token_compress_on);
+    if (body.size() == 2) {
+      string header_name = body[0];
+      boost::to_lower(header_name);
+      req.AddHeader(header_name, body[1]);
+    }
+  }
+  return req;
+}
+
+// Parses every request in "input", read kReadLen bytes at a time.
+// Returns the number of headers seen, so nothing is optimized away.
+static uint64_t LegacyParse(const string& input) {
+  string buffer;
+  uint64_t num_headers = 0;
+  for (size_t i = 0; i < input.size(); i += kReadLen) {
+    buffer += string(input, i, kReadLen);
+    size_t pos;
+    while ((pos = buffer.find(kHeaderEnd)) != string::npos) {
+      hw4::HttpRequest req = LegacyParseRequest(buffer.substr(0, pos));
+      num_headers += req.GetHeaderCount();
+      buffer.erase(0, pos + kHeaderEndLen);
+    }
+  }
+  return num_headers;
+}
+
+// The same, the way HttpConnection does it now.
+static uint64_t ParserParse(const string& input, bool copy) {
+  string buffer;
+  size_t start = 0;
+  hw4::HttpRequestParser parser;
+  hw4::HttpRequest req;
+  uint64_t num_headers = 0;
+  for (size_t i = 0; i < input.size(); i += kReadLen) {
+    if (start > 0) {
+      buffer.erase(0, start);
+      start = 0;
+    }
+    buffer.append(input, i, kReadLen);
+    while (parser.Parse(buffer.data() + start, buffer.size() - start)) {
+      if (copy) {
+        parser.CopyTo(&req);
+        num_headers += req.GetHeaderCount();
+      } else {
+        num_headers += parser.headers().size();
+      }
+      start += parser.consumed();
+      parser.Reset();
+    }
+  }
+  return num_headers;
+}
+
+static string MakeRequest(const string& extra_headers) {
+  return "GET /query?terms=whale+ship HTTP/1.1\r\n"
+         "Host: localhost:5555\r\n"
+         "User-Agent: curl/7.88.1\r\n"
+         "Accept: */*\r\n" + extra_headers + "\r\n";
+}
+
+static void Run(const char* name, const string& request,
+                uint32_t num_requests) {
+  string input;
+  for (uint32_t i = 0; i < num_requests; i++) {
+    input += request;
+  }
+
+  printf("%-8s (%5zu bytes)", name, request.size());
+  for (int which = 0; which < 3; which++) {
+    uint64_t start_ns = NowNs();
+    uint64_t num_headers = (which == 0) ? LegacyParse(input)
+                                        : ParserParse(input, which == 2);
+    uint64_t ns = NowNs() - start_ns;
+    if (num_headers == 0) {
+      printf(" (no headers?)");
+    }
+    printf("  %s %7.1f ns/req %7.1f MB/s",
+           (which == 0) ? "legacy" : (which == 1) ? "views" : "request",
+           static_cast<double>(ns) / num_requests,
+           input.size() * 1000.0 / ns);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  uint32_t num_requests = (argc > 1) ? atoi(argv[1]) : 20000;
+
+  Run("curl", MakeRequest(""), num_requests);
+  Run("browser", MakeRequest(
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Connection: keep-alive\r\n"
+        "Referer: http://localhost:5555/query?terms=whale\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "Cache-Control: max-age=0\r\n"), num_requests);
+  Run("cookie", MakeRequest("Cookie: session=" + string(8192, 'c') + "\r\n"),
+      num_requests / 10);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures what answering pipelined requests together saves.  A client
+// sends "depth" requests at a time over one keep-alive connection to an
+// in-process server, then reads all their responses, against a server
+// that writes each response on its own (--pipeline_batch=1) and one
+// that batches them (the default).  Reports the time per request, the
+// time from sending a burst to having all of its responses, and the
+// write system calls the server makes per request, as counted by the
+// kernel in /proc/self/io (less the client's own).
+//
+// Usage: bench_pipeline [requests]
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <string>
+
+#include "./HttpServer.h"
+#include "./HttpUtils.h"
+
+using std::list;
+using std::string;
+
+static const char* kRequest =
+  "GET /static/transparent.gif HTTP/1.1\r\n"
+  "Host: localhost\r\n\r\n";
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The number of write system calls the whole process has made.
+static uint64_t ProcessWrites() {
+  std::ifstream io("/proc/self/io");
+  string name;
+  uint64_t value;
+  while (io >> name >> value) {
+    if (name == "syscw:") {
+      return value;
+    }
+  }
+  return 0;
+}
+
+static int Connect(const string& path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+              sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Reads from "fd" until "num_responses" whole responses have arrived,
+// counting the reads in "*num_reads".  Returns false if the server
+// hangs up first.
+static bool ReadResponses(int fd, int num_responses, uint64_t* num_reads) {
+  string response;
+  unsigned char buf[65536];
+  size_t start = 0;
+  while (num_responses > 0) {
+    size_t header_end = response.find("\r\n\r\n", start);
+    if (header_end != string::npos) {
+      size_t cl = response.find("Content-length: ", start);
+      if (cl == string::npos || cl > header_end) {
+        return false;
+      }
+      size_t end = header_end + 4 + atoi(response.c_str() + cl + 16);
+      if (end <= response.size()) {
+        start = end;
+        num_responses--;
+        continue;
+      }
+    }
+    int res = hw4::WrappedRead(fd, buf, sizeof(buf));
+    (*num_reads)++;
+    if (res <= 0) {
+      return false;
+    }
+    response.append(reinterpret_cast<char*>(buf), res);
+  }
+  return true;
+}
+
+// Sends "num_requests" requests to the server at "path", "depth" at a
+// time, and prints a line of results.
+static bool Run(const string& path, const char* name, int depth,
+                int num_requests) {
+  int fd = Connect(path);
+  if (fd == -1) {
+    return false;
+  }
+  string burst;
+  for (int i = 0; i < depth; i++) {
+    burst += kRequest;
+  }
+
+  uint64_t num_bursts = num_requests / depth, client_writes = 0;
+  uint64_t client_reads = 0;
+  uint64_t writes_before = ProcessWrites();
+  uint64_t start_ns = NowNs();
+  for (uint64_t i = 0; i < num_bursts; i++) {
+    int len = burst.size();
+    if (hw4::WrappedWrite(fd, reinterpret_cast<const unsigned char*>(
+                            burst.data()), len) != len) {
+      close(fd);
+      return false;
+    }
+    client_writes++;
+    if (!ReadResponses(fd, depth, &client_reads)) {
+      close(fd);
+      return false;
+    }
+  }
+  uint64_t ns = NowNs() - start_ns;
+  uint64_t server_writes = ProcessWrites() - writes_before - client_writes;
+  close(fd);
+
+  uint64_t num_sent = num_bursts * depth;
+  printf("%-8s depth %2d  %7.2f us/request  %8.2f us/burst"
+         "  %5.2f server writes/request  %5.2f client reads/burst\n",
+         name, depth, ns / 1000.0 / num_sent, ns / 1000.0 / num_bursts,
+         static_cast<double>(server_writes) / num_sent,
+         static_cast<double>(client_reads) / num_bursts);
+  return true;
+}
+
+static void* ServerThread(void* arg) {
+  hw4::HttpServer* server = static_cast<hw4::HttpServer*>(arg);
+  return server->Run() ? arg : nullptr;
+}
+
+int main(int argc, char** argv) {
+  int num_requests = (argc > 1) ? atoi(argv[1]) : 32000;
+
+  // The server logs every connection; keep that out of the way.
+  std::cout.setstate(std::ios::failbit);
+
+  for (uint32_t batch : {1U, 32U}) {
+    string path = "/tmp/bench_pipeline_" + std::to_string(getpid());
+    hw4::HttpServerOptions options;
+    options.unix_path = path;
+    options.unix_only = true;
+    options.dns_mode = hw4::kDnsNone;
+    options.drain_timeout_ms = 0;
+    options.pipeline_batch = batch;
+    hw4::HttpServer server(hw4::GetRandPort(), "test_files", list<string>(),
+                           options);
+    pthread_t thr;
+    if (pthread_create(&thr, nullptr, &ServerThread, &server) != 0) {
+      perror("pthread_create");
+      return EXIT_FAILURE;
+    }
+
+    // Wait for the server to come up.
+    int fd;
+    for (int i = 0; (fd = Connect(path)) == -1; i++) {
+      if (i == 100) {
+        fprintf(stderr, "the server didn't start\n");
+        return EXIT_FAILURE;
+      }
+      usleep(100000);  // 0.1s
+    }
+    close(fd);
+
+    const char* name = (batch == 1) ? "unbatched" : "batched";
+    for (int depth : {1, 8, 32}) {
+      if (!Run(path, name, depth, num_requests)) {
+        fprintf(stderr, "%s: depth %d failed\n", name, depth);
+        return EXIT_FAILURE;
+      }
+    }
+
+    server.Drain();
+    pthread_join(thr, nullptr);
+    unlink(path.c_str());
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures how long it takes to bring a ThreadPool up, get a first
+// task run on it, and tear it down again, for pools of a few sizes,
+// started eagerly and lazily.  Every server start (and every test that
+// builds a pool) pays the first of these, so the benchmark fails if any
+// pool takes longer than kMaxStartupMs to start.
+//
+// Usage: bench_poolstartup [rounds]
+
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <cstdio>
+
+#include "./ThreadPool.h"
+
+// A pool that takes this long to start has regressed to polling.
+static const double kMaxStartupMs = 100.0;
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static sem_t task_done;
+
+static void FirstTask(hw4::ThreadPool::Task* t) {
+  delete t;
+  sem_post(&task_done);
+}
+
+// Builds, uses and destroys "rounds" pools of "num_threads" threads,
+// and prints the mean time each step took.  Returns false if starting a
+// pool ever took too long.
+static bool Run(uint32_t num_threads, bool lazy, int rounds) {
+  hw4::ThreadPoolOptions options;
+  options.num_threads = num_threads;
+  options.lazy_start = lazy;
+
+  uint64_t start_ns = 0, first_task_ns = 0, stop_ns = 0, worst_ns = 0;
+  for (int i = 0; i < rounds; i++) {
+    uint64_t t0 = NowNs();
+    hw4::ThreadPool* pool = new hw4::ThreadPool(options);
+    uint64_t t1 = NowNs();
+    pool->Dispatch(new hw4::ThreadPool::Task(FirstTask));
+    sem_wait(&task_done);
+    uint64_t t2 = NowNs();
+    delete pool;
+    uint64_t t3 = NowNs();
+
+    start_ns += t1 - t0;
+    first_task_ns += t2 - t0;
+    stop_ns += t3 - t2;
+    if (t1 - t0 > worst_ns)
+      worst_ns = t1 - t0;
+  }
+
+  double worst_ms = worst_ns / 1e6;
+  printf("%4u threads %-5s  start %9.1f us  first task %9.1f us"
+         "  stop %9.1f us  worst start %7.2f ms\n",
+         num_threads, lazy ? "lazy" : "eager",
+         start_ns / 1e3 / rounds, first_task_ns / 1e3 / rounds,
+         stop_ns / 1e3 / rounds, worst_ms);
+  return worst_ms < kMaxStartupMs;
+}
+
+int main(int argc, char** argv) {
+  int rounds = (argc > 1) ? atoi(argv[1]) : 20;
+  sem_init(&task_done, 0, 0);
+
+  bool ok = true;
+  for (uint32_t num_threads : {1, 8, 100}) {
+    for (bool lazy : {false, true}) {
+      ok = Run(num_threads, lazy, rounds) && ok;
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "a pool took longer than %.0f ms to start\n",
+            kMaxStartupMs);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
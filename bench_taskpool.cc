@@ -0,0 +1,191 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Counts the heap allocations the server makes per connection just to
+// set up and tear down the task that serves it, and times the round
+// trip from the accepting thread to a worker and back.  Compares the
+// pooled HttpServerTask, which comes out of a SlabPool and points at
+// the server's shared HttpServerContext, with the task the server used
+// to allocate for every connection, with its own copy of the server's
+// configuration, which is reproduced here as CopyingTask.  Neither
+// reads a request, since that costs the same either way.
+//
+// Usage: bench_taskpool [connections]
+
+#include <fcntl.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "./HttpServer.h"
+
+using std::list;
+using std::string;
+using std::unique_ptr;
+
+// Every allocation in the process goes through here, so it can be
+// counted.
+static std::atomic<uint64_t> num_news(0);
+
+void* operator new(size_t size) {
+  num_news.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+  free(p);
+}
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// What Accept() fills in, for a client with a long IPv6 address and a
+// DNS name: long enough that none of them fit inside a std::string.
+static const char* kClientAddr = "2001:db8:85a3::8a2e:370:7334";
+static const char* kClientDns = "client-1234.dsl.example.net";
+static const char* kServerAddr = "2001:db8:85a3::1";
+static const char* kServerDns = "www.cs.washington.edu";
+
+static const string kBaseDir = "/home/cse333/hw4/test_tree";  // NOLINT
+static const list<string> kIndices = {"unit_test_indices/enron.idx"};
+
+static int dev_null;
+static sem_t all_done;
+static std::atomic<uint32_t> num_left;
+
+static void Finished() {
+  if (num_left.fetch_sub(1) == 1) {
+    sem_post(&all_done);
+  }
+}
+
+// The task the server used to allocate for every connection.
+class CopyingTask : public hw4::ThreadPool::Task {
+ public:
+  explicit CopyingTask(hw4::ThreadPool::thread_task_fn f)
+    : hw4::ThreadPool::Task(f), idle_set(nullptr), reaper(nullptr),
+      pool(nullptr), has_pending(false) { }
+
+  int client_fd;
+  uint16_t c_port;
+  string c_addr, c_dns, s_addr, s_dns;
+  string base_dir;
+  const list<string>* indices;
+  hw4::IdleConnectionSet* idle_set;
+  hw4::ConnectionReaper* reaper;
+  hw4::ThreadPool* pool;
+  hw4::HttpRequest pending;
+  bool has_pending;
+  unique_ptr<hw4::HttpConnection> connection;
+};
+
+static void CopyingFn(hw4::ThreadPool::Task* t) {
+  unique_ptr<CopyingTask> task(static_cast<CopyingTask*>(t));
+  task->connection.reset(new hw4::HttpConnection(task->client_fd));
+  task.reset();
+  Finished();
+}
+
+static void CopyingAccept(hw4::ThreadPool* pool) {
+  CopyingTask* task = new CopyingTask(&CopyingFn);
+  task->base_dir = kBaseDir;
+  task->indices = &kIndices;
+  task->client_fd = dup(dev_null);
+  task->c_addr = kClientAddr;
+  task->c_port = 54321;
+  task->c_dns = kClientDns;
+  task->s_addr = kServerAddr;
+  task->s_dns = kServerDns;
+  pool->Dispatch(task);
+}
+
+static hw4::HttpServerContext context;
+
+static void PooledFn(hw4::ThreadPool::Task* t) {
+  unique_ptr<hw4::HttpServerTask, hw4::HttpServerTask::Deleter> task(
+    static_cast<hw4::HttpServerTask*>(t));
+  task->connection.Reset(task->client_fd);
+  task.reset();
+  Finished();
+}
+
+static void PooledAccept(hw4::ThreadPool* pool) {
+  hw4::HttpServerTask* task = hw4::HttpServerTask::Get(&PooledFn, &context);
+  task->client_fd = dup(dev_null);
+  task->c_addr = kClientAddr;
+  task->c_port = 54321;
+  task->c_dns = kClientDns;
+  task->s_addr = kServerAddr;
+  task->s_dns = kServerDns;
+  pool->Dispatch(task);
+}
+
+// Accepts "num_conns" pretend connections with "accept" on this thread,
+// and has a pool's workers serve them, twice: once to warm up, and once
+// to measure.  Like the server with --overload=pause, the accepting
+// thread waits whenever kMaxQueued connections are already waiting for
+// a worker, so the number of tasks out at once levels off.
+static const uint32_t kMaxQueued = 64;
+
+static void Run(const char* name, void (*accept)(hw4::ThreadPool*),
+                uint32_t num_conns) {
+  hw4::ThreadPoolOptions options;
+  options.num_threads = 2;
+  options.max_queued = kMaxQueued;
+  hw4::ThreadPool pool(options);
+
+  uint64_t news = 0, ns = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    num_left = num_conns;
+    uint64_t news_before = num_news;
+    uint64_t start_ns = NowNs();
+    for (uint32_t i = 0; i < num_conns; i++) {
+      pool.WaitForRoom();
+      accept(&pool);
+    }
+    sem_wait(&all_done);
+    ns = NowNs() - start_ns;
+    news = num_news - news_before;
+  }
+  printf("%-8s %8.2f allocations and %8.1f ns per connection\n",
+         name, static_cast<double>(news) / num_conns,
+         static_cast<double>(ns) / num_conns);
+}
+
+int main(int argc, char** argv) {
+  uint32_t num_conns = (argc > 1) ? atoi(argv[1]) : 100000;
+  dev_null = open("/dev/null", O_RDONLY);
+  sem_init(&all_done, 0, 0);
+  context.base_dir = &kBaseDir;
+  context.indices = &kIndices;
+
+  Run("copying", &CopyingAccept, num_conns);
+  Run("pooled", &PooledAccept, num_conns);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures how many tasks per second a thread pool can dispatch and
+// run, when the tasks themselves do next to nothing, so that the queue
+// is all there is to measure.  Compares the ThreadPool's lock-free
+// queue with the mutex-and-condition-variable queue it used to have,
+// which is reproduced here as LockedPool.
+//
+// Usage: bench_threadpool [tasks]
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <vector>
+
+#include "./ThreadPool.h"
+
+using std::list;
+using std::vector;
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The old ThreadPool: one lock around a std::list, and a condition
+// variable that idle workers wait on.
+class LockedPool {
+ public:
+  typedef hw4::ThreadPool::Task Task;
+
+  explicit LockedPool(uint32_t num_threads)
+    : threads_(num_threads), terminate_(false) {
+    pthread_mutex_init(&lock_, nullptr);
+    pthread_cond_init(&cond_, nullptr);
+    for (pthread_t& thr : threads_)
+      pthread_create(&thr, nullptr, &ThreadLoop, this);
+  }
+
+  ~LockedPool() {
+    pthread_mutex_lock(&lock_);
+    terminate_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+    for (pthread_t& thr : threads_)
+      pthread_join(thr, nullptr);
+  }
+
+  void Dispatch(Task* t) {
+    pthread_mutex_lock(&lock_);
+    queue_.push_back(t);
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&lock_);
+  }
+
+ private:
+  static void* ThreadLoop(void* arg) {
+    LockedPool* pool = static_cast<LockedPool*>(arg);
+    pthread_mutex_lock(&pool->lock_);
+    while (!pool->terminate_) {
+      if (pool->queue_.empty()) {
+        pthread_cond_wait(&pool->cond_, &pool->lock_);
+        continue;
+      }
+      Task* t = pool->queue_.front();
+      pool->queue_.pop_front();
+      pthread_mutex_unlock(&pool->lock_);
+      t->func_(t);
+      pthread_mutex_lock(&pool->lock_);
+    }
+    pthread_mutex_unlock(&pool->lock_);
+    return nullptr;
+  }
+
+  vector<pthread_t> threads_;
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+  list<Task*> queue_;
+  bool terminate_;
+};
+
+// Every task counts itself done; the last one wakes up the benchmark.
+static std::atomic<uint64_t> num_done;
+static uint64_t num_tasks;
+static sem_t all_done;
+
+static void CountTask(hw4::ThreadPool::Task* t) {
+  delete t;
+  if (num_done.fetch_add(1) + 1 == num_tasks) {
+    sem_post(&all_done);
+  }
+}
+
+template <typename Pool>
+struct ProducerArgs {
+  Pool* pool;
+  uint64_t num_tasks;
+};
+
+template <typename Pool>
+static void* Produce(void* arg) {
+  ProducerArgs<Pool>* args = static_cast<ProducerArgs<Pool>*>(arg);
+  for (uint64_t i = 0; i < args->num_tasks; i++) {
+    args->pool->Dispatch(new hw4::ThreadPool::Task(CountTask));
+  }
+  return nullptr;
+}
+
+// Dispatches "tasks" tasks to "pool" from "num_producers" threads and
+// prints how long it takes them all to run.
+template <typename Pool>
+static void Run(const char* name, Pool* pool, uint32_t num_workers,
+                uint32_t num_producers, uint64_t tasks) {
+  num_done = 0;
+  num_tasks = tasks;
+  vector<pthread_t> producers(num_producers);
+  vector<ProducerArgs<Pool>> args(num_producers);
+
+  uint64_t start = NowNs();
+  for (uint32_t i = 0; i < num_producers; i++) {
+    args[i].pool = pool;
+    args[i].num_tasks = tasks / num_producers;
+    if (i == 0)
+      args[i].num_tasks += tasks % num_producers;
+    pthread_create(&producers[i], nullptr, &Produce<Pool>, &args[i]);
+  }
+  sem_wait(&all_done);
+  uint64_t elapsed = NowNs() - start;
+  for (pthread_t& thr : producers)
+    pthread_join(thr, nullptr);
+
+  printf("%-10s %4u workers %3u producers  %10.0f tasks/s"
+         "  %7.0f ns/task\n",
+         name, num_workers, num_producers, tasks * 1e9 / elapsed,
+         static_cast<double>(elapsed) / tasks);
+}
+
+int main(int argc, char** argv) {
+  uint64_t tasks = (argc > 1) ? atoll(argv[1]) : 1000000;
+  sem_init(&all_done, 0, 0);
+
+  for (uint32_t num_workers : {4, 100}) {
+    for (uint32_t num_producers : {1, 4}) {
+      {
+        LockedPool pool(num_workers);
+        Run("locked", &pool, num_workers, num_producers, tasks);
+      }
+      {
+        hw4::ThreadPool pool(num_workers);
+        Run("lock-free", &pool, num_workers, num_producers, tasks);
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
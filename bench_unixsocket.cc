@@ -0,0 +1,212 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// Measures per-request latency against an in-process server listening
+// on both a loopback TCP port and a Unix domain socket, the way a
+// reverse proxy on the same host would see it: over one keep-alive
+// connection, and with a new connection for every request.  Reports the
+// mean, median, and 99th percentile round trip.
+//
+// Usage: bench_unixsocket [iterations] [port]
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "./HttpServer.h"
+#include "./HttpUtils.h"
+
+using std::list;
+using std::string;
+using std::vector;
+
+static const char* kRequest =
+  "GET /static/transparent.gif HTTP/1.1\r\n"
+  "Host: localhost\r\n\r\n";
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Where the server listens, and how to reach it.
+struct Target {
+  const char* name;
+  uint16_t port;     // if nonzero, connect over TCP to this port
+  string path;       // otherwise, connect to this Unix socket
+};
+
+// Opens a connection to "target", or returns -1.  TCP connections turn
+// off Nagle's algorithm, as any latency-minded proxy would.
+static int Connect(const Target& target) {
+  if (target.port != 0) {
+    int fd;
+    if (!hw4::ConnectToServer("127.0.0.1", target.port, &fd)) {
+      return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, target.path.c_str(), target.path.size());
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+              sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Sends a request on "fd" and reads back one whole response.  Returns
+// false if the server hangs up first.
+static bool RoundTrip(int fd) {
+  int len = strlen(kRequest);
+  if (hw4::WrappedWrite(fd, reinterpret_cast<const unsigned char*>(kRequest),
+                        len) != len) {
+    return false;
+  }
+
+  string response;
+  unsigned char buf[4096];
+  size_t header_end = string::npos, total = 0;
+  while (header_end == string::npos || response.size() < total) {
+    int res = hw4::WrappedRead(fd, buf, sizeof(buf));
+    if (res <= 0) {
+      return false;
+    }
+    response.append(reinterpret_cast<char*>(buf), res);
+    if (header_end == string::npos) {
+      header_end = response.find("\r\n\r\n");
+      if (header_end == string::npos) {
+        continue;
+      }
+      size_t cl = response.find("Content-length: ");
+      if (cl == string::npos || cl > header_end) {
+        return false;
+      }
+      total = header_end + 4 + atoi(response.c_str() + cl + 16);
+    }
+  }
+  return true;
+}
+
+// Times "iterations" requests to "target", over one connection or one
+// connection apiece, and prints a line of results.
+static void Run(const Target& target, bool keep_alive, int iterations) {
+  vector<uint64_t> samples;
+  samples.reserve(iterations);
+  int fd = keep_alive ? Connect(target) : -1;
+  for (int i = 0; i < iterations; i++) {
+    uint64_t start = NowNs();
+    if (!keep_alive) {
+      fd = Connect(target);
+    }
+    if (fd == -1 || !RoundTrip(fd)) {
+      fprintf(stderr, "%s: request %d failed\n", target.name, i);
+      exit(EXIT_FAILURE);
+    }
+    if (!keep_alive) {
+      close(fd);
+    }
+    samples.push_back(NowNs() - start);
+  }
+  if (keep_alive) {
+    close(fd);
+  }
+
+  uint64_t sum = 0;
+  for (uint64_t s : samples)
+    sum += s;
+  std::sort(samples.begin(), samples.end());
+  printf("%-5s %-11s %8d requests  mean %7.1f us  p50 %7.1f us"
+         "  p99 %7.1f us\n",
+         target.name, keep_alive ? "keep-alive" : "per-request",
+         iterations, sum / 1000.0 / iterations,
+         samples[samples.size() / 2] / 1000.0,
+         samples[samples.size() * 99 / 100] / 1000.0);
+}
+
+static void* ServerThread(void* arg) {
+  hw4::HttpServer* server = static_cast<hw4::HttpServer*>(arg);
+  return server->Run() ? arg : nullptr;
+}
+
+int main(int argc, char** argv) {
+  int iterations = (argc > 1) ? atoi(argv[1]) : 20000;
+  uint16_t port = (argc > 2) ? atoi(argv[2]) : hw4::GetRandPort();
+  string path = "/tmp/bench_unixsocket_" + std::to_string(getpid());
+
+  // The server logs every connection; keep that out of the way.
+  std::cout.setstate(std::ios::failbit);
+
+  hw4::HttpServerOptions options;
+  options.unix_path = path;
+  options.dns_mode = hw4::kDnsNone;
+  options.drain_timeout_ms = 0;
+  hw4::HttpServer server(port, "test_files", list<string>(), options);
+  pthread_t thr;
+  if (pthread_create(&thr, nullptr, &ServerThread, &server) != 0) {
+    perror("pthread_create");
+    return EXIT_FAILURE;
+  }
+
+  Target tcp = {"tcp", port, ""};
+  Target unix_socket = {"unix", 0, path};
+
+  // Wait for the server to come up and answer a first request, so that
+  // its startup isn't part of the measurement.
+  int fd;
+  for (int i = 0; (fd = Connect(unix_socket)) == -1; i++) {
+    if (i == 100) {
+      fprintf(stderr, "the server didn't start\n");
+      return EXIT_FAILURE;
+    }
+    usleep(100000);  // 0.1s
+  }
+  bool started = RoundTrip(fd);
+  close(fd);
+  if (!started) {
+    fprintf(stderr, "the server didn't answer\n");
+    return EXIT_FAILURE;
+  }
+
+  for (bool keep_alive : {true, false}) {
+    Run(tcp, keep_alive, iterations);
+    Run(unix_socket, keep_alive, iterations);
+  }
+
+  server.Drain();
+  pthread_join(thr, nullptr);
+  unlink(path.c_str());
+  return EXIT_SUCCESS;
+}
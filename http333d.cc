@@ -11,14 +11,19 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
+#include <stdint.h>
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
 #include <list>
+#include <vector>
 
 #include "./ServerSocket.h"
 #include "./HttpServer.h"
@@ -28,10 +33,25 @@ using std::cout;
 using std::endl;
 using std::list;
 using std::string;
+using std::vector;
 
 // Print out program usage, and exit() with EXIT_FAILURE.
 static void Usage(char* prog_name);
 
+// Parse the optional "--name=value" server options out of argv, filling
+// in "options" and removing them from argv so that only the positional
+// arguments remain.  Calls Usage() on an unknown or malformed option.
+static void GetOptions(int* const argc,
+                       char** argv,
+                       hw4::HttpServerOptions* const options);
+
+// Parse "value" as a whole number, no bigger than a uint32_t can hold,
+// for the option (or argument) "what".  Calls Usage() if it's anything
+// else, e.g., negative or not a number at all.
+static uint32_t GetNumber(const string& what,
+                          const string& value,
+                          char* prog_name);
+
 // Parse command-line arguments to get port, path, and indices to use
 // for your http333d server.
 //
@@ -51,6 +71,35 @@ static void GetPortAndPath(int argc,
                     string* const path,
                     list<string>* const indices);
 
+// What the signal-handling thread needs to know.
+struct SignalArgs {
+  hw4::HttpServer* server;
+  sigset_t signals;      // the signals it waits for
+  vector<char*> argv;    // the original command line, for SIGHUP
+  bool can_hand_off;     // whether --handoff was given
+};
+
+// The signal-handling thread's start routine.  Every other thread has
+// SIGTERM, SIGINT, SIGHUP, SIGUSR1 and SIGCHLD blocked, and this one
+// picks them up with sigwait(), so that it can call into the server
+// like any other thread instead of being limited to async-signal-safe
+// functions:
+//
+//  - SIGTERM or SIGINT drains the server and exits.  A second one exits
+//    right away.
+//
+//  - SIGHUP starts a new server with the same command line, which takes
+//    over the listening sockets through the handoff path; this server
+//    then drains and exits.  This is how to roll out a new binary or
+//    new indices without dropping any connections.
+//
+//  - SIGUSR1 prints how many worker threads the server has and what
+//    they're doing.
+static void* SignalThread(void* arg);
+
+// Starts a copy of this program with command line "argv".
+static void Respawn(const vector<char*>& argv);
+
 int main(int argc, char** argv) {
   // Print out welcome message.
   cout << "Welcome to http333d, the UW cse333 web server!" << endl;
@@ -64,7 +113,23 @@ int main(int argc, char** argv) {
   // disconnects unexpectedly.
   signal(SIGPIPE, SIG_IGN);
 
-  // Get the port number and list of index files.
+  // Handle the shutdown signals on a thread of their own (see
+  // SignalThread()).  Block them before any other threads are created,
+  // so that they all inherit the mask.
+  SignalArgs signal_args;
+  sigemptyset(&signal_args.signals);
+  sigaddset(&signal_args.signals, SIGTERM);
+  sigaddset(&signal_args.signals, SIGINT);
+  sigaddset(&signal_args.signals, SIGHUP);
+  sigaddset(&signal_args.signals, SIGUSR1);
+  sigaddset(&signal_args.signals, SIGCHLD);
+  pthread_sigmask(SIG_BLOCK, &signal_args.signals, nullptr);
+  signal_args.argv.assign(argv, argv + argc);
+  signal_args.argv.push_back(nullptr);
+
+  // Get the server options, port number and list of index files.
+  hw4::HttpServerOptions options;
+  GetOptions(&argc, argv, &options);
   uint16_t port_num;
   string static_dir;
   list<string> indices;
@@ -73,7 +138,16 @@ int main(int argc, char** argv) {
   cout << "    path: " << static_dir << endl;
 
   // Run the server.
-  hw4::HttpServer hs(port_num, static_dir, indices);
+  hw4::HttpServer hs(port_num, static_dir, indices, options);
+  signal_args.server = &hs;
+  signal_args.can_hand_off = !options.handoff_path.empty();
+  pthread_t signal_thread;
+  if (pthread_create(&signal_thread, nullptr, &SignalThread,
+                     &signal_args) != 0) {
+    cerr << "  couldn't start the signal handling thread!?" << endl;
+    return EXIT_FAILURE;
+  }
+  pthread_detach(signal_thread);
   if (!hs.Run()) {
     cerr << "  server failed to run!?" << endl;
   }
@@ -84,11 +158,264 @@ int main(int argc, char** argv) {
 
 
 static void Usage(char* prog_name) {
-  cerr << "Usage: " << prog_name << " port staticfiles_directory indices+";
-  cerr << endl;
+  cerr << "Usage: " << prog_name
+       << " [options] port staticfiles_directory indices+" << endl;
+  cerr << "Options:" << endl;
+  cerr << "  --mode=threads|epoll|park|coro" << endl;
+  cerr << "                         thread per connection (default), epoll"
+       << " event loops," << endl;
+  cerr << "                         threads that park idle connections, or"
+       << " coroutines" << endl;
+  cerr << "                         that wait for clients on a reactor"
+       << endl;
+  cerr << "  --event_loops=N        number of event loops (default: one"
+       << " per CPU)" << endl;
+  cerr << "  --acceptors=N          number of SO_REUSEPORT listeners, each"
+       << " with its own" << endl;
+  cerr << "                         accept thread (default: 1)" << endl;
+  cerr << "  --acceptor_placement=none|compact|scatter|CPULIST" << endl;
+  cerr << "                         pin accept threads to CPUs: none"
+       << " (default), filling" << endl;
+  cerr << "                         one NUMA node first, round-robin over"
+       << " nodes, or" << endl;
+  cerr << "                         thread i on the i'th CPU of a list like"
+       << " 0-3,8" << endl;
+  cerr << "  --pin_acceptors        same as --acceptor_placement=compact"
+       << endl;
+  cerr << "  --dns=blocking|cached|none" << endl;
+  cerr << "                         resolve client names on accept"
+       << " (default), in the" << endl;
+  cerr << "                         background through a cache, or never"
+       << endl;
+  cerr << "  --dns_cache_size=N     names the DNS cache holds (default:"
+       << " 4096)" << endl;
+  cerr << "  --dns_cache_ttl=SECS   how long a cached name is good for"
+       << " (default: 300)" << endl;
+  cerr << "  --io=syscalls|uring    do socket and file I/O with plain"
+       << " system calls" << endl;
+  cerr << "                         (default) or batched through io_uring"
+       << endl;
+  cerr << "  --min_threads=N        worker threads to start with (default:"
+       << " 8)" << endl;
+  cerr << "  --max_threads=N        worker threads to grow to when"
+       << " connections back" << endl;
+  cerr << "                         up (default: 100)" << endl;
+  cerr << "  --thread_idle_timeout=MS" << endl;
+  cerr << "                         retire extra threads idle this long"
+       << " (default:" << endl;
+  cerr << "                         10000; 0 means never)" << endl;
+  cerr << "  --worker_placement=none|compact|scatter|CPULIST" << endl;
+  cerr << "                         pin worker threads likewise; workers"
+       << " on several" << endl;
+  cerr << "                         NUMA nodes prefer connections accepted"
+       << " on their own" << endl;
+  cerr << "  --thread_stack_size=KB worker thread stack size (default:"
+       << " the system's)" << endl;
+  cerr << "  --lanes=none|weighted|strict" << endl;
+  cerr << "                         queue static file requests and"
+       << " queries for workers" << endl;
+  cerr << "                         together (default), in lanes served"
+       << " by weight, or" << endl;
+  cerr << "                         static files always first" << endl;
+  cerr << "  --static_weight=N      static lane turns per query lane turn"
+       << " (default: 4)" << endl;
+  cerr << "  --parallel_queries     search the indices for a query in"
+       << " parallel, on as" << endl;
+  cerr << "                         many workers as there are indices"
+       << endl;
+  cerr << "  --lazy_threads         create even the first min_threads"
+       << " threads only" << endl;
+  cerr << "                         as connections come in" << endl;
+  cerr << "  --max_queued=N         connections that may wait for a worker"
+       << " (default: no" << endl;
+  cerr << "                         limit)" << endl;
+  cerr << "  --overload=shed|pause  beyond that, answer with 503 (default)"
+       << " or stop" << endl;
+  cerr << "                         accepting until a worker frees up"
+       << endl;
+  cerr << "  --retry_after=SECS     Retry-After for shed clients (default:"
+       << " 1)" << endl;
+  cerr << "  --idle_timeout=MS      hang up on connections idle this long"
+       << " between" << endl;
+  cerr << "                         requests (default: 60000; 0 means"
+       << " never)" << endl;
+  cerr << "  --header_timeout=MS    hang up on clients that take this long"
+       << " to finish" << endl;
+  cerr << "                         a request header (default: 10000; 0"
+       << " means never)" << endl;
+  cerr << "  --write_timeout=MS     hang up on clients that take none of a"
+       << " response" << endl;
+  cerr << "                         for this long (default: 30000; 0 means"
+       << " never)" << endl;
+  cerr << "  --max_header_bytes=N   turn down requests whose headers are"
+       << " longer (431)" << endl;
+  cerr << "                         (default: 65536)" << endl;
+  cerr << "  --max_body_bytes=N     turn down requests whose bodies are"
+       << " longer (413)" << endl;
+  cerr << "                         (default: 262144)" << endl;
+  cerr << "  --max_buffered_bytes=N the most unhandled input to hold per"
+       << " connection" << endl;
+  cerr << "                         (default: 1048576)" << endl;
+  cerr << "  --pipeline_batch=N     answer up to N pipelined requests with"
+       << " one write" << endl;
+  cerr << "                         (default: 32; 1 writes each response"
+       << " on its own)" << endl;
+  cerr << "  --drain_timeout=MS     on shutdown, how long open connections"
+       << " get to finish" << endl;
+  cerr << "                         (default: 10000)" << endl;
+  cerr << "  --handoff=PATH         take over the listening sockets of the"
+       << " server at the" << endl;
+  cerr << "                         Unix socket PATH, if any, and hand ours"
+       << " to the next" << endl;
+  cerr << "                         one (e.g., started by SIGHUP)" << endl;
+  cerr << "  --unix=PATH            also listen on the Unix socket PATH,"
+       << " e.g., for a" << endl;
+  cerr << "                         reverse proxy on this host" << endl;
+  cerr << "  --unix_only            listen only on the Unix socket; port"
+       << " is then ignored" << endl;
   exit(EXIT_FAILURE);
 }
 
+static void GetOptions(int* const argc,
+                       char** argv,
+                       hw4::HttpServerOptions* const options) {
+  int num_args = 1;
+  for (int i = 1; i < *argc; i++) {
+    string arg = argv[i];
+    if (arg.substr(0, 2) != "--") {
+      argv[num_args++] = argv[i];
+      continue;
+    }
+
+    size_t eq = arg.find('=');
+    string name = arg.substr(2, eq == string::npos ? string::npos : eq - 2);
+    string value = (eq == string::npos) ? "" : arg.substr(eq + 1);
+    if (name == "mode" && value == "threads") {
+      options->mode = hw4::kThreadPerConnection;
+    } else if (name == "mode" && value == "epoll") {
+      options->mode = hw4::kEventLoop;
+    } else if (name == "mode" && value == "park") {
+      options->mode = hw4::kParkIdle;
+    } else if (name == "mode" && value == "coro") {
+      options->mode = hw4::kCoroutine;
+    } else if (name == "event_loops" && !value.empty()) {
+      options->num_event_loops = GetNumber(arg, value, argv[0]);
+    } else if (name == "acceptors" && !value.empty()) {
+      options->num_acceptors = GetNumber(arg, value, argv[0]);
+    } else if (name == "acceptor_placement") {
+      if (!hw4::ParsePlacement(value, &options->acceptor_placement)) {
+        cerr << "Bad CPU placement " << arg << endl;
+        Usage(argv[0]);
+      }
+    } else if (name == "pin_acceptors" && value.empty()) {
+      options->acceptor_placement.policy = hw4::kPlaceCompact;
+    } else if (name == "worker_placement") {
+      if (!hw4::ParsePlacement(value, &options->worker_placement)) {
+        cerr << "Bad CPU placement " << arg << endl;
+        Usage(argv[0]);
+      }
+    } else if (name == "thread_stack_size" && !value.empty()) {
+      options->worker_placement.stack_size =
+        static_cast<size_t>(GetNumber(arg, value, argv[0])) * 1024;
+    } else if (name == "dns" && value == "blocking") {
+      options->dns_mode = hw4::kDnsBlocking;
+    } else if (name == "dns" && value == "cached") {
+      options->dns_mode = hw4::kDnsCached;
+    } else if (name == "dns" && value == "none") {
+      options->dns_mode = hw4::kDnsNone;
+    } else if (name == "dns_cache_size" && !value.empty()) {
+      options->dns_cache_size = GetNumber(arg, value, argv[0]);
+    } else if (name == "dns_cache_ttl" && !value.empty()) {
+      options->dns_cache_ttl_secs = GetNumber(arg, value, argv[0]);
+    } else if (name == "io" && value == "syscalls") {
+      options->io_engine = hw4::kIoSyscalls;
+    } else if (name == "io" && value == "uring") {
+      options->io_engine = hw4::kIoUring;
+    } else if (name == "min_threads" && !value.empty()) {
+      options->min_threads = GetNumber(arg, value, argv[0]);
+    } else if (name == "max_threads" && !value.empty()) {
+      options->max_threads = GetNumber(arg, value, argv[0]);
+    } else if (name == "thread_idle_timeout" && !value.empty()) {
+      options->thread_idle_timeout_ms = GetNumber(arg, value, argv[0]);
+    } else if (name == "lanes" && value == "none") {
+      options->priority_lanes = false;
+    } else if (name == "lanes" && value == "weighted") {
+      options->priority_lanes = true;
+      options->lane_scheduling = hw4::kLanesWeighted;
+    } else if (name == "lanes" && value == "strict") {
+      options->priority_lanes = true;
+      options->lane_scheduling = hw4::kLanesStrict;
+    } else if (name == "static_weight" && !value.empty()) {
+      options->static_lane_weight = GetNumber(arg, value, argv[0]);
+    } else if (name == "lazy_threads" && value.empty()) {
+      options->lazy_threads = true;
+    } else if (name == "parallel_queries" && value.empty()) {
+      options->parallel_queries = true;
+    } else if (name == "max_queued" && !value.empty()) {
+      options->max_queued = GetNumber(arg, value, argv[0]);
+    } else if (name == "overload" && value == "shed") {
+      options->overload_policy = hw4::kOverloadShed;
+    } else if (name == "overload" && value == "pause") {
+      options->overload_policy = hw4::kOverloadPause;
+    } else if (name == "retry_after" && !value.empty()) {
+      options->retry_after_secs = GetNumber(arg, value, argv[0]);
+    } else if (name == "idle_timeout" && !value.empty()) {
+      options->idle_timeout_ms = GetNumber(arg, value, argv[0]);
+    } else if (name == "header_timeout" && !value.empty()) {
+      options->header_timeout_ms = GetNumber(arg, value, argv[0]);
+    } else if (name == "write_timeout" && !value.empty()) {
+      options->write_timeout_ms = GetNumber(arg, value, argv[0]);
+    } else if (name == "max_header_bytes" && !value.empty()) {
+      options->connection_limits.max_header_bytes =
+        GetNumber(arg, value, argv[0]);
+    } else if (name == "max_body_bytes" && !value.empty()) {
+      options->connection_limits.max_body_bytes =
+        GetNumber(arg, value, argv[0]);
+    } else if (name == "max_buffered_bytes" && !value.empty()) {
+      options->connection_limits.max_buffered_bytes =
+        GetNumber(arg, value, argv[0]);
+    } else if (name == "pipeline_batch" && !value.empty()) {
+      options->pipeline_batch = GetNumber(arg, value, argv[0]);
+    } else if (name == "drain_timeout" && !value.empty()) {
+      options->drain_timeout_ms = GetNumber(arg, value, argv[0]);
+    } else if (name == "handoff" && !value.empty()) {
+      options->handoff_path = value;
+    } else if (name == "unix" && !value.empty()) {
+      options->unix_path = value;
+    } else if (name == "unix_only" && value.empty()) {
+      options->unix_only = true;
+    } else {
+      cerr << "Unrecognized option " << arg << endl;
+      Usage(argv[0]);
+    }
+  }
+  if (options->min_threads == 0) {
+    cerr << "--min_threads must be at least 1" << endl;
+    Usage(argv[0]);
+  }
+  if (options->unix_only && options->unix_path.empty()) {
+    cerr << "--unix_only needs --unix=PATH" << endl;
+    Usage(argv[0]);
+  }
+  *argc = num_args;
+}
+
+static uint32_t GetNumber(const string& what,
+                          const string& value,
+                          char* prog_name) {
+  // strtoul() would skip leading spaces, and take a '-' or '+', so
+  // insist on a digit first.
+  errno = 0;
+  char* end = nullptr;
+  unsigned long number = strtoul(value.c_str(), &end, 10);  // NOLINT
+  if (value.empty() || value[0] < '0' || value[0] > '9' || *end != '\0' ||
+      errno != 0 || number > UINT32_MAX) {
+    cerr << "Expected a whole number: " << what << endl;
+    Usage(prog_name);
+  }
+  return number;
+}
+
 static void GetPortAndPath(int argc,
                     char** argv,
                     uint16_t* const port,
@@ -106,11 +433,12 @@ static void GetPortAndPath(int argc,
     Usage(argv[0]);
   }
 
-  *port = std::stoi(argv[1]);
-  if (*port < 1000 || *port > 9000) {
+  uint32_t port_number = GetNumber(argv[1], argv[1], argv[0]);
+  if (port_number < 1000 || port_number > 9000) {
     cerr << "Port Number must in range [1000,9000]" << endl;
     Usage(argv[0]);
   }
+  *port = port_number;
 
   *path = argv[2];
   struct stat buf;
@@ -135,3 +463,59 @@ static void GetPortAndPath(int argc,
     Usage(argv[0]);
   }
 }
+
+static void* SignalThread(void* arg) {
+  SignalArgs* args = static_cast<SignalArgs*>(arg);
+  bool draining = false;
+  while (1) {
+    int sig;
+    if (sigwait(&args->signals, &sig) != 0) {
+      continue;
+    }
+
+    if (sig == SIGUSR1) {
+      args->server->PrintStatus();
+    } else if (sig == SIGCHLD) {
+      // Reap any respawned servers that gave up before taking over.
+      while (waitpid(-1, nullptr, WNOHANG) > 0) { }
+    } else if (sig == SIGHUP && !draining) {
+      if (!args->can_hand_off) {
+        cout << "  ignoring SIGHUP: restarting needs --handoff" << endl;
+        continue;
+      }
+      // The new server drains us once it has taken over.
+      cout << "  starting a new server to take over..." << endl;
+      Respawn(args->argv);
+    } else if (sig == SIGTERM || sig == SIGINT) {
+      if (draining) {
+        cout << "  exiting without finishing the drain." << endl;
+        _exit(EXIT_FAILURE);
+      }
+      cout << "  shutting down..." << endl;
+      draining = true;
+      args->server->Drain();
+    }
+  }
+  return nullptr;
+}
+
+static void Respawn(const vector<char*>& argv) {
+  pid_t pid = fork();
+  if (pid != 0) {
+    if (pid == -1) {
+      cerr << "  couldn't start a new server!?" << endl;
+    }
+    return;
+  }
+
+  // In the child.  It mustn't hang on to any of our descriptors: the
+  // listening sockets come to it through the handoff, and a client
+  // socket held open here would keep the client from ever seeing its
+  // connection close.  It also mustn't inherit our blocked signals.
+  close_range(STDERR_FILENO + 1, ~0U, 0);
+  sigset_t none;
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK, &none, nullptr);
+  execvp(argv[0], argv.data());
+  _exit(EXIT_FAILURE);
+}
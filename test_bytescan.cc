@@ -0,0 +1,95 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./ByteScan.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+TEST(Test_ByteScan, TestByteScanKinds) {
+  // Random bytes, with the ones looked for sprinkled in sparsely, so
+  // that matches land at every position within a block.
+  srand(333);
+  string data;
+  for (int i = 0; i < 4096; i++) {
+    int r = rand() % 64;  // NOLINT(runtime/threadsafe_fn)
+    data.push_back(r == 0 ? '\n' : r == 1 ? ':' : 'a' + r % 26);
+  }
+  const char* begin = data.data();
+  const char* end = begin + data.size();
+
+  ByteScanKind original = ByteScanKindInUse();
+  ASSERT_TRUE(SelectByteScan(kScanScalar));
+  for (ByteScanKind kind : {kScanScalar, kScanSse2, kScanAvx2}) {
+    if (!SelectByteScan(kind)) {
+      continue;  // not on this CPU
+    }
+    ASSERT_EQ(kind, ByteScanKindInUse());
+
+    // Every kind finds the same bytes as a plain loop, from every
+    // starting point and for every length up to a few blocks.
+    for (size_t start = 0; start < 128; start++) {
+      for (size_t len = 0; len < 100 && start + len <= data.size(); len++) {
+        const char* from = begin + start;
+        const char* to = from + len;
+        const char* expected = from;
+        while (expected < to && *expected != '\n' && *expected != ':')
+          expected++;
+        ASSERT_EQ(expected, FindFirstOf(from, to, '\n', ':'))
+          << ByteScanName(kind) << " " << start << " " << len;
+
+        // And find the same line ends, and colons before them.
+        const char* newline = from;
+        const char* colon = nullptr;
+        while (newline < to && *newline != '\n') {
+          if (*newline == ':' && colon == nullptr)
+            colon = newline;
+          newline++;
+        }
+        const char* found_colon = begin;
+        ASSERT_EQ(newline, FindLineEnd(from, to, ':', &found_colon))
+          << ByteScanName(kind) << " " << start << " " << len;
+        ASSERT_EQ(colon, found_colon)
+          << ByteScanName(kind) << " " << start << " " << len;
+        ASSERT_EQ(newline, FindLineEnd(from, to, ':', nullptr));
+      }
+    }
+
+    // The whole buffer, a line at a time, and one byte at a time.
+    size_t num_found = 0;
+    for (const char* p = begin;
+         (p = FindFirstOf(p, end, '\n', '\n')) != end; p++) {
+      ASSERT_EQ('\n', *p);
+      num_found++;
+    }
+    ASSERT_EQ(static_cast<size_t>(std::count(data.begin(), data.end(), '\n')),
+              num_found);
+    size_t num_lines = 0;
+    for (const char* p = begin;
+         (p = FindLineEnd(p, end, ':', nullptr)) != end; p++) {
+      num_lines++;
+    }
+    ASSERT_EQ(num_found, num_lines);
+    ASSERT_EQ(end, FindFirstOf(begin, end, '!', '?'));
+    ASSERT_EQ(end, FindFirstOf(end, end, '!', '?'));
+    ASSERT_EQ(end, FindLineEnd(end, end, '!', nullptr));
+  }
+  ASSERT_TRUE(SelectByteScan(original));
+}
+
+}  // namespace hw4
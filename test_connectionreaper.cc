@@ -0,0 +1,295 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./ConnectionReaper.h"
+#include "./HttpConnection.h"
+#include "./HttpResponse.h"
+#include "./HttpUtils.h"
+#include "./test_suite.h"
+
+namespace hw4 {
+
+// Sends a byte down the socket "arg" every 50ms, until the socket is
+// shut down or a second has passed.
+static void* TrickleThread(void* arg) {
+  int fd = *static_cast<int*>(arg);
+  unsigned char c = 'G';
+  for (int i = 0; i < 20; i++) {
+    if (send(fd, &c, 1, MSG_NOSIGNAL) != 1) {
+      break;
+    }
+    usleep(50000);  // 0.05s
+  }
+  return nullptr;
+}
+
+TEST(Test_ConnectionReaper, TestConnectionReaperIdle) {
+  ConnectionReaper reaper(200, 0);
+  ASSERT_TRUE(reaper.Start());
+
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+
+  // A disarmed deadline never fires.
+  ConnectionReaper::Deadline deadline;
+  reaper.Arm(&deadline, spair[0], ConnectionReaper::kIdleDeadline);
+  reaper.Disarm(&deadline);
+  usleep(400000);  // 0.4s
+  ASSERT_EQ(0U, reaper.num_reaped());
+
+  // Header deadlines are turned off for this reaper.
+  reaper.Arm(&deadline, spair[0], ConnectionReaper::kHeaderDeadline);
+  ASSERT_FALSE(deadline.pending());
+
+  // An idle client is cut off, which a blocked reader sees as EOF.
+  HttpConnection hc(spair[0]);
+  hc.SetReaper(&reaper);
+  HttpRequest req;
+  ASSERT_FALSE(hc.GetNextRequest(&req));
+  ASSERT_EQ(1U, reaper.num_reaped());
+
+  close(spair[1]);
+}
+
+TEST(Test_ConnectionReaper, TestConnectionReaperSlowHeader) {
+  ConnectionReaper reaper(0, 300);
+  ASSERT_TRUE(reaper.Start());
+
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  HttpConnection hc(spair[0]);
+  hc.SetReaper(&reaper);
+
+  // A complete request gets through...
+  const char* req1 = "GET /foo HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(strlen(req1)),
+            WrappedWrite(spair[1], reinterpret_cast<const unsigned char*>(
+                           req1), strlen(req1)));
+  HttpRequest req;
+  ASSERT_TRUE(hc.GetNextRequest(&req));
+  ASSERT_EQ("/foo", req.uri());
+
+  // ...but a client that trickles in a header a byte at a time is cut
+  // off once the header deadline passes, however steadily it trickles.
+  pthread_t thr;
+  ASSERT_EQ(0, pthread_create(&thr, nullptr, &TrickleThread, &spair[1]));
+  ASSERT_FALSE(hc.GetNextRequest(&req));
+  ASSERT_EQ(1U, reaper.num_reaped());
+  ASSERT_TRUE(hc.HasBufferedData());
+  ASSERT_EQ(0, pthread_join(thr, nullptr));
+  close(spair[1]);
+}
+
+// Reads everything from the socket "arg", 16KB every 10ms, until EOF.
+static void* SlowReaderThread(void* arg) {
+  int fd = *static_cast<int*>(arg);
+  unsigned char buf[16384];
+  while (read(fd, buf, sizeof(buf)) > 0) {
+    usleep(10000);  // 0.01s
+  }
+  return nullptr;
+}
+
+TEST(Test_ConnectionReaper, TestConnectionReaperSlowReader) {
+  ConnectionReaper reaper(0, 0, 500);
+  ASSERT_TRUE(reaper.Start());
+
+  // A response far bigger than the socket buffer.
+  HttpResponse rsp;
+  rsp.set_protocol("HTTP/1.1");
+  rsp.set_response_code(200);
+  rsp.set_message("OK");
+  rsp.AppendToBody(std::string(1024 * 1024, 'x'));
+
+  // A client that reads slowly, but steadily, gets all of it, even
+  // though that takes longer than the write deadline...
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  HttpConnection hc(spair[0]);
+  hc.SetReaper(&reaper);
+  pthread_t thr;
+  ASSERT_EQ(0, pthread_create(&thr, nullptr, &SlowReaderThread, &spair[1]));
+  ASSERT_TRUE(hc.WriteResponse(rsp));
+  ASSERT_EQ(0U, reaper.num_reaped());
+  shutdown(spair[0], SHUT_WR);
+  ASSERT_EQ(0, pthread_join(thr, nullptr));
+  close(spair[1]);
+
+  // ...but one that never reads is cut off once it passes.  (Like the
+  // server, ignore the SIGPIPE the cut-off write raises.)
+  signal(SIGPIPE, SIG_IGN);
+  int stuck[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, stuck));
+  HttpConnection stuck_hc(stuck[0]);
+  stuck_hc.SetReaper(&reaper);
+  HttpResponse copy = rsp;
+  stuck_hc.QueueResponse(&copy);
+  ASSERT_FALSE(stuck_hc.FlushResponses());
+  ASSERT_EQ(1U, reaper.num_reaped());
+  close(stuck[1]);
+}
+
+// Returns true if "fd" is readable (e.g., at EOF) right now.
+static bool Readable(int fd) {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  return poll(&pfd, 1, 0) == 1;
+}
+
+TEST(Test_ConnectionReaper, TestConnectionReaperDrain) {
+  ConnectionReaper reaper(60000, 60000);
+  ASSERT_TRUE(reaper.Start());
+
+  // One connection waiting for its next request, one halfway through
+  // a header, and one whose request is being processed.
+  int idle[2], header[2], busy[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, idle));
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, header));
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, busy));
+  ConnectionReaper::Deadline idle_dl, header_dl, busy_dl;
+  reaper.Arm(&idle_dl, idle[0], ConnectionReaper::kIdleDeadline);
+  reaper.Arm(&header_dl, header[0], ConnectionReaper::kHeaderDeadline);
+  reaper.Arm(&busy_dl, busy[0], ConnectionReaper::kIdleDeadline);
+  reaper.Disarm(&busy_dl);
+  ASSERT_EQ(3U, reaper.num_connections());
+  ASSERT_FALSE(reaper.draining());
+
+  reaper.Drain(1000);
+  ASSERT_TRUE(reaper.draining());
+  usleep(300000);  // 0.3s
+
+  // The idle connection has had its read side shut down, but it can
+  // still send the client the rest of a response.
+  ASSERT_TRUE(Readable(idle[0]));
+  char c;
+  ASSERT_EQ(0, read(idle[0], &c, 1));
+  ASSERT_EQ(1, send(idle[0], "x", 1, MSG_NOSIGNAL));
+  ASSERT_EQ(1, read(idle[1], &c, 1));
+
+  // The others are left alone for now.
+  ASSERT_FALSE(Readable(header[0]));
+  ASSERT_FALSE(Readable(busy[0]));
+
+  // A connection that goes idle while draining is wound down too.
+  reaper.Arm(&busy_dl, busy[0], ConnectionReaper::kIdleDeadline);
+  usleep(300000);  // 0.3s
+  ASSERT_TRUE(Readable(busy[0]));
+  reaper.Disarm(&busy_dl);
+
+  // Once the grace period is over, everybody still registered is shut
+  // down completely, whatever they're doing.
+  usleep(800000);  // 0.8s
+  ASSERT_TRUE(Readable(header[0]));
+  ASSERT_EQ(-1, send(busy[0], "x", 1, MSG_NOSIGNAL));
+
+  // Released connections are forgotten.
+  reaper.Release(&idle_dl);
+  reaper.Release(&header_dl);
+  reaper.Release(&busy_dl);
+  ASSERT_EQ(0U, reaper.num_connections());
+
+  for (int i = 0; i < 2; i++) {
+    close(idle[i]);
+    close(header[i]);
+    close(busy[i]);
+  }
+}
+
+// Connects "*client" to "*server" over the TCP loopback, where (unlike
+// a Unix socket) closing with unread data resets the connection.
+static void LoopbackPair(int* client, int* server) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrlen = sizeof(addr);
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(-1, listen_fd);
+  ASSERT_EQ(0, bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    sizeof(addr)));
+  ASSERT_EQ(0, listen(listen_fd, 1));
+  ASSERT_EQ(0, getsockname(listen_fd,
+                           reinterpret_cast<struct sockaddr*>(&addr),
+                           &addrlen));
+  *client = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(-1, *client);
+  ASSERT_EQ(0, connect(*client, reinterpret_cast<struct sockaddr*>(&addr),
+                       sizeof(addr)));
+  *server = accept(listen_fd, nullptr, nullptr);
+  ASSERT_NE(-1, *server);
+  close(listen_fd);
+}
+
+TEST(Test_ConnectionReaper, TestConnectionReaperLinger) {
+  ConnectionReaper reaper(0, 0);
+  ASSERT_TRUE(reaper.Start());
+
+  // The server sends a client away before it has even sent its request.
+  int client, server;
+  LoopbackPair(&client, &server);
+  std::string response = "HTTP/1.1 503 Service Unavailable\r\n"
+                         "Retry-After: 5\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(response.size()),
+            WrappedWrite(server, (const unsigned char*) response.c_str(),
+                         response.size()));
+  reaper.Linger(server);
+  ASSERT_EQ(1U, reaper.num_lingering());
+
+  // The request shows up after a tick or two, and still the client gets
+  // the whole response and a clean EOF, not a reset.
+  usleep(2 * ConnectionReaper::kTickMs * 1000);
+  std::string request = "GET / HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(request.size()),
+            WrappedWrite(client, (const unsigned char*) request.c_str(),
+                         request.size()));
+  usleep(2 * ConnectionReaper::kTickMs * 1000);
+  std::string got;
+  unsigned char buf[256];
+  int res;
+  while ((res = WrappedRead(client, buf, sizeof(buf))) > 0) {
+    got.append(reinterpret_cast<char*>(buf), res);
+  }
+  ASSERT_EQ(0, res) << strerror(errno);
+  ASSERT_EQ(response, got);
+
+  // Once the client hangs up, the server's socket is closed well before
+  // kLingerMs.
+  close(client);
+  for (int i = 0; i < 10 && reaper.num_lingering() > 0; i++) {
+    usleep(ConnectionReaper::kTickMs * 1000);
+  }
+  ASSERT_EQ(0U, reaper.num_lingering());
+
+  // A client that never hangs up has its socket closed when the reaper
+  // stops, at the latest.
+  LoopbackPair(&client, &server);
+  reaper.Linger(server);
+  ASSERT_EQ(1U, reaper.num_lingering());
+  reaper.Stop();
+  ASSERT_EQ(0U, reaper.num_lingering());
+  ASSERT_EQ(0, WrappedRead(client, buf, sizeof(buf)));
+  close(client);
+}
+
+}  // namespace hw4
@@ -0,0 +1,94 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <unistd.h>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./DnsCache.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// Keeps looking "addr" up until the cache has an answer for it.
+static string WaitForName(DnsCache* cache, const string& addr) {
+  string name = "unset";
+  while (!cache->Lookup(addr, &name)) {
+    usleep(10000);
+  }
+  return name;
+}
+
+TEST(Test_DnsCache, TestDnsCacheBasic) {
+  DnsCache cache(2, 300);
+
+  // The first lookup misses without waiting for the resolver, and
+  // leaves the output parameter alone...
+  string name = "unset";
+  ASSERT_FALSE(cache.Lookup("127.0.0.1", &name));
+  ASSERT_EQ("unset", name);
+
+  // ...but the answer shows up in the background.
+  ASSERT_EQ("localhost", WaitForName(&cache, "127.0.0.1"));
+
+  // IPv4 clients of an IPv6 socket resolve like IPv4 clients.
+  ASSERT_EQ("localhost", WaitForName(&cache, "::ffff:127.0.0.1"));
+
+  // Something that isn't an address has no name, and that's cached too.
+  ASSERT_EQ("", WaitForName(&cache, "not an address"));
+  ASSERT_TRUE(cache.Lookup("not an address", &name));
+
+  // The cache holds only two addresses, so the least recently used one
+  // (127.0.0.1) was evicted to make room.
+  ASSERT_EQ(2U, cache.size());
+  ASSERT_FALSE(cache.Lookup("127.0.0.1", &name));
+}
+
+TEST(Test_DnsCache, TestDnsCacheFlood) {
+  // However many new addresses turn up at once, and however far behind
+  // the resolver falls, only so many wait for it, and each of them is
+  // still in the cache.
+  DnsCache cache(8, 300);
+  string name;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_FALSE(cache.Lookup("10.0.0." + std::to_string(i), &name));
+    ASSERT_LE(cache.num_queued(), 8U);
+    ASSERT_LE(cache.num_queued(), cache.size());
+  }
+
+  // A big cache still only queues kMaxQueued of them.
+  DnsCache big(100000, 300);
+  for (uint32_t i = 0; i < 4 * DnsCache::kMaxQueued; i++) {
+    big.Lookup("not an address " + std::to_string(i), &name);
+    ASSERT_LE(big.num_queued(), DnsCache::kMaxQueued);
+  }
+
+  // Once the resolver catches up, lookups are queued again.
+  while (cache.num_queued() > 0) {
+    usleep(10000);
+  }
+  ASSERT_EQ("", WaitForName(&cache, "not an address"));
+}
+
+TEST(Test_DnsCache, TestDnsCacheExpiry) {
+  // With a TTL of zero, every answer is stale as soon as it arrives, so
+  // each lookup after the first queues another resolution.
+  DnsCache cache(16, 0);
+  string name;
+  ASSERT_FALSE(cache.Lookup("127.0.0.1", &name));
+  usleep(500000);  // 0.5s
+  ASSERT_FALSE(cache.Lookup("127.0.0.1", &name));
+  ASSERT_EQ(1U, cache.size());
+}
+
+}  // namespace hw4
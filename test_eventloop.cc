@@ -0,0 +1,171 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./ConnectionReaper.h"
+#include "./EventLoop.h"
+#include "./HttpRequest.h"
+#include "./HttpResponse.h"
+#include "./HttpUtils.h"
+#include "./ThreadPool.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// A handler that echoes the request URI back as the response body.
+static HttpResponse EchoUriFn(const HttpRequest& req, void* arg) {
+  HttpResponse rsp;
+  rsp.set_protocol("HTTP/1.1");
+  rsp.set_response_code(200);
+  rsp.set_message("OK");
+  rsp.AppendToBody(req.uri());
+  return rsp;
+}
+
+// A handler whose response is far bigger than a socket buffer.
+static HttpResponse BigFn(const HttpRequest& req, void* arg) {
+  HttpResponse rsp;
+  rsp.set_protocol("HTTP/1.1");
+  rsp.set_response_code(200);
+  rsp.set_message("OK");
+  rsp.AppendToBody(string(4 * 1024 * 1024, 'x'));
+  return rsp;
+}
+
+// Reads exactly "len" bytes from "fd", or fewer if the peer closes.
+static string ReadExactly(int fd, size_t len) {
+  string result;
+  unsigned char buf[256];
+  while (result.size() < len) {
+    int res = WrappedRead(fd, buf, std::min(sizeof(buf), len - result.size()));
+    if (res <= 0)
+      break;
+    result.append(reinterpret_cast<char*>(buf), res);
+  }
+  return result;
+}
+
+TEST(Test_EventLoop, TestEventLoopPipelined) {
+  ThreadPool tp(2);
+  EventLoop loop(&tp, &EchoUriFn, nullptr);
+  ASSERT_TRUE(loop.Start());
+
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  loop.AddConnection(spair[0]);
+
+  // Two requests in a single write: the loop has to answer both, in
+  // order, with only one of them in flight at a time.
+  string reqs = "GET /foo HTTP/1.1\r\nHost: a\r\n\r\n"
+                "GET /barbaz HTTP/1.1\r\nHost: a\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(reqs.size()),
+            WrappedWrite(spair[1],
+                         (unsigned char*) reqs.c_str(),
+                         static_cast<int>(reqs.size())));
+
+  string expected1 = "HTTP/1.1 200 OK\r\nContent-length: 4\r\n\r\n/foo";
+  string expected2 = "HTTP/1.1 200 OK\r\nContent-length: 7\r\n\r\n/barbaz";
+  ASSERT_EQ(expected1 + expected2,
+            ReadExactly(spair[1], expected1.size() + expected2.size()));
+  ASSERT_EQ(1U, loop.num_connections());
+
+  // A request split across two writes, asking us to close afterwards.
+  string part1 = "GET /q HTTP/1.1\r\nConn";
+  string part2 = "ection: close\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(part1.size()),
+            WrappedWrite(spair[1],
+                         (unsigned char*) part1.c_str(),
+                         static_cast<int>(part1.size())));
+  usleep(100000);  // 0.1s
+  ASSERT_EQ(static_cast<int>(part2.size()),
+            WrappedWrite(spair[1],
+                         (unsigned char*) part2.c_str(),
+                         static_cast<int>(part2.size())));
+
+  string expected3 = "HTTP/1.1 200 OK\r\nContent-length: 2\r\n\r\n/q";
+  ASSERT_EQ(expected3, ReadExactly(spair[1], expected3.size()));
+
+  // The loop should now close its end, which we see as EOF.
+  unsigned char c;
+  ASSERT_EQ(0, WrappedRead(spair[1], &c, 1));
+  ASSERT_EQ(0U, loop.num_connections());
+
+  loop.Stop();
+  close(spair[1]);
+}
+
+TEST(Test_EventLoop, TestEventLoopHalfClose) {
+  ThreadPool tp(2);
+  EventLoop loop(&tp, &EchoUriFn, nullptr);
+  ASSERT_TRUE(loop.Start());
+
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  loop.AddConnection(spair[0]);
+
+  // A client that sends its requests and then says it has nothing more
+  // to send still gets every answer, before the loop hangs up.
+  string reqs = "GET /one HTTP/1.1\r\n\r\nGET /two HTTP/1.1\r\n\r\n"
+                "GET /partial HTTP/1.1\r\n";
+  ASSERT_EQ(static_cast<int>(reqs.size()),
+            WrappedWrite(spair[1],
+                         (unsigned char*) reqs.c_str(),
+                         static_cast<int>(reqs.size())));
+  ASSERT_EQ(0, shutdown(spair[1], SHUT_WR));
+
+  string expected = "HTTP/1.1 200 OK\r\nContent-length: 4\r\n\r\n/one"
+                    "HTTP/1.1 200 OK\r\nContent-length: 4\r\n\r\n/two";
+  ASSERT_EQ(expected, ReadExactly(spair[1], expected.size() + 1));
+  ASSERT_EQ(0U, loop.num_connections());
+
+  loop.Stop();
+  close(spair[1]);
+}
+
+TEST(Test_EventLoop, TestEventLoopStuckReader) {
+  ConnectionReaper reaper(0, 0, 200);
+  ASSERT_TRUE(reaper.Start());
+  ThreadPool tp(2);
+  EventLoop loop(&tp, &BigFn, nullptr, &reaper);
+  ASSERT_TRUE(loop.Start());
+
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  loop.AddConnection(spair[0]);
+
+  // A client that asks for a response and never reads it doesn't get
+  // to pin the connection, and the rest of its response, forever.
+  string req = "GET / HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(req.size()),
+            WrappedWrite(spair[1],
+                         (unsigned char*) req.c_str(),
+                         static_cast<int>(req.size())));
+  usleep(100000);  // 0.1s
+  ASSERT_EQ(1U, loop.num_connections());
+  for (int i = 0; i < 20 && loop.num_connections() > 0; i++) {
+    usleep(100000);  // 0.1s
+  }
+  ASSERT_EQ(1U, reaper.num_reaped());
+  ASSERT_EQ(0U, loop.num_connections());
+
+  loop.Stop();
+  close(spair[1]);
+}
+
+}  // namespace hw4
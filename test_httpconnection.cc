@@ -13,9 +13,11 @@ extern "C" {
 #include <pthread.h>  // for the pthread threading/mutex functions
 }
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <memory>
 #include <string>
 
 #include "./HttpConnection.h"
@@ -24,6 +26,7 @@ extern "C" {
 #include "./HttpRequest.h"
 #include "./HttpResponse.h"
 #include "./HttpUtils.h"
+#include "./IoEngine.h"
 #include "./test_suite.h"
 
 using std::string;
@@ -358,4 +361,230 @@ static void WritePartialRequests(void* args) {
                          static_cast<int>(req3tail.size())));
 }
 
+// Reads from the socket "arg" until EOF, into a new string.
+static void* ReadAllThread(void* arg) {
+  int fd = *static_cast<int*>(arg);
+  string* got = new string;
+  unsigned char buf[65536];
+  int res;
+  while ((res = WrappedRead(fd, buf, sizeof(buf))) > 0) {
+    got->append(reinterpret_cast<char*>(buf), res);
+  }
+  return got;
+}
+
+TEST(Test_HttpConnection, TestHttpConnectionLargeResponse) {
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  pthread_t reader;
+  ASSERT_EQ(0, pthread_create(&reader, nullptr, &ReadAllThread, &spair[1]));
+
+  // A body much bigger than the socket buffer, so the response can't
+  // go out in one write.
+  HttpResponse rep;
+  rep.set_protocol("HTTP/1.1");
+  rep.set_response_code(200);
+  rep.set_message("OK");
+  for (int i = 0; i < (1 << 22); i++) {
+    rep.mutable_body()->push_back(static_cast<char>('a' + i % 26));
+  }
+  string expected = rep.GenerateResponseString();
+  ASSERT_EQ(rep.GenerateHeaderString() + rep.body(), expected);
+
+  {
+    HttpConnection hc(spair[0]);
+    ASSERT_TRUE(hc.WriteResponse(rep));
+  }  // closes spair[0]
+
+  void* got;
+  ASSERT_EQ(0, pthread_join(reader, &got));
+  std::unique_ptr<string> got_str(static_cast<string*>(got));
+  ASSERT_EQ(expected, *got_str);
+  close(spair[1]);
+}
+
+TEST(Test_HttpConnection, TestHttpConnectionLimits) {
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+
+  // Requests as long as the header limit allows are fine; longer ones
+  // aren't.  (None of these have bodies, so the buffer needn't make
+  // room for one.)
+  HttpConnectionLimits limits;
+  limits.max_header_bytes = 1024;
+  limits.max_body_bytes = 0;
+  limits.max_buffered_bytes = 4096;
+  HttpConnection hc(spair[0]);
+  hc.SetLimits(limits);
+  string ok = "GET /ok HTTP/1.1\r\nX-Pad: ";
+  ok += string(limits.max_header_bytes - ok.size() - 4, 'p') + "\r\n\r\n";
+  string too_long = "GET /long HTTP/1.1\r\nX-Pad: " + string(1024, 'p');
+  too_long += "\r\n\r\n";
+  string req = ok + too_long;
+  ASSERT_EQ(static_cast<int>(req.size()),
+            WrappedWrite(spair[1],
+                         reinterpret_cast<const unsigned char*>(req.data()),
+                         req.size()));
+  HttpRequest htreq;
+  ASSERT_TRUE(hc.GetNextRequest(&htreq));
+  ASSERT_EQ("/ok", htreq.uri());
+  ASSERT_FALSE(hc.GetNextRequest(&htreq));
+  ASSERT_EQ(431, hc.RejectedStatus());
+  close(spair[0]);
+  close(spair[1]);
+
+  // Reading without waiting stops once the buffer is full, and picks
+  // up the rest once requests have been taken out of it.
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  HttpConnection nb(spair[0]);
+  limits.max_header_bytes = 256;
+  limits.max_buffered_bytes = 512;
+  nb.SetLimits(limits);
+  ASSERT_EQ(0, fcntl(spair[0], F_SETFL, O_NONBLOCK));
+  string pipelined;
+  for (int i = 0; i < 50; i++) {
+    pipelined += "GET /" + std::to_string(i) + " HTTP/1.1\r\n\r\n";
+  }
+  ASSERT_EQ(static_cast<int>(pipelined.size()),
+            WrappedWrite(spair[1], reinterpret_cast<const unsigned char*>(
+                           pipelined.data()), pipelined.size()));
+  ASSERT_TRUE(nb.ReadAvailable());
+  ASSERT_TRUE(nb.more_to_read());
+  for (int i = 0; i < 50; i++) {
+    while (!nb.NextBufferedRequest(&htreq)) {
+      ASSERT_TRUE(nb.more_to_read());
+      ASSERT_TRUE(nb.ReadAvailable());
+    }
+    ASSERT_EQ("/" + std::to_string(i), htreq.uri());
+  }
+  ASSERT_TRUE(nb.ReadAvailable());
+  ASSERT_FALSE(nb.more_to_read());
+
+  // A header that fills the buffer without ending is an error.
+  string endless = "GET /endless HTTP/1.1\r\nX-Pad: " + string(1024, 'p');
+  ASSERT_EQ(static_cast<int>(endless.size()),
+            WrappedWrite(spair[1], reinterpret_cast<const unsigned char*>(
+                           endless.data()), endless.size()));
+  ASSERT_TRUE(nb.ReadAvailable());
+  ASSERT_FALSE(nb.NextBufferedRequest(&htreq));
+  ASSERT_EQ(431, nb.RejectedStatus());
+  close(spair[1]);
+}
+
+TEST(Test_HttpConnection, TestHttpConnectionBodies) {
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  HttpConnectionLimits limits;
+  limits.max_body_bytes = 1000;
+  HttpConnection hc(spair[0]);
+  hc.SetLimits(limits);
+
+  // Bodies, however they're framed, are read in full, and nothing of
+  // them is left over for the request behind them.
+  string body(1000, 'b');
+  string req = "POST /query HTTP/1.1\r\nContent-Length: 1000\r\n\r\n" + body;
+  req += "POST /query HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+  req += "1f4\r\n" + body.substr(0, 500) + "\r\n";
+  req += "1F4;ext=1\r\n" + body.substr(500) + "\r\n0\r\n\r\n";
+  req += "GET /after HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(req.size()),
+            WrappedWrite(spair[1],
+                         reinterpret_cast<const unsigned char*>(req.data()),
+                         req.size()));
+  HttpRequest htreq;
+  ASSERT_TRUE(hc.GetNextRequest(&htreq));
+  ASSERT_EQ("POST", htreq.method());
+  ASSERT_EQ(body, htreq.body());
+  ASSERT_TRUE(hc.GetNextRequest(&htreq));
+  ASSERT_EQ("POST", htreq.method());
+  ASSERT_EQ(body, htreq.body());
+  ASSERT_TRUE(hc.GetNextRequest(&htreq));
+  ASSERT_EQ("GET", htreq.method());
+  ASSERT_EQ("/after", htreq.uri());
+  ASSERT_EQ("", htreq.body());
+
+  // A client waiting to be told to go ahead is told, once.
+  ASSERT_EQ(0, fcntl(spair[0], F_SETFL, O_NONBLOCK));
+  req = "POST /query HTTP/1.1\r\nExpect: 100-continue\r\n";
+  req += "Content-Length: 5\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(req.size()),
+            WrappedWrite(spair[1],
+                         reinterpret_cast<const unsigned char*>(req.data()),
+                         req.size()));
+  ASSERT_TRUE(hc.ReadAvailable());
+  ASSERT_FALSE(hc.NextBufferedRequest(&htreq));
+  ASSERT_EQ(0, hc.RejectedStatus());
+  hc.SendContinue();
+  hc.SendContinue();
+  string expected = "HTTP/1.1 100 Continue\r\n\r\n";
+  unsigned char buf[4096];
+  ASSERT_EQ(static_cast<int>(expected.size()),
+            WrappedRead(spair[1], buf, sizeof(buf)));
+  ASSERT_EQ(expected, string(reinterpret_cast<char*>(buf), expected.size()));
+  ASSERT_EQ(5, WrappedWrite(spair[1],
+                            reinterpret_cast<const unsigned char*>("hello"),
+                            5));
+  ASSERT_TRUE(hc.ReadAvailable());
+  ASSERT_TRUE(hc.NextBufferedRequest(&htreq));
+  ASSERT_EQ("hello", htreq.body());
+
+  // A body over the limit is turned down as soon as its length is
+  // known, and the client is told why.
+  req = "POST /query HTTP/1.1\r\nContent-Length: 1001\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(req.size()),
+            WrappedWrite(spair[1],
+                         reinterpret_cast<const unsigned char*>(req.data()),
+                         req.size()));
+  ASSERT_TRUE(hc.ReadAvailable());
+  ASSERT_FALSE(hc.NextBufferedRequest(&htreq));
+  ASSERT_EQ(413, hc.RejectedStatus());
+  ASSERT_TRUE(hc.QueueRejection());
+  ASSERT_TRUE(hc.FlushResponses());
+  int res = WrappedRead(spair[1], buf, sizeof(buf));
+  ASSERT_LT(0, res);
+  string got(reinterpret_cast<char*>(buf), res);
+  ASSERT_EQ(0U, got.find("HTTP/1.1 413 Content Too Large\r\n"));
+  ASSERT_NE(string::npos, got.find("Connection: close\r\n"));
+  close(spair[1]);
+}
+
+TEST(Test_HttpConnection, TestHttpConnectionPipelined) {
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  HttpConnection hc(spair[0]);
+
+  // Responses queue up, bodies and all, until they're flushed...
+  string expected;
+  for (int i = 0; i < 100; i++) {
+    HttpResponse rep;
+    rep.set_protocol("HTTP/1.1");
+    rep.set_response_code(200);
+    rep.set_message("OK");
+    rep.AppendToBody("response " + std::to_string(i));
+    expected += rep.GenerateResponseString();
+    hc.QueueResponse(&rep);
+    ASSERT_EQ("", rep.body());
+  }
+  ASSERT_EQ(100U, hc.num_queued_responses());
+  ASSERT_EQ(expected.size(), hc.queued_bytes());
+
+  // ...when they go out in order, a few dozen of them per write.
+  uint64_t before = IoEngine::Get()->num_syscalls();
+  ASSERT_TRUE(hc.FlushResponses());
+  ASSERT_GE(4U, IoEngine::Get()->num_syscalls() - before);
+  ASSERT_EQ(0U, hc.num_queued_responses());
+  ASSERT_EQ(0U, hc.queued_bytes());
+  ASSERT_TRUE(hc.FlushResponses());
+
+  string got;
+  unsigned char buf[4096];
+  while (got.size() < expected.size()) {
+    int res = WrappedRead(spair[1], buf, sizeof(buf));
+    ASSERT_LT(0, res);
+    got.append(reinterpret_cast<char*>(buf), res);
+  }
+  ASSERT_EQ(expected, got);
+  close(spair[1]);
+}
+
 }  // namespace hw4
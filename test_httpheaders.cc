@@ -0,0 +1,126 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string>
+#include <utility>
+
+#include "gtest/gtest.h"
+#include "./HttpHeaders.h"
+#include "./HttpRequest.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::to_string;
+
+namespace hw4 {
+
+TEST(Test_HttpHeaders, TestHttpHeadersBasic) {
+  ASSERT_EQ(kHeaderConnection, HttpHeaders::Intern("connection"));
+  ASSERT_EQ(kHeaderHost, HttpHeaders::Intern("host"));
+  ASSERT_EQ(kHeaderAcceptEncoding, HttpHeaders::Intern("accept-encoding"));
+  ASSERT_EQ(kHeaderIfNoneMatch, HttpHeaders::Intern("if-none-match"));
+  ASSERT_EQ(kHeaderRange, HttpHeaders::Intern("range"));
+  ASSERT_EQ(kHeaderContentLength, HttpHeaders::Intern("content-length"));
+  ASSERT_EQ(kHeaderOther, HttpHeaders::Intern("hots"));
+  ASSERT_EQ(kHeaderOther, HttpHeaders::Intern("user-agent"));
+
+  HttpHeaders headers;
+  ASSERT_EQ(0U, headers.size());
+  ASSERT_EQ("", headers.Get(kHeaderHost));
+  ASSERT_EQ("", headers.Get("host"));
+
+  headers.Add("host", "localhost:5555");
+  headers.Add("user-agent", "curl/7.88.1");
+  headers.Add("connection", "keep-alive");
+  ASSERT_EQ(3U, headers.size());
+  ASSERT_EQ("localhost:5555", headers.Get(kHeaderHost));
+  ASSERT_EQ("localhost:5555", headers.Get("host"));
+  ASSERT_EQ("keep-alive", headers.Get(kHeaderConnection));
+  ASSERT_EQ("curl/7.88.1", headers.Get("user-agent"));
+  ASSERT_EQ("", headers.Get("user"));
+  ASSERT_EQ("", headers.Get(kHeaderRange));
+  ASSERT_EQ("", headers.Get(kHeaderOther));
+
+  // Adding a header again over-writes it, known or not.
+  headers.Add("connection", "close");
+  headers.Add("user-agent", "");
+  ASSERT_EQ(3U, headers.size());
+  ASSERT_EQ("close", headers.Get(kHeaderConnection));
+  ASSERT_EQ("", headers.Get("user-agent"));
+
+  headers.Clear();
+  ASSERT_EQ(0U, headers.size());
+  ASSERT_EQ("", headers.Get(kHeaderConnection));
+  ASSERT_EQ("", headers.Get("user-agent"));
+  headers.Add("range", "bytes=0-99");
+  ASSERT_EQ("bytes=0-99", headers.Get("range"));
+}
+
+TEST(Test_HttpHeaders, TestHttpHeadersSpill) {
+  // More headers, and more bytes, than fit inside the object.
+  HttpHeaders headers;
+  size_t num_headers = 2 * HttpHeaders::kInlineHeaders;
+  string big(HttpHeaders::kInlineBytes, 'v');
+  for (size_t i = 0; i < num_headers; i++) {
+    headers.Add("x-header-" + to_string(i), (i == 5) ? big : to_string(i));
+  }
+  headers.Add("connection", "keep-alive");
+  ASSERT_EQ(num_headers + 1, headers.size());
+  for (size_t i = 0; i < num_headers; i++) {
+    ASSERT_EQ((i == 5) ? big : to_string(i),
+              headers.Get("x-header-" + to_string(i)));
+  }
+  ASSERT_EQ("keep-alive", headers.Get(kHeaderConnection));
+
+  // A copy has its own bytes.
+  HttpHeaders copy = headers;
+  headers.Clear();
+  headers.Add("connection", "close");
+  ASSERT_EQ(num_headers + 1, copy.size());
+  ASSERT_EQ("keep-alive", copy.Get(kHeaderConnection));
+  ASSERT_EQ(big, copy.Get("x-header-5"));
+  ASSERT_EQ("close", headers.Get(kHeaderConnection));
+
+  // So does a small copy.
+  HttpHeaders small;
+  small.Add("host", "h");
+  copy = small;
+  small.Add("host", "other");
+  ASSERT_EQ(1U, copy.size());
+  ASSERT_EQ("h", copy.Get(kHeaderHost));
+  ASSERT_EQ("", copy.Get("x-header-5"));
+
+  // A move takes everything, and leaves nothing behind.
+  for (size_t i = 0; i < num_headers; i++) {
+    headers.Add("x-header-" + to_string(i), big);
+  }
+  HttpHeaders moved = std::move(headers);
+  ASSERT_EQ(num_headers + 1, moved.size());
+  ASSERT_EQ(big, moved.Get("x-header-" + to_string(num_headers - 1)));
+  ASSERT_EQ("close", moved.Get(kHeaderConnection));
+  ASSERT_EQ(0U, headers.size());
+  ASSERT_EQ("", headers.Get(kHeaderConnection));
+  ASSERT_EQ("", headers.Get("x-header-" + to_string(num_headers - 1)));
+}
+
+TEST(Test_HttpHeaders, TestHttpRequestHeaders) {
+  HttpRequest req;
+  req.AddHeader("host", "localhost");
+  req.AddHeader("accept-encoding", "gzip");
+  ASSERT_EQ(2, req.GetHeaderCount());
+  ASSERT_EQ("gzip", req.GetHeaderValue(kHeaderAcceptEncoding));
+  ASSERT_EQ("gzip", req.GetHeaderValue("accept-encoding"));
+  req.ClearHeaders();
+  ASSERT_EQ(0, req.GetHeaderCount());
+  ASSERT_EQ("", req.GetHeaderValue(kHeaderHost));
+}
+
+}  // namespace hw4
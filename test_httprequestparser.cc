@@ -0,0 +1,208 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./HttpRequest.h"
+#include "./HttpRequestParser.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+TEST(Test_HttpRequestParser, TestHttpRequestParserBasic) {
+  string buf = "GET /foo?bar=baz HTTP/1.1\r\n";
+  buf += "Host: localhost:5555\r\n";
+  buf += "CONNECTION:  keep-alive \r\n";
+  buf += "no colon here\r\n";
+  buf += ": no name\r\n";
+  buf += "Empty:\r\n";
+  buf += "\r\n";
+  string next = "GET /next HTTP/1.1\r\n\r\n";
+  buf += next;
+
+  HttpRequestParser parser;
+  ASSERT_TRUE(parser.Parse(buf.data(), buf.size()));
+  ASSERT_EQ(buf.size() - next.size(), parser.consumed());
+  ASSERT_EQ("GET", parser.method());
+  ASSERT_EQ("/foo?bar=baz", parser.uri());
+  ASSERT_EQ("HTTP/1.1", parser.protocol());
+  ASSERT_EQ(3U, parser.headers().size());
+  ASSERT_EQ("host", parser.headers()[0].name);
+  ASSERT_EQ("localhost:5555", parser.headers()[0].value);
+  ASSERT_EQ("connection", parser.headers()[1].name);
+  ASSERT_EQ("keep-alive", parser.headers()[1].value);
+  ASSERT_EQ("empty", parser.headers()[2].name);
+  ASSERT_EQ("", parser.headers()[2].value);
+
+  // The pieces are slices of the buffer, not copies of it.
+  ASSERT_EQ(buf.data() + 4, parser.uri().data());
+
+  HttpRequest req;
+  parser.CopyTo(&req);
+  ASSERT_EQ("/foo?bar=baz", req.uri());
+  ASSERT_EQ("localhost:5555", req.GetHeaderValue("host"));
+  ASSERT_EQ("keep-alive", req.GetHeaderValue("connection"));
+  ASSERT_EQ(3, req.GetHeaderCount());
+
+  // The next request starts where the last one ended.
+  parser.Reset();
+  size_t consumed = buf.size() - next.size();
+  ASSERT_TRUE(parser.Parse(buf.data() + consumed, next.size()));
+  ASSERT_EQ(next.size(), parser.consumed());
+  ASSERT_EQ("/next", parser.uri());
+  ASSERT_EQ(0U, parser.headers().size());
+}
+
+TEST(Test_HttpRequestParser, TestHttpRequestParserIncremental) {
+  string request = "\r\nGET  /split   HTTP/1.0\n";
+  request += "Accept: */*\r\n";
+  request += "X-Long: " + string(1000, 'x') + "\r\n";
+  request += "\r\n";
+
+  // Whatever pieces the request arrives in, and however its buffer
+  // moves in between, it parses the same.
+  for (size_t piece = 1; piece <= request.size(); piece *= 3) {
+    HttpRequestParser parser;
+    string buf;
+    buf.shrink_to_fit();
+    size_t i = 0;
+    bool done = false;
+    while (!done) {
+      ASSERT_LT(i, request.size());
+      buf.append(request, i, piece);
+      i += piece;
+      done = parser.Parse(buf.data(), buf.size());
+    }
+    ASSERT_EQ(request.size(), parser.consumed());
+    ASSERT_EQ("GET", parser.method());
+    ASSERT_EQ("/split", parser.uri());
+    ASSERT_EQ("HTTP/1.0", parser.protocol());
+    ASSERT_EQ(2U, parser.headers().size());
+    ASSERT_EQ("accept", parser.headers()[0].name);
+    ASSERT_EQ("*/*", parser.headers()[0].value);
+    ASSERT_EQ("x-long", parser.headers()[1].name);
+    ASSERT_EQ(string(1000, 'x'), parser.headers()[1].value);
+  }
+
+  // A malformed request line leaves the URI "/".
+  string bad = "GARBAGE\r\nHost: h\r\n\r\n";
+  HttpRequestParser parser;
+  ASSERT_TRUE(parser.Parse(bad.data(), bad.size()));
+  HttpRequest req;
+  parser.CopyTo(&req);
+  ASSERT_EQ("/", req.uri());
+  ASSERT_EQ("h", req.GetHeaderValue("host"));
+}
+
+TEST(Test_HttpRequestParser, TestHttpRequestParserBody) {
+  string request = "POST /query HTTP/1.1\r\n";
+  request += "Content-Length: 19\r\n\r\n";
+  request += "terms=moby+dick&x=y";
+  string next = "GET /next HTTP/1.1\r\n\r\n";
+  string buf = request + next;
+
+  // A body of Content-Length bytes is a slice of the buffer too, and
+  // only that many bytes belong to the request.
+  HttpRequestParser parser;
+  ASSERT_FALSE(parser.Parse(buf.data(), request.size() - 1));
+  ASSERT_TRUE(parser.in_body());
+  ASSERT_EQ(request.size() - 19, parser.header_bytes());
+  ASSERT_TRUE(parser.Parse(buf.data(), buf.size()));
+  ASSERT_EQ(request.size(), parser.consumed());
+  ASSERT_EQ("terms=moby+dick&x=y", parser.body());
+  ASSERT_EQ(buf.data() + request.size() - 19, parser.body().data());
+  HttpRequest req;
+  parser.CopyTo(&req);
+  ASSERT_EQ("POST", req.method());
+  ASSERT_EQ("terms=moby+dick&x=y", req.body());
+
+  // A chunked body is decoded where it lies, whatever pieces it
+  // arrives in, and trailer fields are skipped.
+  string chunked = "POST /query HTTP/1.1\r\n";
+  chunked += "Transfer-Encoding: Chunked\r\n\r\n";
+  chunked += "6\r\nterms=\r\n";
+  chunked += "a;name=value\r\nmoby+dick!\r\n";
+  chunked += "0\r\nX-Trailer: t\r\n\r\n";
+  for (size_t piece = 1; piece <= chunked.size(); piece *= 2) {
+    HttpRequestParser parser;
+    string buf;
+    size_t i = 0;
+    bool done = false;
+    while (!done) {
+      ASSERT_LT(i, chunked.size());
+      ASSERT_EQ(0, parser.error());
+      buf.append(chunked, i, piece);
+      i += piece;
+      done = parser.Parse(buf.data(), buf.size());
+    }
+    buf += next;
+    ASSERT_EQ(chunked.size(), parser.consumed());
+    ASSERT_EQ("terms=moby+dick!", parser.body());
+    ASSERT_EQ(1U, parser.headers().size());
+    ASSERT_EQ(next, buf.substr(parser.consumed()));
+  }
+
+  // Bodies that can't be framed, or are too long, are given up on as
+  // soon as that's known.
+  struct {
+    string headers;
+    string body;
+    uint16_t error;
+  } bad[] = {
+    {"Content-Length: 12x\r\n", "", 400},
+    {"Content-Length: 5\r\nContent-Length: 6\r\n", "", 400},
+    {"Content-Length: 5\r\nTransfer-Encoding: chunked\r\n", "", 400},
+    {"Transfer-Encoding: gzip\r\n", "", 501},
+    {"Content-Length: 101\r\n", "", 413},
+    {"Content-Length: 99999999999999999999999\r\n", "", 413},
+    {"Transfer-Encoding: chunked\r\n", "zz\r\n", 400},
+    {"Transfer-Encoding: chunked\r\n", "2\r\nabc\r\n", 400},
+    {"Transfer-Encoding: chunked\r\n", "60\r\n", 0},
+    {"Transfer-Encoding: chunked\r\n", "60\r\n" + string(96, 'x') +
+                                       "\r\n5\r\n", 413},
+  };
+  for (const auto& b : bad) {
+    string buf = "POST / HTTP/1.1\r\n" + b.headers + "\r\n" + b.body;
+    HttpRequestParser parser;
+    parser.set_max_body_bytes(100);
+    ASSERT_FALSE(parser.Parse(buf.data(), buf.size()));
+    ASSERT_EQ(b.error, parser.error()) << buf;
+    ASSERT_EQ(b.error == 0, parser.in_body());
+  }
+}
+
+TEST(Test_HttpRequestParser, TestHttpRequestParserMaxHeaders) {
+  // As many headers as allowed are fine; one more isn't, however short.
+  string ok = "GET / HTTP/1.1\r\n";
+  for (size_t i = 0; i < HttpRequestParser::kMaxHeaders; i++) {
+    ok += "x" + std::to_string(i) + ":\r\n";
+  }
+  string too_many = ok + "y:\r\n";
+  ok += "\r\n";
+  too_many += "\r\n";
+
+  HttpRequestParser parser;
+  ASSERT_TRUE(parser.Parse(ok.data(), ok.size()));
+  ASSERT_EQ(HttpRequestParser::kMaxHeaders, parser.headers().size());
+
+  // The request is given up on as soon as the header past the limit
+  // arrives, without waiting for the rest.
+  parser.Reset();
+  ASSERT_FALSE(parser.Parse(too_many.data(), too_many.size() - 2));
+  ASSERT_EQ(431, parser.error());
+  ASSERT_FALSE(parser.Parse(too_many.data(), too_many.size()));
+  ASSERT_EQ(431, parser.error());
+}
+
+}  // namespace hw4
@@ -9,7 +9,12 @@
  * author.
  */
 
+#include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -76,6 +81,14 @@ TEST(Test_HttpUtils, TestHttpUtilsURLParser) {
   ASSERT_EQ((unsigned) 2, p.args().size());
   ASSERT_EQ("\"bar\"", p.args()["foo"]);
   ASSERT_EQ("baz", p.args()["bam"]);
+
+  // A form-encoded body has args, but no path.
+  URLParser form;
+  form.ParseArgs("terms=moby+dick&page=%32");
+  ASSERT_EQ("", form.path());
+  ASSERT_EQ((unsigned) 2, form.args().size());
+  ASSERT_EQ("moby dick", form.args()["terms"]);
+  ASSERT_EQ("2", form.args()["page"]);
 }
 
 TEST(Test_HttpUtils, TestHttpUtilsIsPathSafe) {
@@ -176,4 +189,80 @@ TEST(Test_HttpUtils, TestHttpUtilsWrappedReadWrite) {
   unlink("test_files/test.txt");
 }
 
+TEST(Test_HttpUtils, TestHttpUtilsAdvanceIovec) {
+  char a[4], b[1], c[8];
+  struct iovec iov[3] = {{a, sizeof(a)}, {b, 0}, {c, sizeof(c)}};
+  struct iovec* next = iov;
+  int iovcnt = 3;
+
+  // Part of the first buffer.
+  AdvanceIovec(&next, &iovcnt, 3);
+  ASSERT_EQ(3, iovcnt);
+  ASSERT_EQ(a + 3, next->iov_base);
+  ASSERT_EQ(1U, next->iov_len);
+
+  // The rest of it, the empty buffer, and part of the last one.
+  AdvanceIovec(&next, &iovcnt, 3);
+  ASSERT_EQ(1, iovcnt);
+  ASSERT_EQ(&iov[2], next);
+  ASSERT_EQ(c + 2, next->iov_base);
+  ASSERT_EQ(6U, next->iov_len);
+
+  // Everything.
+  AdvanceIovec(&next, &iovcnt, 6);
+  ASSERT_EQ(0, iovcnt);
+}
+
+TEST(Test_HttpUtils, TestHttpUtilsCloseAfterResponse) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t addrlen = sizeof(addr);
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(-1, listen_fd);
+  ASSERT_EQ(0, bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    sizeof(addr)));
+  ASSERT_EQ(0, listen(listen_fd, 1));
+  ASSERT_EQ(0, getsockname(listen_fd,
+                           reinterpret_cast<struct sockaddr*>(&addr),
+                           &addrlen));
+
+  // The client sends its request before the server even accepts, as
+  // happens when a busy server sheds the connection.
+  int client_fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(-1, client_fd);
+  ASSERT_EQ(0, connect(client_fd, reinterpret_cast<struct sockaddr*>(&addr),
+                       sizeof(addr)));
+  string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(request.size()),
+            WrappedWrite(client_fd,
+                         (const unsigned char*) request.c_str(),
+                         request.size()));
+  int server_fd = accept(listen_fd, nullptr, nullptr);
+  ASSERT_NE(-1, server_fd);
+  close(listen_fd);
+
+  // The server answers without reading the request and hangs up.
+  string response = "HTTP/1.1 503 Service Unavailable\r\n"
+                    "Retry-After: 5\r\n\r\n";
+  ASSERT_EQ(static_cast<int>(response.size()),
+            WrappedWrite(server_fd,
+                         (const unsigned char*) response.c_str(),
+                         response.size()));
+  CloseAfterResponse(server_fd);
+
+  // The client gets the whole response and then a clean EOF, not a
+  // reset.
+  string got;
+  unsigned char buf[256];
+  int res;
+  while ((res = WrappedRead(client_fd, buf, sizeof(buf))) > 0)
+    got.append(reinterpret_cast<char*>(buf), res);
+  ASSERT_EQ(0, res) << strerror(errno);
+  ASSERT_EQ(response, got);
+  close(client_fd);
+}
+
 }  // namespace hw4
@@ -0,0 +1,110 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "gtest/gtest.h"
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+#include "./IdleConnectionSet.h"
+#include "./HttpUtils.h"
+#include "./ThreadPool.h"
+#include "./test_suite.h"
+
+namespace hw4 {
+
+// A task that remembers how many times it ran, and what it read from
+// its socket the last time.
+class TestParkTask : public ThreadPool::Task {
+ public:
+  TestParkTask(ThreadPool::thread_task_fn f, int fd)
+    : ThreadPool::Task(f), fd(fd), num_runs(0), last_read(-1) {
+    Verify333(pthread_mutex_init(&lock, nullptr) == 0);
+  }
+  virtual ~TestParkTask() {
+    Verify333(pthread_mutex_destroy(&lock) == 0);
+  }
+
+  int fd;
+  pthread_mutex_t lock;
+  int num_runs;
+  int last_read;
+};
+
+static void TestParkFn(ThreadPool::Task* t) {
+  TestParkTask* task = static_cast<TestParkTask*>(t);
+  unsigned char c;
+  int res = WrappedRead(task->fd, &c, 1);
+  Verify333(pthread_mutex_lock(&task->lock) == 0);
+  task->num_runs++;
+  task->last_read = res;
+  Verify333(pthread_mutex_unlock(&task->lock) == 0);
+}
+
+static int NumRuns(TestParkTask* task) {
+  Verify333(pthread_mutex_lock(&task->lock) == 0);
+  int num_runs = task->num_runs;
+  Verify333(pthread_mutex_unlock(&task->lock) == 0);
+  return num_runs;
+}
+
+TEST(Test_IdleConnectionSet, TestIdleConnectionSetBasic) {
+  ThreadPool tp(1);
+  IdleConnectionSet idle(&tp);
+
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  TestParkTask task(&TestParkFn, spair[0]);
+
+  // Parking fails until the set is running.
+  ASSERT_FALSE(idle.Park(spair[0], &task));
+  ASSERT_TRUE(idle.Start());
+
+  // A parked task stays parked while the socket is quiet...
+  ASSERT_TRUE(idle.Park(spair[0], &task));
+  ASSERT_EQ(1U, idle.num_parked());
+  usleep(200000);  // 0.2s
+  ASSERT_EQ(0, NumRuns(&task));
+
+  // ...and is dispatched once the client sends something.
+  unsigned char c = 'x';
+  ASSERT_EQ(1, WrappedWrite(spair[1], &c, 1));
+  while (NumRuns(&task) != 1) {
+    usleep(10000);
+  }
+  ASSERT_EQ(1, task.last_read);
+  ASSERT_EQ(0U, idle.num_parked());
+
+  // Parking the same socket again re-arms it.
+  ASSERT_TRUE(idle.Park(spair[0], &task));
+  ASSERT_EQ(1, WrappedWrite(spair[1], &c, 1));
+  while (NumRuns(&task) != 2) {
+    usleep(10000);
+  }
+
+  // Stopping the set hangs up on parked connections and runs their
+  // tasks one last time, so they see EOF.
+  ASSERT_TRUE(idle.Park(spair[0], &task));
+  idle.Stop();
+  while (NumRuns(&task) != 3) {
+    usleep(10000);
+  }
+  ASSERT_EQ(0, task.last_read);
+  ASSERT_FALSE(idle.Park(spair[0], &task));
+
+  close(spair[0]);
+  close(spair[1]);
+}
+
+}  // namespace hw4
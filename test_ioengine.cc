@@ -0,0 +1,110 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./HttpUtils.h"
+#include "./IoEngine.h"
+#include "./ServerSocket.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// Runs the same checks against whichever engine is selected.
+static void CheckEngine(IoEngine* engine) {
+  // Reading files, including binary ones.
+  string contents;
+  ASSERT_TRUE(engine->ReadFile("test_files/hextext.txt", &contents));
+  ASSERT_EQ(4800U, contents.size());
+  ASSERT_TRUE(engine->ReadFile("test_files/transparent.gif", &contents));
+  ASSERT_EQ(43U, contents.size());
+  ASSERT_FALSE(engine->ReadFile("non-existent", &contents));
+
+  // A file bigger than any single read buffer.
+  char tmpl[] = "/tmp/test_ioengine_XXXXXX";
+  int fd = mkstemp(tmpl);
+  ASSERT_NE(-1, fd);
+  string big;
+  for (int i = 0; i < 200000; i++) {
+    big.push_back(static_cast<char>(i * 7));
+  }
+  ASSERT_EQ(static_cast<int>(big.size()),
+            WrappedWrite(fd, reinterpret_cast<const unsigned char*>(
+                           big.data()), big.size()));
+  close(fd);
+  ASSERT_TRUE(engine->ReadFile(tmpl, &contents));
+  unlink(tmpl);
+  ASSERT_EQ(big, contents);
+
+  // Reading and writing sockets, counting the system calls it takes.
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  uint64_t before = engine->num_syscalls();
+  const unsigned char* msg = reinterpret_cast<const unsigned char*>("hello");
+  ASSERT_EQ(5, engine->Write(spair[0], msg, 5));
+  unsigned char buf[16];
+  ASSERT_EQ(5, engine->Read(spair[1], buf, sizeof(buf)));
+  ASSERT_EQ("hello", string(reinterpret_cast<char*>(buf), 5));
+  ASSERT_LT(before, engine->num_syscalls());
+
+  // A scatter read fills one buffer before moving on to the next.
+  ASSERT_EQ(5, engine->Write(spair[0], msg, 5));
+  unsigned char first[3], second[16];
+  struct iovec iov[2] = {{first, sizeof(first)}, {second, sizeof(second)}};
+  ASSERT_EQ(5, engine->Readv(spair[1], iov, 2));
+  ASSERT_EQ("hel", string(reinterpret_cast<char*>(first), 3));
+  ASSERT_EQ("lo", string(reinterpret_cast<char*>(second), 2));
+  close(spair[0]);
+  ASSERT_EQ(0, engine->Read(spair[1], buf, sizeof(buf)));
+  close(spair[1]);
+
+  // Accepting connections through a ServerSocket.
+  uint16_t port = GetRandPort();
+  ServerSocket ss(port);
+  int listen_fd;
+  ASSERT_TRUE(ss.BindAndListen(AF_INET6, &listen_fd));
+  int client_fd;
+  ASSERT_TRUE(ConnectToServer("127.0.0.1", port, &client_fd));
+  int accepted_fd;
+  string caddr, cdns, saddr, sdns;
+  uint16_t cport;
+  ASSERT_TRUE(ss.Accept(&accepted_fd, &caddr, &cport, &cdns, &saddr, &sdns));
+  ASSERT_EQ("::ffff:127.0.0.1", caddr);
+  close(accepted_fd);
+  close(client_fd);
+}
+
+TEST(Test_IoEngine, TestIoEngineSyscalls) {
+  ASSERT_TRUE(IoEngine::Select(kIoSyscalls));
+  ASSERT_EQ(kIoSyscalls, IoEngine::Get()->kind());
+  CheckEngine(IoEngine::Get());
+}
+
+TEST(Test_IoEngine, TestIoEngineUring) {
+  if (!IoEngine::Select(kIoUring)) {
+    // Not every kernel (or container) allows io_uring; the server falls
+    // back to system calls there, which the test above covers.
+    ASSERT_EQ(kIoSyscalls, IoEngine::Get()->kind());
+    GTEST_SKIP() << "io_uring is unavailable";
+  }
+  ASSERT_EQ(kIoUring, IoEngine::Get()->kind());
+  CheckEngine(IoEngine::Get());
+  ASSERT_TRUE(IoEngine::Select(kIoSyscalls));
+}
+
+}  // namespace hw4
@@ -0,0 +1,118 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./HttpUtils.h"
+#include "./ListenerHandoff.h"
+#include "./ServerSocket.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// The old server's side of a handoff, run on a thread of its own.
+struct ServeArgs {
+  ListenerHandoff* handoff;
+  vector<int> listen_fds;
+  bool handed_off;
+};
+
+static void* ServeThread(void* arg) {
+  ServeArgs* args = static_cast<ServeArgs*>(arg);
+  args->handed_off = args->handoff->Serve(args->listen_fds);
+  return nullptr;
+}
+
+TEST(Test_ListenerHandoff, TestListenerHandoffBasic) {
+  string path = "/tmp/test_listenerhandoff_" + std::to_string(getpid());
+
+  // With nobody at the path, there's nothing to claim.
+  ListenerHandoff lonely(path);
+  vector<int> fds;
+  ASSERT_FALSE(lonely.Claim(&fds));
+
+  // The old server listens on a port and offers its listeners up.
+  uint16_t port = GetRandPort();
+  ServerSocket old_socket(port);
+  vector<int> old_fds;
+  ASSERT_TRUE(old_socket.BindAndListen(AF_INET6, 2, &old_fds));
+  ListenerHandoff old_handoff(path);
+  ASSERT_TRUE(old_handoff.Listen());
+  ServeArgs args = {&old_handoff, old_fds, false};
+  pthread_t thr;
+  ASSERT_EQ(0, pthread_create(&thr, nullptr, &ServeThread, &args));
+
+  // A new server that claims them but gives up before confirming
+  // leaves the old one waiting for the next.
+  {
+    ListenerHandoff quitter(path);
+    ASSERT_TRUE(quitter.Claim(&fds));
+    ASSERT_EQ(2U, fds.size());
+    for (int fd : fds)
+      close(fd);
+  }
+
+  // A client connects while the new server is taking over...
+  int client_fd;
+  ASSERT_TRUE(ConnectToServer("127.0.0.1", port, &client_fd));
+
+  ListenerHandoff new_handoff(path);
+  ASSERT_TRUE(new_handoff.Claim(&fds));
+  ASSERT_EQ(2U, fds.size());
+  ServerSocket new_socket(port);
+  ASSERT_TRUE(new_socket.AdoptListeners(fds));
+  ASSERT_EQ(2U, new_socket.num_listeners());
+  new_handoff.Confirm();
+  ASSERT_EQ(0, pthread_join(thr, nullptr));
+  ASSERT_TRUE(args.handed_off);
+
+  // ...and even once the old server closes up shop, the client is
+  // still in the backlog for the new one to accept.
+  old_socket.CloseListeners();
+  const vector<int>& new_fds = new_socket.listen_fds();
+  struct pollfd pfds[2];
+  for (int i = 0; i < 2; i++) {
+    pfds[i].fd = new_fds[i];
+    pfds[i].events = POLLIN;
+  }
+  ASSERT_EQ(1, poll(pfds, 2, 5000));
+  uint32_t listener = (pfds[0].revents & POLLIN) ? 0 : 1;
+  int afd;
+  uint16_t cport;
+  string caddr, cdns, saddr, sdns;
+  ASSERT_TRUE(new_socket.Accept(listener, &afd, &caddr, &cport, &cdns,
+                                &saddr, &sdns));
+  close(afd);
+  close(client_fd);
+
+  // The new server takes over the path for its own successor.
+  ASSERT_TRUE(new_handoff.Listen());
+  ASSERT_EQ(0, access(path.c_str(), F_OK));
+
+  // Serve() gives up when asked to.
+  args.handoff = &new_handoff;
+  args.listen_fds = new_socket.listen_fds();
+  ASSERT_EQ(0, pthread_create(&thr, nullptr, &ServeThread, &args));
+  new_handoff.Stop();
+  ASSERT_EQ(0, pthread_join(thr, nullptr));
+  ASSERT_FALSE(args.handed_off);
+}
+
+}  // namespace hw4
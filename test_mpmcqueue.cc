@@ -0,0 +1,119 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./MpmcQueue.h"
+#include "./test_suite.h"
+
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_MpmcQueue, TestMpmcQueueBasic) {
+  // Capacities round up to a power of two.
+  MpmcQueue<uint32_t> q(5);
+  ASSERT_EQ(8U, q.capacity());
+  ASSERT_EQ(0U, q.size());
+
+  uint32_t item;
+  ASSERT_FALSE(q.TryPop(&item));
+
+  // Go around the ring a few times, filling and emptying it.
+  uint32_t next_push = 0, next_pop = 0;
+  for (int lap = 0; lap < 3; lap++) {
+    while (q.TryPush(next_push)) {
+      next_push++;
+    }
+    ASSERT_EQ(8U, q.size());
+    for (int i = 0; i < 5; i++) {
+      ASSERT_TRUE(q.TryPop(&item));
+      ASSERT_EQ(next_pop++, item);
+    }
+    ASSERT_EQ(3U, q.size());
+  }
+  while (q.TryPop(&item)) {
+    ASSERT_EQ(next_pop++, item);
+  }
+  ASSERT_EQ(next_push, next_pop);
+  ASSERT_EQ(0U, q.size());
+}
+
+// Producers push the numbers [first, first + count), and consumers add
+// up whatever they pop until they've seen their share.
+struct QueueArgs {
+  MpmcQueue<uint64_t>* q;
+  uint64_t first;
+  uint64_t count;
+  uint64_t sum;
+};
+
+static void* Producer(void* arg) {
+  QueueArgs* args = static_cast<QueueArgs*>(arg);
+  for (uint64_t i = args->first; i < args->first + args->count; ) {
+    if (args->q->TryPush(i)) {
+      i++;
+    } else {
+      sched_yield();
+    }
+  }
+  return nullptr;
+}
+
+static void* Consumer(void* arg) {
+  QueueArgs* args = static_cast<QueueArgs*>(arg);
+  args->sum = 0;
+  for (uint64_t i = 0; i < args->count; ) {
+    uint64_t item;
+    if (args->q->TryPop(&item)) {
+      args->sum += item;
+      i++;
+    } else {
+      sched_yield();
+    }
+  }
+  return nullptr;
+}
+
+TEST(Test_MpmcQueue, TestMpmcQueueConcurrent) {
+  // A small ring, so that it fills up and wraps around a lot.
+  MpmcQueue<uint64_t> q(16);
+  const int kNumThreads = 4;
+  const uint64_t kPerThread = 50000;
+
+  vector<pthread_t> threads(2 * kNumThreads);
+  vector<QueueArgs> args(2 * kNumThreads);
+  for (int i = 0; i < kNumThreads; i++) {
+    args[i] = {&q, i * kPerThread, kPerThread, 0};
+    args[kNumThreads + i] = {&q, 0, kPerThread, 0};
+  }
+  for (int i = 0; i < 2 * kNumThreads; i++) {
+    ASSERT_EQ(0, pthread_create(&threads[i], nullptr,
+                                i < kNumThreads ? &Producer : &Consumer,
+                                &args[i]));
+  }
+  uint64_t sum = 0;
+  for (int i = 0; i < 2 * kNumThreads; i++) {
+    ASSERT_EQ(0, pthread_join(threads[i], nullptr));
+    sum += args[i].sum;
+  }
+
+  // Every item came out exactly once.
+  uint64_t n = kNumThreads * kPerThread;
+  ASSERT_EQ(n * (n - 1) / 2, sum);
+  ASSERT_EQ(0U, q.size());
+}
+
+}  // namespace hw4
@@ -0,0 +1,126 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./Coroutine.h"
+#include "./HttpConnection.h"
+#include "./HttpRequest.h"
+#include "./HttpResponse.h"
+#include "./HttpUtils.h"
+#include "./Reactor.h"
+#include "./ThreadPool.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+// What the coroutine below saw, for the test to check once it's done.
+struct CoResults {
+  bool got_first = false, got_second = false, wrote = false;
+  string first_uri, second_uri;
+  sem_t done;
+};
+
+// Reads two requests off "hc" and writes back "rep", waiting on
+// "reactor" whenever the client isn't ready.
+static CoDetached Serve(HttpConnection* hc, Reactor* reactor,
+                        const HttpResponse* rep, CoResults* results) {
+  HttpRequest req;
+  results->got_first = co_await hc->AsyncGetNextRequest(reactor, &req);
+  results->first_uri = req.uri();
+  results->got_second = co_await hc->AsyncGetNextRequest(reactor, &req);
+  results->second_uri = req.uri();
+  results->wrote = co_await hc->AsyncWriteResponse(reactor, *rep);
+  sem_post(&results->done);
+}
+
+TEST(Test_Reactor, TestReactorBasic) {
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+
+  ThreadPool pool(2);
+  Reactor reactor(&pool);
+  ASSERT_TRUE(reactor.Start());
+  ASSERT_TRUE(reactor.Add(spair[0]));
+  HttpConnection hc(spair[0]);
+
+  // A body much bigger than the socket buffer, so the response can't
+  // go out without waiting for the client to read some of it.
+  HttpResponse rep;
+  rep.set_protocol("HTTP/1.1");
+  rep.set_response_code(200);
+  rep.set_message("OK");
+  for (int i = 0; i < (1 << 22); i++) {
+    rep.mutable_body()->push_back(static_cast<char>('a' + i % 26));
+  }
+  string expected = rep.GenerateResponseString();
+
+  CoResults results;
+  sem_init(&results.done, 0, 0);
+  reactor.Spawn(Serve(&hc, &reactor, &rep, &results));
+
+  // With nothing to read, the coroutine waits on the reactor, not on a
+  // worker.
+  usleep(100000);
+  ASSERT_EQ(1U, reactor.num_waiting());
+  ASSERT_EQ(0U, pool.num_queued());
+
+  // Write the first request in pieces, and the second along with the
+  // end of the first, so the coroutine both waits between pieces and
+  // finds a request already read.
+  string req1 = "GET /first HTTP/1.1\r\nHost: somehost\r\n\r\n";
+  string req2 = "GET /second HTTP/1.1\r\n\r\n";
+  string part1 = req1.substr(0, 10);
+  string part2 = req1.substr(10) + req2;
+  ASSERT_EQ(static_cast<int>(part1.size()),
+            WrappedWrite(spair[1],
+                         reinterpret_cast<const unsigned char*>(part1.data()),
+                         part1.size()));
+  usleep(100000);
+  ASSERT_EQ(1U, reactor.num_waiting());
+  ASSERT_EQ(static_cast<int>(part2.size()),
+            WrappedWrite(spair[1],
+                         reinterpret_cast<const unsigned char*>(part2.data()),
+                         part2.size()));
+
+  // Give the coroutine time to fill the socket buffer and wait for
+  // room, then read the whole response.
+  usleep(100000);
+  ASSERT_EQ(1U, reactor.num_waiting());
+  string got;
+  unsigned char buf[65536];
+  while (got.size() < expected.size()) {
+    int res = WrappedRead(spair[1], buf, sizeof(buf));
+    ASSERT_LT(0, res);
+    got.append(reinterpret_cast<char*>(buf), res);
+  }
+  ASSERT_EQ(expected, got);
+
+  sem_wait(&results.done);
+  ASSERT_TRUE(results.got_first);
+  ASSERT_EQ("/first", results.first_uri);
+  ASSERT_TRUE(results.got_second);
+  ASSERT_EQ("/second", results.second_uri);
+  ASSERT_TRUE(results.wrote);
+  ASSERT_EQ(0U, reactor.num_waiting());
+
+  reactor.Remove(spair[0]);
+  reactor.Stop();
+  close(spair[1]);
+}
+
+}  // namespace hw4
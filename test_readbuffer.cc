@@ -0,0 +1,90 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./HttpUtils.h"
+#include "./IoEngine.h"
+#include "./ReadBuffer.h"
+#include "./test_suite.h"
+
+using std::string;
+
+namespace hw4 {
+
+TEST(Test_ReadBuffer, TestReadBufferBasic) {
+  ReadBuffer buf;
+  ASSERT_TRUE(buf.empty());
+  ASSERT_EQ(0U, buf.capacity());
+
+  buf.Append("GET / HTTP/1.1\r\n\r\nGET /next", 27);
+  ASSERT_EQ(27U, buf.size());
+  ASSERT_EQ(ReadBuffer::kInitialCapacity, buf.capacity());
+  const char* start = buf.data();
+
+  // Consuming moves nothing...
+  buf.Consume(18);
+  ASSERT_EQ("GET /next", string(buf.data(), buf.size()));
+
+  // ...until there's more to add, when what's left moves to the front.
+  buf.Append(" HTTP/1.1", 9);
+  ASSERT_EQ(start, buf.data());
+  ASSERT_EQ("GET /next HTTP/1.1", string(buf.data(), buf.size()));
+
+  // Emptied, the buffer keeps its memory, unless it grew big.
+  buf.Consume(buf.size());
+  ASSERT_TRUE(buf.empty());
+  ASSERT_EQ(ReadBuffer::kInitialCapacity, buf.capacity());
+  string big(3 * ReadBuffer::kRetainedCapacity, 'b');
+  buf.Append(big.data(), big.size());
+  ASSERT_LE(big.size(), buf.capacity());
+  buf.Clear();
+  ASSERT_EQ(0U, buf.capacity());
+}
+
+TEST(Test_ReadBuffer, TestReadBufferRead) {
+  int spair[2] = {-1, -1};
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, spair));
+  string msg;
+  for (int i = 0; i < 10000; i++) {
+    msg.push_back(static_cast<char>('a' + i % 26));
+  }
+  ASSERT_EQ(static_cast<int>(msg.size()),
+            WrappedWrite(spair[1],
+                         reinterpret_cast<const unsigned char*>(msg.data()),
+                         msg.size()));
+
+  // A single read takes in more than the buffer had room for.
+  ReadBuffer buf;
+  ASSERT_EQ(100, buf.Read(IoEngine::Get(), spair[0], 100));
+  ASSERT_EQ(static_cast<int>(msg.size() - 100),
+            buf.Read(IoEngine::Get(), spair[0], msg.size()));
+  ASSERT_EQ(msg, string(buf.data(), buf.size()));
+  ASSERT_LT(ReadBuffer::kInitialCapacity, buf.capacity());
+
+  // Without an engine, an empty socket is EAGAIN rather than a wait.
+  int flags = fcntl(spair[0], F_GETFL, 0);
+  ASSERT_EQ(0, fcntl(spair[0], F_SETFL, flags | O_NONBLOCK));
+  ASSERT_EQ(-1, buf.Read(nullptr, spair[0], 100));
+  ASSERT_EQ(EAGAIN, errno);
+
+  close(spair[1]);
+  ASSERT_EQ(0, buf.Read(nullptr, spair[0], 100));
+  ASSERT_EQ(msg, string(buf.data(), buf.size()));
+  close(spair[0]);
+}
+
+}  // namespace hw4
@@ -9,11 +9,19 @@
  * author.
  */
 
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <iostream>
 #include <string>
 #include <cstdlib>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "./ServerSocket.h"
@@ -134,4 +142,163 @@ TEST(Test_ServerSocket, TestServerSocketBasic) {
   HW4Environment::AddPoints(35);
 }
 
+TEST(Test_ServerSocket, TestServerSocketReusePort) {
+  // Open several SO_REUSEPORT listeners on one port.
+  uint16_t port = GetRandPort();
+  ServerSocket ss(port);
+  std::vector<int> listen_fds;
+  ASSERT_TRUE(ss.BindAndListen(AF_INET6, 4, &listen_fds));
+  ASSERT_EQ(4U, listen_fds.size());
+  ASSERT_EQ(4U, ss.num_listeners());
+
+  // Connect a batch of clients, then accept each of them from whichever
+  // listener the kernel queued it on.
+  const int kNumClients = 32;
+  std::vector<int> client_fds;
+  for (int i = 0; i < kNumClients; i++) {
+    int cfd = -1;
+    ASSERT_TRUE(ConnectToServer("127.0.0.1", port, &cfd));
+    client_fds.push_back(cfd);
+  }
+
+  struct pollfd pfds[4];
+  for (int i = 0; i < 4; i++) {
+    pfds[i].fd = listen_fds[i];
+    pfds[i].events = POLLIN;
+  }
+  int num_accepted = 0;
+  while (num_accepted < kNumClients) {
+    ASSERT_LT(0, poll(pfds, 4, 5000));
+    for (uint32_t i = 0; i < 4; i++) {
+      if (!(pfds[i].revents & POLLIN))
+        continue;
+      int afd;
+      uint16_t cport;
+      string caddr, cdns, saddr, sdns;
+      ASSERT_TRUE(ss.Accept(i, &afd, &caddr, &cport, &cdns, &saddr, &sdns));
+      close(afd);
+      num_accepted++;
+    }
+  }
+
+  // Every connection is accounted for by exactly one listener.
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < 4; i++) {
+    total += ss.accept_count(i);
+  }
+  ASSERT_EQ(static_cast<uint64_t>(kNumClients), total);
+
+  for (int cfd : client_fds) {
+    close(cfd);
+  }
+}
+
+// Blocks in Accept() on the ServerSocket "arg"; returns whether it
+// accepted a connection.
+static void* AcceptThread(void* arg) {
+  ServerSocket* ss = static_cast<ServerSocket*>(arg);
+  int afd;
+  uint16_t cport;
+  string caddr, cdns, saddr, sdns;
+  bool accepted = ss->Accept(&afd, &caddr, &cport, &cdns, &saddr, &sdns);
+  if (accepted) {
+    close(afd);
+  }
+  return accepted ? arg : nullptr;
+}
+
+TEST(Test_ServerSocket, TestServerSocketStopAccepting) {
+  uint16_t port = GetRandPort();
+  ServerSocket ss(port);
+  int listen_fd;
+  ASSERT_TRUE(ss.BindAndListen(AF_INET6, &listen_fd));
+
+  // StopAccepting() wakes up an Accept() that is waiting for a client.
+  pthread_t thr;
+  ASSERT_EQ(0, pthread_create(&thr, nullptr, &AcceptThread, &ss));
+  usleep(100000);  // 0.1s
+  ss.StopAccepting();
+  void* res;
+  ASSERT_EQ(0, pthread_join(thr, &res));
+  ASSERT_EQ(nullptr, res);
+
+  // It leaves the listening socket alone, though, so clients can still
+  // connect and wait for somebody else sharing it to accept them.
+  int client_fd;
+  ASSERT_TRUE(ConnectToServer("127.0.0.1", port, &client_fd));
+  int afd = accept(listen_fd, nullptr, nullptr);
+  ASSERT_NE(-1, afd);
+  close(afd);
+  close(client_fd);
+
+  // Once stopped, Accept() fails right away.
+  ASSERT_EQ(nullptr, AcceptThread(&ss));
+}
+
+TEST(Test_ServerSocket, TestServerSocketUnix) {
+  uint16_t port = GetRandPort();
+  string path = "/tmp/test_serversocket_" + std::to_string(getpid());
+  ServerSocket ss(port);
+  int listen_fd;
+  ASSERT_TRUE(ss.BindAndListen(AF_INET6, &listen_fd));
+
+  // A file that isn't a socket is left alone...
+  int file = creat(path.c_str(), 0600);
+  ASSERT_NE(-1, file);
+  close(file);
+  ASSERT_FALSE(ss.BindUnix(path));
+  struct stat st;
+  ASSERT_EQ(0, lstat(path.c_str(), &st));
+  ASSERT_TRUE(S_ISREG(st.st_mode));
+  ASSERT_EQ(1U, ss.num_listeners());
+  unlink(path.c_str());
+
+  // ...but without it, the Unix listener goes after the TCP one.
+  ASSERT_TRUE(ss.BindUnix(path));
+  ASSERT_EQ(2U, ss.num_listeners());
+  ASSERT_FALSE(ss.BindUnix(string(200, 'x')));
+
+  int client_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_NE(-1, client_fd);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  ASSERT_EQ(0, connect(client_fd, reinterpret_cast<struct sockaddr*>(&addr),
+                       sizeof(addr)));
+
+  // Unix clients are known by the path they connected to.
+  int afd;
+  uint16_t cport = 1;
+  string caddr, cdns = "x", saddr, sdns = "x";
+  ASSERT_TRUE(ss.Accept(1, &afd, &caddr, &cport, &cdns, &saddr, &sdns));
+  ASSERT_EQ("unix:" + path, caddr);
+  ASSERT_EQ(0, cport);
+  ASSERT_EQ("", cdns);
+  ASSERT_EQ("unix:" + path, saddr);
+  ASSERT_EQ("", sdns);
+  ASSERT_EQ(1U, ss.accept_count(1));
+
+  // Data flows both ways.
+  ASSERT_EQ(2, WrappedWrite(client_fd,
+                            reinterpret_cast<const unsigned char*>("hi"), 2));
+  unsigned char buf[2];
+  ASSERT_EQ(2, WrappedRead(afd, buf, 2));
+  ASSERT_EQ(0, memcmp(buf, "hi", 2));
+  close(afd);
+  close(client_fd);
+
+  // Nobody else gets to take over a socket that's being listened on.
+  ServerSocket other(GetRandPort());
+  ASSERT_FALSE(other.BindUnix(path));
+
+  // Closing the listener leaves the socket file in place for whoever
+  // has taken it over; if nobody has, it's stale, and is replaced.
+  ss.CloseListeners();
+  ASSERT_EQ(0, access(path.c_str(), F_OK));
+  ASSERT_TRUE(other.BindUnix(path));
+  other.CloseListeners();
+  unlink(path.c_str());
+}
+
 }  // namespace hw4
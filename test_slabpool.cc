@@ -0,0 +1,130 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./SlabPool.h"
+#include "./test_suite.h"
+
+using std::set;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Each test gets a type of its own, and so a pool of its own.
+struct BasicObject {
+  string name;
+};
+
+TEST(Test_SlabPool, TestSlabPoolBasic) {
+  typedef SlabPool<BasicObject> Pool;
+  ASSERT_EQ(0U, Pool::num_allocated());
+
+  // The first Get() allocates a whole slab.
+  BasicObject* obj = Pool::Get();
+  ASSERT_EQ(Pool::kBatch, Pool::num_allocated());
+  obj->name = "a name too long to fit inside the string itself";
+  const char* buffer = obj->name.data();
+
+  // What goes back comes out again, still constructed, and keeping its
+  // memory.
+  Pool::Put(obj);
+  BasicObject* again = Pool::Get();
+  ASSERT_EQ(obj, again);
+  ASSERT_EQ(buffer, again->name.data());
+  again->name.clear();
+  again->name = "another name, but no longer than the first one";
+  ASSERT_EQ(buffer, again->name.data());
+  Pool::Put(again);
+
+  // Objects are only allocated when none are free, and are never handed
+  // out twice at once.
+  vector<BasicObject*> objs;
+  set<BasicObject*> distinct;
+  for (uint32_t i = 0; i < 3 * Pool::kBatch; i++) {
+    objs.push_back(Pool::Get());
+    distinct.insert(objs.back());
+  }
+  ASSERT_EQ(objs.size(), distinct.size());
+  ASSERT_EQ(3 * Pool::kBatch, Pool::num_allocated());
+  for (BasicObject* o : objs) {
+    Pool::Put(o);
+  }
+  for (uint32_t i = 0; i < 3 * Pool::kBatch; i++) {
+    ASSERT_EQ(1U, distinct.count(Pool::Get()));
+  }
+  ASSERT_EQ(3 * Pool::kBatch, Pool::num_allocated());
+}
+
+struct SharedObject {
+  uint32_t owner = 0;
+};
+
+struct PutterArgs {
+  vector<SharedObject*>* objs;
+  uint32_t first, count;
+};
+
+// Puts back its share of the objects, and exits, leaving some of them
+// in its cache.
+static void* Putter(void* arg) {
+  PutterArgs* args = static_cast<PutterArgs*>(arg);
+  for (uint32_t i = args->first; i < args->first + args->count; i++) {
+    SlabPool<SharedObject>::Put((*args->objs)[i]);
+  }
+  return nullptr;
+}
+
+TEST(Test_SlabPool, TestSlabPoolThreads) {
+  typedef SlabPool<SharedObject> Pool;
+
+  // One thread gets the objects and several others put them back, the
+  // way the acceptor and workers do.  Everything the others put back
+  // finds its way back to the first thread, whether through a full
+  // cache or one left behind by a thread that exited.
+  const uint32_t kNumThreads = 4;
+  const uint32_t kPerThread = 2 * Pool::kBatch + 5;
+  vector<SharedObject*> objs;
+  for (uint32_t i = 0; i < kNumThreads * kPerThread; i++) {
+    objs.push_back(Pool::Get());
+    objs.back()->owner = i;
+  }
+  uint64_t num_allocated = Pool::num_allocated();
+  ASSERT_LE(objs.size(), num_allocated);
+
+  for (int round = 0; round < 3; round++) {
+    vector<pthread_t> threads(kNumThreads);
+    vector<PutterArgs> args(kNumThreads);
+    for (uint32_t i = 0; i < kNumThreads; i++) {
+      args[i] = {&objs, i * kPerThread, kPerThread};
+      ASSERT_EQ(0, pthread_create(&threads[i], nullptr, &Putter, &args[i]));
+    }
+    for (uint32_t i = 0; i < kNumThreads; i++) {
+      ASSERT_EQ(0, pthread_join(threads[i], nullptr));
+    }
+
+    set<SharedObject*> distinct;
+    for (uint32_t i = 0; i < objs.size(); i++) {
+      objs[i] = Pool::Get();
+      distinct.insert(objs[i]);
+    }
+    ASSERT_EQ(objs.size(), distinct.size());
+    ASSERT_EQ(num_allocated, Pool::num_allocated());
+  }
+}
+
+}  // namespace hw4
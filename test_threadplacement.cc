@@ -0,0 +1,153 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./ThreadPlacement.h"
+#include "./ThreadPool.h"
+#include "./test_suite.h"
+
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_ThreadPlacement, TestThreadPlacementParse) {
+  vector<int> cpus;
+  ASSERT_TRUE(ParseCpuList("0-3,8,10-11", &cpus));
+  ASSERT_EQ(vector<int>({0, 1, 2, 3, 8, 10, 11}), cpus);
+  ASSERT_TRUE(ParseCpuList("5", &cpus));
+  ASSERT_EQ(vector<int>({5}), cpus);
+  ASSERT_FALSE(ParseCpuList("", &cpus));
+  ASSERT_FALSE(ParseCpuList("3-1", &cpus));
+  ASSERT_FALSE(ParseCpuList("1,,2", &cpus));
+  ASSERT_FALSE(ParseCpuList("x", &cpus));
+  ASSERT_FALSE(ParseCpuList("1-2y", &cpus));
+  ASSERT_EQ(vector<int>({5}), cpus);
+
+  PlacementOptions options;
+  ASSERT_TRUE(ParsePlacement("scatter", &options));
+  ASSERT_EQ(kPlaceScatter, options.policy);
+  ASSERT_TRUE(ParsePlacement("2,4", &options));
+  ASSERT_EQ(kPlaceList, options.policy);
+  ASSERT_EQ(vector<int>({2, 4}), options.cpus);
+  ASSERT_FALSE(ParsePlacement("sideways", &options));
+  ASSERT_EQ(kPlaceList, options.policy);
+}
+
+TEST(Test_ThreadPlacement, TestThreadPlacementPolicies) {
+  // Two nodes of four CPUs, numbered the way two sockets often are, and
+  // a node with no CPUs at all, which is left out.
+  CpuTopology topology({{0, 1, 2, 3}, {}, {4, 5, 6, 7}});
+  ASSERT_EQ(2U, topology.num_nodes());
+  ASSERT_EQ(8U, topology.num_cpus());
+  ASSERT_EQ(1, topology.NodeOf(5));
+  ASSERT_EQ(-1, topology.NodeOf(8));
+
+  PlacementOptions options;
+  ThreadPlacement none(options, topology);
+  ASSERT_EQ(-1, none.CpuFor(0));
+  ASSERT_EQ(0U, none.NodeFor(3));
+  ASSERT_EQ(1U, none.num_nodes());
+  ASSERT_EQ(0U, none.CurrentNode());
+
+  // Compact fills node 0 first; scatter alternates between the nodes.
+  // Both wrap around once every CPU has a thread.
+  options.policy = kPlaceCompact;
+  ThreadPlacement compact(options, topology);
+  options.policy = kPlaceScatter;
+  ThreadPlacement scatter(options, topology);
+  const int kCompact[] = {0, 1, 2, 3, 4, 5, 6, 7, 0};
+  const int kScatter[] = {0, 4, 1, 5, 2, 6, 3, 7, 0};
+  for (uint32_t i = 0; i < 9; i++) {
+    ASSERT_EQ(kCompact[i], compact.CpuFor(i));
+    ASSERT_EQ(kScatter[i], scatter.CpuFor(i));
+  }
+  ASSERT_EQ(0U, compact.NodeFor(3));
+  ASSERT_EQ(1U, compact.NodeFor(4));
+  ASSERT_EQ(1U, scatter.NodeFor(1));
+  ASSERT_EQ(2U, scatter.num_nodes());
+
+  // CPUs that aren't in the topology are dropped from a list.
+  options.policy = kPlaceList;
+  options.cpus = {6, 42, 2};
+  ThreadPlacement list(options, topology);
+  ASSERT_EQ(6, list.CpuFor(0));
+  ASSERT_EQ(2, list.CpuFor(1));
+  ASSERT_EQ(6, list.CpuFor(2));
+  ASSERT_EQ(0U, list.NodeFor(1));
+}
+
+struct PlacedArgs {
+  int cpu;
+  size_t stack_size;
+};
+
+static void* PlacedThread(void* arg) {
+  PlacedArgs* args = static_cast<PlacedArgs*>(arg);
+  args->cpu = sched_getcpu();
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    pthread_attr_getstacksize(&attr, &args->stack_size);
+    pthread_attr_destroy(&attr);
+  }
+  return nullptr;
+}
+
+static std::atomic<uint32_t> num_ran;
+
+static void CountFn(ThreadPool::Task* t) {
+  num_ran++;
+  delete t;
+}
+
+TEST(Test_ThreadPlacement, TestThreadPlacementCreate) {
+  // Pin a thread to the last CPU we're allowed on, with a stack that
+  // isn't the default size.
+  const CpuTopology& system = CpuTopology::System();
+  ASSERT_LT(0U, system.num_cpus());
+  uint32_t last_node = system.num_nodes() - 1;
+  int last_cpu = system.cpus(last_node).back();
+
+  PlacementOptions options;
+  options.policy = kPlaceList;
+  options.cpus = {last_cpu};
+  options.stack_size = 3 * 1024 * 1024 + 1;
+  ThreadPlacement placement(options);
+  ASSERT_EQ(last_node, placement.NodeFor(0));
+
+  PlacedArgs args = {-1, 0};
+  pthread_t thread;
+  ASSERT_EQ(0, placement.Create(0, &thread, &PlacedThread, &args));
+  ASSERT_EQ(0, pthread_join(thread, nullptr));
+  ASSERT_EQ(last_cpu, args.cpu);
+  ASSERT_LE(options.stack_size, args.stack_size);
+
+  // A pool placed compactly still runs everything it's given.
+  ThreadPoolOptions pool_options;
+  pool_options.num_threads = 4;
+  pool_options.placement.policy = kPlaceCompact;
+  pool_options.placement.stack_size = 256 * 1024;
+  num_ran = 0;
+  {
+    ThreadPool tp(pool_options);
+    for (int i = 0; i < 100; i++) {
+      tp.Dispatch(new ThreadPool::Task(CountFn));
+    }
+  }
+  ASSERT_EQ(100U, num_ran);
+}
+
+}  // namespace hw4
@@ -9,7 +9,11 @@
  * author.
  */
 
+#include <time.h>
 #include <unistd.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
 
 #include "gtest/gtest.h"
 extern "C" {
@@ -62,4 +66,388 @@ TEST(Test_ThreadPool, TestThreadPoolBasic) {
   ASSERT_EQ((uint32_t) 300, workcount);
 }
 
+// A task that just counts itself.
+void TestCountFn(ThreadPool::Task* t) {
+  Verify333(pthread_mutex_lock(&mtx) == 0);
+  workcount++;
+  Verify333(pthread_mutex_unlock(&mtx) == 0);
+  delete t;
+}
+
+// A task that holds its worker until the test lets it go.
+static pthread_mutex_t gate;
+
+void TestGateFn(ThreadPool::Task* t) {
+  Verify333(pthread_mutex_lock(&gate) == 0);
+  Verify333(pthread_mutex_unlock(&gate) == 0);
+  delete t;
+}
+
+TEST(Test_ThreadPool, TestThreadPoolBounded) {
+  Verify333(pthread_mutex_init(&gate, nullptr) == 0);
+  Verify333(pthread_mutex_lock(&gate) == 0);
+  ThreadPool tp(1, 2);
+
+  // The lone worker picks up the first task and blocks in it; the next
+  // two wait in the queue, which is then full.
+  ASSERT_TRUE(tp.TryDispatch(new ThreadPool::Task(TestGateFn)));
+  while (tp.num_queued() != 0) {
+    usleep(10000);
+  }
+  ASSERT_TRUE(tp.TryDispatch(new ThreadPool::Task(TestGateFn)));
+  ASSERT_TRUE(tp.TryDispatch(new ThreadPool::Task(TestGateFn)));
+  ASSERT_EQ(2U, tp.num_queued());
+
+  // A full queue turns new tasks away, and leaves them with the caller.
+  ThreadPool::Task* refused = new ThreadPool::Task(TestGateFn);
+  ASSERT_FALSE(tp.TryDispatch(refused));
+  ASSERT_EQ(2U, tp.num_queued());
+
+  // Dispatch() doesn't enforce the limit.
+  tp.Dispatch(refused);
+  ASSERT_EQ(3U, tp.num_queued());
+
+  // Once the worker gets going again, there's room.
+  Verify333(pthread_mutex_unlock(&gate) == 0);
+  tp.WaitForRoom();
+  ASSERT_GT(2U, tp.num_queued());
+  ASSERT_TRUE(tp.TryDispatch(new ThreadPool::Task(TestGateFn)));
+}
+
+TEST(Test_ThreadPool, TestThreadPoolOverflow) {
+  Verify333(pthread_mutex_lock(&gate) == 0);
+  workcount = 0;
+  const uint32_t kNumTasks = 3 * ThreadPool::kQueueCapacity;
+  {
+    ThreadPool tp(2);
+
+    // With both workers held up, queue more tasks than the ring holds;
+    // Dispatch() still takes every one of them.
+    tp.Dispatch(new ThreadPool::Task(TestGateFn));
+    tp.Dispatch(new ThreadPool::Task(TestGateFn));
+    while (tp.num_queued() != 0) {
+      usleep(10000);
+    }
+    for (uint32_t i = 0; i < kNumTasks; i++) {
+      tp.Dispatch(new ThreadPool::Task(TestCountFn));
+    }
+    ASSERT_EQ(kNumTasks, tp.num_queued());
+
+    // Let the workers go, and they run them all.
+    Verify333(pthread_mutex_unlock(&gate) == 0);
+    while (tp.num_queued() != 0) {
+      usleep(10000);
+    }
+  }
+  ASSERT_EQ(kNumTasks, workcount);
+}
+
+// A task that spawns "fanout" children that count themselves, then
+// blocks on the gate.
+class ParentTask : public ThreadPool::Task {
+ public:
+  ParentTask(ThreadPool* pool, uint32_t fanout)
+    : ThreadPool::Task(&ParentTask::Run), pool_(pool), fanout_(fanout) { }
+
+  static void Run(ThreadPool::Task* t) {
+    ParentTask* self = static_cast<ParentTask*>(t);
+    for (uint32_t i = 0; i < self->fanout_; i++) {
+      self->pool_->Spawn(new ThreadPool::Task(TestCountFn));
+    }
+    TestGateFn(t);
+  }
+
+ private:
+  ThreadPool* pool_;
+  uint32_t fanout_;
+};
+
+// A task that spawns a binary tree of tasks "depth" levels deep under
+// itself, all of which count themselves.
+class TreeTask : public ThreadPool::Task {
+ public:
+  TreeTask(ThreadPool* pool, uint32_t depth)
+    : ThreadPool::Task(&TreeTask::Run), pool_(pool), depth_(depth) { }
+
+  static void Run(ThreadPool::Task* t) {
+    TreeTask* self = static_cast<TreeTask*>(t);
+    if (self->depth_ > 0) {
+      self->pool_->Spawn(new TreeTask(self->pool_, self->depth_ - 1));
+      self->pool_->Spawn(new TreeTask(self->pool_, self->depth_ - 1));
+    }
+    TestCountFn(t);
+  }
+
+ private:
+  ThreadPool* pool_;
+  uint32_t depth_;
+};
+
+TEST(Test_ThreadPool, TestThreadPoolStartup) {
+  // Starting a pool doesn't take anywhere near a second, even with
+  // quite a few threads.
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  {
+    ThreadPool tp(50);
+    ASSERT_EQ(50U, tp.num_threads());
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ASSERT_GT(0.5, (end.tv_sec - start.tv_sec) +
+                 (end.tv_nsec - start.tv_nsec) / 1e9);
+
+  // A lazy pool doesn't start any threads until it gets work, and then
+  // one per task no idle worker can take, up to num_threads.
+  ThreadPoolOptions options;
+  options.num_threads = 2;
+  options.lazy_start = true;
+  ThreadPool lazy(options);
+  ASSERT_EQ(0U, lazy.num_threads());
+
+  Verify333(pthread_mutex_lock(&gate) == 0);
+  lazy.Dispatch(new ThreadPool::Task(TestGateFn));
+  ASSERT_EQ(1U, lazy.num_threads());
+  lazy.Dispatch(new ThreadPool::Task(TestGateFn));
+  lazy.Dispatch(new ThreadPool::Task(TestGateFn));
+  ASSERT_EQ(2U, lazy.num_threads());
+  Verify333(pthread_mutex_unlock(&gate) == 0);
+  while (lazy.num_queued() != 0) {
+    usleep(10000);
+  }
+  ASSERT_EQ(2U, lazy.num_threads());
+}
+
+// Like TestGateFn(), but lets the pool know it's blocked.
+void TestBlockingGateFn(ThreadPool::Task* t) {
+  ThreadPool::BeginBlocking();
+  TestGateFn(t);
+  ThreadPool::EndBlocking();
+}
+
+TEST(Test_ThreadPool, TestThreadPoolElastic) {
+  ThreadPoolOptions options;
+  options.num_threads = 1;
+  options.max_threads = 4;
+  options.idle_timeout_ms = 100;
+  ThreadPool tp(options);
+  ASSERT_EQ(1U, tp.num_threads());
+
+  // Every worker that picks up one of these blocks, so the pool adds
+  // another for the next one, until it can't grow any more.
+  Verify333(pthread_mutex_lock(&gate) == 0);
+  for (int i = 0; i < 6; i++) {
+    tp.Dispatch(new ThreadPool::Task(TestBlockingGateFn));
+  }
+  while (tp.num_threads_blocked() != 4) {
+    usleep(10000);
+  }
+  ASSERT_EQ(4U, tp.num_threads());
+  ASSERT_EQ(2U, tp.num_queued());
+
+  // Once they're done, the extra threads retire, and the pool goes back
+  // down to its minimum.
+  Verify333(pthread_mutex_unlock(&gate) == 0);
+  while (tp.num_threads() != 1) {
+    usleep(10000);
+  }
+  ASSERT_EQ(0U, tp.num_queued());
+  ASSERT_EQ(4U, tp.peak_threads());
+
+  // It grows again the next time it's needed.
+  workcount = 0;
+  Verify333(pthread_mutex_lock(&gate) == 0);
+  tp.Dispatch(new ThreadPool::Task(TestBlockingGateFn));
+  while (tp.num_threads_blocked() != 1) {
+    usleep(10000);
+  }
+  tp.Dispatch(new ThreadPool::Task(TestCountFn));
+  while (workcount != 1) {
+    usleep(10000);
+  }
+  ASSERT_EQ(2U, tp.num_threads());
+  Verify333(pthread_mutex_unlock(&gate) == 0);
+}
+
+// Records the order tasks run in, by lane.
+static std::vector<uint32_t> lanes_run;
+
+void TestLaneFn(ThreadPool::Task* t) {
+  Verify333(pthread_mutex_lock(&mtx) == 0);
+  lanes_run.push_back(t->lane_);
+  Verify333(pthread_mutex_unlock(&mtx) == 0);
+  delete t;
+}
+
+// With its one worker held up, queues "n" tasks in lane 1 and then "n"
+// in lane 0 on "tp", and then lets them all run.
+static void RunLanes(ThreadPool* tp, int n) {
+  lanes_run.clear();
+  Verify333(pthread_mutex_lock(&gate) == 0);
+  tp->Dispatch(new ThreadPool::Task(TestGateFn));
+  while (tp->num_queued() != 0) {
+    usleep(10000);
+  }
+  for (uint32_t lane : {1, 0}) {
+    for (int i = 0; i < n; i++) {
+      ThreadPool::Task* t = new ThreadPool::Task(TestLaneFn);
+      t->lane_ = lane;
+      tp->Dispatch(t);
+    }
+  }
+  Verify333(pthread_mutex_unlock(&gate) == 0);
+  while (tp->num_queued() != 0 || lanes_run.size() != 2U * n) {
+    usleep(10000);
+  }
+}
+
+TEST(Test_ThreadPool, TestThreadPoolLanes) {
+  ThreadPoolOptions options;
+  options.lane_weights = {3, 1};
+  options.lane_scheduling = kLanesStrict;
+  {
+    // Strictly, lane 0 goes first, even though it was queued last.
+    ThreadPool tp(options);
+    ASSERT_EQ(2U, tp.num_lanes());
+    RunLanes(&tp, 4);
+    ASSERT_EQ(std::vector<uint32_t>({0, 0, 0, 0, 1, 1, 1, 1}), lanes_run);
+
+    LaneStats stats = tp.lane_stats(1);
+    ASSERT_EQ(0U, stats.num_queued);
+    ASSERT_EQ(4U, stats.num_run);
+    ASSERT_LE(stats.total_wait_ns / 4, stats.max_wait_ns);
+    ASSERT_LT(0U, stats.max_wait_ns);
+  }
+
+  options.lane_scheduling = kLanesWeighted;
+  {
+    // By weight, lane 0 gets three turns to lane 1's one for as long as
+    // both have tasks waiting, wherever in the cycle the worker starts.
+    ThreadPool tp(options);
+    RunLanes(&tp, 8);
+    uint32_t lane0 = 0;
+    for (int i = 0; i < 8; i++) {
+      lane0 += (lanes_run[i] == 0);
+    }
+    ASSERT_EQ(6U, lane0);
+  }
+}
+
+TEST(Test_ThreadPool, TestThreadPoolWorkStealing) {
+  ThreadPoolOptions options;
+  options.num_threads = 4;
+  options.work_stealing = true;
+  workcount = 0;
+  {
+    ThreadPool tp(options);
+
+    // The parent's children go onto its own deque, and since the parent
+    // is stuck, the other workers have to steal every one of them.
+    Verify333(pthread_mutex_lock(&gate) == 0);
+    tp.Dispatch(new ParentTask(&tp, 100));
+    while (tp.num_stolen() < 100) {
+      usleep(10000);
+    }
+    ASSERT_EQ(0U, tp.num_queued());
+    Verify333(pthread_mutex_lock(&mtx) == 0);
+    ASSERT_EQ(100U, workcount);
+    Verify333(pthread_mutex_unlock(&mtx) == 0);
+    Verify333(pthread_mutex_unlock(&gate) == 0);
+
+    // Tasks spawned from outside the pool just go onto the shared
+    // queue.
+    workcount = 0;
+    tp.Spawn(new TreeTask(&tp, 10));
+  }
+
+  // The whole tree ran, whether on the workers or in the destructor.
+  ASSERT_EQ((1U << 11) - 1, workcount);
+}
+
+// Computes Fibonacci numbers the slow way, Submit()ting one of the two
+// halves of every step to the pool and waiting for it.
+static uint64_t Fib(ThreadPool* tp, uint32_t n) {
+  if (n < 2) {
+    return n;
+  }
+  TaskFuture<uint64_t> half = tp->Submit([tp, n] { return Fib(tp, n - 1); });
+  uint64_t other = Fib(tp, n - 2);
+  return half.Get() + other;
+}
+
+TEST(Test_ThreadPool, TestThreadPoolFutures) {
+  ThreadPool tp(2);
+
+  TaskFuture<int> answer = tp.Submit([] { return 6 * 7; });
+  ASSERT_TRUE(answer.valid());
+  ASSERT_EQ(42, answer.Get());
+
+  std::atomic<int> ran(0);
+  TaskFuture<void> done = tp.Submit([&ran] { ran++; });
+  done.Wait();
+  ASSERT_TRUE(done.ready());
+  ASSERT_EQ(1, ran);
+
+  // What a task throws comes out of Get().
+  TaskFuture<int> oops = tp.Submit([]() -> int {
+      throw std::runtime_error("oops");
+    });
+  ASSERT_THROW(oops.Get(), std::runtime_error);
+
+  std::vector<TaskFuture<uint32_t>> squares;
+  for (uint32_t i = 0; i < 50; i++) {
+    squares.push_back(tp.Submit([i] { return i * i; }));
+  }
+  std::vector<uint32_t> results = WhenAll(&squares);
+  ASSERT_EQ(50U, results.size());
+  for (uint32_t i = 0; i < 50; i++) {
+    ASSERT_EQ(i * i, results[i]);
+  }
+
+  // Every index is visited exactly once, however the range is split.
+  std::vector<std::atomic<int>> visits(1000);
+  tp.ParallelFor(0, visits.size(), [&visits](size_t i) { visits[i]++; });
+  tp.ParallelFor(100, 103, [&visits](size_t i) { visits[i]++; }, 2);
+  tp.ParallelFor(5, 5, [&visits](size_t i) { visits[i]++; });
+  for (size_t i = 0; i < visits.size(); i++) {
+    ASSERT_EQ((i >= 100 && i < 103) ? 2 : 1, visits[i]);
+  }
+  ASSERT_THROW(tp.ParallelFor(0, 100, [](size_t i) {
+      if (i == 77) {
+        throw std::out_of_range("77");
+      }
+    }), std::out_of_range);
+}
+
+TEST(Test_ThreadPool, TestThreadPoolFuturesNested) {
+  // Tasks that wait on tasks they submitted, far more of them than
+  // there are workers.  Without waiters helping, the one worker would
+  // wait on the first child forever.
+  ThreadPool tp(1);
+  TaskFuture<uint64_t> fib = tp.Submit([&tp] { return Fib(&tp, 20); });
+  ASSERT_EQ(6765U, fib.Get());
+
+  // The same, with the worker alone doing the waiting, while the test
+  // thread waits on a gate it can't help with.
+  Verify333(pthread_mutex_lock(&mtx) == 0);
+  workcount = 0;
+  Verify333(pthread_mutex_unlock(&mtx) == 0);
+  uint64_t result = 0;
+  tp.Submit([&tp, &result] {
+      result = Fib(&tp, 15);
+      Verify333(pthread_mutex_lock(&mtx) == 0);
+      workcount = 1;
+      Verify333(pthread_mutex_unlock(&mtx) == 0);
+    });
+  while (1) {
+    Verify333(pthread_mutex_lock(&mtx) == 0);
+    uint32_t count = workcount;
+    Verify333(pthread_mutex_unlock(&mtx) == 0);
+    if (count == 1) {
+      break;
+    }
+    usleep(1000);
+  }
+  ASSERT_EQ(610U, result);
+}
+
 }  // namespace hw4
@@ -0,0 +1,106 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./TimerWheel.h"
+#include "./test_suite.h"
+
+using std::vector;
+
+namespace hw4 {
+
+// A timer that remembers when it was supposed to fire.
+class TestTimer : public TimerWheel::Timer {
+ public:
+  uint64_t when;
+};
+
+TEST(Test_TimerWheel, TestTimerWheelBasic) {
+  TimerWheel wheel(1000);
+  vector<TimerWheel::Timer*> expired;
+
+  // Timers at every level of the wheel, plus one past its far edge,
+  // scheduled out of order.
+  const uint64_t kDelays[] = {
+    5, 1, 63, 64, 65, 200, 4095, 4096, 5000, 300000, 20000000
+  };
+  const int kNumTimers = sizeof(kDelays) / sizeof(kDelays[0]);
+  TestTimer timers[kNumTimers];
+  for (int i = kNumTimers - 1; i >= 0; i--) {
+    timers[i].when = 1000 + kDelays[i];
+    wheel.Schedule(&timers[i], timers[i].when);
+  }
+  ASSERT_EQ(static_cast<uint64_t>(kNumTimers), wheel.size());
+
+  // Cancelling a timer takes it off the wheel.
+  wheel.Cancel(&timers[2]);
+  ASSERT_FALSE(timers[2].pending());
+
+  // Nothing fires early.
+  wheel.Advance(1000, &expired);
+  ASSERT_TRUE(expired.empty());
+
+  // Step through time in uneven strides; every timer fires exactly on
+  // its tick, in order.
+  uint64_t now = 1000;
+  uint64_t last = 0;
+  int num_fired = 0;
+  while (now <= 1000 + 300000) {
+    uint64_t prev = now;
+    now += 1 + now % 97;
+    expired.clear();
+    wheel.Advance(now, &expired);
+    for (TimerWheel::Timer* t : expired) {
+      TestTimer* timer = static_cast<TestTimer*>(t);
+      ASSERT_FALSE(timer->pending());
+      ASSERT_LT(prev, timer->when);
+      ASSERT_LE(timer->when, now);
+      ASSERT_LE(last, timer->when);
+      last = timer->when;
+      num_fired++;
+    }
+  }
+  ASSERT_EQ(kNumTimers - 2, num_fired);
+  ASSERT_EQ(1U, wheel.size());
+
+  // The last timer was too far out, so it was moved in to the edge of
+  // the wheel.
+  expired.clear();
+  wheel.Advance(1000 + (1 << 24), &expired);
+  ASSERT_EQ(1U, expired.size());
+  ASSERT_EQ(&timers[kNumTimers - 1], expired[0]);
+  ASSERT_EQ(0U, wheel.size());
+}
+
+TEST(Test_TimerWheel, TestTimerWheelReschedule) {
+  TimerWheel wheel(0);
+  vector<TimerWheel::Timer*> expired;
+  TestTimer timer;
+
+  // Rescheduling a pending timer moves it rather than adding it twice.
+  wheel.Schedule(&timer, 10);
+  wheel.Schedule(&timer, 100);
+  ASSERT_EQ(1U, wheel.size());
+  wheel.Advance(99, &expired);
+  ASSERT_TRUE(expired.empty());
+  wheel.Advance(100, &expired);
+  ASSERT_EQ(1U, expired.size());
+
+  // A timer that's already due fires as soon as the wheel moves on.
+  expired.clear();
+  wheel.Schedule(&timer, 50);
+  wheel.Advance(101, &expired);
+  ASSERT_EQ(1U, expired.size());
+}
+
+}  // namespace hw4
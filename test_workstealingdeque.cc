@@ -0,0 +1,125 @@
+/*
+ * Copyright ©2023 Justin Hsia.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Winter Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./WorkStealingDeque.h"
+#include "./test_suite.h"
+
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_WorkStealingDeque, TestWorkStealingDequeBasic) {
+  WorkStealingDeque<uint32_t> d(3);
+  ASSERT_EQ(4U, d.capacity());
+
+  uint32_t item;
+  ASSERT_FALSE(d.Pop(&item));
+  ASSERT_FALSE(d.Steal(&item));
+
+  // The owner pops newest first; thieves steal oldest first.
+  for (uint32_t i = 0; i < 4; i++) {
+    ASSERT_TRUE(d.Push(i));
+  }
+  ASSERT_FALSE(d.Push(4));
+  ASSERT_EQ(4U, d.size());
+  ASSERT_TRUE(d.Pop(&item));
+  ASSERT_EQ(3U, item);
+  ASSERT_TRUE(d.Steal(&item));
+  ASSERT_EQ(0U, item);
+  ASSERT_TRUE(d.Steal(&item));
+  ASSERT_EQ(1U, item);
+  ASSERT_TRUE(d.Pop(&item));
+  ASSERT_EQ(2U, item);
+  ASSERT_FALSE(d.Pop(&item));
+  ASSERT_FALSE(d.Steal(&item));
+  ASSERT_EQ(0U, d.size());
+
+  // Stealing made room at the top, so pushes wrap around the ring.
+  for (uint32_t i = 10; i < 14; i++) {
+    ASSERT_TRUE(d.Push(i));
+  }
+  for (uint32_t i = 10; i < 14; i++) {
+    ASSERT_TRUE(d.Steal(&item));
+    ASSERT_EQ(i, item);
+  }
+}
+
+// Thieves add up what they steal until the owner says it's done.
+struct ThiefArgs {
+  WorkStealingDeque<uint64_t>* d;
+  std::atomic<bool>* done;
+  uint64_t sum;
+};
+
+static void* Thief(void* arg) {
+  ThiefArgs* args = static_cast<ThiefArgs*>(arg);
+  args->sum = 0;
+  uint64_t item;
+  while (!*args->done) {
+    if (args->d->Steal(&item)) {
+      args->sum += item;
+    } else {
+      sched_yield();
+    }
+  }
+  while (args->d->Steal(&item)) {
+    args->sum += item;
+  }
+  return nullptr;
+}
+
+TEST(Test_WorkStealingDeque, TestWorkStealingDequeConcurrent) {
+  // A small deque, so the owner and thieves fight over the last items
+  // a lot.
+  WorkStealingDeque<uint64_t> d(8);
+  std::atomic<bool> done(false);
+  const int kNumThieves = 3;
+  vector<pthread_t> threads(kNumThieves);
+  vector<ThiefArgs> args(kNumThieves);
+  for (int i = 0; i < kNumThieves; i++) {
+    args[i] = {&d, &done, 0};
+    ASSERT_EQ(0, pthread_create(&threads[i], nullptr, &Thief, &args[i]));
+  }
+
+  // The owner pushes [0, kNumItems), popping every other item back off
+  // itself.
+  const uint64_t kNumItems = 200000;
+  uint64_t sum = 0, item;
+  for (uint64_t i = 0; i < kNumItems; i++) {
+    while (!d.Push(i)) {
+      if (d.Pop(&item))
+        sum += item;
+    }
+    if ((i % 2) == 0 && d.Pop(&item)) {
+      sum += item;
+    }
+  }
+  done = true;
+  for (int i = 0; i < kNumThieves; i++) {
+    ASSERT_EQ(0, pthread_join(threads[i], nullptr));
+    sum += args[i].sum;
+  }
+  while (d.Pop(&item)) {
+    sum += item;
+  }
+
+  // Every item was taken exactly once.
+  ASSERT_EQ(kNumItems * (kNumItems - 1) / 2, sum);
+}
+
+}  // namespace hw4